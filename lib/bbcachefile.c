@@ -0,0 +1,226 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Binary beam blockage cache files
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#include "bbcachefile.h"
+#include "rave_debug.h"
+#include "rave_alloc.h"
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Byte order marker
+ */
+#define BBCACHEFILE_BYTEORDER 0x01020304
+
+/*@{ Private functions */
+/**
+ * Initializes a header.
+ * @param[in] header - the header to initialize
+ * @param[in] key - the key
+ */
+static void BBCacheFileInternal_initHeader(BBCacheFileHeader* header, const BBCacheFileKey* key)
+{
+  memset(header, 0, sizeof(BBCacheFileHeader));
+  strncpy(header->magic, BBCACHEFILE_MAGIC, sizeof(header->magic) - 1);
+  header->byteorder = BBCACHEFILE_BYTEORDER;
+  header->version = BBCACHEFILE_VERSION;
+  header->headersize = sizeof(BBCacheFileHeader);
+  header->key = *key;
+  header->payloadsize = (uint64_t)(key->nrays * key->nbins);
+}
+/*@} End of Private functions */
+
+/*@{ Interface functions */
+uint32_t BBCacheFile_checksum(const unsigned char* data, size_t len)
+{
+  uint32_t a = 1, b = 0;
+  size_t i = 0;
+  while (len > 0) {
+    /* 5552 is the largest n where the sums can't overflow before the modulo */
+    size_t n = (len < 5552) ? len : 5552;
+    len -= n;
+    for (i = 0; i < n; i++) {
+      a += *data++;
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return (b << 16) | a;
+}
+
+int BBCacheFile_keyMatches(const BBCacheFileKey* a, const BBCacheFileKey* b, const BBCacheFileKey* tolerance)
+{
+  if (a == NULL || b == NULL) {
+    return 0;
+  }
+  if (tolerance == NULL) {
+    return (memcmp(a, b, sizeof(BBCacheFileKey)) == 0);
+  }
+  return (a->nrays == b->nrays && a->nbins == b->nbins && a->dblim == b->dblim &&
+          a->topography == b->topography && a->horizon == b->horizon &&
+          a->sampling == b->sampling && a->levels == b->levels &&
+          fabs(a->lon - b->lon) <= tolerance->lon &&
+          fabs(a->lat - b->lat) <= tolerance->lat &&
+          fabs(a->height - b->height) <= tolerance->height &&
+          fabs(a->elangle - b->elangle) <= tolerance->elangle &&
+          fabs(a->rscale - b->rscale) <= tolerance->rscale &&
+          fabs(a->rstart - b->rstart) <= tolerance->rstart &&
+          fabs(a->beamwidth - b->beamwidth) <= tolerance->beamwidth);
+}
+
+int BBCacheFile_write(const char* filename, const BBCacheFileKey* key, RaveField_t* field, double gain, double offset)
+{
+  BBCacheFileHeader header;
+  FILE* fp = NULL;
+  unsigned char* data = NULL;
+  int result = 0;
+
+  if (filename == NULL || key == NULL || field == NULL) {
+    RAVE_ERROR0("Must provide filename, key and field when writing cache file");
+    return 0;
+  }
+
+  if (RaveField_getDataType(field) != RaveDataType_UCHAR ||
+      RaveField_getXsize(field) != key->nbins || RaveField_getYsize(field) != key->nrays) {
+    RAVE_ERROR0("Only unsigned char fields with the dimensions of the key can be written to cache file");
+    return 0;
+  }
+
+  data = (unsigned char*)RaveField_getData(field);
+  if (data == NULL) {
+    RAVE_ERROR0("Field has no data");
+    return 0;
+  }
+
+  BBCacheFileInternal_initHeader(&header, key);
+  header.gain = gain;
+  header.offset = offset;
+  header.checksum = BBCacheFile_checksum(data, (size_t)header.payloadsize);
+
+  fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    RAVE_ERROR1("Failed to open %s for writing", filename);
+    goto done;
+  }
+  if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+      fwrite(data, 1, (size_t)header.payloadsize, fp) != (size_t)header.payloadsize) {
+    RAVE_ERROR1("Failed to write %s", filename);
+    goto done;
+  }
+
+  result = 1;
+done:
+  if (fp != NULL && fclose(fp) != 0) {
+    RAVE_ERROR1("Failed to close %s", filename);
+    result = 0;
+  }
+  return result;
+}
+
+RaveField_t* BBCacheFile_read(const char* filename, const BBCacheFileKey* key, double* gain, double* offset)
+{
+  return BBCacheFile_readMatching(filename, key, NULL, NULL, gain, offset);
+}
+
+RaveField_t* BBCacheFile_readMatching(const char* filename, const BBCacheFileKey* key, const BBCacheFileKey* tolerance,
+                                      BBCacheFileKey* stored, double* gain, double* offset)
+{
+  BBCacheFileHeader expected;
+  const BBCacheFileHeader* header = NULL;
+  RaveField_t *field = NULL, *result = NULL;
+  void* base = MAP_FAILED;
+  size_t length = 0;
+  struct stat st;
+  int fd = -1;
+
+  if (filename == NULL || key == NULL || gain == NULL || offset == NULL) {
+    RAVE_ERROR0("Must provide filename, key, gain and offset when reading cache file");
+    return NULL;
+  }
+
+  BBCacheFileInternal_initHeader(&expected, key);
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    goto done; /* No cache file is not an error */
+  }
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size != sizeof(BBCacheFileHeader) + (size_t)expected.payloadsize) {
+    RAVE_WARNING1("Cache file %s has wrong size, ignoring it", filename);
+    goto done;
+  }
+  length = (size_t)st.st_size;
+
+  base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED) {
+    RAVE_ERROR1("Failed to map %s", filename);
+    goto done;
+  }
+  header = (const BBCacheFileHeader*)base;
+
+  if (memcmp(header->magic, expected.magic, sizeof(expected.magic)) != 0 ||
+      header->byteorder != expected.byteorder ||
+      header->version != expected.version ||
+      header->headersize != expected.headersize ||
+      !BBCacheFile_keyMatches(&header->key, &expected.key, tolerance) ||
+      header->payloadsize != expected.payloadsize) {
+    RAVE_WARNING1("Cache file %s does not match the scan, ignoring it", filename);
+    goto done;
+  }
+
+  if (header->checksum != BBCacheFile_checksum((const unsigned char*)base + sizeof(BBCacheFileHeader), (size_t)header->payloadsize)) {
+    RAVE_WARNING1("Cache file %s has wrong checksum, ignoring it", filename);
+    goto done;
+  }
+
+  field = RAVE_OBJECT_NEW(&RaveField_TYPE);
+  if (field == NULL ||
+      !RaveField_setData(field, (long)key->nbins, (long)key->nrays, (unsigned char*)base + sizeof(BBCacheFileHeader), RaveDataType_UCHAR)) {
+    RAVE_ERROR0("Failed to create field from cache file");
+    goto done;
+  }
+  *gain = header->gain;
+  *offset = header->offset;
+  if (stored != NULL) {
+    *stored = header->key;
+  }
+
+  result = RAVE_OBJECT_COPY(field);
+done:
+  if (base != MAP_FAILED) {
+    munmap(base, length);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  RAVE_OBJECT_RELEASE(field);
+  return result;
+}
+/*@} End of Interface functions */
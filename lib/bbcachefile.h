@@ -0,0 +1,139 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Binary beam blockage cache files. A file consists of a fixed header that
+ * identifies the scan geometry, the scaling and the payload checksum followed by
+ * the raw nrays x nbins unsigned char blockage values. The file is memory mapped
+ * when read, the adler-32 checksum of the payload is verified in the mapping and the
+ * payload is then copied into the field, so no HDF5 decoding or conversion is done
+ * but the data is still read and copied once.
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#ifndef BBCACHEFILE_H
+#define BBCACHEFILE_H
+#include "rave_field.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Magic bytes at the start of a binary cache file
+ */
+#define BBCACHEFILE_MAGIC "BBCACHE"
+
+/**
+ * Version of the binary cache file format
+ */
+#define BBCACHEFILE_VERSION 2
+
+/**
+ * Identifies the blockage field stored in a cache file. Same values as are used in the cache filename.
+ * Besides the scan geometry the key contains how the topography was mapped against the scan and
+ * which topography was used, since they give different blockage for the same geometry.
+ */
+typedef struct _BBCacheFileKey {
+  double lon;       /**< radar longitude (degrees) */
+  double lat;       /**< radar latitude (degrees) */
+  double height;    /**< radar height (meters) */
+  double elangle;   /**< elevation angle (degrees) */
+  int64_t nrays;    /**< number of rays */
+  int64_t nbins;    /**< number of bins */
+  double rscale;    /**< bin length (meters) */
+  double rstart;    /**< range to first bin (km) */
+  double beamwidth; /**< beamwidth (degrees) */
+  double dblim;     /**< limit of Gaussian approximation of main lobe */
+  uint32_t topography; /**< identity of the topography, see BeamBlockageMap_getTopographyId */
+  int32_t horizon;  /**< 1 if the topography was taken from the horizon profile of the site */
+  int32_t sampling; /**< the sampling of the bin footprints, see BeamBlockageMapSampling */
+  int32_t levels;   /**< number of topography overview levels */
+} BBCacheFileKey;
+
+/**
+ * The header of a binary cache file. Values are stored in native byte order.
+ */
+typedef struct _BBCacheFileHeader {
+  char magic[8];        /**< BBCACHEFILE_MAGIC */
+  uint32_t byteorder;   /**< 0x01020304 in native byte order */
+  uint32_t version;     /**< BBCACHEFILE_VERSION */
+  uint64_t headersize;  /**< size of the header */
+  BBCacheFileKey key;   /**< the key */
+  double gain;          /**< gain of the payload */
+  double offset;        /**< offset of the payload */
+  uint64_t payloadsize; /**< nrays * nbins */
+  uint32_t checksum;    /**< adler-32 checksum of the payload */
+  uint32_t reserved;    /**< always 0 */
+} BBCacheFileHeader;
+
+/**
+ * Calculates the adler-32 checksum that is used for the payload.
+ * @param[in] data - the data
+ * @param[in] len - the number of bytes
+ * @return the checksum
+ */
+uint32_t BBCacheFile_checksum(const unsigned char* data, size_t len);
+
+/**
+ * Compares two keys. The number of rays and bins, the dB limit, the topography and how it
+ * was mapped must always be the same.
+ * @param[in] a - the first key
+ * @param[in] b - the second key
+ * @param[in] tolerance - the largest allowed absolute difference of each geometry value,
+ * if NULL the keys must be identical
+ * @return 1 if the keys match otherwise 0
+ */
+int BBCacheFile_keyMatches(const BBCacheFileKey* a, const BBCacheFileKey* b, const BBCacheFileKey* tolerance);
+
+/**
+ * Writes a binary cache file.
+ * @param[in] filename - the file to write
+ * @param[in] key - the key of the field
+ * @param[in] field - the blockage field, must be of type UCHAR and have nbins x nrays values
+ * @param[in] gain - the gain of the field
+ * @param[in] offset - the offset of the field
+ * @return 1 on success otherwise 0
+ */
+int BBCacheFile_write(const char* filename, const BBCacheFileKey* key, RaveField_t* field, double gain, double offset);
+
+/**
+ * Reads a binary cache file. The file is only used if the header is intact, the key is the same as the
+ * provided key and the checksum of the payload is correct. The payload is copied into the returned field.
+ * @param[in] filename - the file to read
+ * @param[in] key - the expected key
+ * @param[out] gain - the gain of the field
+ * @param[out] offset - the offset of the field
+ * @return the field without any attributes or NULL if the file doesn't exist or can't be used
+ */
+RaveField_t* BBCacheFile_read(const char* filename, const BBCacheFileKey* key, double* gain, double* offset);
+
+/**
+ * Reads a binary cache file whose key is within the tolerance of the provided key,
+ * see \ref BBCacheFile_keyMatches.
+ * @param[in] filename - the file to read
+ * @param[in] key - the expected key
+ * @param[in] tolerance - the allowed differences, NULL means that the key must be identical
+ * @param[out] stored - the key in the file, may be NULL
+ * @param[out] gain - the gain of the field
+ * @param[out] offset - the offset of the field
+ * @return the field without any attributes or NULL if the file doesn't exist or can't be used
+ */
+RaveField_t* BBCacheFile_readMatching(const char* filename, const BBCacheFileKey* key, const BBCacheFileKey* tolerance,
+                                      BBCacheFileKey* stored, double* gain, double* offset);
+
+#endif /* BBCACHEFILE_H */
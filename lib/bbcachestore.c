@@ -0,0 +1,717 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Single file store for beam blockage fields
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#include "bbcachestore.h"
+#include "rave_debug.h"
+#include "rave_alloc.h"
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+/**
+ * Byte order marker
+ */
+#define BBCACHESTORE_BYTEORDER 0x01020304
+
+/**
+ * Initial number of slots in the index
+ */
+#define BBCACHESTORE_INITIAL_CAPACITY 64
+
+/**
+ * Number of bytes read at a time when searching for the next record after a corrupt record
+ */
+#define BBCACHESTORE_SCAN_BUFFER 65536
+
+/**
+ * One indexed record
+ */
+typedef struct _BBCacheStoreEntry {
+  int used;             /**< if the slot is used */
+  BBCacheStoreRecord record; /**< the record header */
+  off_t position;       /**< position of the record header in the store */
+} BBCacheStoreEntry;
+
+/**
+ * The in-memory index of a store
+ */
+typedef struct _BBCacheStoreIndex {
+  char* filename;              /**< the store */
+  int fd;                      /**< the store opened for reading, -1 if not open */
+  dev_t dev;                   /**< device of the opened store */
+  ino_t ino;                   /**< inode of the opened store, changes when the store is compacted */
+  off_t end;                   /**< end of the last indexed or skipped record */
+  off_t size;                  /**< size of the store at the last update */
+  time_t mtime;                /**< modification time of the store at the last update */
+  BBCacheStoreEntry* entries;  /**< hash table with the latest record for each key */
+  long capacity;               /**< number of slots in entries */
+  long nentries;               /**< number of used slots */
+  off_t livebytes;             /**< bytes used by the latest records */
+  off_t deadbytes;             /**< bytes used by superseded records */
+  struct _BBCacheStoreIndex* next; /**< next index */
+} BBCacheStoreIndex;
+
+/**
+ * Protects the indexes. All flocks on the stores are taken while holding this lock.
+ */
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The indexes of the stores that have been used
+ */
+static BBCacheStoreIndex* store_indexes = NULL;
+
+/*@{ Private functions */
+/**
+ * Calculates a FNV-1a hash of the key.
+ * @param[in] key - the key
+ * @return the hash
+ */
+static unsigned long BBCacheStoreInternal_hash(const BBCacheFileKey* key)
+{
+  const unsigned char* p = (const unsigned char*)key;
+  uint64_t h = 14695981039346656037ULL;
+  size_t i = 0;
+  for (i = 0; i < sizeof(BBCacheFileKey); i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return (unsigned long)h;
+}
+
+/**
+ * Returns the slot for the key, either the slot holding the key or the empty slot where it should be added.
+ * @param[in] index - the index, must have at least one empty slot
+ * @param[in] key - the key
+ * @return the slot
+ */
+static BBCacheStoreEntry* BBCacheStoreInternal_findSlot(BBCacheStoreIndex* index, const BBCacheFileKey* key)
+{
+  unsigned long i = BBCacheStoreInternal_hash(key) & (index->capacity - 1);
+  while (index->entries[i].used && memcmp(&index->entries[i].record.key, key, sizeof(BBCacheFileKey)) != 0) {
+    i = (i + 1) & (index->capacity - 1);
+  }
+  return &index->entries[i];
+}
+
+/**
+ * Adds a record to the index, an existing record with the same key is superseded.
+ * @param[in] index - the index
+ * @param[in] record - the record header
+ * @param[in] position - the position of the record in the store
+ * @return 1 on success otherwise 0
+ */
+static int BBCacheStoreInternal_add(BBCacheStoreIndex* index, const BBCacheStoreRecord* record, off_t position)
+{
+  BBCacheStoreEntry* slot = NULL;
+  off_t size = (off_t)(sizeof(BBCacheStoreRecord) + record->payloadsize);
+
+  if ((index->nentries + 1) * 2 > index->capacity) {
+    long capacity = (index->capacity == 0) ? BBCACHESTORE_INITIAL_CAPACITY : index->capacity * 2;
+    BBCacheStoreEntry* old = index->entries;
+    long oldcapacity = index->capacity, i = 0;
+    index->entries = RAVE_MALLOC(sizeof(BBCacheStoreEntry) * capacity);
+    if (index->entries == NULL) {
+      RAVE_ERROR0("Failed to allocate memory for store index");
+      index->entries = old;
+      return 0;
+    }
+    memset(index->entries, 0, sizeof(BBCacheStoreEntry) * capacity);
+    index->capacity = capacity;
+    for (i = 0; i < oldcapacity; i++) {
+      if (old[i].used) {
+        *BBCacheStoreInternal_findSlot(index, &old[i].record.key) = old[i];
+      }
+    }
+    RAVE_FREE(old);
+  }
+
+  slot = BBCacheStoreInternal_findSlot(index, &record->key);
+  if (slot->used) {
+    off_t oldsize = (off_t)(sizeof(BBCacheStoreRecord) + slot->record.payloadsize);
+    index->livebytes -= oldsize;
+    index->deadbytes += oldsize;
+  } else {
+    index->nentries++;
+  }
+  slot->used = 1;
+  slot->record = *record;
+  slot->position = position;
+  index->livebytes += size;
+  return 1;
+}
+
+/**
+ * Returns the entry for the key.
+ * @param[in] index - the index
+ * @param[in] key - the key
+ * @return the entry or NULL if the key isn't indexed
+ */
+static BBCacheStoreEntry* BBCacheStoreInternal_find(BBCacheStoreIndex* index, const BBCacheFileKey* key)
+{
+  BBCacheStoreEntry* slot = NULL;
+  if (index->capacity == 0) {
+    return NULL;
+  }
+  slot = BBCacheStoreInternal_findSlot(index, key);
+  return slot->used ? slot : NULL;
+}
+
+/**
+ * Closes the store and empties the index.
+ * @param[in] index - the index
+ */
+static void BBCacheStoreInternal_reset(BBCacheStoreIndex* index)
+{
+  if (index->fd >= 0) {
+    close(index->fd);
+  }
+  index->fd = -1;
+  index->end = 0;
+  index->size = 0;
+  index->mtime = 0;
+  RAVE_FREE(index->entries);
+  index->capacity = 0;
+  index->nentries = 0;
+  index->livebytes = 0;
+  index->deadbytes = 0;
+}
+
+/**
+ * Returns the index for the store, it is created if there is none. Must be called when holding the lock.
+ * @param[in] filename - the store
+ * @return the index or NULL on memory failure
+ */
+static BBCacheStoreIndex* BBCacheStoreInternal_getIndex(const char* filename)
+{
+  BBCacheStoreIndex* index = NULL;
+  for (index = store_indexes; index != NULL; index = index->next) {
+    if (strcmp(index->filename, filename) == 0) {
+      return index;
+    }
+  }
+  index = RAVE_MALLOC(sizeof(BBCacheStoreIndex));
+  if (index == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for store index");
+    return NULL;
+  }
+  memset(index, 0, sizeof(BBCacheStoreIndex));
+  index->fd = -1;
+  index->filename = RAVE_STRDUP(filename);
+  if (index->filename == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for store index");
+    RAVE_FREE(index);
+    return NULL;
+  }
+  index->next = store_indexes;
+  store_indexes = index;
+  return index;
+}
+
+/**
+ * Initializes a store header.
+ * @param[in] header - the header
+ */
+static void BBCacheStoreInternal_initHeader(BBCacheStoreHeader* header)
+{
+  memset(header, 0, sizeof(BBCacheStoreHeader));
+  strncpy(header->magic, BBCACHESTORE_MAGIC, sizeof(header->magic) - 1);
+  header->byteorder = BBCACHESTORE_BYTEORDER;
+  header->version = BBCACHESTORE_VERSION;
+}
+
+/**
+ * Reads the record header at a position in the store and checks it.
+ * @param[in] fd - the store
+ * @param[in] position - position of the record header
+ * @param[in] size - size of the store
+ * @param[out] record - the record header
+ * @return 1 if the record is intact, 0 if the header is corrupt and -1 if the record doesn't
+ * end within the store, e.g. since it is still being written
+ */
+static int BBCacheStoreInternal_readRecord(int fd, off_t position, off_t size, BBCacheStoreRecord* record)
+{
+  if (position + (off_t)sizeof(BBCacheStoreRecord) > size ||
+      pread(fd, record, sizeof(BBCacheStoreRecord), position) != sizeof(BBCacheStoreRecord)) {
+    return -1;
+  }
+  if (record->magic != BBCACHESTORE_RECORD_MAGIC ||
+      record->key.nrays <= 0 || record->key.nrays > INT32_MAX ||
+      record->key.nbins <= 0 || record->key.nbins > INT32_MAX ||
+      record->payloadsize != (uint64_t)(record->key.nrays * record->key.nbins)) {
+    return 0;
+  }
+  if (record->payloadsize > (uint64_t)(size - position - (off_t)sizeof(BBCacheStoreRecord))) {
+    return -1;
+  }
+  return 1;
+}
+
+/**
+ * Finds where the next record starts after a corrupt record header. The length in the corrupt
+ * header is used if it leads to the end of the store or to another record header, otherwise
+ * the store is searched for the next record magic that starts a record header.
+ * @param[in] fd - the store
+ * @param[in] position - position of the corrupt record header
+ * @param[in] size - size of the store
+ * @param[in] corrupt - the corrupt record header
+ * @return the position of the next record or -1 if there is no record after the corrupt one
+ */
+static off_t BBCacheStoreInternal_findNextRecord(int fd, off_t position, off_t size, const BBCacheStoreRecord* corrupt)
+{
+  BBCacheStoreRecord record;
+  unsigned char* buffer = NULL;
+  uint32_t magic = BBCACHESTORE_RECORD_MAGIC;
+  off_t start = position + 1, result = -1;
+  ssize_t nread = 0, i = 0;
+
+  if (corrupt->magic == BBCACHESTORE_RECORD_MAGIC &&
+      corrupt->payloadsize <= (uint64_t)(size - position - (off_t)sizeof(BBCacheStoreRecord))) {
+    off_t next = position + (off_t)(sizeof(BBCacheStoreRecord) + corrupt->payloadsize);
+    if (next == size || BBCacheStoreInternal_readRecord(fd, next, size, &record) != 0) {
+      return next;
+    }
+  }
+
+  buffer = RAVE_MALLOC(BBCACHESTORE_SCAN_BUFFER);
+  if (buffer == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for store scan");
+    return -1;
+  }
+  while (result < 0 && start + (off_t)sizeof(magic) <= size) {
+    nread = pread(fd, buffer, BBCACHESTORE_SCAN_BUFFER, start);
+    if (nread < (ssize_t)sizeof(magic)) {
+      break;
+    }
+    for (i = 0; i + (ssize_t)sizeof(magic) <= nread; i++) {
+      if (memcmp(buffer + i, &magic, sizeof(magic)) == 0 &&
+          BBCacheStoreInternal_readRecord(fd, start + i, size, &record) != 0) {
+        result = start + i;
+        break;
+      }
+    }
+    /* The magic may be split between two reads */
+    start += nread - (ssize_t)sizeof(magic) + 1;
+  }
+  RAVE_FREE(buffer);
+  return result;
+}
+
+/**
+ * Brings the index up to date with the store. The store is reopened if it has been replaced
+ * and the records appended since the last update are added. A partially written record at the
+ * end of the store ends the update, it is picked up by a later update. A corrupt record is
+ * skipped with a warning and counted as superseded, so the records after it are still indexed
+ * and the space is reclaimed when the store is compacted. Must be called when holding the lock.
+ * @param[in] index - the index
+ * @param[in] locked - 1 if the caller holds the exclusive flock on the store
+ * @return 1 if the store exists and is valid, otherwise 0
+ */
+static int BBCacheStoreInternal_update(BBCacheStoreIndex* index, int locked)
+{
+  struct stat st;
+  BBCacheStoreHeader header, expected;
+  BBCacheStoreRecord record;
+  int status = 0, result = 0;
+
+  if (stat(index->filename, &st) != 0) {
+    BBCacheStoreInternal_reset(index);
+    return 0;
+  }
+  if (index->fd < 0 || index->dev != st.st_dev || index->ino != st.st_ino) {
+    BBCacheStoreInternal_reset(index);
+    index->fd = open(index->filename, O_RDONLY);
+    if (index->fd < 0 || fstat(index->fd, &st) != 0) {
+      BBCacheStoreInternal_reset(index);
+      return 0;
+    }
+    index->dev = st.st_dev;
+    index->ino = st.st_ino;
+  } else if (fstat(index->fd, &st) != 0) {
+    BBCacheStoreInternal_reset(index);
+    return 0;
+  }
+
+  if (index->end != 0 && st.st_size == index->size && st.st_mtime == index->mtime) {
+    return 1;
+  }
+
+  if (!locked && flock(index->fd, LOCK_SH) != 0) {
+    RAVE_ERROR1("Failed to lock %s", index->filename);
+    return 0;
+  }
+  if (fstat(index->fd, &st) != 0) {
+    goto done;
+  }
+
+  if (index->end == 0) {
+    if (st.st_size < (off_t)sizeof(BBCacheStoreHeader)) {
+      goto done; /* The store is being created */
+    }
+    BBCacheStoreInternal_initHeader(&expected);
+    if (pread(index->fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(&header, &expected, sizeof(header)) != 0) {
+      RAVE_WARNING1("%s is not a beam blockage store", index->filename);
+      goto done;
+    }
+    index->end = sizeof(BBCacheStoreHeader);
+  }
+
+  while ((status = BBCacheStoreInternal_readRecord(index->fd, index->end, st.st_size, &record)) >= 0) {
+    if (status == 0) {
+      off_t next = BBCacheStoreInternal_findNextRecord(index->fd, index->end, st.st_size, &record);
+      if (next < 0) {
+        RAVE_WARNING2("Corrupt data at offset %lld to the end of %s, ignoring it", (long long)index->end, index->filename);
+        break;
+      }
+      RAVE_WARNING2("Skipping corrupt record at offset %lld in %s", (long long)index->end, index->filename);
+      index->deadbytes += next - index->end;
+      index->end = next;
+      continue;
+    }
+    if (!BBCacheStoreInternal_add(index, &record, index->end)) {
+      goto done;
+    }
+    index->end += (off_t)(sizeof(record) + record.payloadsize);
+  }
+  index->size = st.st_size;
+  index->mtime = st.st_mtime;
+
+  result = 1;
+done:
+  if (!locked) {
+    flock(index->fd, LOCK_UN);
+  }
+  return result;
+}
+
+/**
+ * Opens the store and takes an exclusive flock on it. If the store is replaced while
+ * waiting for the lock, the new store is opened instead.
+ * @param[in] filename - the store
+ * @param[in] create - if the store should be created if it doesn't exist
+ * @return the locked file descriptor or -1 on failure
+ */
+static int BBCacheStoreInternal_lock(const char* filename, int create)
+{
+  struct stat st, fst;
+  int fd = -1;
+
+  while (1) {
+    fd = open(filename, create ? (O_RDWR | O_CREAT) : O_RDWR, 0666);
+    if (fd < 0) {
+      if (errno != ENOENT || create) {
+        RAVE_ERROR1("Failed to open %s", filename);
+      }
+      return -1;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+      RAVE_ERROR1("Failed to lock %s", filename);
+      close(fd);
+      return -1;
+    }
+    if (fstat(fd, &fst) == 0 && stat(filename, &st) == 0 && fst.st_dev == st.st_dev && fst.st_ino == st.st_ino) {
+      return fd;
+    }
+    close(fd);
+  }
+}
+
+/**
+ * Copies the latest record for each key to a new store that replaces the old one. Must be called
+ * when holding the lock and the exclusive flock on the store.
+ * @param[in] index - an updated index
+ * @return 1 on success otherwise 0
+ */
+static int BBCacheStoreInternal_compact(BBCacheStoreIndex* index)
+{
+  char tmpname[1024];
+  BBCacheStoreHeader header;
+  unsigned char* buffer = NULL;
+  FILE* fp = NULL;
+  long i = 0;
+  int result = 0;
+
+  if (snprintf(tmpname, sizeof(tmpname), "%s.%ld.tmp", index->filename, (long)getpid()) >= (int)sizeof(tmpname)) {
+    RAVE_ERROR0("Not enough room was created for temporary filename");
+    return 0;
+  }
+
+  fp = fopen(tmpname, "wb");
+  if (fp == NULL) {
+    RAVE_ERROR1("Failed to open %s for writing", tmpname);
+    return 0;
+  }
+  BBCacheStoreInternal_initHeader(&header);
+  if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+    goto done;
+  }
+  for (i = 0; i < index->capacity; i++) {
+    BBCacheStoreEntry* entry = &index->entries[i];
+    size_t size = 0;
+    if (!entry->used) {
+      continue;
+    }
+    size = sizeof(BBCacheStoreRecord) + (size_t)entry->record.payloadsize;
+    buffer = RAVE_MALLOC(size);
+    if (buffer == NULL || pread(index->fd, buffer, size, entry->position) != (ssize_t)size ||
+        fwrite(buffer, 1, size, fp) != size) {
+      goto done;
+    }
+    RAVE_FREE(buffer);
+  }
+  result = 1;
+done:
+  RAVE_FREE(buffer);
+  if (fclose(fp) != 0) {
+    result = 0;
+  }
+  if (result && rename(tmpname, index->filename) != 0) {
+    result = 0;
+  }
+  if (!result) {
+    RAVE_ERROR1("Failed to compact %s", index->filename);
+    unlink(tmpname);
+  }
+  BBCacheStoreInternal_reset(index); /* Reopened at the next update */
+  return result;
+}
+/*@} End of Private functions */
+
+/*@{ Interface functions */
+RaveField_t* BBCacheStore_read(const char* filename, const BBCacheFileKey* key, double* gain, double* offset)
+{
+  BBCacheStoreIndex* index = NULL;
+  BBCacheStoreEntry* entry = NULL;
+  RaveField_t *field = NULL, *result = NULL;
+  unsigned char* data = NULL;
+
+  if (filename == NULL || key == NULL || gain == NULL || offset == NULL) {
+    RAVE_ERROR0("Must provide filename, key, gain and offset when reading store");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&store_lock);
+  index = BBCacheStoreInternal_getIndex(filename);
+  if (index == NULL || !BBCacheStoreInternal_update(index, 0)) {
+    goto done;
+  }
+  entry = BBCacheStoreInternal_find(index, key);
+  if (entry == NULL) {
+    goto done;
+  }
+
+  field = RAVE_OBJECT_NEW(&RaveField_TYPE);
+  if (field == NULL || !RaveField_createData(field, (long)key->nbins, (long)key->nrays, RaveDataType_UCHAR)) {
+    RAVE_ERROR0("Failed to create field from store");
+    goto done;
+  }
+  /* Records are never modified once they have been indexed so no flock is needed */
+  data = (unsigned char*)RaveField_getData(field);
+  if (pread(index->fd, data, (size_t)entry->record.payloadsize, entry->position + sizeof(BBCacheStoreRecord)) != (ssize_t)entry->record.payloadsize ||
+      BBCacheFile_checksum(data, (size_t)entry->record.payloadsize) != entry->record.checksum) {
+    RAVE_WARNING1("Failed to read record from %s, ignoring it", filename);
+    goto done;
+  }
+  *gain = entry->record.gain;
+  *offset = entry->record.offset;
+
+  result = RAVE_OBJECT_COPY(field);
+done:
+  pthread_mutex_unlock(&store_lock);
+  RAVE_OBJECT_RELEASE(field);
+  return result;
+}
+
+int BBCacheStore_contains(const char* filename, const BBCacheFileKey* key)
+{
+  BBCacheStoreIndex* index = NULL;
+  int result = 0;
+
+  if (filename == NULL || key == NULL) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&store_lock);
+  index = BBCacheStoreInternal_getIndex(filename);
+  if (index != NULL && BBCacheStoreInternal_update(index, 0)) {
+    result = (BBCacheStoreInternal_find(index, key) != NULL);
+  }
+  pthread_mutex_unlock(&store_lock);
+  return result;
+}
+
+int BBCacheStore_write(const char* filename, const BBCacheFileKey* key, RaveField_t* field, double gain, double offset)
+{
+  BBCacheStoreIndex* index = NULL;
+  BBCacheStoreHeader header, expected;
+  BBCacheStoreRecord record;
+  unsigned char* data = NULL;
+  struct stat st;
+  off_t position = 0;
+  int fd = -1, result = 0;
+
+  if (filename == NULL || key == NULL || field == NULL) {
+    RAVE_ERROR0("Must provide filename, key and field when writing to store");
+    return 0;
+  }
+  if (RaveField_getDataType(field) != RaveDataType_UCHAR ||
+      RaveField_getXsize(field) != key->nbins || RaveField_getYsize(field) != key->nrays) {
+    RAVE_ERROR0("Only unsigned char fields with the dimensions of the key can be written to store");
+    return 0;
+  }
+  data = (unsigned char*)RaveField_getData(field);
+  if (data == NULL) {
+    RAVE_ERROR0("Field has no data");
+    return 0;
+  }
+
+  memset(&record, 0, sizeof(record));
+  record.magic = BBCACHESTORE_RECORD_MAGIC;
+  record.key = *key;
+  record.gain = gain;
+  record.offset = offset;
+  record.payloadsize = (uint64_t)(key->nrays * key->nbins);
+  record.checksum = BBCacheFile_checksum(data, (size_t)record.payloadsize);
+
+  pthread_mutex_lock(&store_lock);
+  index = BBCacheStoreInternal_getIndex(filename);
+  if (index == NULL) {
+    goto done;
+  }
+  fd = BBCacheStoreInternal_lock(filename, 1);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    goto done;
+  }
+
+  BBCacheStoreInternal_initHeader(&expected);
+  if (st.st_size < (off_t)sizeof(BBCacheStoreHeader) ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(&header, &expected, sizeof(header)) != 0) {
+    /* New store, one where the creation failed or one written with another version of the format */
+    if (st.st_size >= (off_t)sizeof(BBCacheStoreHeader)) {
+      RAVE_WARNING1("%s has another format, replacing it", filename);
+    }
+    BBCacheStoreInternal_initHeader(&header);
+    BBCacheStoreInternal_reset(index);
+    if (ftruncate(fd, 0) != 0 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      RAVE_ERROR1("Failed to create %s", filename);
+      goto done;
+    }
+  }
+  if (!BBCacheStoreInternal_update(index, 1)) {
+    goto done;
+  }
+
+  /* Anything after the last indexed or skipped record is a partially written record left by a
+   * writer that failed or corrupt data without any intact record after it */
+  position = index->end;
+  if (ftruncate(fd, position) != 0 ||
+      pwrite(fd, &record, sizeof(record), position) != sizeof(record) ||
+      pwrite(fd, data, (size_t)record.payloadsize, position + sizeof(record)) != (ssize_t)record.payloadsize) {
+    RAVE_ERROR1("Failed to write to %s", filename);
+    goto done;
+  }
+  if (!BBCacheStoreInternal_update(index, 1)) {
+    goto done;
+  }
+
+  result = 1;
+  if (index->deadbytes > BBCACHESTORE_COMPACT_MIN && index->deadbytes > index->livebytes) {
+    BBCacheStoreInternal_compact(index);
+  }
+done:
+  if (fd >= 0) {
+    flock(fd, LOCK_UN);
+    close(fd);
+  }
+  pthread_mutex_unlock(&store_lock);
+  return result;
+}
+
+int BBCacheStore_compact(const char* filename)
+{
+  BBCacheStoreIndex* index = NULL;
+  int fd = -1, result = 0;
+
+  if (filename == NULL) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&store_lock);
+  index = BBCacheStoreInternal_getIndex(filename);
+  if (index == NULL) {
+    goto done;
+  }
+  fd = BBCacheStoreInternal_lock(filename, 0);
+  if (fd < 0) {
+    result = (errno == ENOENT);
+    goto done;
+  }
+  if (BBCacheStoreInternal_update(index, 1)) {
+    result = BBCacheStoreInternal_compact(index);
+  }
+done:
+  if (fd >= 0) {
+    flock(fd, LOCK_UN);
+    close(fd);
+  }
+  pthread_mutex_unlock(&store_lock);
+  return result;
+}
+
+long BBCacheStore_getNumberOfEntries(const char* filename)
+{
+  BBCacheStoreIndex* index = NULL;
+  long result = 0;
+
+  if (filename == NULL) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&store_lock);
+  index = BBCacheStoreInternal_getIndex(filename);
+  if (index != NULL && BBCacheStoreInternal_update(index, 0)) {
+    result = index->nentries;
+  }
+  pthread_mutex_unlock(&store_lock);
+  return result;
+}
+
+void BBCacheStore_clear(void)
+{
+  pthread_mutex_lock(&store_lock);
+  while (store_indexes != NULL) {
+    BBCacheStoreIndex* index = store_indexes;
+    store_indexes = index->next;
+    BBCacheStoreInternal_reset(index);
+    RAVE_FREE(index->filename);
+    RAVE_FREE(index);
+  }
+  pthread_mutex_unlock(&store_lock);
+}
+/*@} End of Interface functions */
@@ -0,0 +1,134 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Single file store for beam blockage fields. All fields are kept in one file that
+ * starts with a small file header followed by records, each record being a fixed
+ * record header (key, gain/offset, checksum) and the raw nrays x nbins payload.
+ * New fields are appended, a field that is written again supersedes the older record
+ * and the superseded records are removed by compacting the store.
+ *
+ * Each process keeps an in-memory index of the records that is updated with the
+ * records appended since the last lookup, so a lookup is a stat of the store, an index
+ * probe and a single read of the payload. Appending and compacting is protected by an
+ * exclusive flock on the store and reading by a shared flock. A record with a corrupt
+ * header is skipped with a warning and the records after it are still used.
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#ifndef BBCACHESTORE_H
+#define BBCACHESTORE_H
+#include "rave_field.h"
+#include "bbcachefile.h"
+
+/**
+ * Magic bytes at the start of a store
+ */
+#define BBCACHESTORE_MAGIC "BBSTORE"
+
+/**
+ * Version of the store format
+ */
+#define BBCACHESTORE_VERSION 2
+
+/**
+ * Magic value at the start of each record
+ */
+#define BBCACHESTORE_RECORD_MAGIC 0x42425243
+
+/**
+ * The store is compacted automatically after a write when the superseded records
+ * use more space than this and more space than the live records.
+ */
+#define BBCACHESTORE_COMPACT_MIN (1024*1024)
+
+/**
+ * The header at the start of the store. Values are stored in native byte order.
+ */
+typedef struct _BBCacheStoreHeader {
+  char magic[8];       /**< BBCACHESTORE_MAGIC */
+  uint32_t byteorder;  /**< 0x01020304 in native byte order */
+  uint32_t version;    /**< BBCACHESTORE_VERSION */
+  uint64_t reserved[2]; /**< always 0 */
+} BBCacheStoreHeader;
+
+/**
+ * The header of each record, followed by payloadsize bytes
+ */
+typedef struct _BBCacheStoreRecord {
+  uint32_t magic;       /**< BBCACHESTORE_RECORD_MAGIC */
+  uint32_t reserved;    /**< always 0 */
+  BBCacheFileKey key;   /**< the key */
+  double gain;          /**< gain of the payload */
+  double offset;        /**< offset of the payload */
+  uint64_t payloadsize; /**< nrays * nbins */
+  uint32_t checksum;    /**< adler-32 checksum of the payload */
+  uint32_t reserved2;   /**< always 0 */
+} BBCacheStoreRecord;
+
+/**
+ * Reads a field from the store.
+ * @param[in] filename - the store
+ * @param[in] key - the key of the field
+ * @param[out] gain - the gain of the field
+ * @param[out] offset - the offset of the field
+ * @return the field without any attributes or NULL if the store or key doesn't exist
+ */
+RaveField_t* BBCacheStore_read(const char* filename, const BBCacheFileKey* key, double* gain, double* offset);
+
+/**
+ * Returns if the store contains the key.
+ * @param[in] filename - the store
+ * @param[in] key - the key of the field
+ * @return 1 if the key exists otherwise 0
+ */
+int BBCacheStore_contains(const char* filename, const BBCacheFileKey* key);
+
+/**
+ * Appends a field to the store, the store is created if it doesn't exist. A store written
+ * with another version of the format is replaced.
+ * @param[in] filename - the store
+ * @param[in] key - the key of the field
+ * @param[in] field - the blockage field, must be of type UCHAR and have nbins x nrays values
+ * @param[in] gain - the gain of the field
+ * @param[in] offset - the offset of the field
+ * @return 1 on success otherwise 0
+ */
+int BBCacheStore_write(const char* filename, const BBCacheFileKey* key, RaveField_t* field, double gain, double offset);
+
+/**
+ * Rewrites the store so that it only contains the latest record for each key.
+ * @param[in] filename - the store
+ * @return 1 on success or if the store doesn't exist otherwise 0
+ */
+int BBCacheStore_compact(const char* filename);
+
+/**
+ * Returns the number of keys in the store.
+ * @param[in] filename - the store
+ * @return the number of keys
+ */
+long BBCacheStore_getNumberOfEntries(const char* filename);
+
+/**
+ * Releases the in-memory indexes and the open store files.
+ */
+void BBCacheStore_clear(void);
+
+#endif /* BBCACHESTORE_H */
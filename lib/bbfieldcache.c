@@ -0,0 +1,204 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Process wide cache of decoded beam blockage fields
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#include "bbfieldcache.h"
+#include "bblrucache.h"
+#include "rave_debug.h"
+#include "rave_alloc.h"
+#include <string.h>
+#include <sys/stat.h>
+
+/**
+ * One cached field
+ */
+typedef struct _BBFieldCacheEntry {
+  BBLruEntry lru;      /**< maintained by the cache, must be first */
+  char* filename;      /**< the cache file */
+  time_t mtime;        /**< modification time of the file */
+  off_t filesize;      /**< size of the file */
+  RaveField_t* field;  /**< the field */
+} BBFieldCacheEntry;
+
+/*@{ Private functions */
+/**
+ * Releases an entry.
+ * @param[in] entry - the entry to release
+ */
+static void BBFieldCacheInternal_freeEntry(BBLruEntry* entry)
+{
+  BBFieldCacheEntry* e = (BBFieldCacheEntry*)entry;
+  if (e != NULL) {
+    RAVE_FREE(e->filename);
+    RAVE_OBJECT_RELEASE(e->field);
+    RAVE_FREE(e);
+  }
+}
+
+/**
+ * Checks if the entry belongs to a cache file.
+ * @param[in] entry - the entry
+ * @param[in] key - the filename
+ * @return 1 if it does otherwise 0
+ */
+static int BBFieldCacheInternal_equals(const BBLruEntry* entry, const void* key)
+{
+  return (strcmp(((const BBFieldCacheEntry*)entry)->filename, (const char*)key) == 0);
+}
+
+/**
+ * Returns the size of the field in an entry.
+ * @param[in] entry - the entry
+ * @return the size of the field data in bytes
+ */
+static long BBFieldCacheInternal_size(const BBLruEntry* entry)
+{
+  RaveField_t* field = ((const BBFieldCacheEntry*)entry)->field;
+  return RaveField_getXsize(field) * RaveField_getYsize(field) * get_ravetype_size(RaveField_getDataType(field));
+}
+/*@} End of Private functions */
+
+/**
+ * The cache
+ */
+static BBLruCache cache = BBLRUCACHE_INITIALIZER(BBFieldCacheInternal_equals, BBFieldCacheInternal_size, BBFieldCacheInternal_freeEntry, BBFIELDCACHE_DEFAULT_SIZE);
+
+/**
+ * Number of hits, protected by the cache lock
+ */
+static long cache_hits = 0;
+
+/**
+ * Number of misses, protected by the cache lock
+ */
+static long cache_misses = 0;
+
+/*@{ Interface functions */
+RaveField_t* BBFieldCache_get(const char* filename)
+{
+  BBFieldCacheEntry* entry = NULL;
+  RaveField_t* result = NULL;
+  struct stat st;
+  int exists = 0;
+
+  exists = (filename != NULL && stat(filename, &st) == 0);
+
+  BBLruCache_lock(&cache);
+  if (exists) {
+    entry = (BBFieldCacheEntry*)BBLruCache_find(&cache, BBLruCache_hashString(BBLRUCACHE_HASH_INIT, filename), filename);
+  }
+  if (entry != NULL) {
+    if (entry->mtime == st.st_mtime && entry->filesize == st.st_size) {
+      /* The clone is created while holding the lock since object reference counts are not thread safe */
+      result = RAVE_OBJECT_CLONE(entry->field);
+    } else {
+      BBLruCache_remove(&cache, &entry->lru);
+    }
+  }
+  if (result != NULL) {
+    cache_hits++;
+  } else {
+    cache_misses++;
+  }
+  BBLruCache_unlock(&cache);
+
+  return result;
+}
+
+int BBFieldCache_put(const char* filename, RaveField_t* field)
+{
+  BBFieldCacheEntry* entry = NULL;
+  struct stat st;
+  int result = 0;
+
+  if (filename == NULL || field == NULL || stat(filename, &st) != 0) {
+    return 0;
+  }
+
+  entry = RAVE_MALLOC(sizeof(BBFieldCacheEntry));
+  if (entry == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for field cache entry");
+    goto done;
+  }
+  memset(entry, 0, sizeof(BBFieldCacheEntry));
+  entry->filename = RAVE_STRDUP(filename);
+  entry->field = RAVE_OBJECT_CLONE(field);
+  entry->mtime = st.st_mtime;
+  entry->filesize = st.st_size;
+  if (entry->filename == NULL || entry->field == NULL) {
+    RAVE_ERROR0("Failed to create field cache entry");
+    goto done;
+  }
+
+  if (BBLruCache_insert(&cache, BBLruCache_hashString(BBLRUCACHE_HASH_INIT, filename), filename, &entry->lru)) {
+    entry = NULL;
+    result = 1;
+  }
+
+done:
+  BBFieldCacheInternal_freeEntry((BBLruEntry*)entry);
+  return result;
+}
+
+void BBFieldCache_setMaxSize(long size)
+{
+  BBLruCache_setMaxSize(&cache, size);
+}
+
+long BBFieldCache_getMaxSize(void)
+{
+  return BBLruCache_getMaxSize(&cache);
+}
+
+long BBFieldCache_getSize(void)
+{
+  return BBLruCache_getSize(&cache);
+}
+
+long BBFieldCache_getHits(void)
+{
+  long result = 0;
+  BBLruCache_lock(&cache);
+  result = cache_hits;
+  BBLruCache_unlock(&cache);
+  return result;
+}
+
+long BBFieldCache_getMisses(void)
+{
+  long result = 0;
+  BBLruCache_lock(&cache);
+  result = cache_misses;
+  BBLruCache_unlock(&cache);
+  return result;
+}
+
+void BBFieldCache_clear(void)
+{
+  BBLruCache_lock(&cache);
+  BBLruCache_clear(&cache);
+  cache_hits = 0;
+  cache_misses = 0;
+  BBLruCache_unlock(&cache);
+}
+/*@} End of Interface functions */
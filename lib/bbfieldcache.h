@@ -0,0 +1,92 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Process wide cache of decoded beam blockage fields that is layered over the
+ * cache files. The cache is shared by all beam blockage instances and is safe
+ * to use from several threads. Fields are keyed by the name of their cache file
+ * and the least recently used fields are dropped when the cache grows beyond its
+ * size limit. A cached field is only used as long as the cache file has the same
+ * size and modification time as when the field was added.
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#ifndef BBFIELDCACHE_H
+#define BBFIELDCACHE_H
+#include "rave_field.h"
+
+/**
+ * Default maximum size of the cache in bytes.
+ */
+#define BBFIELDCACHE_DEFAULT_SIZE (64L*1024L*1024L)
+
+/**
+ * Returns a copy of the field that belongs to the cache file if it exists in the cache.
+ * Each call is counted as either a hit or a miss.
+ * @param[in] filename - the cache file
+ * @return a copy of the cached field or NULL if there is no such field in the cache
+ */
+RaveField_t* BBFieldCache_get(const char* filename);
+
+/**
+ * Adds a copy of the field to the cache. If there already is a field for filename, it will be
+ * replaced. The cache file must exist.
+ * @param[in] filename - the cache file
+ * @param[in] field - the field
+ * @return 1 if the field was added otherwise 0
+ */
+int BBFieldCache_put(const char* filename, RaveField_t* field);
+
+/**
+ * Sets the maximum size of the cache in bytes. A field is counted as the size of its data.
+ * If size is 0, nothing will be cached.
+ * @param[in] size - the maximum size in bytes
+ */
+void BBFieldCache_setMaxSize(long size);
+
+/**
+ * Returns the maximum size of the cache in bytes.
+ * @return the maximum size in bytes
+ */
+long BBFieldCache_getMaxSize(void);
+
+/**
+ * Returns the current size of the cache in bytes.
+ * @return the current size in bytes
+ */
+long BBFieldCache_getSize(void);
+
+/**
+ * Returns the number of calls to \ref BBFieldCache_get that returned a field.
+ * @return the number of hits
+ */
+long BBFieldCache_getHits(void);
+
+/**
+ * Returns the number of calls to \ref BBFieldCache_get that did not return a field.
+ * @return the number of misses
+ */
+long BBFieldCache_getMisses(void);
+
+/**
+ * Removes all fields from the cache and resets the hit and miss counters.
+ */
+void BBFieldCache_clear(void);
+
+#endif /* BBFIELDCACHE_H */
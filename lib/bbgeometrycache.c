@@ -0,0 +1,230 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Process wide cache of scan to topography cell indices
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#include "bbgeometrycache.h"
+#include "bblrucache.h"
+#include "rave_debug.h"
+#include "rave_alloc.h"
+#include "polarnav.h"
+#include <string.h>
+
+/**
+ * One cached index table
+ */
+typedef struct _BBGeometryCacheEntry {
+  BBLruEntry lru;      /**< maintained by the cache, must be first */
+  BBGeometryKey key;   /**< the key */
+  int* indices;        /**< the cell indices */
+} BBGeometryCacheEntry;
+
+/*@{ Private functions */
+/**
+ * Releases an entry.
+ * @param[in] entry - the entry to release
+ */
+static void BBGeometryCacheInternal_freeEntry(BBLruEntry* entry)
+{
+  BBGeometryCacheEntry* e = (BBGeometryCacheEntry*)entry;
+  if (e != NULL) {
+    RAVE_FREE(e->indices);
+    RAVE_FREE(e);
+  }
+}
+
+/**
+ * Checks if an entry has a key.
+ * @param[in] entry - the entry
+ * @param[in] key - the \ref BBGeometryKey
+ * @return 1 if the keys are equal otherwise 0
+ */
+static int BBGeometryCacheInternal_equals(const BBLruEntry* entry, const void* key)
+{
+  const BBGeometryKey* a = &((const BBGeometryCacheEntry*)entry)->key;
+  const BBGeometryKey* b = (const BBGeometryKey*)key;
+  return (a->lat == b->lat && a->lon == b->lon && a->height == b->height &&
+          a->elangle == b->elangle && a->rscale == b->rscale && a->rstart == b->rstart &&
+          a->nrays == b->nrays && a->nbins == b->nbins &&
+          a->poleRadius == b->poleRadius && a->equatorRadius == b->equatorRadius && a->dndh == b->dndh &&
+          a->ulxmap == b->ulxmap && a->ulymap == b->ulymap && a->xdim == b->xdim && a->ydim == b->ydim &&
+          a->ncols == b->ncols && a->nrows == b->nrows);
+}
+
+/**
+ * Returns the size of the indices in an entry.
+ * @param[in] entry - the entry
+ * @return the size in bytes
+ */
+static long BBGeometryCacheInternal_size(const BBLruEntry* entry)
+{
+  const BBGeometryKey* key = &((const BBGeometryCacheEntry*)entry)->key;
+  return key->nrays * key->nbins * sizeof(int);
+}
+
+/**
+ * Returns the hash of a key.
+ * @param[in] key - the key
+ * @return the hash
+ */
+static unsigned long BBGeometryCacheInternal_hash(const BBGeometryKey* key)
+{
+  unsigned long hash = BBLRUCACHE_HASH_INIT;
+  hash = BBLruCache_hashDouble(hash, key->lat);
+  hash = BBLruCache_hashDouble(hash, key->lon);
+  hash = BBLruCache_hashDouble(hash, key->height);
+  hash = BBLruCache_hashDouble(hash, key->elangle);
+  hash = BBLruCache_hashDouble(hash, key->rscale);
+  hash = BBLruCache_hashDouble(hash, key->rstart);
+  hash = BBLruCache_hash(hash, &key->nrays, sizeof(long));
+  hash = BBLruCache_hash(hash, &key->nbins, sizeof(long));
+  hash = BBLruCache_hashDouble(hash, key->poleRadius);
+  hash = BBLruCache_hashDouble(hash, key->equatorRadius);
+  hash = BBLruCache_hashDouble(hash, key->dndh);
+  hash = BBLruCache_hashDouble(hash, key->ulxmap);
+  hash = BBLruCache_hashDouble(hash, key->ulymap);
+  hash = BBLruCache_hashDouble(hash, key->xdim);
+  hash = BBLruCache_hashDouble(hash, key->ydim);
+  hash = BBLruCache_hash(hash, &key->ncols, sizeof(long));
+  hash = BBLruCache_hash(hash, &key->nrows, sizeof(long));
+  return hash;
+}
+/*@} End of Private functions */
+
+/**
+ * The cache
+ */
+static BBLruCache cache = BBLRUCACHE_INITIALIZER(BBGeometryCacheInternal_equals, BBGeometryCacheInternal_size, BBGeometryCacheInternal_freeEntry, BBGEOMETRYCACHE_DEFAULT_SIZE);
+
+/*@{ Interface functions */
+int BBGeometryCache_createKey(BBGeometryKey* key, PolarScan_t* scan, BBTopography_t* topo)
+{
+  PolarNavigator_t* navigator = NULL;
+
+  RAVE_ASSERT((key != NULL), "key == NULL");
+  if (scan == NULL || topo == NULL) {
+    return 0;
+  }
+
+  navigator = PolarScan_getNavigator(scan);
+  if (navigator == NULL) {
+    return 0;
+  }
+
+  memset(key, 0, sizeof(BBGeometryKey));
+  key->lat = PolarScan_getLatitude(scan);
+  key->lon = PolarScan_getLongitude(scan);
+  key->height = PolarScan_getHeight(scan);
+  key->elangle = PolarScan_getElangle(scan);
+  key->rscale = PolarScan_getRscale(scan);
+  key->rstart = PolarScan_getRstart(scan);
+  key->nrays = PolarScan_getNrays(scan);
+  key->nbins = PolarScan_getNbins(scan);
+  key->poleRadius = PolarNavigator_getPoleRadius(navigator);
+  key->equatorRadius = PolarNavigator_getEquatorRadius(navigator);
+  key->dndh = PolarNavigator_getDndh(navigator);
+  key->ulxmap = BBTopography_getUlxmap(topo);
+  key->ulymap = BBTopography_getUlymap(topo);
+  key->xdim = BBTopography_getXDim(topo);
+  key->ydim = BBTopography_getYDim(topo);
+  key->ncols = BBTopography_getNcols(topo);
+  key->nrows = BBTopography_getNrows(topo);
+
+  RAVE_OBJECT_RELEASE(navigator);
+  return 1;
+}
+
+int BBGeometryCache_get(const BBGeometryKey* key, int* indices)
+{
+  BBGeometryCacheEntry* entry = NULL;
+  int result = 0;
+
+  RAVE_ASSERT((key != NULL), "key == NULL");
+  RAVE_ASSERT((indices != NULL), "indices == NULL");
+
+  BBLruCache_lock(&cache);
+  entry = (BBGeometryCacheEntry*)BBLruCache_find(&cache, BBGeometryCacheInternal_hash(key), key);
+  if (entry != NULL) {
+    memcpy(indices, entry->indices, entry->lru.size);
+    result = 1;
+  }
+  BBLruCache_unlock(&cache);
+
+  return result;
+}
+
+int BBGeometryCache_put(const BBGeometryKey* key, const int* indices)
+{
+  BBGeometryCacheEntry* entry = NULL;
+  long size = 0;
+  int result = 0;
+
+  RAVE_ASSERT((key != NULL), "key == NULL");
+  RAVE_ASSERT((indices != NULL), "indices == NULL");
+
+  entry = RAVE_MALLOC(sizeof(BBGeometryCacheEntry));
+  if (entry == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for geometry cache entry");
+    goto done;
+  }
+  memset(entry, 0, sizeof(BBGeometryCacheEntry));
+  entry->key = *key;
+  size = key->nrays * key->nbins * sizeof(int);
+  entry->indices = RAVE_MALLOC(size);
+  if (entry->indices == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for geometry cache entry");
+    goto done;
+  }
+  memcpy(entry->indices, indices, size);
+
+  if (BBLruCache_insert(&cache, BBGeometryCacheInternal_hash(key), key, &entry->lru)) {
+    entry = NULL;
+    result = 1;
+  }
+
+done:
+  BBGeometryCacheInternal_freeEntry((BBLruEntry*)entry);
+  return result;
+}
+
+void BBGeometryCache_setMaxSize(long size)
+{
+  BBLruCache_setMaxSize(&cache, size);
+}
+
+long BBGeometryCache_getMaxSize(void)
+{
+  return BBLruCache_getMaxSize(&cache);
+}
+
+long BBGeometryCache_getSize(void)
+{
+  return BBLruCache_getSize(&cache);
+}
+
+void BBGeometryCache_clear(void)
+{
+  BBLruCache_lock(&cache);
+  BBLruCache_clear(&cache);
+  BBLruCache_unlock(&cache);
+}
+/*@} End of Interface functions */
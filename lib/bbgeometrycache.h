@@ -0,0 +1,123 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Process wide cache of the topography cell that each bin in a scan is located in.
+ * Scans with the same geometry that are mapped against a topography with the same
+ * grid can then get their topography without any navigation. The cache is safe
+ * to use from several threads and the least recently used tables are dropped when
+ * the cache grows beyond its size limit.
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#ifndef BBGEOMETRYCACHE_H
+#define BBGEOMETRYCACHE_H
+#include "bbtopography.h"
+#include "polarscan.h"
+
+/**
+ * Default maximum size of the cache in bytes.
+ */
+#define BBGEOMETRYCACHE_DEFAULT_SIZE (64L*1024L*1024L)
+
+/**
+ * Identifies a scan geometry together with the topography grid it is mapped against.
+ */
+typedef struct _BBGeometryKey {
+  double lat;           /**< radar latitude (radians) */
+  double lon;           /**< radar longitude (radians) */
+  double height;        /**< radar height (meters) */
+  double elangle;       /**< elevation angle (radians) */
+  double rscale;        /**< bin length (meters) */
+  double rstart;        /**< range to first bin (km) */
+  long nrays;           /**< number of rays */
+  long nbins;           /**< number of bins */
+  double poleRadius;    /**< navigator pole radius */
+  double equatorRadius; /**< navigator equator radius */
+  double dndh;          /**< navigator refraction gradient */
+  double ulxmap;        /**< topography upper left longitude (radians) */
+  double ulymap;        /**< topography upper left latitude (radians) */
+  double xdim;          /**< topography x step size (radians) */
+  double ydim;          /**< topography y step size (radians) */
+  long ncols;           /**< topography number of columns */
+  long nrows;           /**< topography number of rows */
+} BBGeometryKey;
+
+/**
+ * Fills in the key for the scan and topography.
+ * @param[out] key - the key
+ * @param[in] scan - the scan
+ * @param[in] topo - the topography the scan is mapped against
+ * @return 1 on success otherwise 0
+ */
+int BBGeometryCache_createKey(BBGeometryKey* key, PolarScan_t* scan, BBTopography_t* topo);
+
+/**
+ * Cell index of a bin that can't be navigated, i.e. there is no position to look up.
+ */
+#define BBGEOMETRYCACHE_NO_POSITION -1
+
+/**
+ * Cell index of a bin that has a position but is located outside the topography.
+ */
+#define BBGEOMETRYCACHE_OUTSIDE -2
+
+/**
+ * Copies the cell indices for the key into indices if they exist in the cache. The index
+ * for ray ri and bin bi is located at indices[ri * nbins + bi] and is either row * ncols + col
+ * in the topography, \ref BBGEOMETRYCACHE_NO_POSITION (-1) if the bin can't be navigated or
+ * \ref BBGEOMETRYCACHE_OUTSIDE (-2) if the bin is located outside the topography.
+ * @param[in] key - the key
+ * @param[out] indices - an array of nrays * nbins indices
+ * @return 1 if found otherwise 0
+ */
+int BBGeometryCache_get(const BBGeometryKey* key, int* indices);
+
+/**
+ * Adds a copy of the cell indices for the key to the cache.
+ * @param[in] key - the key
+ * @param[in] indices - an array of nrays * nbins indices, see \ref BBGeometryCache_get
+ * @return 1 if the indices were added otherwise 0
+ */
+int BBGeometryCache_put(const BBGeometryKey* key, const int* indices);
+
+/**
+ * Sets the maximum size of the cache in bytes. If size is 0, nothing will be cached.
+ * @param[in] size - the maximum size in bytes
+ */
+void BBGeometryCache_setMaxSize(long size);
+
+/**
+ * Returns the maximum size of the cache in bytes.
+ * @return the maximum size in bytes
+ */
+long BBGeometryCache_getMaxSize(void);
+
+/**
+ * Returns the current size of the cache in bytes.
+ * @return the current size in bytes
+ */
+long BBGeometryCache_getSize(void);
+
+/**
+ * Removes all entries from the cache.
+ */
+void BBGeometryCache_clear(void);
+
+#endif /* BBGEOMETRYCACHE_H */
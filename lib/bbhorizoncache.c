@@ -0,0 +1,230 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Process wide cache of horizon profiles
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#include "bbhorizoncache.h"
+#include "bblrucache.h"
+#include "rave_debug.h"
+#include "rave_alloc.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * Maximum difference in radians between two azimuths that are considered to be the same
+ */
+#define BBHORIZONCACHE_AZIMUTH_TOLERANCE 1e-9
+
+/**
+ * Maximum difference between two grids in fractions of a cell for them to be considered the same
+ */
+#define BBHORIZONCACHE_GRID_TOLERANCE 1e-6
+
+/**
+ * One cached horizon profile
+ */
+typedef struct _BBHorizonCacheEntry {
+  BBLruEntry lru;      /**< maintained by the cache, must be first */
+  BBHorizonKey key;    /**< the key */
+  double* azimuths;    /**< the azimuth of each ray */
+  double* heights;     /**< the heights, nrays * nsamples */
+  long nsamples;       /**< number of samples along each azimuth */
+} BBHorizonCacheEntry;
+
+/**
+ * What a profile is looked up with
+ */
+typedef struct _BBHorizonCacheLookup {
+  const BBHorizonKey* key; /**< the key */
+  const double* azimuths;  /**< the azimuths */
+} BBHorizonCacheLookup;
+
+/*@{ Private functions */
+/**
+ * Releases an entry.
+ * @param[in] entry - the entry to release
+ */
+static void BBHorizonCacheInternal_freeEntry(BBLruEntry* entry)
+{
+  BBHorizonCacheEntry* e = (BBHorizonCacheEntry*)entry;
+  if (e != NULL) {
+    RAVE_FREE(e->azimuths);
+    RAVE_FREE(e->heights);
+    RAVE_FREE(e);
+  }
+}
+
+/**
+ * Checks if an entry is the profile for the key and azimuths. The topography grids only have
+ * to share their cell corners since regions read from the same tiles have the same values
+ * at the same position.
+ * @param[in] entry - the entry
+ * @param[in] lookup - the \ref BBHorizonCacheLookup
+ * @return 1 if they are equal otherwise 0
+ */
+static int BBHorizonCacheInternal_equals(const BBLruEntry* entry, const void* lookup)
+{
+  const BBHorizonCacheEntry* e = (const BBHorizonCacheEntry*)entry;
+  const BBHorizonKey* a = &e->key;
+  const BBHorizonKey* key = ((const BBHorizonCacheLookup*)lookup)->key;
+  const double* azimuths = ((const BBHorizonCacheLookup*)lookup)->azimuths;
+  long i = 0;
+
+  if (a->topographyid != key->topographyid || a->lat != key->lat || a->lon != key->lon ||
+      a->step != key->step || a->nrays != key->nrays ||
+      fabs(a->xdim - key->xdim) > BBHORIZONCACHE_GRID_TOLERANCE * a->xdim ||
+      fabs(a->ydim - key->ydim) > BBHORIZONCACHE_GRID_TOLERANCE * a->ydim ||
+      fabs(remainder(a->ulxmap - key->ulxmap, a->xdim)) > BBHORIZONCACHE_GRID_TOLERANCE * a->xdim ||
+      fabs(remainder(a->ulymap - key->ulymap, a->ydim)) > BBHORIZONCACHE_GRID_TOLERANCE * a->ydim) {
+    return 0;
+  }
+  for (i = 0; i < a->nrays; i++) {
+    if (fabs(remainder(e->azimuths[i] - azimuths[i], 2.0*M_PI)) > BBHORIZONCACHE_AZIMUTH_TOLERANCE) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Returns the size of the azimuths and heights in an entry.
+ * @param[in] entry - the entry
+ * @return the size in bytes
+ */
+static long BBHorizonCacheInternal_size(const BBLruEntry* entry)
+{
+  const BBHorizonCacheEntry* e = (const BBHorizonCacheEntry*)entry;
+  return e->key.nrays * (e->nsamples + 1) * sizeof(double);
+}
+
+/**
+ * Returns the hash of a key. Only the members that must be exactly equal are hashed, the
+ * grid and azimuths are compared with a tolerance.
+ * @param[in] key - the key
+ * @return the hash
+ */
+static unsigned long BBHorizonCacheInternal_hash(const BBHorizonKey* key)
+{
+  unsigned long hash = BBLRUCACHE_HASH_INIT;
+  hash = BBLruCache_hash(hash, &key->topographyid, sizeof(unsigned long));
+  hash = BBLruCache_hashDouble(hash, key->lat);
+  hash = BBLruCache_hashDouble(hash, key->lon);
+  hash = BBLruCache_hashDouble(hash, key->step);
+  hash = BBLruCache_hash(hash, &key->nrays, sizeof(long));
+  return hash;
+}
+/*@} End of Private functions */
+
+/**
+ * The cache
+ */
+static BBLruCache cache = BBLRUCACHE_INITIALIZER(BBHorizonCacheInternal_equals, BBHorizonCacheInternal_size, BBHorizonCacheInternal_freeEntry, BBHORIZONCACHE_DEFAULT_SIZE);
+
+/*@{ Interface functions */
+int BBHorizonCache_get(const BBHorizonKey* key, const double* azimuths, long nsamples, double* heights)
+{
+  BBHorizonCacheEntry* entry = NULL;
+  BBHorizonCacheLookup lookup;
+  long ri = 0;
+  int result = 0;
+
+  RAVE_ASSERT((key != NULL), "key == NULL");
+  RAVE_ASSERT((azimuths != NULL), "azimuths == NULL");
+  RAVE_ASSERT((heights != NULL), "heights == NULL");
+
+  lookup.key = key;
+  lookup.azimuths = azimuths;
+
+  BBLruCache_lock(&cache);
+  entry = (BBHorizonCacheEntry*)BBLruCache_find(&cache, BBHorizonCacheInternal_hash(key), &lookup);
+  if (entry != NULL && entry->nsamples >= nsamples) {
+    for (ri = 0; ri < key->nrays; ri++) {
+      memcpy(heights + ri * nsamples, entry->heights + ri * entry->nsamples, sizeof(double) * nsamples);
+    }
+    result = 1;
+  }
+  BBLruCache_unlock(&cache);
+
+  return result;
+}
+
+int BBHorizonCache_put(const BBHorizonKey* key, const double* azimuths, long nsamples, const double* heights)
+{
+  BBHorizonCacheEntry* entry = NULL;
+  BBHorizonCacheLookup lookup;
+  int result = 0;
+
+  RAVE_ASSERT((key != NULL), "key == NULL");
+  RAVE_ASSERT((azimuths != NULL), "azimuths == NULL");
+  RAVE_ASSERT((heights != NULL), "heights == NULL");
+
+  entry = RAVE_MALLOC(sizeof(BBHorizonCacheEntry));
+  if (entry == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for horizon cache entry");
+    goto done;
+  }
+  memset(entry, 0, sizeof(BBHorizonCacheEntry));
+  entry->key = *key;
+  entry->nsamples = nsamples;
+  entry->azimuths = RAVE_MALLOC(sizeof(double) * key->nrays);
+  entry->heights = RAVE_MALLOC(sizeof(double) * key->nrays * nsamples);
+  if (entry->azimuths == NULL || entry->heights == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for horizon cache entry");
+    goto done;
+  }
+  memcpy(entry->azimuths, azimuths, sizeof(double) * key->nrays);
+  memcpy(entry->heights, heights, sizeof(double) * key->nrays * nsamples);
+
+  lookup.key = key;
+  lookup.azimuths = azimuths;
+  if (BBLruCache_insert(&cache, BBHorizonCacheInternal_hash(key), &lookup, &entry->lru)) {
+    entry = NULL;
+    result = 1;
+  }
+
+done:
+  BBHorizonCacheInternal_freeEntry((BBLruEntry*)entry);
+  return result;
+}
+
+void BBHorizonCache_setMaxSize(long size)
+{
+  BBLruCache_setMaxSize(&cache, size);
+}
+
+long BBHorizonCache_getMaxSize(void)
+{
+  return BBLruCache_getMaxSize(&cache);
+}
+
+long BBHorizonCache_getSize(void)
+{
+  return BBLruCache_getSize(&cache);
+}
+
+void BBHorizonCache_clear(void)
+{
+  BBLruCache_lock(&cache);
+  BBLruCache_clear(&cache);
+  BBLruCache_unlock(&cache);
+}
+/*@} End of Interface functions */
@@ -0,0 +1,99 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Process wide cache of horizon profiles. A horizon profile is the terrain height along
+ * each azimuth of a radar site, sampled at a fixed angular distance step. The bin positions
+ * only depend on the elevation angle through their distance from the radar, so all scans
+ * from a site with the same azimuths can get their topography from the same profile.
+ * The cache is safe to use from several threads and the least recently used profiles are
+ * dropped when the cache grows beyond its size limit.
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#ifndef BBHORIZONCACHE_H
+#define BBHORIZONCACHE_H
+
+/**
+ * Default maximum size of the cache in bytes.
+ */
+#define BBHORIZONCACHE_DEFAULT_SIZE (64L*1024L*1024L)
+
+/**
+ * Identifies the site and topography that a horizon profile is sampled from.
+ */
+typedef struct _BBHorizonKey {
+  unsigned long topographyid; /**< identifies the topography, see \ref BeamBlockageMap_getTopographyId */
+  double lat;           /**< radar latitude (radians) */
+  double lon;           /**< radar longitude (radians) */
+  double step;          /**< angular distance between two samples (radians) */
+  long nrays;           /**< number of azimuths */
+  double ulxmap;        /**< topography upper left longitude (radians), any cell corner of the grid */
+  double ulymap;        /**< topography upper left latitude (radians), any cell corner of the grid */
+  double xdim;          /**< topography x step size (radians) */
+  double ydim;          /**< topography y step size (radians) */
+} BBHorizonKey;
+
+/**
+ * Copies the first nsamples samples of each azimuth in the profile for the key into heights if
+ * such a profile exists in the cache. The height at sample k of ray ri is located at
+ * heights[ri * nsamples + k] and sample k is located k * step from the radar.
+ * @param[in] key - the key
+ * @param[in] azimuths - the azimuth of each of the key->nrays rays (radians)
+ * @param[in] nsamples - the number of samples needed along each azimuth
+ * @param[out] heights - an array of nrays * nsamples heights
+ * @return 1 if found otherwise 0
+ */
+int BBHorizonCache_get(const BBHorizonKey* key, const double* azimuths, long nsamples, double* heights);
+
+/**
+ * Adds a copy of the profile for the key to the cache, replacing any profile with the same key
+ * and azimuths.
+ * @param[in] key - the key
+ * @param[in] azimuths - the azimuth of each of the key->nrays rays (radians)
+ * @param[in] nsamples - the number of samples along each azimuth
+ * @param[in] heights - an array of nrays * nsamples heights, see \ref BBHorizonCache_get
+ * @return 1 if the profile was added otherwise 0
+ */
+int BBHorizonCache_put(const BBHorizonKey* key, const double* azimuths, long nsamples, const double* heights);
+
+/**
+ * Sets the maximum size of the cache in bytes. If size is 0, nothing will be cached.
+ * @param[in] size - the maximum size in bytes
+ */
+void BBHorizonCache_setMaxSize(long size);
+
+/**
+ * Returns the maximum size of the cache in bytes.
+ * @return the maximum size in bytes
+ */
+long BBHorizonCache_getMaxSize(void);
+
+/**
+ * Returns the current size of the cache in bytes.
+ * @return the current size in bytes
+ */
+long BBHorizonCache_getSize(void);
+
+/**
+ * Removes all entries from the cache.
+ */
+void BBHorizonCache_clear(void);
+
+#endif /* BBHORIZONCACHE_H */
@@ -0,0 +1,279 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Size limited least recently used cache that the process wide caches are built on
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#include "bblrucache.h"
+#include "rave_debug.h"
+#include "rave_alloc.h"
+#include <string.h>
+
+/**
+ * Number of hash buckets when the first entry is added. Always a power of two.
+ */
+#define BBLRUCACHE_INITIAL_BUCKETS 64
+
+/**
+ * FNV-1a prime
+ */
+#define BBLRUCACHE_HASH_PRIME 16777619u
+
+/*@{ Private functions */
+/**
+ * Returns the bucket that a hash belongs to.
+ * @param[in] cache - the cache
+ * @param[in] hash - the hash
+ * @return the bucket
+ */
+static BBLruEntry** BBLruCacheInternal_bucket(BBLruCache* cache, unsigned long hash)
+{
+  return &cache->buckets[hash & (unsigned long)(cache->nbuckets - 1)];
+}
+
+/**
+ * Doubles the number of buckets, or allocates the first ones. If the memory can not be
+ * allocated the current buckets are kept, the chains just get longer.
+ * @param[in] cache - the cache
+ * @return 1 if there are buckets afterwards otherwise 0
+ */
+static int BBLruCacheInternal_grow(BBLruCache* cache)
+{
+  long nbuckets = (cache->nbuckets > 0) ? cache->nbuckets * 2 : BBLRUCACHE_INITIAL_BUCKETS;
+  BBLruEntry** buckets = RAVE_MALLOC(sizeof(BBLruEntry*) * nbuckets);
+  BBLruEntry* entry = NULL;
+
+  if (buckets == NULL) {
+    RAVE_WARNING0("Failed to allocate memory for cache buckets");
+    return (cache->nbuckets > 0);
+  }
+  memset(buckets, 0, sizeof(BBLruEntry*) * nbuckets);
+  RAVE_FREE(cache->buckets);
+  cache->buckets = buckets;
+  cache->nbuckets = nbuckets;
+  for (entry = cache->head; entry != NULL; entry = entry->next) {
+    BBLruEntry** bucket = BBLruCacheInternal_bucket(cache, entry->hash);
+    entry->chain = *bucket;
+    *bucket = entry;
+  }
+  return 1;
+}
+
+/**
+ * Unlinks an entry from its bucket and from the list. Must be called when holding the lock.
+ * @param[in] cache - the cache
+ * @param[in] entry - the entry
+ */
+static void BBLruCacheInternal_unlink(BBLruCache* cache, BBLruEntry* entry)
+{
+  BBLruEntry** pp = BBLruCacheInternal_bucket(cache, entry->hash);
+  while (*pp != entry) {
+    pp = &(*pp)->chain;
+  }
+  *pp = entry->chain;
+  entry->chain = NULL;
+
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+  entry->prev = entry->next = NULL;
+  cache->size -= entry->size;
+  cache->count--;
+}
+
+/**
+ * Puts an unlinked entry first in the list.
+ * @param[in] cache - the cache
+ * @param[in] entry - the entry
+ */
+static void BBLruCacheInternal_pushFront(BBLruCache* cache, BBLruEntry* entry)
+{
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head != NULL) {
+    cache->head->prev = entry;
+  } else {
+    cache->tail = entry;
+  }
+  cache->head = entry;
+}
+
+/**
+ * Removes the least recently used entries until the cache is within the size limit.
+ * Must be called when holding the lock.
+ * @param[in] cache - the cache
+ */
+static void BBLruCacheInternal_evict(BBLruCache* cache)
+{
+  while (cache->size > cache->maxsize && cache->tail != NULL) {
+    BBLruCache_remove(cache, cache->tail);
+  }
+}
+/*@} End of Private functions */
+
+/*@{ Interface functions */
+unsigned long BBLruCache_hash(unsigned long hash, const void* data, size_t len)
+{
+  const unsigned char* p = (const unsigned char*)data;
+  size_t i = 0;
+  for (i = 0; i < len; i++) {
+    hash = ((hash ^ p[i]) * BBLRUCACHE_HASH_PRIME) & 0xffffffffUL;
+  }
+  return hash;
+}
+
+unsigned long BBLruCache_hashString(unsigned long hash, const char* s)
+{
+  return BBLruCache_hash(hash, s, strlen(s));
+}
+
+unsigned long BBLruCache_hashDouble(unsigned long hash, double v)
+{
+  v = v + 0.0; /* -0.0 becomes 0.0 */
+  return BBLruCache_hash(hash, &v, sizeof(double));
+}
+
+void BBLruCache_lock(BBLruCache* cache)
+{
+  RAVE_ASSERT((cache != NULL), "cache == NULL");
+  pthread_mutex_lock(&cache->lock);
+}
+
+void BBLruCache_unlock(BBLruCache* cache)
+{
+  RAVE_ASSERT((cache != NULL), "cache == NULL");
+  pthread_mutex_unlock(&cache->lock);
+}
+
+BBLruEntry* BBLruCache_find(BBLruCache* cache, unsigned long hash, const void* key)
+{
+  BBLruEntry* entry = NULL;
+
+  RAVE_ASSERT((cache != NULL), "cache == NULL");
+  if (cache->nbuckets == 0) {
+    return NULL;
+  }
+  for (entry = *BBLruCacheInternal_bucket(cache, hash); entry != NULL; entry = entry->chain) {
+    if (entry->hash == hash && cache->equals(entry, key)) {
+      if (entry != cache->head) {
+        if (entry->next != NULL) {
+          entry->next->prev = entry->prev;
+        } else {
+          cache->tail = entry->prev;
+        }
+        entry->prev->next = entry->next;
+        BBLruCacheInternal_pushFront(cache, entry);
+      }
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+void BBLruCache_remove(BBLruCache* cache, BBLruEntry* entry)
+{
+  RAVE_ASSERT((cache != NULL), "cache == NULL");
+  RAVE_ASSERT((entry != NULL), "entry == NULL");
+  BBLruCacheInternal_unlink(cache, entry);
+  cache->free_entry(entry);
+}
+
+int BBLruCache_insert(BBLruCache* cache, unsigned long hash, const void* key, BBLruEntry* entry)
+{
+  BBLruEntry* old = NULL;
+  BBLruEntry** bucket = NULL;
+  int result = 0;
+
+  RAVE_ASSERT((cache != NULL), "cache == NULL");
+  RAVE_ASSERT((entry != NULL), "entry == NULL");
+
+  entry->hash = hash;
+  entry->size = cache->sizeof_entry(entry);
+  entry->prev = entry->next = entry->chain = NULL;
+
+  pthread_mutex_lock(&cache->lock);
+  old = BBLruCache_find(cache, hash, key);
+  if (old != NULL) {
+    BBLruCache_remove(cache, old);
+  }
+  if (entry->size > cache->maxsize) {
+    goto done;
+  }
+  if (cache->count >= cache->nbuckets && !BBLruCacheInternal_grow(cache)) {
+    goto done;
+  }
+  bucket = BBLruCacheInternal_bucket(cache, hash);
+  entry->chain = *bucket;
+  *bucket = entry;
+  BBLruCacheInternal_pushFront(cache, entry);
+  cache->size += entry->size;
+  cache->count++;
+  result = 1;
+  BBLruCacheInternal_evict(cache);
+done:
+  pthread_mutex_unlock(&cache->lock);
+  return result;
+}
+
+void BBLruCache_setMaxSize(BBLruCache* cache, long size)
+{
+  RAVE_ASSERT((cache != NULL), "cache == NULL");
+  pthread_mutex_lock(&cache->lock);
+  cache->maxsize = (size > 0) ? size : 0;
+  BBLruCacheInternal_evict(cache);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+long BBLruCache_getMaxSize(BBLruCache* cache)
+{
+  long result = 0;
+  RAVE_ASSERT((cache != NULL), "cache == NULL");
+  pthread_mutex_lock(&cache->lock);
+  result = cache->maxsize;
+  pthread_mutex_unlock(&cache->lock);
+  return result;
+}
+
+long BBLruCache_getSize(BBLruCache* cache)
+{
+  long result = 0;
+  RAVE_ASSERT((cache != NULL), "cache == NULL");
+  pthread_mutex_lock(&cache->lock);
+  result = cache->size;
+  pthread_mutex_unlock(&cache->lock);
+  return result;
+}
+
+void BBLruCache_clear(BBLruCache* cache)
+{
+  RAVE_ASSERT((cache != NULL), "cache == NULL");
+  while (cache->head != NULL) {
+    BBLruCache_remove(cache, cache->head);
+  }
+}
+/*@} End of Interface functions */
@@ -0,0 +1,197 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Size limited least recently used cache that the process wide caches are built on.
+ * The entries are kept in a hash table for lookup and in a doubly linked list in order
+ * of use, so lookup, insertion, removal and eviction are all done in constant time.
+ *
+ * The cache is intrusive, each cache defines its own entry struct that starts with a
+ * \ref BBLruEntry and provides functions that compare an entry with a key, return the
+ * size of an entry and release an entry. The caller computes the hash of the key, e.g.
+ * with \ref BBLruCache_hash, and entries that are equal must have the same hash.
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#ifndef BBLRUCACHE_H
+#define BBLRUCACHE_H
+#include <stddef.h>
+#include <pthread.h>
+
+/**
+ * Initial value of a hash, see \ref BBLruCache_hash.
+ */
+#define BBLRUCACHE_HASH_INIT 2166136261u
+
+/**
+ * The part of a cache entry that is maintained by the cache. Must be the first member of
+ * the entry struct.
+ */
+typedef struct _BBLruEntry {
+  struct _BBLruEntry* prev;  /**< more recently used entry */
+  struct _BBLruEntry* next;  /**< less recently used entry */
+  struct _BBLruEntry* chain; /**< next entry in the same hash bucket */
+  unsigned long hash;        /**< the hash of the key */
+  long size;                 /**< the size of the entry in bytes */
+} BBLruEntry;
+
+/**
+ * Checks if an entry has the provided key.
+ * @param[in] entry - the entry
+ * @param[in] key - the key
+ * @return 1 if the entry has the key otherwise 0
+ */
+typedef int (*BBLruEqualsFunction)(const BBLruEntry* entry, const void* key);
+
+/**
+ * Returns the size of an entry that is counted against the size limit.
+ * @param[in] entry - the entry
+ * @return the size in bytes
+ */
+typedef long (*BBLruSizeFunction)(const BBLruEntry* entry);
+
+/**
+ * Releases an entry and everything it owns.
+ * @param[in] entry - the entry
+ */
+typedef void (*BBLruFreeFunction)(BBLruEntry* entry);
+
+/**
+ * A cache. Should be defined static and initialized with \ref BBLRUCACHE_INITIALIZER.
+ */
+typedef struct _BBLruCache {
+  pthread_mutex_t lock;       /**< protects the cache */
+  BBLruEqualsFunction equals; /**< compares an entry with a key */
+  BBLruSizeFunction sizeof_entry; /**< returns the size of an entry */
+  BBLruFreeFunction free_entry; /**< releases an entry */
+  long maxsize;               /**< maximum size in bytes */
+  long size;                  /**< current size in bytes */
+  long count;                 /**< number of entries */
+  long nbuckets;              /**< number of hash buckets */
+  BBLruEntry** buckets;       /**< the hash buckets */
+  BBLruEntry* head;           /**< most recently used entry */
+  BBLruEntry* tail;           /**< least recently used entry */
+} BBLruCache;
+
+/**
+ * Static initializer for a cache.
+ * @param[in] equals - a \ref BBLruEqualsFunction
+ * @param[in] sizefunc - a \ref BBLruSizeFunction
+ * @param[in] freefunc - a \ref BBLruFreeFunction
+ * @param[in] maxsize - the initial maximum size in bytes
+ */
+#define BBLRUCACHE_INITIALIZER(equals, sizefunc, freefunc, maxsize) \
+  { PTHREAD_MUTEX_INITIALIZER, equals, sizefunc, freefunc, maxsize, 0, 0, 0, NULL, NULL, NULL }
+
+/**
+ * Adds len bytes to a FNV-1a hash. Start with \ref BBLRUCACHE_HASH_INIT.
+ * @param[in] hash - the hash so far
+ * @param[in] data - the data
+ * @param[in] len - number of bytes
+ * @return the new hash
+ */
+unsigned long BBLruCache_hash(unsigned long hash, const void* data, size_t len);
+
+/**
+ * Adds a string to a hash, see \ref BBLruCache_hash.
+ * @param[in] hash - the hash so far
+ * @param[in] s - the string
+ * @return the new hash
+ */
+unsigned long BBLruCache_hashString(unsigned long hash, const char* s);
+
+/**
+ * Adds a double to a hash, see \ref BBLruCache_hash. 0.0 and -0.0 give the same hash since they
+ * are equal.
+ * @param[in] hash - the hash so far
+ * @param[in] v - the value
+ * @return the new hash
+ */
+unsigned long BBLruCache_hashDouble(unsigned long hash, double v);
+
+/**
+ * Locks the cache. The lock must be held when calling \ref BBLruCache_find and
+ * \ref BBLruCache_remove and as long as a found entry is used.
+ * @param[in] cache - the cache
+ */
+void BBLruCache_lock(BBLruCache* cache);
+
+/**
+ * Unlocks the cache.
+ * @param[in] cache - the cache
+ */
+void BBLruCache_unlock(BBLruCache* cache);
+
+/**
+ * Finds the entry with the key and marks it as the most recently used. Must be called when
+ * holding the lock.
+ * @param[in] cache - the cache
+ * @param[in] hash - the hash of the key
+ * @param[in] key - the key
+ * @return the entry, still owned by the cache, or NULL if not found
+ */
+BBLruEntry* BBLruCache_find(BBLruCache* cache, unsigned long hash, const void* key);
+
+/**
+ * Removes and releases an entry. Must be called when holding the lock.
+ * @param[in] cache - the cache
+ * @param[in] entry - an entry in the cache
+ */
+void BBLruCache_remove(BBLruCache* cache, BBLruEntry* entry);
+
+/**
+ * Adds an entry as the most recently used, replacing any entry with the same key, and evicts
+ * the least recently used entries until the cache is within its size limit. Takes the lock.
+ * @param[in] cache - the cache
+ * @param[in] hash - the hash of the key
+ * @param[in] key - the key
+ * @param[in] entry - the entry, owned by the cache if it was added
+ * @return 1 if the entry was added otherwise 0, e.g. if it is larger than the maximum size
+ */
+int BBLruCache_insert(BBLruCache* cache, unsigned long hash, const void* key, BBLruEntry* entry);
+
+/**
+ * Sets the maximum size of the cache in bytes and evicts entries until the cache is within
+ * the limit. If size is 0, nothing will be cached. Takes the lock.
+ * @param[in] cache - the cache
+ * @param[in] size - the maximum size in bytes
+ */
+void BBLruCache_setMaxSize(BBLruCache* cache, long size);
+
+/**
+ * Returns the maximum size of the cache in bytes. Takes the lock.
+ * @param[in] cache - the cache
+ * @return the maximum size in bytes
+ */
+long BBLruCache_getMaxSize(BBLruCache* cache);
+
+/**
+ * Returns the current size of the cache in bytes. Takes the lock.
+ * @param[in] cache - the cache
+ * @return the current size in bytes
+ */
+long BBLruCache_getSize(BBLruCache* cache);
+
+/**
+ * Removes and releases all entries. Must be called when holding the lock.
+ * @param[in] cache - the cache
+ */
+void BBLruCache_clear(BBLruCache* cache);
+
+#endif /* BBLRUCACHE_H */
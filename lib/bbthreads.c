@@ -0,0 +1,112 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Splits a range of independent work items between a number of threads.
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#include "bbthreads.h"
+#include "rave_debug.h"
+#include <pthread.h>
+
+/**
+ * A range of items processed by one thread.
+ */
+typedef struct _BBThreadsRange {
+  BBThreads_function fn; /**< the function */
+  void* arg;             /**< the user argument */
+  int thread;            /**< the worker index */
+  long start;            /**< first item */
+  long end;              /**< one past the last item */
+} BBThreadsRange;
+
+/*@{ Private functions */
+/**
+ * Thread entry point.
+ * @param[in] p - the range
+ * @return NULL
+ */
+static void* BBThreadsInternal_run(void* p)
+{
+  BBThreadsRange* range = (BBThreadsRange*)p;
+  range->fn(range->arg, range->thread, range->start, range->end);
+  return NULL;
+}
+/*@} End of Private functions */
+
+/*@{ Interface functions */
+int BBThreads_getWorkers(int nthreads, long nitems)
+{
+  if (nthreads > BBTHREADS_MAX_THREADS) {
+    nthreads = BBTHREADS_MAX_THREADS;
+  }
+  if (nitems < nthreads) {
+    nthreads = (int)nitems;
+  }
+  return (nthreads < 1) ? 1 : nthreads;
+}
+
+void BBThreads_run(int nthreads, long nitems, BBThreads_function fn, void* arg)
+{
+  BBThreadsRange ranges[BBTHREADS_MAX_THREADS];
+  pthread_t threads[BBTHREADS_MAX_THREADS];
+  int started[BBTHREADS_MAX_THREADS];
+  int nworkers = 0, i = 0;
+
+  RAVE_ASSERT((fn != NULL), "fn == NULL");
+
+  if (nitems <= 0) {
+    return;
+  }
+
+  nworkers = BBThreads_getWorkers(nthreads, nitems);
+  if (nworkers == 1) {
+    fn(arg, 0, 0, nitems);
+    return;
+  }
+
+  for (i = 0; i < nworkers; i++) {
+    ranges[i].fn = fn;
+    ranges[i].arg = arg;
+    ranges[i].thread = i;
+    ranges[i].start = (nitems * i) / nworkers;
+    ranges[i].end = (nitems * (i + 1)) / nworkers;
+    started[i] = 0;
+  }
+
+  for (i = 1; i < nworkers; i++) {
+    if (pthread_create(&threads[i], NULL, BBThreadsInternal_run, &ranges[i]) == 0) {
+      started[i] = 1;
+    } else {
+      RAVE_WARNING0("Failed to start thread, processing range in calling thread");
+    }
+  }
+
+  BBThreadsInternal_run(&ranges[0]);
+
+  for (i = 1; i < nworkers; i++) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+    } else {
+      BBThreadsInternal_run(&ranges[i]);
+    }
+  }
+}
+/*@} End of Interface functions */
@@ -0,0 +1,63 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Splits a range of independent work items between a number of threads.
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#ifndef BBTHREADS_H
+#define BBTHREADS_H
+
+/**
+ * Max number of threads that will be used.
+ */
+#define BBTHREADS_MAX_THREADS 64
+
+/**
+ * Processes the items [start, end).
+ * @param[in] arg - the user argument
+ * @param[in] thread - index of the worker, 0 <= thread < number of threads, can be used to select scratch buffers
+ * @param[in] start - first item
+ * @param[in] end - one past the last item
+ */
+typedef void (*BBThreads_function)(void* arg, int thread, long start, long end);
+
+/**
+ * Returns the number of workers that will be used by \ref BBThreads_run for the
+ * provided number of threads and items.
+ * @param[in] nthreads - the wanted number of threads
+ * @param[in] nitems - the number of items
+ * @return the number of workers, at least 1
+ */
+int BBThreads_getWorkers(int nthreads, long nitems);
+
+/**
+ * Splits the items 0 - nitems into consecutive ranges and calls the function once for each range,
+ * each from a separate thread. The calling thread processes the first range and the function
+ * returns when all ranges have been processed. If a thread can't be started, its range is
+ * processed by the calling thread instead.
+ * @param[in] nthreads - the wanted number of threads, <= 1 means that everything is processed by the calling thread
+ * @param[in] nitems - the number of items
+ * @param[in] fn - the function
+ * @param[in] arg - the user argument
+ */
+void BBThreads_run(int nthreads, long nitems, BBThreads_function fn, void* arg);
+
+#endif /* BBTHREADS_H */
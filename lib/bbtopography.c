@@ -27,6 +27,77 @@ along with beamb.  If not, see <http://www.gnu.org/licenses/>.
 #include "rave_alloc.h"
 #include "math.h"
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <float.h>
+
+/**
+ * Read-only raster storage of big-endian 16-bit values that can be shared between
+ * several topography instances. The storage is reference counted with its own lock
+ * since clones might be released from different threads.
+ */
+typedef struct _BBTopographyStorage {
+  pthread_mutex_t lock; /**< protects the reference count */
+  int refcnt;           /**< the reference count */
+  void* base;           /**< the mapped memory */
+  size_t length;        /**< the length of the mapping in bytes */
+} BBTopographyStorage;
+
+/**
+ * Log2 of the width and height of the blocks in compressed and block layout storage
+ */
+#define BBTOPOGRAPHY_BLOCK_SHIFT 6
+
+/**
+ * Mask for the column or row within a block in compressed storage
+ */
+#define BBTOPOGRAPHY_BLOCK_MASK ((1L << BBTOPOGRAPHY_BLOCK_SHIFT) - 1)
+
+/**
+ * Set in the bit count of a block in compressed storage when the largest code is nodata
+ */
+#define BBTOPOGRAPHY_BLOCK_NODATA 0x80
+
+/**
+ * Read-only storage of 16-bit values in square blocks, either compressed or as plain values. A
+ * compressed block holds the offset of every value from the smallest value in the block,
+ * bit-packed with as many bits as the largest offset needs, so any value can be decoded directly
+ * without decoding the rest of the block. Blocks that contain nodata reserve the largest code for
+ * it. Each block is row-major and the blocks in the last column and row of blocks only hold the
+ * cells that are within the topography. The storage is reference counted in the same way as
+ * \ref BBTopographyStorage.
+ */
+typedef struct _BBTopographyBlocks {
+  pthread_mutex_t lock; /**< protects the reference count */
+  int refcnt;           /**< the reference count */
+  long ncols;           /**< number of columns */
+  long nrows;           /**< number of rows */
+  long nblockcols;      /**< number of blocks in each row of blocks */
+  long lastcols;        /**< number of columns in the last block of each row of blocks, the other blocks are full */
+  size_t* offsets;      /**< the offset of each block in the packed data in bytes, or in the values */
+  short* values;        /**< the plain values block by block, used instead of the packed data when set */
+  short* mins;          /**< the smallest value in each block */
+  unsigned char* bits;  /**< the number of bits per value in each block, possibly with BBTOPOGRAPHY_BLOCK_NODATA */
+  unsigned char* packed; /**< the packed values, padded so that 4 bytes can always be read */
+  size_t length;        /**< the length of the packed values in bytes */
+  short nodata;         /**< the value that is decoded from the nodata code */
+} BBTopographyBlocks;
+
+/**
+ * A tile in a mosaic
+ */
+typedef struct _BBTopographyTile {
+  BBTopography_t* topo; /**< the tile */
+  long col;             /**< the column in the mosaic of the tiles first column */
+  long row;             /**< the row in the mosaic of the tiles first row */
+  long ncols;           /**< number of columns in the tile */
+  long nrows;           /**< number of rows in the tile */
+} BBTopographyTile;
 
 /**
  * Represents the beam blockage topography
@@ -34,6 +105,23 @@ along with beamb.  If not, see <http://www.gnu.org/licenses/>.
 struct _BBTopography_t {
   RAVE_OBJECT_HEAD /** Always on top */
   RaveData2D_t* data; /**< the data */
+  BBTopographyStorage* storage; /**< mapped raw data, used instead of data when set */
+  const unsigned short* raw; /**< the big-endian values in the storage */
+  long rawcols;       /**< number of columns in the storage */
+  long rawrows;       /**< number of rows in the storage */
+  BBTopographyBlocks* blocks; /**< compressed or block layout data, used instead of data when set */
+  BBTopographyTile* tiles; /**< the tiles when this is a mosaic, used instead of data when set */
+  int ntiles;         /**< number of tiles */
+  long mosaiccols;    /**< number of columns in the mosaic */
+  long mosaicrows;    /**< number of rows in the mosaic */
+  BBTopography_t** levels; /**< the overview levels, level n is at index n-1 */
+  int nlevels;        /**< number of overview levels */
+  double* sumtable;   /**< summed-area table of the heights, (tablecols + 1) * (tablerows + 1) */
+  int* counttable;    /**< summed-area table of the number of cells with data */
+  float** maxpyramid; /**< the max pyramid, level n is at index n-1 and has 2^n times larger cells */
+  int nmaxlevels;     /**< number of levels in the max pyramid */
+  long tablecols;     /**< number of columns when the footprint tables were created */
+  long tablerows;     /**< number of rows when the footprint tables were created */
   double nodata; /**< the nodata */
   double ulxmap; /**< the upper left x-coordinate (longitude / radians)*/
   double ulymap; /**< the upper left x-coordinate(latitude / radians) */
@@ -42,6 +130,469 @@ struct _BBTopography_t {
 };
 
 /*@{ Private functions */
+/**
+ * Increases the reference count of the storage.
+ * @param[in] storage - the storage
+ * @return the storage
+ */
+static BBTopographyStorage* BBTopographyInternal_retainStorage(BBTopographyStorage* storage)
+{
+  if (storage != NULL) {
+    pthread_mutex_lock(&storage->lock);
+    storage->refcnt++;
+    pthread_mutex_unlock(&storage->lock);
+  }
+  return storage;
+}
+
+/**
+ * Decreases the reference count of the storage and unmaps it when no one
+ * is referencing it any longer.
+ * @param[in] storage - the storage
+ */
+static void BBTopographyInternal_releaseStorage(BBTopographyStorage* storage)
+{
+  int refcnt = 0;
+  if (storage != NULL) {
+    pthread_mutex_lock(&storage->lock);
+    refcnt = --storage->refcnt;
+    pthread_mutex_unlock(&storage->lock);
+    if (refcnt == 0) {
+      munmap(storage->base, storage->length);
+      pthread_mutex_destroy(&storage->lock);
+      RAVE_FREE(storage);
+    }
+  }
+}
+
+/**
+ * Drops any mapped storage so that the topography only uses the 2d data field.
+ * @param[in] self - self
+ */
+static void BBTopographyInternal_dropStorage(BBTopography_t* self)
+{
+  BBTopographyInternal_releaseStorage(self->storage);
+  self->storage = NULL;
+  self->raw = NULL;
+  self->rawcols = 0;
+  self->rawrows = 0;
+}
+
+/**
+ * Increases the reference count of the compressed storage.
+ * @param[in] blocks - the compressed storage
+ * @return the compressed storage
+ */
+static BBTopographyBlocks* BBTopographyInternal_retainBlocks(BBTopographyBlocks* blocks)
+{
+  if (blocks != NULL) {
+    pthread_mutex_lock(&blocks->lock);
+    blocks->refcnt++;
+    pthread_mutex_unlock(&blocks->lock);
+  }
+  return blocks;
+}
+
+/**
+ * Decreases the reference count of the compressed storage and frees it when no one
+ * is referencing it any longer.
+ * @param[in] blocks - the compressed storage
+ */
+static void BBTopographyInternal_releaseBlocks(BBTopographyBlocks* blocks)
+{
+  int refcnt = 0;
+  if (blocks != NULL) {
+    pthread_mutex_lock(&blocks->lock);
+    refcnt = --blocks->refcnt;
+    pthread_mutex_unlock(&blocks->lock);
+    if (refcnt == 0) {
+      RAVE_FREE(blocks->offsets);
+      RAVE_FREE(blocks->values);
+      RAVE_FREE(blocks->mins);
+      RAVE_FREE(blocks->bits);
+      RAVE_FREE(blocks->packed);
+      pthread_mutex_destroy(&blocks->lock);
+      RAVE_FREE(blocks);
+    }
+  }
+}
+
+/**
+ * Drops any compressed or block layout storage so that the topography only uses the 2d data field.
+ * @param[in] self - self
+ */
+static void BBTopographyInternal_dropBlocks(BBTopography_t* self)
+{
+  BBTopographyInternal_releaseBlocks(self->blocks);
+  self->blocks = NULL;
+}
+
+/**
+ * Creates an empty block storage with the block offsets allocated.
+ * @param[in] ncols - number of columns
+ * @param[in] nrows - number of rows
+ * @param[out] nblocks - the number of blocks
+ * @return the block storage on success otherwise NULL
+ */
+static BBTopographyBlocks* BBTopographyInternal_newBlocks(long ncols, long nrows, long* nblocks)
+{
+  BBTopographyBlocks* blocks = RAVE_MALLOC(sizeof(BBTopographyBlocks));
+  if (blocks == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for topography blocks");
+    return NULL;
+  }
+  memset(blocks, 0, sizeof(BBTopographyBlocks));
+  pthread_mutex_init(&blocks->lock, NULL);
+  blocks->refcnt = 1;
+  blocks->ncols = ncols;
+  blocks->nrows = nrows;
+  blocks->nblockcols = (ncols + BBTOPOGRAPHY_BLOCK_MASK) >> BBTOPOGRAPHY_BLOCK_SHIFT;
+  blocks->lastcols = ncols - ((blocks->nblockcols - 1) << BBTOPOGRAPHY_BLOCK_SHIFT);
+  *nblocks = blocks->nblockcols * ((nrows + BBTOPOGRAPHY_BLOCK_MASK) >> BBTOPOGRAPHY_BLOCK_SHIFT);
+  blocks->offsets = RAVE_MALLOC(sizeof(size_t) * (*nblocks + 1));
+  if (blocks->offsets == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for topography blocks");
+    BBTopographyInternal_releaseBlocks(blocks);
+    return NULL;
+  }
+  return blocks;
+}
+
+/**
+ * Reads one value from the block storage. The column and row must be within the storage.
+ * @param[in] blocks - the block storage
+ * @param[in] col - the column
+ * @param[in] row - the row
+ * @return the value
+ */
+static short BBTopographyInternal_getBlockValue(const BBTopographyBlocks* blocks, long col, long row)
+{
+  long block = (row >> BBTOPOGRAPHY_BLOCK_SHIFT) * blocks->nblockcols + (col >> BBTOPOGRAPHY_BLOCK_SHIFT);
+  long width = ((col >> BBTOPOGRAPHY_BLOCK_SHIFT) == blocks->nblockcols - 1) ? blocks->lastcols : (1L << BBTOPOGRAPHY_BLOCK_SHIFT);
+  int bits = 0;
+  unsigned int code = 0;
+
+  if (blocks->values != NULL) {
+    return blocks->values[blocks->offsets[block] + (row & BBTOPOGRAPHY_BLOCK_MASK) * width + (col & BBTOPOGRAPHY_BLOCK_MASK)];
+  }
+
+  bits = blocks->bits[block] & ~BBTOPOGRAPHY_BLOCK_NODATA;
+  if (bits > 0) {
+    size_t bitpos = (size_t)((row & BBTOPOGRAPHY_BLOCK_MASK) * width + (col & BBTOPOGRAPHY_BLOCK_MASK)) * bits;
+    const unsigned char* p = blocks->packed + blocks->offsets[block] + (bitpos >> 3);
+    code = ((unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24)) >> (bitpos & 7);
+    code &= (1u << bits) - 1;
+    if ((blocks->bits[block] & BBTOPOGRAPHY_BLOCK_NODATA) && code == (1u << bits) - 1) {
+      return blocks->nodata;
+    }
+  }
+  return (short)(blocks->mins[block] + (int)code);
+}
+
+/**
+ * Releases the tiles in a tile array.
+ * @param[in] tiles - the tiles
+ * @param[in] ntiles - the number of tiles
+ */
+static void BBTopographyInternal_freeTiles(BBTopographyTile* tiles, int ntiles)
+{
+  int i = 0;
+  if (tiles != NULL) {
+    for (i = 0; i < ntiles; i++) {
+      RAVE_OBJECT_RELEASE(tiles[i].topo);
+    }
+    RAVE_FREE(tiles);
+  }
+}
+
+/**
+ * Drops the mosaic tiles so that the topography only uses the 2d data field.
+ * @param[in] self - self
+ */
+static void BBTopographyInternal_dropTiles(BBTopography_t* self)
+{
+  BBTopographyInternal_freeTiles(self->tiles, self->ntiles);
+  self->tiles = NULL;
+  self->ntiles = 0;
+  self->mosaiccols = 0;
+  self->mosaicrows = 0;
+}
+
+/**
+ * Drops the overview levels.
+ * @param[in] self - self
+ */
+static void BBTopographyInternal_dropLevels(BBTopography_t* self)
+{
+  int i = 0;
+  if (self->levels != NULL) {
+    for (i = 0; i < self->nlevels; i++) {
+      RAVE_OBJECT_RELEASE(self->levels[i]);
+    }
+    RAVE_FREE(self->levels);
+  }
+  self->levels = NULL;
+  self->nlevels = 0;
+}
+
+/**
+ * Drops the footprint tables.
+ * @param[in] self - self
+ */
+static void BBTopographyInternal_dropFootprintTables(BBTopography_t* self)
+{
+  int i = 0;
+  if (self->maxpyramid != NULL) {
+    for (i = 0; i < self->nmaxlevels; i++) {
+      RAVE_FREE(self->maxpyramid[i]);
+    }
+    RAVE_FREE(self->maxpyramid);
+  }
+  RAVE_FREE(self->sumtable);
+  RAVE_FREE(self->counttable);
+  self->maxpyramid = NULL;
+  self->nmaxlevels = 0;
+  self->tablecols = 0;
+  self->tablerows = 0;
+}
+
+/**
+ * Drops the overview levels and footprint tables, this is done whenever the data or the
+ * georeferencing is changed.
+ * @param[in] self - self
+ */
+static void BBTopographyInternal_dropDerived(BBTopography_t* self)
+{
+  BBTopographyInternal_dropLevels(self);
+  BBTopographyInternal_dropFootprintTables(self);
+}
+
+/**
+ * Returns the highest cell with data within the max pyramid cells [col0, col1] x [row0, row1]
+ * of a level, see \ref BBTopography_getFootprintMax.
+ * @param[in] self - self
+ * @param[in] level - the max pyramid level, 0 is the topography itself
+ * @param[in] col0 - first column in the level
+ * @param[in] row0 - first row in the level
+ * @param[in] col1 - last column in the level
+ * @param[in] row1 - last row in the level
+ * @return the highest value or -FLT_MAX if none of the cells has any data
+ */
+static float BBTopographyInternal_getPyramidMax(BBTopography_t* self, int level, long col0, long row0, long col1, long row1)
+{
+  float result = -FLT_MAX;
+  long ci = 0, ri = 0;
+  double v = 0.0;
+
+  if (level == 0) {
+    for (ri = row0; ri <= row1; ri++) {
+      for (ci = col0; ci <= col1; ci++) {
+        if (BBTopography_getValue(self, ci, ri, &v) && v != self->nodata && v > result) {
+          result = (float)v;
+        }
+      }
+    }
+  } else {
+    const float* maxlevel = self->maxpyramid[level - 1];
+    long ncols = (self->tablecols + (1L << level) - 1) >> level;
+    for (ri = row0; ri <= row1; ri++) {
+      for (ci = col0; ci <= col1; ci++) {
+        if (maxlevel[ri * ncols + ci] > result) {
+          result = maxlevel[ri * ncols + ci];
+        }
+      }
+    }
+  }
+  return result;
+}
+
+/**
+ * Returns the highest cell with data within the box [col0, col1] x [row0, row1], given in cells
+ * of the topography, by looking up the cells of the max pyramid level that the box covers. The
+ * cells that are completely within the box are looked up first. The cells that are only partly
+ * within the box are then only refined into the next finer level if they can raise the maximum.
+ * @param[in] self - self
+ * @param[in] level - the pyramid level to look up the box in
+ * @param[in] col0 - first column
+ * @param[in] row0 - first row
+ * @param[in] col1 - last column
+ * @param[in] row1 - last row
+ * @param[in] best - the highest value found so far
+ * @return the highest value, -FLT_MAX if no cell has data
+ */
+static float BBTopographyInternal_getBoxMax(BBTopography_t* self, int level, long col0, long row0, long col1, long row1, float best)
+{
+  long ci = 0, ri = 0;
+  int pass = 0;
+
+  for (pass = 0; pass < 2; pass++) {
+    for (ri = row0 >> level; ri <= (row1 >> level); ri++) {
+      long cellrow0 = ri << level, cellrow1 = ((ri + 1) << level) - 1;
+      if (cellrow1 >= self->tablerows) {
+        cellrow1 = self->tablerows - 1;
+      }
+      for (ci = col0 >> level; ci <= (col1 >> level); ci++) {
+        long cellcol0 = ci << level, cellcol1 = ((ci + 1) << level) - 1;
+        int inside = 0;
+        float m = 0.0;
+        if (cellcol1 >= self->tablecols) {
+          cellcol1 = self->tablecols - 1;
+        }
+        inside = (cellcol0 >= col0 && cellcol1 <= col1 && cellrow0 >= row0 && cellrow1 <= row1);
+        if (inside != (pass == 0)) {
+          continue;
+        }
+        m = BBTopographyInternal_getPyramidMax(self, level, ci, ri, ci, ri);
+        if (m <= best) {
+          continue;
+        }
+        if (inside) {
+          best = m;
+        } else {
+          best = BBTopographyInternal_getBoxMax(self, level - 1,
+                                                (cellcol0 > col0) ? cellcol0 : col0, (cellrow0 > row0) ? cellrow0 : row0,
+                                                (cellcol1 < col1) ? cellcol1 : col1, (cellrow1 < row1) ? cellrow1 : row1, best);
+        }
+      }
+    }
+  }
+  return best;
+}
+
+/**
+ * Creates the next overview level. The sum and the number of cells with data that each cell in the
+ * previous level covers are reduced in the same way, so each level gets the mean of all cells in
+ * the topography that it covers and not a mean of means.
+ * @param[in] self - self, used for nodata and georeferencing
+ * @param[in] level - the level to create
+ * @param[in] ncols - the number of columns in the previous level
+ * @param[in] nrows - the number of rows in the previous level
+ * @param[in,out] sums - the sums of the previous level, replaced by the sums of the created level
+ * @param[in,out] counts - the counts of the previous level, replaced by the counts of the created level
+ * @return the created level on success otherwise NULL
+ */
+static BBTopography_t* BBTopographyInternal_reduce(BBTopography_t* self, int level, long ncols, long nrows, double* sums, long* counts)
+{
+  BBTopography_t *field = NULL, *result = NULL;
+  long rncols = (ncols + 1) / 2, rnrows = (nrows + 1) / 2;
+  long ci = 0, ri = 0, k = 0;
+
+  field = RAVE_OBJECT_NEW(&BBTopography_TYPE);
+  if (field == NULL || !BBTopography_createData(field, rncols, rnrows, BBTopography_getDataType(self))) {
+    RAVE_ERROR0("Failed to create overview level");
+    goto done;
+  }
+  field->nodata = self->nodata;
+  field->ulxmap = self->ulxmap;
+  field->ulymap = self->ulymap;
+  field->xdim = self->xdim * (double)(1L << level);
+  field->ydim = self->ydim * (double)(1L << level);
+
+  /* Each reduced cell is placed before the cells it is reduced from, so the arrays can be reused */
+  for (ri = 0; ri < rnrows; ri++) {
+    for (ci = 0; ci < rncols; ci++) {
+      double sum = 0.0;
+      long n = 0;
+      for (k = 0; k < 4; k++) {
+        long c = 2*ci + (k & 1), r = 2*ri + (k >> 1);
+        if (c < ncols && r < nrows) {
+          sum += sums[r * ncols + c];
+          n += counts[r * ncols + c];
+        }
+      }
+      sums[ri * rncols + ci] = sum;
+      counts[ri * rncols + ci] = n;
+      RaveData2D_setValue(field->data, ci, ri, (n > 0) ? floor(sum / n + 0.5) : self->nodata);
+    }
+  }
+
+  result = RAVE_OBJECT_COPY(field);
+done:
+  RAVE_OBJECT_RELEASE(field);
+  return result;
+}
+
+/**
+ * Copies the mosaic tiles into the 2d data field.
+ * @param[in] self - self
+ * @return 1 on success otherwise 0
+ */
+static int BBTopographyInternal_materializeTiles(BBTopography_t* self)
+{
+  BBTopographyTile* tiles = self->tiles;
+  int ntiles = self->ntiles, i = 0;
+  int result = 0;
+
+  if (!RaveData2D_createData(self->data, self->mosaiccols, self->mosaicrows, BBTopography_getDataType(tiles[0].topo), self->nodata)) {
+    RAVE_ERROR0("Failed to allocate memory for topography data");
+    return 0;
+  }
+
+  /* Detach the tiles first since the data field is used from now on */
+  self->tiles = NULL;
+  self->ntiles = 0;
+  self->mosaiccols = 0;
+  self->mosaicrows = 0;
+
+  for (i = 0; i < ntiles; i++) {
+    if (!BBTopography_copyRegion(self, tiles[i].topo, 0, 0, tiles[i].col, tiles[i].row, tiles[i].ncols, tiles[i].nrows)) {
+      goto done;
+    }
+  }
+
+  result = 1;
+done:
+  BBTopographyInternal_freeTiles(tiles, ntiles);
+  return result;
+}
+
+/**
+ * Decodes the mapped or compressed storage or copies the mosaic tiles into the 2d data field. This is only
+ * performed when someone needs direct access to the data array or wants to modify the data.
+ * @param[in] self - self
+ * @return 1 on success otherwise 0
+ */
+static int BBTopographyInternal_materialize(BBTopography_t* self)
+{
+  short* data = NULL;
+  long i = 0, nitems = 0;
+
+  if (self->tiles != NULL) {
+    return BBTopographyInternal_materializeTiles(self);
+  }
+
+  if (self->blocks != NULL) {
+    long ci = 0, ri = 0, ncols = self->blocks->ncols, nrows = self->blocks->nrows;
+    if (!RaveData2D_createData(self->data, ncols, nrows, RaveDataType_SHORT, 0)) {
+      RAVE_ERROR0("Failed to allocate memory for topography data");
+      return 0;
+    }
+    data = (short*)RaveData2D_getData(self->data);
+    for (ri = 0; ri < nrows; ri++) {
+      for (ci = 0; ci < ncols; ci++) {
+        data[ri * ncols + ci] = BBTopographyInternal_getBlockValue(self->blocks, ci, ri);
+      }
+    }
+    BBTopographyInternal_dropBlocks(self);
+    return 1;
+  }
+
+  if (self->storage == NULL) {
+    return 1;
+  }
+  if (!RaveData2D_createData(self->data, self->rawcols, self->rawrows, RaveDataType_SHORT, 0)) {
+    RAVE_ERROR0("Failed to allocate memory for topography data");
+    return 0;
+  }
+  data = (short*)RaveData2D_getData(self->data);
+  nitems = self->rawcols * self->rawrows;
+  for (i = 0; i < nitems; i++) {
+    data[i] = (short)ntohs(self->raw[i]);
+  }
+  BBTopographyInternal_dropStorage(self);
+  return 1;
+}
+
 /**
  * Constructor.
  */
@@ -49,6 +600,23 @@ static int BBTopography_constructor(RaveCoreObject* obj)
 {
   BBTopography_t* self = (BBTopography_t*)obj;
   self->data = RAVE_OBJECT_NEW(&RaveData2D_TYPE);;
+  self->storage = NULL;
+  self->raw = NULL;
+  self->rawcols = 0;
+  self->rawrows = 0;
+  self->blocks = NULL;
+  self->tiles = NULL;
+  self->ntiles = 0;
+  self->mosaiccols = 0;
+  self->mosaicrows = 0;
+  self->levels = NULL;
+  self->nlevels = 0;
+  self->sumtable = NULL;
+  self->counttable = NULL;
+  self->maxpyramid = NULL;
+  self->nmaxlevels = 0;
+  self->tablecols = 0;
+  self->tablerows = 0;
   self->nodata = -9999.0;
   self->ulxmap = 0.0;
   self->ulymap = 0.0;
@@ -73,6 +641,10 @@ static void BBTopography_destructor(RaveCoreObject* obj)
 {
   BBTopography_t* self = (BBTopography_t*)obj;
   RAVE_OBJECT_RELEASE(self->data);
+  BBTopographyInternal_dropStorage(self);
+  BBTopographyInternal_dropBlocks(self);
+  BBTopographyInternal_dropTiles(self);
+  BBTopographyInternal_dropDerived(self);
 }
 
 /**
@@ -85,7 +657,25 @@ static int BBTopography_copyconstructor(RaveCoreObject* obj, RaveCoreObject* src
 {
   BBTopography_t* this = (BBTopography_t*)obj;
   BBTopography_t* src = (BBTopography_t*)srcobj;
+  int i = 0;
   this->data = RAVE_OBJECT_CLONE(src->data);
+  this->storage = BBTopographyInternal_retainStorage(src->storage);
+  this->raw = src->raw;
+  this->rawcols = src->rawcols;
+  this->rawrows = src->rawrows;
+  this->blocks = BBTopographyInternal_retainBlocks(src->blocks);
+  this->tiles = NULL;
+  this->ntiles = 0;
+  this->mosaiccols = src->mosaiccols;
+  this->mosaicrows = src->mosaicrows;
+  this->levels = NULL;
+  this->nlevels = 0;
+  this->sumtable = NULL;
+  this->counttable = NULL;
+  this->maxpyramid = NULL;
+  this->nmaxlevels = 0;
+  this->tablecols = 0;
+  this->tablerows = 0;
   this->nodata = src->nodata;
   this->ulxmap = src->ulxmap;
   this->ulymap = src->ulymap;
@@ -97,9 +687,71 @@ static int BBTopography_copyconstructor(RaveCoreObject* obj, RaveCoreObject* src
     goto error;
   }
 
+  if (src->tiles != NULL) {
+    this->tiles = RAVE_MALLOC(sizeof(BBTopographyTile) * src->ntiles);
+    if (this->tiles == NULL) {
+      RAVE_ERROR0("Failed to allocate memory for mosaic tiles");
+      goto error;
+    }
+    for (i = 0; i < src->ntiles; i++) {
+      this->tiles[i] = src->tiles[i];
+      this->tiles[i].topo = RAVE_OBJECT_CLONE(src->tiles[i].topo);
+      this->ntiles++;
+      if (this->tiles[i].topo == NULL) {
+        RAVE_ERROR0("Failed to clone mosaic tile");
+        goto error;
+      }
+    }
+  }
+
+  if (src->levels != NULL) {
+    this->levels = RAVE_MALLOC(sizeof(BBTopography_t*) * src->nlevels);
+    if (this->levels == NULL) {
+      RAVE_ERROR0("Failed to allocate memory for overview levels");
+      goto error;
+    }
+    for (i = 0; i < src->nlevels; i++) {
+      this->levels[i] = RAVE_OBJECT_CLONE(src->levels[i]);
+      this->nlevels++;
+      if (this->levels[i] == NULL) {
+        RAVE_ERROR0("Failed to clone overview level");
+        goto error;
+      }
+    }
+  }
+
+  if (src->sumtable != NULL) {
+    size_t ntable = (size_t)(src->tablecols + 1) * (size_t)(src->tablerows + 1);
+    this->sumtable = RAVE_MALLOC(sizeof(double) * ntable);
+    this->counttable = RAVE_MALLOC(sizeof(int) * ntable);
+    this->maxpyramid = RAVE_MALLOC(sizeof(float*) * (src->nmaxlevels + 1));
+    if (this->sumtable == NULL || this->counttable == NULL || this->maxpyramid == NULL) {
+      RAVE_ERROR0("Failed to allocate memory for footprint tables");
+      goto error;
+    }
+    memcpy(this->sumtable, src->sumtable, sizeof(double) * ntable);
+    memcpy(this->counttable, src->counttable, sizeof(int) * ntable);
+    this->tablecols = src->tablecols;
+    this->tablerows = src->tablerows;
+    for (i = 0; i < src->nmaxlevels; i++) {
+      size_t n = (size_t)((src->tablecols + (1L << (i + 1)) - 1) >> (i + 1)) * (size_t)((src->tablerows + (1L << (i + 1)) - 1) >> (i + 1));
+      this->maxpyramid[i] = RAVE_MALLOC(sizeof(float) * n);
+      if (this->maxpyramid[i] == NULL) {
+        RAVE_ERROR0("Failed to allocate memory for footprint tables");
+        goto error;
+      }
+      memcpy(this->maxpyramid[i], src->maxpyramid[i], sizeof(float) * n);
+      this->nmaxlevels++;
+    }
+  }
+
   return 1;
 error:
   RAVE_OBJECT_RELEASE(this->data);
+  BBTopographyInternal_dropStorage(this);
+  BBTopographyInternal_dropBlocks(this);
+  BBTopographyInternal_dropTiles(this);
+  BBTopographyInternal_dropDerived(this);
   return 0;
 }
 
@@ -109,6 +761,7 @@ error:
 void BBTopography_setNodata(BBTopography_t* self, double nodata)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  BBTopographyInternal_dropDerived(self);
   self->nodata = nodata;
 }
 
@@ -121,6 +774,7 @@ double BBTopography_getNodata(BBTopography_t* self)
 void BBTopography_setXDim(BBTopography_t* self, double xdim)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  BBTopographyInternal_dropDerived(self);
   self->xdim = xdim;
 }
 
@@ -134,6 +788,7 @@ double BBTopography_getXDim(BBTopography_t* self)
 void BBTopography_setYDim(BBTopography_t* self, double ydim)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  BBTopographyInternal_dropDerived(self);
   self->ydim = ydim;
 }
 
@@ -146,6 +801,7 @@ double BBTopography_getYDim(BBTopography_t* self)
 void BBTopography_setUlxmap(BBTopography_t* self, double ulxmap)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  BBTopographyInternal_dropDerived(self);
   self->ulxmap = ulxmap;
 }
 
@@ -158,6 +814,7 @@ double BBTopography_getUlxmap(BBTopography_t* self)
 void BBTopography_setUlymap(BBTopography_t* self, double ulymap)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  BBTopographyInternal_dropDerived(self);
   self->ulymap = ulymap;
 }
 
@@ -170,21 +827,456 @@ double BBTopography_getUlymap(BBTopography_t* self)
 int BBTopography_createData(BBTopography_t* self, long ncols, long nrows, RaveDataType type)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  BBTopographyInternal_dropStorage(self);
+  BBTopographyInternal_dropBlocks(self);
+  BBTopographyInternal_dropTiles(self);
+  BBTopographyInternal_dropDerived(self);
   return RaveData2D_createData(self->data, ncols, nrows, type, 0);
 }
 
 int BBTopography_setData(BBTopography_t* self, long ncols, long nrows, void* data, RaveDataType type)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  BBTopographyInternal_dropStorage(self);
+  BBTopographyInternal_dropBlocks(self);
+  BBTopographyInternal_dropTiles(self);
+  BBTopographyInternal_dropDerived(self);
   return RaveData2D_setData(self->data, ncols, nrows, data, type);
 }
 
 void* BBTopography_getData(BBTopography_t* self)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  if (!BBTopographyInternal_materialize(self)) {
+    return NULL;
+  }
   return RaveData2D_getData(self->data);
 }
 
+int BBTopography_mapFile(BBTopography_t* self, const char* filename, long ncols, long nrows)
+{
+  int result = 0;
+  int fd = -1;
+  struct stat st;
+  size_t length = 0;
+  void* base = MAP_FAILED;
+  BBTopographyStorage* storage = NULL;
+  RaveData2D_t* empty = NULL;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  if (filename == NULL || ncols <= 0 || nrows <= 0) {
+    RAVE_ERROR0("Must provide filename and dimensions when mapping topography");
+    goto done;
+  }
+
+  length = (size_t)ncols * (size_t)nrows * sizeof(short);
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    RAVE_ERROR1("Failed to open %s for reading", filename);
+    goto done;
+  }
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < length) {
+    RAVE_ERROR1("%s is too small for the requested dimensions", filename);
+    goto done;
+  }
+
+  base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    RAVE_ERROR1("Failed to map %s", filename);
+    goto done;
+  }
+
+  storage = RAVE_MALLOC(sizeof(BBTopographyStorage));
+  if (storage == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for topography storage");
+    goto done;
+  }
+  pthread_mutex_init(&storage->lock, NULL);
+  storage->refcnt = 1;
+  storage->base = base;
+  storage->length = length;
+  base = MAP_FAILED; /* Storage is responsible for the mapping */
+
+  /* Free the previous data, the mapping replaces it */
+  empty = RAVE_OBJECT_NEW(&RaveData2D_TYPE);
+  if (empty == NULL) {
+    BBTopographyInternal_releaseStorage(storage);
+    goto done;
+  }
+  RAVE_OBJECT_RELEASE(self->data);
+  self->data = empty;
+  BBTopographyInternal_dropStorage(self);
+  BBTopographyInternal_dropBlocks(self);
+  BBTopographyInternal_dropTiles(self);
+  BBTopographyInternal_dropDerived(self);
+  self->storage = storage;
+  self->raw = (const unsigned short*)storage->base;
+  self->rawcols = ncols;
+  self->rawrows = nrows;
+
+  result = 1;
+done:
+  if (base != MAP_FAILED) {
+    munmap(base, length);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  return result;
+}
+
+int BBTopography_isMapped(BBTopography_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return (self->storage != NULL) ? 1 : 0;
+}
+
+int BBTopography_compress(BBTopography_t* self)
+{
+  int result = 0;
+  BBTopographyBlocks* blocks = NULL;
+  RaveData2D_t* empty = NULL;
+  const short* data = NULL;
+  long ncols = 0, nrows = 0, nblocks = 0, b = 0;
+  int hasnodata = 0;
+  short nodata = 0;
+  size_t length = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  if (BBTopography_isCompressed(self)) {
+    return 1;
+  }
+  if (BBTopography_getDataType(self) != RaveDataType_SHORT) {
+    RAVE_ERROR0("Only topography with 16-bit data can be compressed");
+    return 0;
+  }
+  if ((self->tiles != NULL || self->blocks != NULL) && !BBTopographyInternal_materialize(self)) {
+    return 0;
+  }
+
+  ncols = BBTopography_getNcols(self);
+  nrows = BBTopography_getNrows(self);
+  if (self->storage == NULL) {
+    data = (const short*)RaveData2D_getData(self->data);
+  }
+  hasnodata = (self->nodata == floor(self->nodata) && self->nodata >= -32768.0 && self->nodata <= 32767.0);
+  nodata = hasnodata ? (short)self->nodata : 0;
+
+  blocks = BBTopographyInternal_newBlocks(ncols, nrows, &nblocks);
+  if (blocks == NULL) {
+    goto done;
+  }
+  blocks->nodata = nodata;
+  blocks->mins = RAVE_MALLOC(sizeof(short) * (nblocks + 1));
+  blocks->bits = RAVE_MALLOC(sizeof(unsigned char) * (nblocks + 1));
+  if (blocks->mins == NULL || blocks->bits == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for compressed topography");
+    goto done;
+  }
+
+  /* First pass finds the range of each block and the size of the packed data */
+  for (b = 0; b < nblocks; b++) {
+    long c0 = (b % blocks->nblockcols) << BBTOPOGRAPHY_BLOCK_SHIFT, r0 = (b / blocks->nblockcols) << BBTOPOGRAPHY_BLOCK_SHIFT;
+    long c1 = (c0 + BBTOPOGRAPHY_BLOCK_MASK < ncols) ? c0 + BBTOPOGRAPHY_BLOCK_MASK : ncols - 1;
+    long r1 = (r0 + BBTOPOGRAPHY_BLOCK_MASK < nrows) ? r0 + BBTOPOGRAPHY_BLOCK_MASK : nrows - 1;
+    long ci = 0, ri = 0;
+    int minv = 32767, maxv = -32768, blocknodata = 0, bits = 0, allbits = 0;
+    for (ri = r0; ri <= r1; ri++) {
+      for (ci = c0; ci <= c1; ci++) {
+        short v = (data != NULL) ? data[ri * ncols + ci] : (short)ntohs(self->raw[ri * ncols + ci]);
+        if (hasnodata && v == nodata) {
+          blocknodata = 1;
+        } else {
+          minv = (v < minv) ? v : minv;
+          maxv = (v > maxv) ? v : maxv;
+        }
+      }
+    }
+    if (minv > maxv) {
+      /* Only nodata, no bits are needed */
+      minv = maxv = nodata;
+      blocknodata = 0;
+    }
+    while (((unsigned int)(maxv - minv) + (blocknodata ? 1 : 0)) >> bits) {
+      bits++;
+    }
+    if (blocknodata) {
+      /* Nodata can also be coded as any other value when that needs fewer bits */
+      int allmin = (nodata < minv) ? nodata : minv, allmax = (nodata > maxv) ? nodata : maxv;
+      while ((unsigned int)(allmax - allmin) >> allbits) {
+        allbits++;
+      }
+      if (allbits < bits) {
+        minv = allmin;
+        bits = allbits;
+        blocknodata = 0;
+      }
+    }
+    blocks->mins[b] = (short)minv;
+    blocks->bits[b] = (unsigned char)(bits | (blocknodata ? BBTOPOGRAPHY_BLOCK_NODATA : 0));
+    blocks->offsets[b] = length;
+    length += ((size_t)bits * (size_t)(c1 - c0 + 1) * (size_t)(r1 - r0 + 1) + 7) / 8;
+  }
+
+  blocks->length = length;
+  blocks->packed = RAVE_MALLOC(length + 4);
+  if (blocks->packed == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for compressed topography");
+    goto done;
+  }
+  memset(blocks->packed, 0, length + 4);
+
+  /* Second pass packs the values */
+  for (b = 0; b < nblocks; b++) {
+    long c0 = (b % blocks->nblockcols) << BBTOPOGRAPHY_BLOCK_SHIFT, r0 = (b / blocks->nblockcols) << BBTOPOGRAPHY_BLOCK_SHIFT;
+    long c1 = (c0 + BBTOPOGRAPHY_BLOCK_MASK < ncols) ? c0 + BBTOPOGRAPHY_BLOCK_MASK : ncols - 1;
+    long r1 = (r0 + BBTOPOGRAPHY_BLOCK_MASK < nrows) ? r0 + BBTOPOGRAPHY_BLOCK_MASK : nrows - 1;
+    int bits = blocks->bits[b] & ~BBTOPOGRAPHY_BLOCK_NODATA;
+    long ci = 0, ri = 0;
+    if (bits == 0) {
+      continue;
+    }
+    for (ri = r0; ri <= r1; ri++) {
+      for (ci = c0; ci <= c1; ci++) {
+        short v = (data != NULL) ? data[ri * ncols + ci] : (short)ntohs(self->raw[ri * ncols + ci]);
+        size_t bitpos = (size_t)((ri - r0) * (c1 - c0 + 1) + (ci - c0)) * bits;
+        unsigned char* p = blocks->packed + blocks->offsets[b] + (bitpos >> 3);
+        unsigned int code = ((blocks->bits[b] & BBTOPOGRAPHY_BLOCK_NODATA) && v == nodata) ? (1u << bits) - 1 : (unsigned int)(v - blocks->mins[b]);
+        code <<= (bitpos & 7);
+        p[0] |= (unsigned char)code;
+        p[1] |= (unsigned char)(code >> 8);
+        p[2] |= (unsigned char)(code >> 16);
+      }
+    }
+  }
+
+  /* Free the previous data, the compressed storage replaces it. The values are the same so
+   * overview levels and footprint tables are kept. */
+  empty = RAVE_OBJECT_NEW(&RaveData2D_TYPE);
+  if (empty == NULL) {
+    goto done;
+  }
+  RAVE_OBJECT_RELEASE(self->data);
+  self->data = empty;
+  BBTopographyInternal_dropStorage(self);
+  self->blocks = blocks;
+  blocks = NULL;
+
+  result = 1;
+done:
+  BBTopographyInternal_releaseBlocks(blocks);
+  return result;
+}
+
+int BBTopography_isCompressed(BBTopography_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return (self->blocks != NULL && self->blocks->values == NULL) ? 1 : 0;
+}
+
+int BBTopography_createBlockLayout(BBTopography_t* self)
+{
+  int result = 0;
+  BBTopographyBlocks* blocks = NULL;
+  RaveData2D_t* empty = NULL;
+  const short* data = NULL;
+  long ncols = 0, nrows = 0, nblocks = 0, b = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  if (BBTopography_hasBlockLayout(self)) {
+    return 1;
+  }
+  if (BBTopography_getDataType(self) != RaveDataType_SHORT) {
+    RAVE_ERROR0("Only topography with 16-bit data can be stored in blocks");
+    return 0;
+  }
+  if ((self->tiles != NULL || self->blocks != NULL) && !BBTopographyInternal_materialize(self)) {
+    return 0;
+  }
+
+  ncols = BBTopography_getNcols(self);
+  nrows = BBTopography_getNrows(self);
+  if (self->storage == NULL) {
+    data = (const short*)RaveData2D_getData(self->data);
+  }
+
+  blocks = BBTopographyInternal_newBlocks(ncols, nrows, &nblocks);
+  if (blocks == NULL) {
+    goto done;
+  }
+  blocks->values = RAVE_MALLOC(sizeof(short) * ncols * nrows + 1);
+  if (blocks->values == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for topography blocks");
+    goto done;
+  }
+
+  for (b = 0; b < nblocks; b++) {
+    long c0 = (b % blocks->nblockcols) << BBTOPOGRAPHY_BLOCK_SHIFT, r0 = (b / blocks->nblockcols) << BBTOPOGRAPHY_BLOCK_SHIFT;
+    long c1 = (c0 + BBTOPOGRAPHY_BLOCK_MASK < ncols) ? c0 + BBTOPOGRAPHY_BLOCK_MASK : ncols - 1;
+    long r1 = (r0 + BBTOPOGRAPHY_BLOCK_MASK < nrows) ? r0 + BBTOPOGRAPHY_BLOCK_MASK : nrows - 1;
+    long ci = 0, ri = 0;
+    short* dp = NULL;
+    /* The rows of blocks above this one and the blocks to the left of it within its row of blocks */
+    blocks->offsets[b] = (size_t)r0 * ncols + (size_t)c0 * (r1 - r0 + 1);
+    dp = blocks->values + blocks->offsets[b];
+    for (ri = r0; ri <= r1; ri++) {
+      for (ci = c0; ci <= c1; ci++) {
+        *dp++ = (data != NULL) ? data[ri * ncols + ci] : (short)ntohs(self->raw[ri * ncols + ci]);
+      }
+    }
+  }
+
+  /* Free the previous data, the block storage replaces it. The values are the same so
+   * overview levels and footprint tables are kept. */
+  empty = RAVE_OBJECT_NEW(&RaveData2D_TYPE);
+  if (empty == NULL) {
+    goto done;
+  }
+  RAVE_OBJECT_RELEASE(self->data);
+  self->data = empty;
+  BBTopographyInternal_dropStorage(self);
+  self->blocks = blocks;
+  blocks = NULL;
+
+  result = 1;
+done:
+  BBTopographyInternal_releaseBlocks(blocks);
+  return result;
+}
+
+int BBTopography_hasBlockLayout(BBTopography_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return (self->blocks != NULL && self->blocks->values != NULL) ? 1 : 0;
+}
+
+long BBTopography_getDataSize(BBTopography_t* self)
+{
+  long result = 0;
+  int i = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (self->tiles != NULL) {
+    for (i = 0; i < self->ntiles; i++) {
+      result += BBTopography_getDataSize(self->tiles[i].topo);
+    }
+  } else if (self->blocks != NULL && self->blocks->values != NULL) {
+    long nblocks = self->blocks->nblockcols * ((self->blocks->nrows + BBTOPOGRAPHY_BLOCK_MASK) >> BBTOPOGRAPHY_BLOCK_SHIFT);
+    result = self->blocks->ncols * self->blocks->nrows * (long)sizeof(short) + nblocks * (long)sizeof(size_t);
+  } else if (self->blocks != NULL) {
+    long nblocks = self->blocks->nblockcols * ((self->blocks->nrows + BBTOPOGRAPHY_BLOCK_MASK) >> BBTOPOGRAPHY_BLOCK_SHIFT);
+    result = (long)self->blocks->length + nblocks * (long)(sizeof(size_t) + sizeof(short) + sizeof(unsigned char));
+  } else if (self->storage != NULL) {
+    result = self->rawcols * self->rawrows * (long)sizeof(short);
+  } else {
+    result = BBTopography_getNcols(self) * BBTopography_getNrows(self) * get_ravetype_size(BBTopography_getDataType(self));
+  }
+  return result;
+}
+
+int BBTopography_addTile(BBTopography_t* self, BBTopography_t* tile)
+{
+  BBTopographyTile* tiles = NULL;
+  RaveData2D_t* empty = NULL;
+  double ulxmap = 0.0;
+  long col = 0, row = 0, ncols = 0, nrows = 0, width = 0, bestwidth = 0;
+  int i = 0, k = 0;
+  const int shifts[3] = {0, -1, 1};
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (tile == NULL || tile == self) {
+    RAVE_ERROR0("Trying to add invalid tile to mosaic");
+    return 0;
+  }
+
+  ncols = BBTopography_getNcols(tile);
+  nrows = BBTopography_getNrows(tile);
+
+  if (self->tiles == NULL) {
+    empty = RAVE_OBJECT_NEW(&RaveData2D_TYPE);
+    if (empty == NULL) {
+      return 0;
+    }
+    RAVE_OBJECT_RELEASE(self->data);
+    self->data = empty;
+    BBTopographyInternal_dropStorage(self);
+    BBTopographyInternal_dropBlocks(self);
+    BBTopographyInternal_dropDerived(self);
+    self->nodata = tile->nodata;
+    self->ulxmap = tile->ulxmap;
+    self->ulymap = tile->ulymap;
+    self->xdim = tile->xdim;
+    self->ydim = tile->ydim;
+  } else {
+    if (self->xdim != tile->xdim || self->ydim != tile->ydim) {
+      RAVE_ERROR0("Cannot add a tile that don't have same xdim and ydim values to a mosaic");
+      return 0;
+    }
+  }
+
+  if (self->xdim == 0.0 || self->ydim == 0.0) {
+    RAVE_ERROR0("xdim or ydim == 0.0 in mosaic tile");
+    return 0;
+  }
+
+  /* Place the tile 360 degrees east or west if that gives a more narrow mosaic */
+  ulxmap = tile->ulxmap;
+  for (k = 0; k < 3; k++) {
+    long c = lround((tile->ulxmap + shifts[k]*2.0*M_PI - self->ulxmap)/self->xdim);
+    width = ((c + ncols > self->mosaiccols) ? c + ncols : self->mosaiccols) - ((c < 0) ? c : 0);
+    if (k == 0 || width < bestwidth) {
+      bestwidth = width;
+      col = c;
+      ulxmap = tile->ulxmap + shifts[k]*2.0*M_PI;
+    }
+  }
+  row = lround((self->ulymap - tile->ulymap)/self->ydim);
+
+  tiles = RAVE_REALLOC(self->tiles, sizeof(BBTopographyTile) * (self->ntiles + 1));
+  if (tiles == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for mosaic tiles");
+    return 0;
+  }
+  self->tiles = tiles;
+
+  /* Move the upper left corner if the tile is west or north of it */
+  if (col < 0) {
+    for (i = 0; i < self->ntiles; i++) {
+      self->tiles[i].col -= col;
+    }
+    self->mosaiccols -= col;
+    self->ulxmap = ulxmap;
+    col = 0;
+  }
+  if (row < 0) {
+    for (i = 0; i < self->ntiles; i++) {
+      self->tiles[i].row -= row;
+    }
+    self->mosaicrows -= row;
+    self->ulymap = tile->ulymap;
+    row = 0;
+  }
+
+  self->tiles[self->ntiles].topo = RAVE_OBJECT_COPY(tile);
+  self->tiles[self->ntiles].col = col;
+  self->tiles[self->ntiles].row = row;
+  self->tiles[self->ntiles].ncols = ncols;
+  self->tiles[self->ntiles].nrows = nrows;
+  self->ntiles++;
+  if (col + ncols > self->mosaiccols) {
+    self->mosaiccols = col + ncols;
+  }
+  if (row + nrows > self->mosaicrows) {
+    self->mosaicrows = row + nrows;
+  }
+
+  return 1;
+}
+
 int BBTopography_setDatafield(BBTopography_t* self, RaveData2D_t* datafield)
 {
   int result = 0;
@@ -192,6 +1284,10 @@ int BBTopography_setDatafield(BBTopography_t* self, RaveData2D_t* datafield)
   if (datafield != NULL) {
     RaveData2D_t* d = RAVE_OBJECT_CLONE(datafield);
     if (d != NULL) {
+      BBTopographyInternal_dropStorage(self);
+      BBTopographyInternal_dropBlocks(self);
+      BBTopographyInternal_dropTiles(self);
+      BBTopographyInternal_dropDerived(self);
       RAVE_OBJECT_RELEASE(self->data);
       self->data = d;
       result = 1;
@@ -208,6 +1304,10 @@ RaveData2D_t* BBTopography_getDatafield(BBTopography_t* self)
 
   RAVE_ASSERT((self != NULL), "self == NULL");
 
+  if (!BBTopographyInternal_materialize(self)) {
+    return NULL;
+  }
+
   result = RAVE_OBJECT_CLONE(self->data);
   if (result == NULL) {
     RAVE_ERROR0("Failed to clone data field");
@@ -219,36 +1319,183 @@ RaveData2D_t* BBTopography_getDatafield(BBTopography_t* self)
 long BBTopography_getNcols(BBTopography_t* self)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  if (self->tiles != NULL) {
+    return self->mosaiccols;
+  }
+  if (self->storage != NULL) {
+    return self->rawcols;
+  }
+  if (self->blocks != NULL) {
+    return self->blocks->ncols;
+  }
   return RaveData2D_getXsize(self->data);
 }
 
 long BBTopography_getNrows(BBTopography_t* self)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  if (self->tiles != NULL) {
+    return self->mosaicrows;
+  }
+  if (self->storage != NULL) {
+    return self->rawrows;
+  }
+  if (self->blocks != NULL) {
+    return self->blocks->nrows;
+  }
   return RaveData2D_getYsize(self->data);
 }
 
 RaveDataType BBTopography_getDataType(BBTopography_t* self)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  if (self->tiles != NULL) {
+    return BBTopography_getDataType(self->tiles[0].topo);
+  }
+  if (self->storage != NULL || self->blocks != NULL) {
+    return RaveDataType_SHORT;
+  }
   return RaveData2D_getType(self->data);
 }
 
 int BBTopography_getValue(BBTopography_t* self, long col, long row, double* v)
 {
+  int i = 0;
   RAVE_ASSERT((self != NULL), "self == NULL");
+  if (self->tiles != NULL) {
+    if (col < 0 || col >= self->mosaiccols || row < 0 || row >= self->mosaicrows) {
+      return 0;
+    }
+    for (i = 0; i < self->ntiles; i++) {
+      BBTopographyTile* t = &self->tiles[i];
+      if (col >= t->col && col < t->col + t->ncols && row >= t->row && row < t->row + t->nrows) {
+        return BBTopography_getValue(t->topo, col - t->col, row - t->row, v);
+      }
+    }
+    *v = self->nodata;
+    return 1;
+  }
+  if (self->storage != NULL) {
+    if (col < 0 || col >= self->rawcols || row < 0 || row >= self->rawrows) {
+      return 0;
+    }
+    *v = (double)((short)ntohs(self->raw[row * self->rawcols + col]));
+    return 1;
+  }
+  if (self->blocks != NULL) {
+    if (col < 0 || col >= self->blocks->ncols || row < 0 || row >= self->blocks->nrows) {
+      return 0;
+    }
+    *v = (double)BBTopographyInternal_getBlockValue(self->blocks, col, row);
+    return 1;
+  }
   return RaveData2D_getValue(self->data, col, row, v);
 }
 
 int BBTopography_setValue(BBTopography_t* self, long col, long row, double value)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
+  if (!BBTopographyInternal_materialize(self)) {
+    return 0;
+  }
+  BBTopographyInternal_dropDerived(self);
   return RaveData2D_setValue(self->data, col, row, value);
 }
 
+int BBTopography_copyRegion(BBTopography_t* self, BBTopography_t* src, long srccol, long srcrow, long dstcol, long dstrow, long ncols, long nrows)
+{
+  long ri = 0, ci = 0;
+  double v = 0.0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (src == NULL) {
+    RAVE_ERROR0("Trying to copy region from NULL");
+    return 0;
+  }
+
+  if (ncols < 0 || nrows < 0 ||
+      srccol < 0 || srcrow < 0 || srccol + ncols > BBTopography_getNcols(src) || srcrow + nrows > BBTopography_getNrows(src) ||
+      dstcol < 0 || dstrow < 0 || dstcol + ncols > BBTopography_getNcols(self) || dstrow + nrows > BBTopography_getNrows(self)) {
+    RAVE_ERROR0("Region is outside topography boundaries");
+    return 0;
+  }
+
+  if (!BBTopographyInternal_materialize(self)) {
+    return 0;
+  }
+  BBTopographyInternal_dropDerived(self);
+
+  if (src->storage != NULL && RaveData2D_getType(self->data) == RaveDataType_SHORT) {
+    short* data = (short*)RaveData2D_getData(self->data);
+    long dstncols = RaveData2D_getXsize(self->data);
+    for (ri = 0; ri < nrows; ri++) {
+      const unsigned short* sp = src->raw + (srcrow + ri) * src->rawcols + srccol;
+      short* dp = data + (dstrow + ri) * dstncols + dstcol;
+      for (ci = 0; ci < ncols; ci++) {
+        dp[ci] = (short)ntohs(sp[ci]);
+      }
+    }
+  } else if (src->blocks != NULL && RaveData2D_getType(self->data) == RaveDataType_SHORT) {
+    short* data = (short*)RaveData2D_getData(self->data);
+    long dstncols = RaveData2D_getXsize(self->data);
+    for (ri = 0; ri < nrows; ri++) {
+      short* dp = data + (dstrow + ri) * dstncols + dstcol;
+      for (ci = 0; ci < ncols; ci++) {
+        dp[ci] = BBTopographyInternal_getBlockValue(src->blocks, srccol + ci, srcrow + ri);
+      }
+    }
+  } else {
+    for (ri = 0; ri < nrows; ri++) {
+      for (ci = 0; ci < ncols; ci++) {
+        if (!BBTopography_getValue(src, srccol + ci, srcrow + ri, &v) ||
+            !RaveData2D_setValue(self->data, dstcol + ci, dstrow + ri, v)) {
+          return 0;
+        }
+      }
+    }
+  }
+
+  return 1;
+}
+
+int BBTopography_getIndexAtLonLat(BBTopography_t* self, double lon, double lat, long* col, long* row)
+{
+  long ci = 0, ri = 0, ncols = 0, nrows = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((col != NULL), "col == NULL");
+  RAVE_ASSERT((row != NULL), "row == NULL");
+
+  if (self->xdim == 0.0 || self->ydim == 0.0) {
+    RAVE_CRITICAL0("xdim or ydim == 0.0 in topography field");
+    return 0;
+  }
+
+  ncols = BBTopography_getNcols(self);
+  nrows = BBTopography_getNrows(self);
+
+  ci = (lon - self->ulxmap)/self->xdim;
+  ri = (self->ulymap - lat)/self->ydim;
+
+  if (ci < 0 || ci >= ncols) {
+    if (lon < self->ulxmap) {
+      ci = (lon + 2.0*M_PI - self->ulxmap)/self->xdim;
+    } else if (lon - 2.0*M_PI >= self->ulxmap) {
+      ci = (lon - 2.0*M_PI - self->ulxmap)/self->xdim;
+    }
+  }
+
+  if (ci < 0 || ci >= ncols || ri < 0 || ri >= nrows) {
+    return 0;
+  }
+
+  *col = ci;
+  *row = ri;
+  return 1;
+}
+
 int BBTopography_getValueAtLonLat(BBTopography_t* self, double lon, double lat, double* v)
 {
-  int result = 0;
   long ci = 0, ri = 0;
   double nv = 0.0;
 
@@ -256,23 +1503,285 @@ int BBTopography_getValueAtLonLat(BBTopography_t* self, double lon, double lat,
   RAVE_ASSERT((v != NULL), "v == NULL");
   *v = self->nodata;
 
-  if (self->xdim == 0.0 || self->ydim == 0.0) {
-    RAVE_CRITICAL0("xdim or ydim == 0.0 in topography field");
+  if (BBTopography_getIndexAtLonLat(self, lon, lat, &ci, &ri) &&
+      BBTopography_getValue(self, ci, ri, &nv)) {
+    *v = nv;
+    return 1;
+  }
+
+  return 0;
+}
+
+int BBTopography_createOverviews(BBTopography_t* self, int nlevels)
+{
+  BBTopography_t** levels = NULL;
+  double* sums = NULL;
+  long* counts = NULL;
+  long ncols = 0, nrows = 0, ci = 0, ri = 0;
+  double v = 0.0;
+  int n = 0, i = 0;
+  int result = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  BBTopographyInternal_dropLevels(self);
+  ncols = BBTopography_getNcols(self);
+  nrows = BBTopography_getNrows(self);
+  if (nlevels <= 0 || ncols <= 0 || nrows <= 0) {
+    return 1;
+  }
+
+  levels = RAVE_MALLOC(sizeof(BBTopography_t*) * nlevels);
+  sums = RAVE_MALLOC(sizeof(double) * ncols * nrows);
+  counts = RAVE_MALLOC(sizeof(long) * ncols * nrows);
+  if (levels == NULL || sums == NULL || counts == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for overview levels");
     goto done;
   }
 
-  ci = (lon - self->ulxmap)/self->xdim;
-  ri = (self->ulymap - lat)/self->ydim;
+  for (ri = 0; ri < nrows; ri++) {
+    for (ci = 0; ci < ncols; ci++) {
+      int valid = BBTopography_getValue(self, ci, ri, &v) && v != self->nodata;
+      sums[ri * ncols + ci] = valid ? v : 0.0;
+      counts[ri * ncols + ci] = valid ? 1 : 0;
+    }
+  }
 
-  if (RaveData2D_getValue(self->data, ci, ri, &nv)) {
-    *v = nv;
-    result = 1;
+  while (n < nlevels && (ncols > 1 || nrows > 1)) {
+    levels[n] = BBTopographyInternal_reduce(self, n + 1, ncols, nrows, sums, counts);
+    if (levels[n] == NULL) {
+      goto done;
+    }
+    ncols = BBTopography_getNcols(levels[n]);
+    nrows = BBTopography_getNrows(levels[n]);
+    n++;
   }
 
+  self->levels = levels;
+  self->nlevels = n;
+  levels = NULL;
+  result = 1;
 done:
+  if (levels != NULL) {
+    for (i = 0; i < n; i++) {
+      RAVE_OBJECT_RELEASE(levels[i]);
+    }
+    RAVE_FREE(levels);
+  }
+  RAVE_FREE(sums);
+  RAVE_FREE(counts);
   return result;
 }
 
+int BBTopography_getNlevels(BBTopography_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->nlevels;
+}
+
+BBTopography_t* BBTopography_getLevel(BBTopography_t* self, int level)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (level < 0 || level > self->nlevels) {
+    RAVE_ERROR1("No overview level %d", level);
+    return NULL;
+  }
+  if (level == 0) {
+    return RAVE_OBJECT_COPY(self);
+  }
+  return RAVE_OBJECT_COPY(self->levels[level - 1]);
+}
+
+int BBTopography_getLevelValue(BBTopography_t* self, int level, long col, long row, double* v)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (level == 0) {
+    return BBTopography_getValue(self, col, row, v);
+  }
+  if (level < 0 || level > self->nlevels) {
+    return 0;
+  }
+  return BBTopography_getValue(self->levels[level - 1], col, row, v);
+}
+
+int BBTopography_createFootprintTables(BBTopography_t* self)
+{
+  long ncols = 0, nrows = 0, ci = 0, ri = 0, pcols = 0, prows = 0;
+  size_t tcols = 0;
+  double v = 0.0;
+  int level = 0, maxlevels = 0;
+  int result = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  BBTopographyInternal_dropFootprintTables(self);
+  ncols = BBTopography_getNcols(self);
+  nrows = BBTopography_getNrows(self);
+  if (ncols <= 0 || nrows <= 0) {
+    RAVE_ERROR0("Can not create footprint tables for empty topography");
+    return 0;
+  }
+  self->tablecols = ncols;
+  self->tablerows = nrows;
+  tcols = (size_t)ncols + 1;
+
+  while ((1L << maxlevels) < ncols || (1L << maxlevels) < nrows) {
+    maxlevels++;
+  }
+
+  self->sumtable = RAVE_MALLOC(sizeof(double) * tcols * (size_t)(nrows + 1));
+  self->counttable = RAVE_MALLOC(sizeof(int) * tcols * (size_t)(nrows + 1));
+  self->maxpyramid = RAVE_MALLOC(sizeof(float*) * (maxlevels + 1));
+  if (self->sumtable == NULL || self->counttable == NULL || self->maxpyramid == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for footprint tables");
+    goto done;
+  }
+
+  /* The tables have an extra first row and column with zeros so that no special cases are needed */
+  memset(self->sumtable, 0, sizeof(double) * tcols);
+  memset(self->counttable, 0, sizeof(int) * tcols);
+  for (ri = 0; ri < nrows; ri++) {
+    double rowsum = 0.0;
+    int rowcount = 0;
+    double* sums = self->sumtable + (ri + 1) * tcols;
+    int* counts = self->counttable + (ri + 1) * tcols;
+    sums[0] = 0.0;
+    counts[0] = 0;
+    for (ci = 0; ci < ncols; ci++) {
+      if (BBTopography_getValue(self, ci, ri, &v) && v != self->nodata) {
+        rowsum += v;
+        rowcount++;
+      }
+      sums[ci + 1] = sums[ci + 1 - tcols] + rowsum;
+      counts[ci + 1] = counts[ci + 1 - tcols] + rowcount;
+    }
+  }
+
+  /* Each level in the max pyramid holds the highest cell with data of the 2x2 cells it covers in the previous level */
+  pcols = ncols;
+  prows = nrows;
+  for (level = 1; level <= maxlevels; level++) {
+    long lcols = (pcols + 1) / 2, lrows = (prows + 1) / 2, k = 0;
+    float* maxlevel = RAVE_MALLOC(sizeof(float) * lcols * lrows);
+    if (maxlevel == NULL) {
+      RAVE_ERROR0("Failed to allocate memory for footprint tables");
+      goto done;
+    }
+    self->maxpyramid[level - 1] = maxlevel;
+    self->nmaxlevels = level;
+    for (ri = 0; ri < lrows; ri++) {
+      for (ci = 0; ci < lcols; ci++) {
+        float m = -FLT_MAX;
+        for (k = 0; k < 4; k++) {
+          long c = 2*ci + (k & 1), r = 2*ri + (k >> 1);
+          if (c < pcols && r < prows) {
+            float pv = BBTopographyInternal_getPyramidMax(self, level - 1, c, r, c, r);
+            if (pv > m) {
+              m = pv;
+            }
+          }
+        }
+        maxlevel[ri * lcols + ci] = m;
+      }
+    }
+    pcols = lcols;
+    prows = lrows;
+  }
+
+  result = 1;
+done:
+  if (!result) {
+    BBTopographyInternal_dropFootprintTables(self);
+  }
+  return result;
+}
+
+int BBTopography_hasFootprintTables(BBTopography_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return (self->sumtable != NULL) ? 1 : 0;
+}
+
+/**
+ * Clips a box to the topography that the footprint tables were created for.
+ * @param[in] self - self
+ * @param[in,out] col0 - first column
+ * @param[in,out] row0 - first row
+ * @param[in,out] col1 - last column
+ * @param[in,out] row1 - last row
+ * @return 1 if any part of the box is within the topography otherwise 0
+ */
+static int BBTopographyInternal_clipBox(BBTopography_t* self, long* col0, long* row0, long* col1, long* row1)
+{
+  if (*col0 < 0) {
+    *col0 = 0;
+  }
+  if (*row0 < 0) {
+    *row0 = 0;
+  }
+  if (*col1 >= self->tablecols) {
+    *col1 = self->tablecols - 1;
+  }
+  if (*row1 >= self->tablerows) {
+    *row1 = self->tablerows - 1;
+  }
+  return (*col0 <= *col1 && *row0 <= *row1) ? 1 : 0;
+}
+
+int BBTopography_getFootprintMean(BBTopography_t* self, long col0, long row0, long col1, long row1, double* v)
+{
+  size_t tcols = 0;
+  double sum = 0.0;
+  int count = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((v != NULL), "v == NULL");
+  *v = self->nodata;
+
+  if (self->sumtable == NULL || !BBTopographyInternal_clipBox(self, &col0, &row0, &col1, &row1)) {
+    return 0;
+  }
+
+  tcols = (size_t)self->tablecols + 1;
+  sum = self->sumtable[(row1 + 1) * tcols + col1 + 1] - self->sumtable[row0 * tcols + col1 + 1] -
+        self->sumtable[(row1 + 1) * tcols + col0] + self->sumtable[row0 * tcols + col0];
+  count = self->counttable[(row1 + 1) * tcols + col1 + 1] - self->counttable[row0 * tcols + col1 + 1] -
+          self->counttable[(row1 + 1) * tcols + col0] + self->counttable[row0 * tcols + col0];
+  if (count == 0) {
+    return 0;
+  }
+  *v = sum / count;
+  return 1;
+}
+
+int BBTopography_getFootprintMax(BBTopography_t* self, long col0, long row0, long col1, long row1, double* v)
+{
+  long size = 0;
+  int level = 0;
+  float m = -FLT_MAX;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((v != NULL), "v == NULL");
+  *v = self->nodata;
+
+  if (self->sumtable == NULL || !BBTopographyInternal_clipBox(self, &col0, &row0, &col1, &row1)) {
+    return 0;
+  }
+
+  /* The level where a cell is at most as large as the box, so the box covers at most 3x3 cells */
+  size = (col1 - col0 > row1 - row0) ? col1 - col0 + 1 : row1 - row0 + 1;
+  while (level < self->nmaxlevels && (2L << level) <= size) {
+    level++;
+  }
+
+  m = BBTopographyInternal_getBoxMax(self, level, col0, row0, col1, row1, -FLT_MAX);
+  if (m == -FLT_MAX) {
+    return 0;
+  }
+  *v = m;
+  return 1;
+}
+
 BBTopography_t* BBTopography_concatX(BBTopography_t* self, BBTopography_t* other)
 {
   BBTopography_t *result = NULL;
@@ -291,6 +1800,10 @@ BBTopography_t* BBTopography_concatX(BBTopography_t* self, BBTopography_t* other
     return NULL;
   }
 
+  if (!BBTopographyInternal_materialize(self) || !BBTopographyInternal_materialize(other)) {
+    return NULL;
+  }
+
   dfield = RaveData2D_concatX(self->data, other->data);
   if (dfield != NULL) {
     result = RAVE_OBJECT_NEW(&BBTopography_TYPE);
@@ -329,6 +1842,10 @@ BBTopography_t* BBTopography_concatY(BBTopography_t* self, BBTopography_t* other
     return NULL;
   }
 
+  if (!BBTopographyInternal_materialize(self) || !BBTopographyInternal_materialize(other)) {
+    return NULL;
+  }
+
   dfield = RaveData2D_concatY(self->data, other->data);
   if (dfield != NULL) {
     result = RAVE_OBJECT_NEW(&BBTopography_TYPE);
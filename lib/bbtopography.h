@@ -129,12 +129,97 @@ int BBTopography_createData(BBTopography_t* self, long ncols, long nrows, RaveDa
  */
 int BBTopography_setData(BBTopography_t* self, long ncols, long nrows, void* data, RaveDataType type);
 /**
- * Returns a pointer to the internal data storage.
+ * Returns a pointer to the internal data storage. If the data is mapped from file or if
+ * this is a mosaic, it will first be decoded into memory.
  * @param[in] self - self
  * @return the internal data pointer (NOTE! Do not release this pointer)
  */
 void* BBTopography_getData(BBTopography_t* self);
 
+/**
+ * Maps a raw big-endian 16-bit raster file (like a GTOPO30 .DEM file) read-only into
+ * the topography field. No data is copied, the values are byte-swapped when accessed
+ * so only the pages that actually are used will be read from disk. The mapping is
+ * shared between clones. Any call that modifies the data or requests the internal data
+ * pointer will decode the mapping into a regular data field.
+ * @param[in] self - self
+ * @param[in] filename - the file to map
+ * @param[in] ncols - the number of columns in the file
+ * @param[in] nrows - the number of rows in the file
+ * @return 1 on success otherwise 0
+ */
+int BBTopography_mapFile(BBTopography_t* self, const char* filename, long ncols, long nrows);
+
+/**
+ * Returns if the topography data is read directly from a mapped file.
+ * @param[in] self - self
+ * @return 1 if mapped, otherwise 0
+ */
+int BBTopography_isMapped(BBTopography_t* self);
+
+/**
+ * Compresses the topography data in memory. The data is split into blocks of 64x64 cells and
+ * each block is bit-packed as offsets from its smallest value, which typically needs less than
+ * half the memory of the 16-bit data for land and almost nothing for sea. Values are decoded
+ * one at a time by \ref BBTopography_getValue, so the compressed data can be shared read-only
+ * between threads. Only topography with 16-bit data can be compressed, and the data is decoded
+ * again if it is accessed directly or modified.
+ * @param[in] self - self
+ * @return 1 on success otherwise 0
+ */
+int BBTopography_compress(BBTopography_t* self);
+
+/**
+ * Returns if the topography data is compressed, see \ref BBTopography_compress.
+ * @param[in] self - self
+ * @return 1 if compressed, otherwise 0
+ */
+int BBTopography_isCompressed(BBTopography_t* self);
+
+/**
+ * Stores the topography data in blocks of 64x64 cells in memory instead of row by row. This keeps
+ * cells that are close to each other in any direction on the same few cache lines and pages,
+ * which suits the radial access pattern when a topography is mapped against a scan. The layout
+ * is only used internally by \ref BBTopography_getValue and \ref BBTopography_getValueAtLonLat, the
+ * data is rearranged row by row again if it is accessed directly or modified. Only topography with
+ * 16-bit data can be stored in blocks.
+ * @param[in] self - self
+ * @return 1 on success otherwise 0
+ */
+int BBTopography_createBlockLayout(BBTopography_t* self);
+
+/**
+ * Returns if the topography data is stored in blocks, see \ref BBTopography_createBlockLayout.
+ * @param[in] self - self
+ * @return 1 if stored in blocks, otherwise 0
+ */
+int BBTopography_hasBlockLayout(BBTopography_t* self);
+
+/**
+ * Returns the number of bytes that holds the topography data, i.e. the compressed size if the
+ * data is compressed and the mapped size if the data is mapped from a file. Overview levels and
+ * footprint tables are not included.
+ * @param[in] self - self
+ * @return the size of the data in bytes
+ */
+long BBTopography_getDataSize(BBTopography_t* self);
+
+/**
+ * Adds a tile to this topography so that it becomes a mosaic of tiles. The tiles are not
+ * copied, instead values are read from the tile that covers the requested position and
+ * positions not covered by any tile will get nodata. The first tile added defines xdim, ydim
+ * and nodata and all other tiles must have the same xdim and ydim. Tiles are positioned
+ * according to their ulxmap and ulymap, if placing a tile 360 degrees east or west gives a more
+ * narrow mosaic, that is done so mosaics can reach across the +/-180 degree meridian.
+ * Any previous data in self is replaced when adding the first tile and the tiles will
+ * be copied into a regular data field first when someone needs the internal data pointer
+ * or modifies the data.
+ * @param[in] self - self
+ * @param[in] tile - the tile to add
+ * @return 1 on success otherwise 0
+ */
+int BBTopography_addTile(BBTopography_t* self, BBTopography_t* tile);
+
 /**
  * Sets the rave data 2d field. This will create a clone from the provided data field.
  * @param[in] self - self
@@ -192,10 +277,39 @@ int BBTopography_getValue(BBTopography_t* self, long col, long row, double* v);
  */
 int BBTopography_setValue(BBTopography_t* self, long col, long row, double value);
 
+/**
+ * Copies a rectangular region of cells from another topography field into this field.
+ * Both regions must be within the respective fields boundaries. If the source is a
+ * mapped file, only the rows within the region will be touched.
+ * @param[in] self - self (the destination)
+ * @param[in] src - the source field
+ * @param[in] srccol - the first column in the source
+ * @param[in] srcrow - the first row in the source
+ * @param[in] dstcol - the first column in self
+ * @param[in] dstrow - the first row in self
+ * @param[in] ncols - the number of columns to copy
+ * @param[in] nrows - the number of rows to copy
+ * @return 1 on success otherwise 0
+ */
+int BBTopography_copyRegion(BBTopography_t* self, BBTopography_t* src, long srccol, long srcrow, long dstcol, long dstrow, long ncols, long nrows);
+
+/**
+ * Returns the column and row of the cell that contains the specified lon/lat coordinate.
+ * Longitudes are handled in the same way as in \ref BBTopography_getValueAtLonLat.
+ * @param[in] self - self
+ * @param[in] lon - the longitude
+ * @param[in] lat - the latitude
+ * @param[out] col - the column
+ * @param[out] row - the row
+ * @return 1 if the coordinate is within the field otherwise 0
+ */
+int BBTopography_getIndexAtLonLat(BBTopography_t* self, double lon, double lat, long* col, long* row);
+
 /**
  * Returns the value at the specified lon/lat coordinate. If outside boundaries or if
  * there is no data at provided coordinate the returned value will be 0 but v will still
- * be set to nodata.
+ * be set to nodata. Longitudes that are outside the field will also be tried 360 degrees
+ * east or west so that fields reaching across the +/-180 degree meridian can be used.
  *
  * @param[in] self - self
  * @param[in] lon - the longitude
@@ -205,6 +319,92 @@ int BBTopography_setValue(BBTopography_t* self, long col, long row, double value
  */
 int BBTopography_getValueAtLonLat(BBTopography_t* self, double lon, double lat, double* v);
 
+/**
+ * Creates overview levels of the topography. Level n has 2^n times larger cells than the
+ * topography itself and each cell is the mean of the cells with data in the 2x2 cells
+ * it covers in level n-1. All levels share the upper left corner of the topography, so the
+ * cell (col, row) in the topography is covered by the cell (col >> n, row >> n) in level n.
+ * Fewer levels are created if the topography is reduced to a single cell before that. The
+ * levels are dropped when the data or the georeferencing of the topography is changed.
+ * @param[in] self - self
+ * @param[in] nlevels - the number of overview levels, not counting the topography itself
+ * @return 1 on success otherwise 0
+ */
+int BBTopography_createOverviews(BBTopography_t* self, int nlevels);
+
+/**
+ * Returns the number of overview levels, see \ref BBTopography_createOverviews.
+ * @param[in] self - self
+ * @return the number of overview levels
+ */
+int BBTopography_getNlevels(BBTopography_t* self);
+
+/**
+ * Returns an overview level, see \ref BBTopography_createOverviews.
+ * @param[in] self - self
+ * @param[in] level - the level, 0 is the topography itself
+ * @return the level on success otherwise NULL
+ */
+BBTopography_t* BBTopography_getLevel(BBTopography_t* self, int level);
+
+/**
+ * Returns the value at the specified index in an overview level. Unlike \ref BBTopography_getLevel
+ * this does not reference the level, so it can be used by several threads at the same time.
+ * @param[in] self - self
+ * @param[in] level - the level, 0 is the topography itself
+ * @param[in] col - the column in the level
+ * @param[in] row - the row in the level
+ * @param[out] v - the data at the specified index
+ * @return 1 on success, 0 otherwise
+ */
+int BBTopography_getLevelValue(BBTopography_t* self, int level, long col, long row, double* v);
+
+/**
+ * Creates the tables used for aggregating the heights within a box of cells in constant time,
+ * see \ref BBTopography_getFootprintMean and \ref BBTopography_getFootprintMax. These are a
+ * summed-area table of the heights and of the number of cells with data, and a max pyramid where
+ * each level holds the highest cell of 2x2 cells in the previous level. The tables need about
+ * 13 bytes per cell and are dropped when the data or the georeferencing of the topography is changed.
+ * @param[in] self - self
+ * @return 1 on success otherwise 0
+ */
+int BBTopography_createFootprintTables(BBTopography_t* self);
+
+/**
+ * Returns if the topography has footprint tables, see \ref BBTopography_createFootprintTables.
+ * @param[in] self - self
+ * @return 1 if the topography has footprint tables otherwise 0
+ */
+int BBTopography_hasFootprintTables(BBTopography_t* self);
+
+/**
+ * Returns the mean of the cells with data within the box [col0, col1] x [row0, row1]. The parts
+ * of the box that are outside the topography are ignored. Requires the footprint tables.
+ * @param[in] self - self
+ * @param[in] col0 - first column
+ * @param[in] row0 - first row
+ * @param[in] col1 - last column
+ * @param[in] row1 - last row
+ * @param[out] v - the mean, nodata if there is no cell with data within the box
+ * @return 1 if there was any cell with data within the box, otherwise 0
+ */
+int BBTopography_getFootprintMean(BBTopography_t* self, long col0, long row0, long col1, long row1, double* v);
+
+/**
+ * Returns the highest cell with data within the box [col0, col1] x [row0, row1]. The box is
+ * looked up in the level of the max pyramid where it covers at most 3x3 cells, and the cells at
+ * the edges of the box are only refined into finer levels when they can raise the maximum.
+ * The parts of the box that are outside the topography are ignored. Requires the footprint tables.
+ * @param[in] self - self
+ * @param[in] col0 - first column
+ * @param[in] row0 - first row
+ * @param[in] col1 - last column
+ * @param[in] row1 - last row
+ * @param[out] v - the maximum, nodata if there is no cell with data within the box
+ * @return 1 if there was any cell with data within the box, otherwise 0
+ */
+int BBTopography_getFootprintMax(BBTopography_t* self, long col0, long row0, long col1, long row1, double* v);
+
 /**
  * Concatenates two topography fields horizontally with each other.
  * The field's and other's y-dimension must be the same as well as the data
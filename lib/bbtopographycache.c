@@ -0,0 +1,167 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Process wide cache of topography tiles
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#include "bbtopographycache.h"
+#include "bblrucache.h"
+#include "rave_debug.h"
+#include "rave_alloc.h"
+#include <string.h>
+#include <sys/stat.h>
+
+/**
+ * One cached tile
+ */
+typedef struct _BBTopographyCacheEntry {
+  BBLruEntry lru;      /**< maintained by the cache, must be first */
+  char* filename;      /**< the file the tile was read from */
+  time_t mtime;        /**< modification time of the file */
+  off_t filesize;      /**< size of the file */
+  BBTopography_t* topo; /**< the tile */
+} BBTopographyCacheEntry;
+
+/*@{ Private functions */
+/**
+ * Releases an entry.
+ * @param[in] entry - the entry to release
+ */
+static void BBTopographyCacheInternal_freeEntry(BBLruEntry* entry)
+{
+  BBTopographyCacheEntry* e = (BBTopographyCacheEntry*)entry;
+  if (e != NULL) {
+    RAVE_FREE(e->filename);
+    RAVE_OBJECT_RELEASE(e->topo);
+    RAVE_FREE(e);
+  }
+}
+
+/**
+ * Checks if the entry was read from a file.
+ * @param[in] entry - the entry
+ * @param[in] key - the filename
+ * @return 1 if it was otherwise 0
+ */
+static int BBTopographyCacheInternal_equals(const BBLruEntry* entry, const void* key)
+{
+  return (strcmp(((const BBTopographyCacheEntry*)entry)->filename, (const char*)key) == 0);
+}
+
+/**
+ * Returns the size of the tile in an entry.
+ * @param[in] entry - the entry
+ * @return the size in bytes, see \ref BBTopography_getDataSize
+ */
+static long BBTopographyCacheInternal_size(const BBLruEntry* entry)
+{
+  return BBTopography_getDataSize(((const BBTopographyCacheEntry*)entry)->topo);
+}
+/*@} End of Private functions */
+
+/**
+ * The cache
+ */
+static BBLruCache cache = BBLRUCACHE_INITIALIZER(BBTopographyCacheInternal_equals, BBTopographyCacheInternal_size, BBTopographyCacheInternal_freeEntry, BBTOPOGRAPHYCACHE_DEFAULT_SIZE);
+
+/*@{ Interface functions */
+BBTopography_t* BBTopographyCache_get(const char* filename)
+{
+  BBTopographyCacheEntry* entry = NULL;
+  BBTopography_t* result = NULL;
+  struct stat st;
+
+  if (filename == NULL || stat(filename, &st) != 0) {
+    return NULL;
+  }
+
+  BBLruCache_lock(&cache);
+  entry = (BBTopographyCacheEntry*)BBLruCache_find(&cache, BBLruCache_hashString(BBLRUCACHE_HASH_INIT, filename), filename);
+  if (entry != NULL) {
+    if (entry->mtime == st.st_mtime && entry->filesize == st.st_size) {
+      /* The clone is created while holding the lock since object reference counts are not thread safe */
+      result = RAVE_OBJECT_CLONE(entry->topo);
+    } else {
+      BBLruCache_remove(&cache, &entry->lru);
+    }
+  }
+  BBLruCache_unlock(&cache);
+
+  return result;
+}
+
+int BBTopographyCache_put(const char* filename, BBTopography_t* topo)
+{
+  BBTopographyCacheEntry* entry = NULL;
+  struct stat st;
+  int result = 0;
+
+  if (filename == NULL || topo == NULL || stat(filename, &st) != 0) {
+    return 0;
+  }
+
+  entry = RAVE_MALLOC(sizeof(BBTopographyCacheEntry));
+  if (entry == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for topography cache entry");
+    goto done;
+  }
+  memset(entry, 0, sizeof(BBTopographyCacheEntry));
+  entry->filename = RAVE_STRDUP(filename);
+  entry->topo = RAVE_OBJECT_CLONE(topo);
+  entry->mtime = st.st_mtime;
+  entry->filesize = st.st_size;
+  if (entry->filename == NULL || entry->topo == NULL) {
+    RAVE_ERROR0("Failed to create topography cache entry");
+    goto done;
+  }
+
+  if (BBLruCache_insert(&cache, BBLruCache_hashString(BBLRUCACHE_HASH_INIT, filename), filename, &entry->lru)) {
+    entry = NULL;
+    result = 1;
+  }
+
+done:
+  BBTopographyCacheInternal_freeEntry((BBLruEntry*)entry);
+  return result;
+}
+
+void BBTopographyCache_setMaxSize(long size)
+{
+  BBLruCache_setMaxSize(&cache, size);
+}
+
+long BBTopographyCache_getMaxSize(void)
+{
+  return BBLruCache_getMaxSize(&cache);
+}
+
+long BBTopographyCache_getSize(void)
+{
+  return BBLruCache_getSize(&cache);
+}
+
+void BBTopographyCache_clear(void)
+{
+  BBLruCache_lock(&cache);
+  BBLruCache_clear(&cache);
+  BBLruCache_unlock(&cache);
+}
+/*@} End of Interface functions */
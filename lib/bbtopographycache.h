@@ -0,0 +1,79 @@
+/* --------------------------------------------------------------------
+Copyright (C) 2026 Swedish Meteorological and Hydrological Institute, SMHI,
+
+This file is part of beam blockage (beamb).
+
+beamb is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+beamb is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with beamb.  If not, see <http://www.gnu.org/licenses/>.
+------------------------------------------------------------------------*/
+/**
+ * Process wide cache of topography tiles. The cache is shared by all
+ * beam blockage map instances and is safe to use from several threads.
+ * Tiles are keyed by their file name (including topo directory) and the
+ * least recently used tiles are dropped when the cache grows beyond its
+ * size limit. A cached tile is only used as long as the file has the same
+ * size and modification time as when the tile was added.
+ * @file
+ * @author Anders Henja (Swedish Meteorological and Hydrological Institute, SMHI)
+ * @date 2026-10-16
+ */
+#ifndef BBTOPOGRAPHYCACHE_H
+#define BBTOPOGRAPHYCACHE_H
+#include "bbtopography.h"
+
+/**
+ * Default maximum size of the cache in bytes.
+ */
+#define BBTOPOGRAPHYCACHE_DEFAULT_SIZE (512L*1024L*1024L)
+
+/**
+ * Returns a copy of the tile that has been read from filename if it exists in the cache.
+ * @param[in] filename - the file the tile was read from
+ * @return a copy of the cached tile or NULL if there is no such tile in the cache
+ */
+BBTopography_t* BBTopographyCache_get(const char* filename);
+
+/**
+ * Adds a copy of the tile to the cache. If there already is a tile for filename, it will be replaced.
+ * @param[in] filename - the file the tile was read from
+ * @param[in] topo - the tile
+ * @return 1 if the tile was added otherwise 0
+ */
+int BBTopographyCache_put(const char* filename, BBTopography_t* topo);
+
+/**
+ * Sets the maximum size of the cache in bytes. A tile is counted as ncols * nrows * 2 bytes
+ * regardless if it is mapped or not, unless it is compressed in which case the compressed size
+ * is counted, see \ref BBTopography_getDataSize. If size is 0, nothing will be cached.
+ * @param[in] size - the maximum size in bytes
+ */
+void BBTopographyCache_setMaxSize(long size);
+
+/**
+ * Returns the maximum size of the cache in bytes.
+ * @return the maximum size in bytes
+ */
+long BBTopographyCache_getMaxSize(void);
+
+/**
+ * Returns the current size of the cache in bytes.
+ * @return the current size in bytes
+ */
+long BBTopographyCache_getSize(void);
+
+/**
+ * Removes all tiles from the cache.
+ */
+void BBTopographyCache_clear(void);
+
+#endif /* BBTOPOGRAPHYCACHE_H */
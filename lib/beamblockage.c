@@ -29,10 +29,23 @@ along with beamb.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "beamblockage.h"
 #include "beamblockagemap.h"
+#include "bbthreads.h"
+#include "bbfieldcache.h"
+#include "bbcachefile.h"
+#include "bbcachestore.h"
 #include "rave_debug.h"
 #include "rave_alloc.h"
 #include "math.h"
 #include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
 #include "config.h"
 #include "hlhdf.h"
 #include "odim_io_utilities.h"
@@ -46,6 +59,12 @@ struct _BeamBlockage_t {
   BeamBlockageMap_t* mapper; /**< the topography reader */
   char* cachedir;            /**< the cache directory */
   int rewritecache;         /**< if cache should be recreated */
+  int nthreads;             /**< number of threads used when calculating the blockage */
+  BeamBlockageCacheFormat cacheformat; /**< the format of the cache files */
+  long long cachemaxsize;   /**< max number of bytes in the cache directory, 0 = no limit */
+  long cachemaxage;         /**< max number of seconds since a cache file was used, 0 = no limit */
+  BeamBlockageCacheTolerance cachetolerance; /**< tolerances of the cache key, all 0 = exact key */
+  int cachephi;             /**< if the blocking elevation angles should be cached */
 };
 
 /**
@@ -54,6 +73,184 @@ struct _BeamBlockage_t {
  */
 #define RAD2DEG(rad) (rad*180.0/M_PI)
 
+/**
+ * Number of values that the blockage field can have
+ */
+#define BEAMBLOCKAGE_NLEVELS 256
+
+/**
+ * The beam properties that are needed to go from blocking elevation angle to the
+ * stored blockage value.
+ */
+typedef struct _BeamBlockageBeam {
+  double elangle; /**< elevation angle (degrees) */
+  double elLim;   /**< elevation limit of the main lobe relative the elevation angle (degrees) */
+  double c;       /**< width of the gaussian */
+  double bb_tot;  /**< total blockage within -elLim to +elLim */
+  double gain;    /**< gain of the blockage field */
+  double offset;  /**< offset of the blockage field */
+} BeamBlockageBeam;
+
+/**
+ * The data shared by the threads that calculate the blockage. Each thread processes a
+ * range of rays and uses its own part of the phi buffer.
+ */
+typedef struct _BeamBlockageRays {
+  const BeamBlockageBeam* beam; /**< the beam properties */
+  const double* limits;  /**< the value limits, see \ref BeamBlockageInternal_createLimits */
+  int uselimits;         /**< if the value limits can be used */
+  double R;              /**< effective earth radius */
+  double Rh2;            /**< squared distance from earth center to the antenna */
+  const double* gg;      /**< squared ground range of each bin */
+  const double* den;     /**< denominator of each bin */
+  BBTopography_t* topo;  /**< the topography mapped against the scan */
+  const short* topodata; /**< the topography data if it is of type short, otherwise NULL */
+  RaveField_t* field;    /**< the blockage field */
+  unsigned char* bbdata; /**< the blockage field data */
+  long nbins;            /**< number of bins */
+  double* phi;           /**< nbins scratch values per thread */
+  const double* phiin;   /**< sine of the blocking elevation angles read from the cache, if set the topography is not used */
+  double* phiout;        /**< where the sine of the blocking elevation angles should be saved, may be NULL */
+} BeamBlockageRays;
+
+/**
+ * The data shared by the threads that process the scans in a volume. Each thread processes
+ * a range of the scans in the volume that should be processed.
+ */
+typedef struct _BeamBlockageVolume {
+  BeamBlockage_t* self;       /**< self */
+  BeamBlockageMap_t* mapper;  /**< single threaded topography reader */
+  BBTopography_t* region;     /**< topography covering all scans, NULL if each scan should read its own */
+  PolarScan_t** scans;        /**< the scans to process */
+  RaveField_t** fields;       /**< the blockage fields, fields read from the cache are set before processing */
+  int* deferred;              /**< 1 if another process is computing the field, it is handled after the others */
+  RaveField_t** phi;          /**< the cached sine of the blocking elevation angles, or the calculated ones that should be cached. NULL if they aren't cached */
+  int* status;                /**< 1 if the scan was processed successfully */
+  double dBlim;               /**< Limit of Gaussian approximation of main lobe */
+  const char* quantity;       /**< the quantity to restore or NULL */
+  double threshold;           /**< the restore threshold */
+} BeamBlockageVolume;
+
+/**
+ * The data shared by the threads that precompute the blockage for a list of scans.
+ */
+typedef struct _BeamBlockagePrecompute {
+  BeamBlockage_t* self;       /**< self */
+  BeamBlockageMap_t* mapper;  /**< single threaded topography reader */
+  PolarScan_t** scans;        /**< the scans */
+  int nscans;                 /**< number of scans */
+  double dBlim;               /**< Limit of Gaussian approximation of main lobe */
+  pthread_mutex_t lock;       /**< protects ndone, nfailed and the progress function */
+  int ndone;                  /**< number of scans that have been processed */
+  int nfailed;                /**< number of scans that failed */
+  BeamBlockageProgressFunction progress; /**< the progress function, may be NULL */
+  void* data;                 /**< user data to the progress function */
+} BeamBlockagePrecompute;
+
+/**
+ * What restoring does with the bins that have a specific blockage value.
+ */
+typedef enum BeamBlockageRestoreAction {
+  BeamBlockageRestoreAction_KEEP = 0, /**< the bin is left as it is */
+  BeamBlockageRestoreAction_CORRECT,  /**< the blockage is compensated for, only data bins */
+  BeamBlockageRestoreAction_MASK,     /**< the bin is set to nodata, data and undetect bins */
+  BeamBlockageRestoreAction_INVALID   /**< the blockage value is out of bounds */
+} BeamBlockageRestoreAction;
+
+/**
+ * HDF5 is not necessarily built thread safe so all reading and writing of cache files is serialized.
+ */
+static pthread_mutex_t hdf5_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Called before hdf5_lock is taken, see \ref BeamBlockage_setHdf5LockFunctions
+ */
+static BeamBlockageHdf5LockFunction hdf5_lockfunction = NULL;
+
+/**
+ * Called after hdf5_lock has been released, see \ref BeamBlockage_setHdf5LockFunctions
+ */
+static BeamBlockageHdf5UnlockFunction hdf5_unlockfunction = NULL;
+
+/**
+ * User data to the HDF5 lock functions
+ */
+static void* hdf5_lockdata = NULL;
+
+/**
+ * Protects the counter used to create unique temporary cache filenames.
+ */
+static pthread_mutex_t tmpname_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Counter used to create unique temporary cache filenames within the process.
+ */
+static unsigned long tmpname_counter = 0;
+
+/**
+ * Returned by \ref BeamBlockageInternal_lockCacheFile when someone else holds the lock.
+ */
+#define BEAMBLOCKAGE_LOCK_BUSY -2
+
+/**
+ * Name of the store in the cache directory when using BeamBlockageCacheFormat_STORE
+ */
+#define BEAMBLOCKAGE_STORE_FILENAME "beamb_cache.bbs"
+
+/**
+ * Number of lock files that the keys in the store are spread over
+ */
+#define BEAMBLOCKAGE_STORE_LOCKS 64
+
+/**
+ * Minimum number of seconds between two automatic cache cleanings within a process
+ */
+#define BEAMBLOCKAGE_CLEAN_INTERVAL 60
+
+/**
+ * A file in the cache directory
+ */
+typedef struct _BeamBlockageCacheFile {
+  char name[256];   /**< the filename without directory */
+  off_t size;       /**< size of the file */
+  double lastused;  /**< last time the file was used, seconds since epoch */
+} BeamBlockageCacheFile;
+
+/**
+ * Protects the cache statistics
+ */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Number of blockage fields found in the cache
+ */
+static long stats_hits = 0;
+
+/**
+ * Number of blockage fields not found in the cache
+ */
+static long stats_misses = 0;
+
+/**
+ * Number of calculated blockage fields
+ */
+static long stats_computed = 0;
+
+/**
+ * Total time spent calculating blockage fields
+ */
+static double stats_computetime = 0.0;
+
+/**
+ * Number of cache files removed by the cache cleaning
+ */
+static long stats_evicted = 0;
+
+/**
+ * When the cache was last cleaned automatically
+ */
+static time_t stats_lastclean = 0;
+
 /*@{ Private functions */
 /**
  * Constructor.
@@ -64,6 +261,12 @@ static int BeamBlockage_constructor(RaveCoreObject* obj)
   self->cachedir = NULL;
   self->mapper = RAVE_OBJECT_NEW(&BeamBlockageMap_TYPE);
   self->rewritecache = 0;
+  self->nthreads = 1;
+  self->cacheformat = BeamBlockageCacheFormat_HDF5;
+  self->cachemaxsize = 0;
+  self->cachemaxage = 0;
+  memset(&self->cachetolerance, 0, sizeof(BeamBlockageCacheTolerance));
+  self->cachephi = 0;
 
   if (self->mapper == NULL || !BeamBlockage_setCacheDirectory(self, BEAMB_CACHE_DIR)) {
 	  goto error;
@@ -97,6 +300,12 @@ static int BeamBlockage_copyconstructor(RaveCoreObject* obj, RaveCoreObject* src
   this->mapper = RAVE_OBJECT_CLONE(src->mapper);
   this->cachedir = NULL;
   this->rewritecache = src->rewritecache;
+  this->nthreads = src->nthreads;
+  this->cacheformat = src->cacheformat;
+  this->cachemaxsize = src->cachemaxsize;
+  this->cachemaxage = src->cachemaxage;
+  this->cachetolerance = src->cachetolerance;
+  this->cachephi = src->cachephi;
 
   if (this->mapper == NULL || !BeamBlockage_setCacheDirectory(this, src->cachedir)) {
     goto error;
@@ -178,12 +387,364 @@ static void BeamBlockageInternal_cummax(double* p, long nlen)
   }
 }
 
+/**
+ * Calculates the value that should be stored in the blockage field for the specified blocking
+ * elevation angle.
+ * @param[in] beam - the beam properties
+ * @param[in] elBlock - the blocking elevation angle in degrees
+ * @return the value to be stored
+ */
+static double BeamBlockageInternal_blockageValue(const BeamBlockageBeam* beam, double elBlock)
+{
+  double bbval = 0.0;
+
+  if (elBlock < beam->elangle - beam->elLim) {
+    elBlock = -9999.0;
+  }
+  if (elBlock > beam->elangle + beam->elLim) {
+    elBlock = beam->elangle + beam->elLim;
+  }
+  bbval = -1.0/2.0 * sqrt(M_PI * beam->c) * (erf((beam->elangle - elBlock)/sqrt(beam->c)) - erf(beam->elLim/sqrt(beam->c)))/beam->bb_tot;
+
+  /* Discard non-physical values for blockage */
+  if (bbval < 0.0) {
+    bbval = 0.0;
+  } else if (bbval > 1.0) {
+    bbval = 1.0;
+  }
+
+  /* ODIM's rule for representing quality is that 0=lowest, 1=highest quality. Therefore invert. */
+  return ((1.0-bbval) - beam->offset) / beam->gain;
+}
+
+/**
+ * Returns the value that actually ends up in the blockage field when the sine of the blocking
+ * elevation angle is x. The value is passed through a 1x1 field of the same type as the
+ * blockage field so that the conversion is exactly the same.
+ * @param[in] beam - the beam properties
+ * @param[in] scratch - a 1x1 field
+ * @param[in] x - sine of the blocking elevation angle
+ * @return the stored value
+ */
+static double BeamBlockageInternal_storedValue(const BeamBlockageBeam* beam, RaveField_t* scratch, double x)
+{
+  double v = 0.0;
+  RaveField_setValue(scratch, 0, 0, BeamBlockageInternal_blockageValue(beam, RAD2DEG(asin(x))));
+  RaveField_getValue(scratch, 0, 0, &v);
+  return v;
+}
+
+/**
+ * Maps a double to an integer with the same ordering, so that bisection can be
+ * performed over all representable doubles.
+ * @param[in] d - the double
+ * @return the ordered integer
+ */
+static long long BeamBlockageInternal_orderedKey(double d)
+{
+  long long i = 0;
+  memcpy(&i, &d, sizeof(i));
+  return (i >= 0) ? i : -(i & 0x7fffffffffffffffLL);
+}
+
+/**
+ * Inverse of \ref BeamBlockageInternal_orderedKey.
+ * @param[in] key - the ordered integer
+ * @return the double
+ */
+static double BeamBlockageInternal_fromOrderedKey(long long key)
+{
+  double d = 0.0;
+  long long i = (key >= 0) ? key : ((-key) | (long long)0x8000000000000000ULL);
+  memcpy(&d, &i, sizeof(d));
+  return d;
+}
+
+/**
+ * The stored blockage value only depends on the sine x of the blocking elevation angle and it never
+ * increases when x increases. This calculates, for each possible stored value k, the largest x that
+ * gives a stored value of at least k. The stored value for any x is then the largest k where
+ * x <= limits[k], so that no asin or erf has to be evaluated for each bin. The limits are found by
+ * bisecting over all doubles in [-1, 1] with the same calculation as is used per bin, so the result
+ * is identical to evaluating each bin as long as erf is monotone.
+ * @param[in] beam - the beam properties
+ * @param[out] limits - BEAMBLOCKAGE_NLEVELS limits, limits[0] is not used
+ * @return 1 on success, 0 if the limits could not be determined
+ */
+static int BeamBlockageInternal_createLimits(const BeamBlockageBeam* beam, double* limits)
+{
+  RaveField_t* scratch = NULL;
+  long long lo = 0, hi = 0, mid = 0;
+  double vlo = 0.0, vhi = 0.0;
+  int k = 0, result = 0;
+
+  if (!isfinite(beam->elLim) || !isfinite(beam->c) || !(beam->c > 0.0) || !(beam->bb_tot > 0.0)) {
+    return 0;
+  }
+
+  scratch = RAVE_OBJECT_NEW(&RaveField_TYPE);
+  if (scratch == NULL || !RaveField_createData(scratch, 1, 1, RaveDataType_UCHAR)) {
+    goto done;
+  }
+
+  vlo = BeamBlockageInternal_storedValue(beam, scratch, -1.0);
+  vhi = BeamBlockageInternal_storedValue(beam, scratch, 1.0);
+  if (vlo < vhi) {
+    goto done;
+  }
+
+  limits[0] = 2.0;
+  for (k = 1; k < BEAMBLOCKAGE_NLEVELS; k++) {
+    if (vhi >= k) {
+      limits[k] = 1.0;       /* Always at least k */
+    } else if (vlo < k) {
+      limits[k] = -2.0;      /* Never k */
+    } else {
+      lo = BeamBlockageInternal_orderedKey(-1.0);
+      hi = BeamBlockageInternal_orderedKey(1.0);
+      while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (BeamBlockageInternal_storedValue(beam, scratch, BeamBlockageInternal_fromOrderedKey(mid)) >= k) {
+          lo = mid;
+        } else {
+          hi = mid;
+        }
+      }
+      limits[k] = BeamBlockageInternal_fromOrderedKey(lo);
+    }
+  }
+
+  result = 1;
+done:
+  RAVE_OBJECT_RELEASE(scratch);
+  return result;
+}
+
+/**
+ * Calculates the blockage for the rays [start, end).
+ * @param[in] arg - the \ref BeamBlockageRays
+ * @param[in] thread - the thread index
+ * @param[in] start - first ray
+ * @param[in] end - one past the last ray
+ */
+static void BeamBlockageInternal_raysWorker(void* arg, int thread, long start, long end)
+{
+  BeamBlockageRays* rays = (BeamBlockageRays*)arg;
+  long nbins = rays->nbins;
+  double* phi = rays->phi + thread * nbins;
+  double R = rays->R, Rh2 = rays->Rh2;
+  long ri = 0, bi = 0;
+
+  for (ri = start; ri < end; ri++) {
+    int inside = 1;
+
+    /* Sine of the blocking elevation angle */
+    if (rays->phiin != NULL) {
+      memcpy(phi, rays->phiin + ri * nbins, sizeof(double) * nbins);
+    } else if (rays->topodata != NULL) {
+      const short* trow = rays->topodata + ri * nbins;
+      for (bi = 0; bi < nbins; bi++) {
+        double v = (double)trow[bi];
+        phi[bi] = (((v+R)*(v+R)) - rays->gg[bi] - Rh2) / rays->den[bi];
+      }
+    } else {
+      for (bi = 0; bi < nbins; bi++) {
+        double v = 0.0;
+        BBTopography_getValue(rays->topo, bi, ri, &v);
+        phi[bi] = (((v+R)*(v+R)) - rays->gg[bi] - Rh2) / rays->den[bi];
+      }
+    }
+    if (rays->phiout != NULL) {
+      memcpy(rays->phiout + ri * nbins, phi, sizeof(double) * nbins);
+    }
+    for (bi = 0; bi < nbins; bi++) {
+      inside &= (phi[bi] >= -1.0 && phi[bi] <= 1.0);
+    }
+
+    if (rays->uselimits && inside && rays->bbdata != NULL) {
+      /* asin is increasing so the cumulative max can be taken on the sine directly */
+      unsigned char* brow = rays->bbdata + ri * nbins;
+      int k = BEAMBLOCKAGE_NLEVELS - 1;
+      BeamBlockageInternal_cummax(phi, nbins);
+      for (bi = 0; bi < nbins; bi++) {
+        while (k > 0 && phi[bi] > rays->limits[k]) {
+          k--;
+        }
+        brow[bi] = (unsigned char)k;
+      }
+    } else {
+      for (bi = 0; bi < nbins; bi++) {
+        phi[bi] = RAD2DEG(asin(phi[bi]));
+      }
+      BeamBlockageInternal_cummax(phi, nbins);
+      for (bi = 0; bi < nbins; bi++) {
+        RaveField_setValue(rays->field, bi, ri, BeamBlockageInternal_blockageValue(rays->beam, phi[bi]));
+      }
+    }
+  }
+}
+
+/**
+ * Creates the key that identifies a binary cache file. Same values as in the cache filename
+ * but with full precision. The key also contains the topography and how it is mapped against
+ * the scan. Only the mapping settings that take effect are kept, see \ref BeamBlockageMap_setHorizon,
+ * so settings that give the same topography share cache entries.
+ * @param[in] self - self
+ * @param[in] scan - the scan
+ * @param[in] dblim - Limit of Gaussian approximation of main lobe
+ * @param[out] key - the key
+ */
+static void BeamBlockageInternal_createCacheKey(BeamBlockage_t* self, PolarScan_t* scan, double dblim, BBCacheFileKey* key)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((scan != NULL), "scan == NULL");
+  RAVE_ASSERT((key != NULL), "key == NULL");
+  memset(key, 0, sizeof(BBCacheFileKey));
+  key->lon = PolarScan_getLongitude(scan) * 180.0 / M_PI;
+  key->lat = PolarScan_getLatitude(scan) * 180.0 / M_PI;
+  key->height = PolarScan_getHeight(scan);
+  key->elangle = PolarScan_getElangle(scan) * 180.0 / M_PI;
+  key->nrays = PolarScan_getNrays(scan);
+  key->nbins = PolarScan_getNbins(scan);
+  key->rscale = PolarScan_getRscale(scan);
+  key->rstart = PolarScan_getRstart(scan);
+  key->beamwidth = PolarScan_getBeamwidth(scan) * 180.0 / M_PI;
+  key->dblim = dblim;
+  key->topography = (uint32_t)BeamBlockageMap_getTopographyId(self->mapper);
+  key->horizon = BeamBlockageMap_getHorizon(self->mapper) ? 1 : 0;
+  if (!key->horizon) {
+    key->sampling = BeamBlockageMap_getSampling(self->mapper);
+    if (key->sampling == BeamBlockageMapSampling_NEAREST) {
+      key->levels = BeamBlockageMap_getLevels(self->mapper);
+    }
+  }
+}
+
+/**
+ * Creates the part of the cache filename that tells how the topography was mapped against the
+ * scan and which topography was used, formatted as mapping_topography where mapping is h for the
+ * horizon profile, mean or max for footprint sampling, lN for N overview levels and n for the
+ * nearest cell, and topography is the identity of the topography as 8 hexadecimal digits.
+ * @param[in] key - the key
+ * @param[in] name - the allocated array where the name should be written
+ * @param[in] len - the length of the allocated array
+ */
+static void BeamBlockageInternal_createMappingName(const BBCacheFileKey* key, char* name, int len)
+{
+  char mapping[16];
+  if (key->horizon) {
+    strcpy(mapping, "h");
+  } else if (key->sampling == BeamBlockageMapSampling_MEAN) {
+    strcpy(mapping, "mean");
+  } else if (key->sampling == BeamBlockageMapSampling_MAX) {
+    strcpy(mapping, "max");
+  } else if (key->levels > 0) {
+    snprintf(mapping, sizeof(mapping), "l%d", (int)key->levels);
+  } else {
+    strcpy(mapping, "n");
+  }
+  snprintf(name, len, "%s_%08lx", mapping, (unsigned long)key->topography);
+}
+
+/**
+ * Returns if the cache key is quantized, i.e. if any tolerance has been set.
+ * @param[in] self - self
+ * @return 1 if the key is quantized otherwise 0
+ */
+static int BeamBlockageInternal_isQuantizedKey(BeamBlockage_t* self)
+{
+  return (self->cachetolerance.position > 0.0 || self->cachetolerance.height > 0.0 ||
+          self->cachetolerance.angle > 0.0 || self->cachetolerance.range > 0.0);
+}
+
+/**
+ * Creates the allowed differences between the geometry of a scan and the geometry of the
+ * scan a cached field was calculated for, expressed in the units of the key.
+ * @param[in] self - self
+ * @param[out] tolerance - the tolerance of each value in the key
+ */
+static void BeamBlockageInternal_createToleranceKey(BeamBlockage_t* self, BBCacheFileKey* tolerance)
+{
+  memset(tolerance, 0, sizeof(BBCacheFileKey));
+  tolerance->lon = self->cachetolerance.position;
+  tolerance->lat = self->cachetolerance.position;
+  tolerance->height = self->cachetolerance.height;
+  tolerance->elangle = self->cachetolerance.angle;
+  tolerance->beamwidth = self->cachetolerance.angle;
+  tolerance->rscale = self->cachetolerance.range;
+  tolerance->rstart = self->cachetolerance.range / 1000.0; /* rstart is in km */
+}
+
+/**
+ * Rounds a value to the nearest multiple of the tolerance.
+ * @param[in] value - the value
+ * @param[in] tolerance - the tolerance, if 0 the value is returned as is
+ * @return the quantized value
+ */
+static double BeamBlockageInternal_quantize(double value, double tolerance)
+{
+  if (tolerance <= 0.0) {
+    return value;
+  }
+  return floor(value / tolerance + 0.5) * tolerance;
+}
+
+/**
+ * Creates the key that is used to look up a field in the cache. When tolerances are set
+ * the geometry is quantized so that scans with nearly the same geometry share the field.
+ * @param[in] self - self
+ * @param[in] scan - the scan
+ * @param[in] dblim - Limit of Gaussian approximation of main lobe
+ * @param[out] key - the key
+ */
+static void BeamBlockageInternal_createLookupKey(BeamBlockage_t* self, PolarScan_t* scan, double dblim, BBCacheFileKey* key)
+{
+  BBCacheFileKey tolerance;
+
+  BeamBlockageInternal_createCacheKey(self, scan, dblim, key);
+  if (BeamBlockageInternal_isQuantizedKey(self)) {
+    BeamBlockageInternal_createToleranceKey(self, &tolerance);
+    key->lon = BeamBlockageInternal_quantize(key->lon, tolerance.lon);
+    key->lat = BeamBlockageInternal_quantize(key->lat, tolerance.lat);
+    key->height = BeamBlockageInternal_quantize(key->height, tolerance.height);
+    key->elangle = BeamBlockageInternal_quantize(key->elangle, tolerance.elangle);
+    key->rscale = BeamBlockageInternal_quantize(key->rscale, tolerance.rscale);
+    key->rstart = BeamBlockageInternal_quantize(key->rstart, tolerance.rstart);
+    key->beamwidth = BeamBlockageInternal_quantize(key->beamwidth, tolerance.beamwidth);
+  }
+}
+
+/**
+ * Returns the number of decimals needed to represent multiples of the tolerance in a filename.
+ * @param[in] tolerance - the tolerance
+ * @param[in] decimals - the number of decimals to use if tolerance is 0
+ * @return the number of decimals (at most 6)
+ */
+static int BeamBlockageInternal_getDecimals(double tolerance, int decimals)
+{
+  double scaled = tolerance;
+  if (tolerance <= 0.0) {
+    return decimals;
+  }
+  for (decimals = 0; decimals < 6; decimals++) {
+    if (fabs(scaled - floor(scaled + 0.5)) < 1e-6) {
+      break;
+    }
+    scaled *= 10.0;
+  }
+  return decimals;
+}
+
 /**
  * Creates a full filename from the information in the scan file and the cache dir name. If
  * cachedir is NULL, only the filename will be set.
  * We format the filename like this.
- *   lon_lat_height_elangle_nrays_nbins_rscale_rstart_beamwidth
- *   All floating point values except height are represented with 2 decimals
+ *   lon_lat_height_elangle_nrays_nbins_rscale_rstart_beamwidth_dblim_mapping_topography
+ *   All floating point values except height are represented with 2 decimals, mapping and
+ *   topography are described in \ref BeamBlockageInternal_createMappingName.
+ *   The suffix is .h5 for HDF5 files and .bbc for binary files.
+ * When the key is quantized the name is prefixed with q and the quantized values are
+ * represented with as many decimals as the tolerances need.
  *
  * @param[in] self - self
  * @param[in] scan - scan
@@ -198,10 +759,24 @@ static int BeamBlockageInternal_createCacheFilename(BeamBlockage_t* self, PolarS
   double lat, lon, height, bw, elangle, rscale, rstart;
   long nrays, nbins;
   int elen = 0;
+  const char* suffix = NULL;
+  char mapping[64];
+  BBCacheFileKey key;
 
   RAVE_ASSERT((self != NULL), "self == NULL");
   RAVE_ASSERT((scan != NULL), "scan == NULL");
 
+  BeamBlockageInternal_createLookupKey(self, scan, dblim, &key);
+  BeamBlockageInternal_createMappingName(&key, mapping, sizeof(mapping));
+
+  if (self->cacheformat == BeamBlockageCacheFormat_BINARY) {
+    suffix = "bbc";
+  } else if (self->cacheformat == BeamBlockageCacheFormat_STORE) {
+    suffix = "bbs";
+  } else {
+    suffix = "h5";
+  }
+
   lat = PolarScan_getLatitude(scan) * 180.0 / M_PI;
   lon = PolarScan_getLongitude(scan) * 180.0 / M_PI;
   height = PolarScan_getHeight(scan);
@@ -212,14 +787,29 @@ static int BeamBlockageInternal_createCacheFilename(BeamBlockage_t* self, PolarS
   rscale = PolarScan_getRscale(scan);
   rstart = PolarScan_getRstart(scan);
 
-  if (self->cachedir == NULL) {
+  if (BeamBlockageInternal_isQuantizedKey(self)) {
+    BBCacheFileKey tolerance;
+    BeamBlockageInternal_createToleranceKey(self, &tolerance);
+    elen = snprintf(filename, len,
+                    "%s%sq%.*f_%.*f_%.*f_%.*f_%ld_%ld_%.*f_%.*f_%.*f_%.2f_%s.%s",
+                    (self->cachedir != NULL) ? self->cachedir : "", (self->cachedir != NULL) ? "/" : "",
+                    BeamBlockageInternal_getDecimals(tolerance.lon, 2), key.lon,
+                    BeamBlockageInternal_getDecimals(tolerance.lat, 2), key.lat,
+                    BeamBlockageInternal_getDecimals(tolerance.height, 0), key.height,
+                    BeamBlockageInternal_getDecimals(tolerance.elangle, 2), key.elangle,
+                    nrays, nbins,
+                    BeamBlockageInternal_getDecimals(tolerance.rscale, 2), key.rscale,
+                    BeamBlockageInternal_getDecimals(tolerance.rstart, 2), key.rstart,
+                    BeamBlockageInternal_getDecimals(tolerance.beamwidth, 2), key.beamwidth,
+                    dblim, mapping, suffix);
+  } else if (self->cachedir == NULL) {
     elen = snprintf(filename, len,
-                    "%.2f_%.2f_%.0f_%.2f_%ld_%ld_%.2f_%.2f_%.2f_%.2f.h5",
-                    lon, lat, height, elangle, nrays, nbins, rscale, rstart, bw, dblim);
+                    "%.2f_%.2f_%.0f_%.2f_%ld_%ld_%.2f_%.2f_%.2f_%.2f_%s.%s",
+                    lon, lat, height, elangle, nrays, nbins, rscale, rstart, bw, dblim, mapping, suffix);
   } else {
     elen = snprintf(filename, len,
-                    "%s/%.2f_%.2f_%.0f_%.2f_%ld_%ld_%.2f_%.2f_%.2f_%.2f.h5",
-                    self->cachedir, lon, lat, height, elangle, nrays, nbins, rscale, rstart, bw, dblim);
+                    "%s/%.2f_%.2f_%.0f_%.2f_%ld_%ld_%.2f_%.2f_%.2f_%.2f_%s.%s",
+                    self->cachedir, lon, lat, height, elangle, nrays, nbins, rscale, rstart, bw, dblim, mapping, suffix);
   }
 
   if (elen >= len) {
@@ -232,50 +822,394 @@ done:
   return result;
 }
 
-static int BeamBlockageInternal_addMetaInformation(RaveField_t* field, double gain, double offset, double dbLimit)
+/**
+ * Creates the name of the store in the cache directory.
+ * @param[in] self - self, cachedir must not be NULL
+ * @param[in] filename - the allocated array where the filename should be written
+ * @param[in] len - the length of the allocated array
+ * @return 1 on success otherwise 0
+ */
+static int BeamBlockageInternal_createStoreFilename(BeamBlockage_t* self, char* filename, int len)
 {
-  RaveAttribute_t* attribute = NULL;
-  int result = 0;
-
-  attribute = RaveAttributeHelp_createString("how/task", "se.smhi.detector.beamblockage");
-  if (attribute == NULL || !RaveField_addAttribute(field, attribute)) {
-    RAVE_ERROR0("Failed to add how/task");
-    goto done;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((self->cachedir != NULL), "cachedir == NULL");
+  if (snprintf(filename, len, "%s/%s", self->cachedir, BEAMBLOCKAGE_STORE_FILENAME) >= len) {
+    RAVE_ERROR0("Not enough room was created for filename");
+    return 0;
   }
-  RAVE_OBJECT_RELEASE(attribute);
+  return 1;
+}
 
-  attribute = RaveAttributeHelp_createDouble("what/gain", gain);
-  if (attribute == NULL || !RaveField_addAttribute(field, attribute)) {
-    RAVE_ERROR0("Failed to add what/gain");
-    goto done;
-  }
-  RAVE_OBJECT_RELEASE(attribute);
+/**
+ * Returns if the cache file for the scan exists.
+ * @param[in] self - self
+ * @param[in] scan - the scan
+ * @param[in] dblim - Limit of Gaussian approximation of main lobe
+ * @return 1 if the cache file exists otherwise 0
+ */
+static int BeamBlockageInternal_hasCachedFile(BeamBlockage_t* self, PolarScan_t* scan, double dblim)
+{
+  char filename[512];
+  struct stat st;
 
-  attribute = RaveAttributeHelp_createDouble("what/offset", offset);
-  if (attribute == NULL || !RaveField_addAttribute(field, attribute)) {
-    RAVE_ERROR0("Failed to add what/offset");
-    goto done;
+  if (self->cachedir == NULL) {
+    return 0;
   }
-  RAVE_OBJECT_RELEASE(attribute);
-
-  attribute = RaveAttributeHelp_createStringFmt("how/task_args", "DBLIMIT:%g", dbLimit);
-  if (attribute == NULL || !RaveField_addAttribute(field, attribute)) {
-    RAVE_ERROR0("Failed to add how/task_args");
-    goto done;
+  if (self->cacheformat == BeamBlockageCacheFormat_STORE) {
+    BBCacheFileKey key;
+    BeamBlockageInternal_createLookupKey(self, scan, dblim, &key);
+    return BeamBlockageInternal_createStoreFilename(self, filename, 512) && BBCacheStore_contains(filename, &key);
   }
-  RAVE_OBJECT_RELEASE(attribute);
-
-  result = 1;
-done:
-  RAVE_OBJECT_RELEASE(attribute);
-  return result;
+  if (!BeamBlockageInternal_createCacheFilename(self, scan, dblim, filename, 512)) {
+    return 0;
+  }
+  return (stat(filename, &st) == 0);
 }
 
-static int BeamBlockageInternal_getMetaInformation(RaveField_t* field, double* gain, double* offset)
+/**
+ * Takes an exclusive flock on the lock file, the file is created if it doesn't exist.
+ * @param[in] lockname - the lock file
+ * @param[in] wait - if 1 the call blocks until the lock is available
+ * @return the file descriptor holding the lock, BEAMBLOCKAGE_LOCK_BUSY if wait is 0 and someone else
+ * holds the lock or -1 if no lock could be taken
+ */
+static int BeamBlockageInternal_lockFile(const char* lockname, int wait)
 {
-  int result = 0;
-  RaveAttribute_t* attribute = NULL;
-  char* svalue = NULL;
+  int fd = open(lockname, O_RDWR | O_CREAT, 0666);
+  if (fd < 0) {
+    RAVE_WARNING1("Could not open lock file %s, cache file is not protected", lockname);
+    return -1;
+  }
+  while (flock(fd, wait ? LOCK_EX : (LOCK_EX | LOCK_NB)) != 0) {
+    int err = errno;
+    if (err == EINTR) {
+      continue;
+    }
+    close(fd);
+    if (err == EWOULDBLOCK) {
+      return BEAMBLOCKAGE_LOCK_BUSY;
+    }
+    RAVE_WARNING1("Could not lock %s, cache file is not protected", lockname);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Takes the advisory lock that protects the cache file of the scan. The lock is a flock on
+ * <cachefile>.lock, so it works both between processes sharing the cache directory and between
+ * threads within a process. The lock files are left in the cache directory since removing them
+ * would open for two processes holding the lock at the same time. The only exception is the cache
+ * cleaning, where that at worst means that an evicted field is calculated twice.
+ * @param[in] self - self
+ * @param[in] scan - the scan
+ * @param[in] dblim - Limit of Gaussian approximation of main lobe
+ * @param[in] wait - if 1 the call blocks until the lock is available
+ * @return the file descriptor holding the lock, BEAMBLOCKAGE_LOCK_BUSY if wait is 0 and someone else
+ * holds the lock or -1 if no lock could be taken (no cache directory, not writable, ...)
+ */
+static int BeamBlockageInternal_lockCacheFile(BeamBlockage_t* self, PolarScan_t* scan, double dblim, int wait)
+{
+  char filename[512], lockname[520];
+
+  if (self->cachedir == NULL || !BeamBlockageInternal_createCacheFilename(self, scan, dblim, filename, 512)) {
+    return -1;
+  }
+  if (self->cacheformat == BeamBlockageCacheFormat_STORE) {
+    /* The keys are spread over a fixed number of lock files so the cache directory doesn't grow */
+    unsigned long hash = 5381;
+    const char* p = NULL;
+    for (p = filename; *p != '\0'; p++) {
+      hash = hash * 33 + (unsigned char)*p;
+    }
+    if (!BeamBlockageInternal_createStoreFilename(self, filename, 512)) {
+      return -1;
+    }
+    snprintf(lockname, sizeof(lockname), "%s.lock.%02lu", filename, hash % BEAMBLOCKAGE_STORE_LOCKS);
+  } else {
+    snprintf(lockname, sizeof(lockname), "%s.lock", filename);
+  }
+
+  return BeamBlockageInternal_lockFile(lockname, wait);
+}
+
+/**
+ * Releases a lock taken with \ref BeamBlockageInternal_lockCacheFile.
+ * @param[in] fd - the lock, negative values are ignored
+ */
+static void BeamBlockageInternal_unlockCacheFile(int fd)
+{
+  if (fd >= 0) {
+    flock(fd, LOCK_UN);
+    close(fd);
+  }
+}
+
+/**
+ * Creates a unique name for the temporary file that a cache file is written to before it
+ * is renamed to its final name.
+ * @param[in] filename - the cache filename
+ * @param[in] tmpname - the allocated array where the name should be written
+ * @param[in] len - the length of the allocated array
+ * @return 1 on success otherwise 0
+ */
+static int BeamBlockageInternal_createTemporaryFilename(const char* filename, char* tmpname, int len)
+{
+  unsigned long counter = 0;
+
+  pthread_mutex_lock(&tmpname_lock);
+  counter = tmpname_counter++;
+  pthread_mutex_unlock(&tmpname_lock);
+
+  if (snprintf(tmpname, len, "%s.%ld.%lu.tmp", filename, (long)getpid(), counter) >= len) {
+    RAVE_ERROR0("Not enough room was created for temporary filename");
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Returns if the name is the name of a cache file, i.e. lon_lat_height_elangle_nrays_nbins_rscale_rstart_beamwidth_dblim_mapping_topography
+ * optionally prefixed with q and followed by .h5 or .bbc. Names without mapping and topography, as
+ * written by earlier versions, are also accepted so that those files are counted and evicted even
+ * though they are never read anymore.
+ * @param[in] name - the filename without directory
+ * @return 1 if it is a cache file otherwise 0
+ */
+static int BeamBlockageInternal_isCacheFilename(const char* name)
+{
+  const char* p = NULL;
+  size_t len = strlen(name);
+  int nseparators = 0;
+
+  if (!((len > 3 && strcmp(name + len - 3, ".h5") == 0) || (len > 4 && strcmp(name + len - 4, ".bbc") == 0))) {
+    return 0;
+  }
+  if (strncmp(name, "phi_", 4) == 0) {
+    name += 4; /* blocking elevation angles, no beamwidth and dblim */
+    nseparators = 2;
+  } else if (*name == 'q') {
+    name++; /* quantized key */
+  }
+  for (p = name; *p != '\0'; p++) {
+    if (*p == '_') {
+      nseparators++;
+    } else if (!(*p == '.' || *p == '-' || (*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'z')) && p < strrchr(name, '.')) {
+      return 0;
+    }
+  }
+  return (nseparators == 11 || nseparators == 9);
+}
+
+/**
+ * Converts a file time to seconds since epoch.
+ */
+static double BeamBlockageInternal_toSeconds(const struct timespec* ts)
+{
+  return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+/**
+ * Lists the cache files in the cache directory.
+ * @param[in] self - self, cachedir must not be NULL
+ * @param[out] nfiles - number of files
+ * @return the files (must be released with RAVE_FREE) or NULL if there are no files or on failure
+ */
+static BeamBlockageCacheFile* BeamBlockageInternal_listCacheFiles(BeamBlockage_t* self, long* nfiles)
+{
+  BeamBlockageCacheFile* files = NULL;
+  long capacity = 0;
+  DIR* dir = NULL;
+  struct dirent* dent = NULL;
+
+  *nfiles = 0;
+  dir = opendir(self->cachedir);
+  if (dir == NULL) {
+    return NULL;
+  }
+  while ((dent = readdir(dir)) != NULL) {
+    char filename[520];
+    struct stat st;
+    if (strlen(dent->d_name) >= sizeof(files->name) || !BeamBlockageInternal_isCacheFilename(dent->d_name) ||
+        snprintf(filename, 512, "%s/%s", self->cachedir, dent->d_name) >= 512 ||
+        stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    if (*nfiles == capacity) {
+      BeamBlockageCacheFile* tmp = NULL;
+      capacity = (capacity == 0) ? 64 : capacity * 2;
+      tmp = RAVE_REALLOC(files, sizeof(BeamBlockageCacheFile) * capacity);
+      if (tmp == NULL) {
+        RAVE_ERROR0("Failed to allocate memory for cache file list");
+        break;
+      }
+      files = tmp;
+    }
+    strcpy(files[*nfiles].name, dent->d_name);
+    files[*nfiles].size = st.st_size;
+    files[*nfiles].lastused = BeamBlockageInternal_toSeconds(&st.st_mtim);
+    if (BeamBlockageInternal_toSeconds(&st.st_atim) > files[*nfiles].lastused) {
+      files[*nfiles].lastused = BeamBlockageInternal_toSeconds(&st.st_atim);
+    }
+    strcat(filename, ".lock");
+    if (stat(filename, &st) == 0 && BeamBlockageInternal_toSeconds(&st.st_mtim) > files[*nfiles].lastused) {
+      files[*nfiles].lastused = BeamBlockageInternal_toSeconds(&st.st_mtim); /* See BeamBlockageInternal_touchCacheFile */
+    }
+    (*nfiles)++;
+  }
+  closedir(dir);
+  return files;
+}
+
+/**
+ * Orders cache files with the least recently used first.
+ */
+static int BeamBlockageInternal_compareLastUsed(const void* a, const void* b)
+{
+  double ta = ((const BeamBlockageCacheFile*)a)->lastused, tb = ((const BeamBlockageCacheFile*)b)->lastused;
+  return (ta < tb) ? -1 : ((ta > tb) ? 1 : 0);
+}
+
+/**
+ * Marks a cache file as used. File systems are often mounted without access time updates and
+ * the cache file itself should not be modified when read, so the time is recorded as the
+ * modification time of the lock file belonging to the cache file. Nothing is done if there is
+ * no lock file.
+ * @param[in] filename - the cache file
+ */
+static void BeamBlockageInternal_touchCacheFile(const char* filename)
+{
+  char lockname[520];
+  if (snprintf(lockname, sizeof(lockname), "%s.lock", filename) < (int)sizeof(lockname)) {
+    utimensat(AT_FDCWD, lockname, NULL, 0);
+  }
+}
+
+/**
+ * Removes the least recently used cache files until the cache directory is within the size budget
+ * and the files that haven't been used within the max age. Files that are locked, i.e. are being
+ * calculated, are left. The store is not affected since its records have no access times.
+ * @param[in] self - self
+ * @return the number of removed files
+ */
+static long BeamBlockageInternal_cleanCache(BeamBlockage_t* self)
+{
+  BeamBlockageCacheFile* files = NULL;
+  long nfiles = 0, i = 0, nevicted = 0;
+  long long total = 0;
+  time_t now = time(NULL);
+
+  if (self->cachedir == NULL || self->cacheformat == BeamBlockageCacheFormat_STORE ||
+      (self->cachemaxsize <= 0 && self->cachemaxage <= 0)) {
+    return 0;
+  }
+
+  files = BeamBlockageInternal_listCacheFiles(self, &nfiles);
+  for (i = 0; i < nfiles; i++) {
+    total += files[i].size;
+  }
+  if (nfiles > 0) {
+    qsort(files, nfiles, sizeof(BeamBlockageCacheFile), BeamBlockageInternal_compareLastUsed);
+  }
+
+  for (i = 0; i < nfiles; i++) {
+    char filename[512], lockname[520];
+    int lock = -1;
+    if (!((self->cachemaxage > 0 && now - files[i].lastused > self->cachemaxage) ||
+          (self->cachemaxsize > 0 && total > self->cachemaxsize))) {
+      continue;
+    }
+    snprintf(filename, sizeof(filename), "%s/%s", self->cachedir, files[i].name);
+    snprintf(lockname, sizeof(lockname), "%s.lock", filename);
+    lock = BeamBlockageInternal_lockFile(lockname, 0);
+    if (lock == BEAMBLOCKAGE_LOCK_BUSY) {
+      continue;
+    }
+    if (unlink(filename) == 0) {
+      total -= files[i].size;
+      nevicted++;
+    }
+    if (lock >= 0) {
+      /* Someone waiting for the old lock file may compute the field again, which is harmless */
+      unlink(lockname);
+    }
+    BeamBlockageInternal_unlockCacheFile(lock);
+  }
+  RAVE_FREE(files);
+
+  pthread_mutex_lock(&stats_lock);
+  stats_evicted += nevicted;
+  pthread_mutex_unlock(&stats_lock);
+  return nevicted;
+}
+
+/**
+ * Cleans the cache if a budget is set and the cache hasn't been cleaned recently by this process.
+ * @param[in] self - self
+ */
+static void BeamBlockageInternal_autoCleanCache(BeamBlockage_t* self)
+{
+  time_t now = time(NULL);
+  int clean = 0;
+
+  if (self->cachemaxsize <= 0 && self->cachemaxage <= 0) {
+    return;
+  }
+  pthread_mutex_lock(&stats_lock);
+  if (now - stats_lastclean >= BEAMBLOCKAGE_CLEAN_INTERVAL) {
+    stats_lastclean = now;
+    clean = 1;
+  }
+  pthread_mutex_unlock(&stats_lock);
+  if (clean) {
+    BeamBlockageInternal_cleanCache(self);
+  }
+}
+
+static int BeamBlockageInternal_addMetaInformation(RaveField_t* field, double gain, double offset, double dbLimit)
+{
+  RaveAttribute_t* attribute = NULL;
+  int result = 0;
+
+  attribute = RaveAttributeHelp_createString("how/task", "se.smhi.detector.beamblockage");
+  if (attribute == NULL || !RaveField_addAttribute(field, attribute)) {
+    RAVE_ERROR0("Failed to add how/task");
+    goto done;
+  }
+  RAVE_OBJECT_RELEASE(attribute);
+
+  attribute = RaveAttributeHelp_createDouble("what/gain", gain);
+  if (attribute == NULL || !RaveField_addAttribute(field, attribute)) {
+    RAVE_ERROR0("Failed to add what/gain");
+    goto done;
+  }
+  RAVE_OBJECT_RELEASE(attribute);
+
+  attribute = RaveAttributeHelp_createDouble("what/offset", offset);
+  if (attribute == NULL || !RaveField_addAttribute(field, attribute)) {
+    RAVE_ERROR0("Failed to add what/offset");
+    goto done;
+  }
+  RAVE_OBJECT_RELEASE(attribute);
+
+  attribute = RaveAttributeHelp_createStringFmt("how/task_args", "DBLIMIT:%g", dbLimit);
+  if (attribute == NULL || !RaveField_addAttribute(field, attribute)) {
+    RAVE_ERROR0("Failed to add how/task_args");
+    goto done;
+  }
+  RAVE_OBJECT_RELEASE(attribute);
+
+  result = 1;
+done:
+  RAVE_OBJECT_RELEASE(attribute);
+  return result;
+}
+
+static int BeamBlockageInternal_getMetaInformation(RaveField_t* field, double* gain, double* offset)
+{
+  int result = 0;
+  RaveAttribute_t* attribute = NULL;
+  char* svalue = NULL;
 
   RAVE_ASSERT((field != NULL), "field == NULL");
   RAVE_ASSERT((gain != NULL), "gain == NULL");
@@ -316,297 +1250,1193 @@ done:
 }
 
 /**
- * Returns a cached file matching the given scan if there is one.
+ * Adds the exact geometry that the field was calculated for as how/beamb_geometry. Only used
+ * when the cache key is quantized.
+ * @param[in] field - the field
+ * @param[in] key - the exact geometry, see \ref BeamBlockageInternal_createCacheKey
+ * @return 1 on success otherwise 0
+ */
+static int BeamBlockageInternal_addGeometryInformation(RaveField_t* field, const BBCacheFileKey* key)
+{
+  int result = 0;
+  RaveAttribute_t* attribute = NULL;
+
+  attribute = RaveAttributeHelp_createStringFmt("how/beamb_geometry", "%.17g %.17g %.17g %.17g %lld %lld %.17g %.17g %.17g %.17g %lu %d %d %d",
+                                                key->lon, key->lat, key->height, key->elangle, (long long)key->nrays, (long long)key->nbins,
+                                                key->rscale, key->rstart, key->beamwidth, key->dblim, (unsigned long)key->topography,
+                                                (int)key->horizon, (int)key->sampling, (int)key->levels);
+  if (attribute == NULL || !RaveField_addAttribute(field, attribute)) {
+    RAVE_ERROR0("Failed to add how/beamb_geometry");
+    goto done;
+  }
+
+  result = 1;
+done:
+  RAVE_OBJECT_RELEASE(attribute);
+  return result;
+}
+
+/**
+ * Returns if the field has been calculated for a geometry within the tolerances of the scan's
+ * geometry. Always true when the cache key isn't quantized.
  * @param[in] self - self
  * @param[in] scan - the scan
  * @param[in] dblim - Limit of Gaussian approximation of main lobe
+ * @param[in] field - the cached field
+ * @return 1 if the field can be used for the scan otherwise 0
  */
-static RaveField_t* BeamBlockageInternal_getCachedFile(BeamBlockage_t* self, PolarScan_t* scan, double dblim)
+static int BeamBlockageInternal_matchesGeometry(BeamBlockage_t* self, PolarScan_t* scan, double dblim, RaveField_t* field)
 {
-  RaveField_t* result = NULL;
-  LazyNodeListReader_t* nodelist = NULL;
+  int result = 0;
+  RaveAttribute_t* attribute = NULL;
+  char* svalue = NULL;
+  BBCacheFileKey key, stored, tolerance;
+  long long nrays = 0, nbins = 0;
+  unsigned long topography = 0;
+  int horizon = 0, sampling = 0, levels = 0;
 
-  RAVE_ASSERT((self != NULL), "self == NULL");
-  RAVE_ASSERT((scan != NULL), "scan == NULL");
+  if (!BeamBlockageInternal_isQuantizedKey(self)) {
+    return 1;
+  }
 
-  if (self->cachedir != NULL) {
-    char filename[512];
-    if (!BeamBlockageInternal_createCacheFilename(self, scan, dblim, filename, 512)) {
-      goto done;
-    }
+  attribute = RaveField_getAttribute(field, "how/beamb_geometry");
+  if (attribute == NULL || !RaveAttribute_getString(attribute, &svalue) || svalue == NULL) {
+    goto done;
+  }
+  memset(&stored, 0, sizeof(BBCacheFileKey));
+  if (sscanf(svalue, "%lf %lf %lf %lf %lld %lld %lf %lf %lf %lf %lu %d %d %d", &stored.lon, &stored.lat, &stored.height, &stored.elangle,
+             &nrays, &nbins, &stored.rscale, &stored.rstart, &stored.beamwidth, &stored.dblim,
+             &topography, &horizon, &sampling, &levels) != 14) {
+    goto done;
+  }
+  stored.nrays = nrays;
+  stored.nbins = nbins;
+  stored.topography = (uint32_t)topography;
+  stored.horizon = horizon;
+  stored.sampling = sampling;
+  stored.levels = levels;
+
+  BeamBlockageInternal_createCacheKey(self, scan, dblim, &key);
+  BeamBlockageInternal_createToleranceKey(self, &tolerance);
+  result = BBCacheFile_keyMatches(&key, &stored, &tolerance);
+done:
+  RAVE_OBJECT_RELEASE(attribute);
+  return result;
+}
 
-    if(HL_isHDF5File(filename)) {
-      nodelist =  LazyNodeListReader_readPreloaded(filename);
-      if (nodelist == NULL) {
-        RAVE_ERROR1("Failed to read hdf5 file %s", filename);
-        goto done;
-      }
+/**
+ * Takes the locks that serialize the HDF5 calls, first the application's lock if one has been
+ * set and then the internal lock.
+ * @return the token to pass to \ref BeamBlockageInternal_unlockHdf5
+ */
+static void* BeamBlockageInternal_lockHdf5(void)
+{
+  void* token = NULL;
+  if (hdf5_lockfunction != NULL && hdf5_unlockfunction != NULL) {
+    token = hdf5_lockfunction(hdf5_lockdata);
+  }
+  pthread_mutex_lock(&hdf5_lock);
+  return token;
+}
+
+/**
+ * Releases the locks taken by \ref BeamBlockageInternal_lockHdf5.
+ * @param[in] token - the token returned by \ref BeamBlockageInternal_lockHdf5
+ */
+static void BeamBlockageInternal_unlockHdf5(void* token)
+{
+  pthread_mutex_unlock(&hdf5_lock);
+  if (hdf5_lockfunction != NULL && hdf5_unlockfunction != NULL) {
+    hdf5_unlockfunction(hdf5_lockdata, token);
+  }
+}
+
+/**
+ * Reads the field stored as /beamb_field in a HDF5 file.
+ * @param[in] filename - the file
+ * @return the field or NULL if the file doesn't exist or can't be read
+ */
+static RaveField_t* BeamBlockageInternal_readFieldFile(const char* filename)
+{
+  RaveField_t* result = NULL;
+  LazyNodeListReader_t* nodelist = NULL;
+  void* token = NULL;
+
+  token = BeamBlockageInternal_lockHdf5();
+  if(HL_isHDF5File(filename)) {
+    nodelist =  LazyNodeListReader_readPreloaded(filename);
+    if (nodelist == NULL) {
+      RAVE_ERROR1("Failed to read hdf5 file %s", filename);
+    } else {
       result = OdimIoUtilities_loadField(nodelist, RaveIO_ODIM_Version_2_4, "/beamb_field");
     }
   }
-
-done:
   RAVE_OBJECT_RELEASE(nodelist);
+  BeamBlockageInternal_unlockHdf5(token);
+
   return result;
 }
 
 /**
- * Writes a rave field to the cache. There is no particular file properties or
+ * Writes the field as /beamb_field in a HDF5 file. There is no particular file properties or
  * compressions used.
- * @param[in] self - self
- * @param[in] scan - the scan
- * @param[in] field - the rave field
- * @param[in] dblim - Limit of Gaussian approximation of main lobe
+ * @param[in] field - the field
+ * @param[in] filename - the file
  * @return 1 on success otherwise 0
  */
-static int BeamBlockageInternal_writeCachedFile(BeamBlockage_t* self, PolarScan_t* scan, RaveField_t* field, double dblim)
+static int BeamBlockageInternal_writeFieldFile(RaveField_t* field, const char* filename)
 {
   int result = 0;
   HL_NodeList* nodelist = NULL;
   HL_Compression* compression = NULL;
   HL_FileCreationProperty* property = NULL;
+  void* token = NULL;
 
-  RAVE_ASSERT((self != NULL), "self == NULL");
-  RAVE_ASSERT((scan != NULL), "scan == NULL");
-  RAVE_ASSERT((field != NULL), "field == NULL");
-
-  if (self->cachedir != NULL) {
-    char filename[512];
-    if (!BeamBlockageInternal_createCacheFilename(self, scan, dblim, filename, 512)) {
-      goto done;
-    }
-    compression = HLCompression_new(CT_ZLIB);
-    property = HLFileCreationProperty_new();
-    nodelist = HLNodeList_new();
-
-    if (nodelist == NULL || compression == NULL || property == NULL) {
-      RAVE_ERROR0("Failed to create necessary hlhdf objects");
-      goto done;
-    }
-    compression->level = (int)6;
-    property->userblock = (hsize_t)0;
-    property->sizes.sizeof_size = (size_t)4;
-    property->sizes.sizeof_addr = (size_t)4;
-    property->sym_k.ik = (int)1;
-    property->sym_k.lk = (int)1;
-    property->istore_k = (long)1;
-    property->meta_block_size = (long)0;
+  compression = HLCompression_new(CT_ZLIB);
+  property = HLFileCreationProperty_new();
+  nodelist = HLNodeList_new();
 
-    result = OdimIoUtilities_addRaveField(field, nodelist, RaveIO_ODIM_Version_2_4, "/beamb_field");
-    if (result == 1) {
-      result = HLNodeList_setFileName(nodelist, filename);
-    }
-    if (result == 1) {
-      result = HLNodeList_write(nodelist, property, compression);
-    }
-  } else {
-    result = 1; /* We always succeed when there is no cache file to be written */
+  if (nodelist == NULL || compression == NULL || property == NULL) {
+    RAVE_ERROR0("Failed to create necessary hlhdf objects");
+    goto done;
+  }
+  compression->level = (int)6;
+  property->userblock = (hsize_t)0;
+  property->sizes.sizeof_size = (size_t)4;
+  property->sizes.sizeof_addr = (size_t)4;
+  property->sym_k.ik = (int)1;
+  property->sym_k.lk = (int)1;
+  property->istore_k = (long)1;
+  property->meta_block_size = (long)0;
+
+  token = BeamBlockageInternal_lockHdf5();
+  result = OdimIoUtilities_addRaveField(field, nodelist, RaveIO_ODIM_Version_2_4, "/beamb_field");
+  if (result == 1) {
+    result = HLNodeList_setFileName(nodelist, filename);
   }
+  if (result == 1) {
+    result = HLNodeList_write(nodelist, property, compression);
+  }
+  BeamBlockageInternal_unlockHdf5(token);
 
 done:
   HLCompression_free(compression);
   HLFileCreationProperty_free(property);
   HLNodeList_free(nodelist);
+  return result;
+}
+
+/**
+ * Creates the name of the file with the blocking elevation angles for the scan. The angles
+ * only depend on the ground geometry and the topography so the name is formatted like the cache
+ * filename without beamwidth and dblim:
+ *   phi_lon_lat_height_elangle_nrays_nbins_rscale_rstart_mapping_topography.h5
+ * The elevation angle is kept since the ground range of the bins depends on it, mapping and
+ * topography are described in \ref BeamBlockageInternal_createMappingName.
+ * @param[in] self - self, cachedir must not be NULL
+ * @param[in] scan - the scan
+ * @param[in] filename - the allocated array where the filename should be written
+ * @param[in] len - the length of the allocated array
+ * @return 1 on success otherwise 0
+ */
+static int BeamBlockageInternal_createPhiFilename(BeamBlockage_t* self, PolarScan_t* scan, char* filename, int len)
+{
+  BBCacheFileKey key;
+  char mapping[64];
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((self->cachedir != NULL), "cachedir == NULL");
+
+  BeamBlockageInternal_createCacheKey(self, scan, 0.0, &key);
+  BeamBlockageInternal_createMappingName(&key, mapping, sizeof(mapping));
+  if (snprintf(filename, len, "%s/phi_%.2f_%.2f_%.0f_%.2f_%ld_%ld_%.2f_%.2f_%s.h5", self->cachedir,
+               key.lon, key.lat, key.height, key.elangle, (long)key.nrays, (long)key.nbins, key.rscale, key.rstart, mapping) >= len) {
+    RAVE_ERROR0("Not enough room was created for filename");
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Returns the cached sine of the blocking elevation angle for each bin in the scan.
+ * @param[in] self - self, cachedir must not be NULL
+ * @param[in] scan - the scan
+ * @return a nbins x nrays field of doubles or NULL if there is none
+ */
+static RaveField_t* BeamBlockageInternal_getCachedPhi(BeamBlockage_t* self, PolarScan_t* scan)
+{
+  RaveField_t* result = NULL;
+  char filename[512];
+
+  if (!BeamBlockageInternal_createPhiFilename(self, scan, filename, 512)) {
+    return NULL;
+  }
+  result = BBFieldCache_get(filename);
+  if (result == NULL) {
+    result = BeamBlockageInternal_readFieldFile(filename);
+    if (result != NULL) {
+      BBFieldCache_put(filename, result);
+    }
+  }
+  if (result != NULL && (RaveField_getDataType(result) != RaveDataType_DOUBLE ||
+                         RaveField_getXsize(result) != PolarScan_getNbins(scan) ||
+                         RaveField_getYsize(result) != PolarScan_getNrays(scan))) {
+    RAVE_WARNING1("Cache file %s does not match the scan, ignoring it", filename);
+    RAVE_OBJECT_RELEASE(result);
+  }
+  if (result != NULL) {
+    BeamBlockageInternal_touchCacheFile(filename);
+  }
+  return result;
+}
+
+/**
+ * Writes the sine of the blocking elevation angles to the cache.
+ * @param[in] self - self, cachedir must not be NULL
+ * @param[in] scan - the scan
+ * @param[in] phifield - the nbins x nrays field of doubles
+ * @return 1 on success otherwise 0
+ */
+static int BeamBlockageInternal_writeCachedPhi(BeamBlockage_t* self, PolarScan_t* scan, RaveField_t* phifield)
+{
+  char filename[512], tmpname[560];
+  int result = 0;
+
+  if (!BeamBlockageInternal_createPhiFilename(self, scan, filename, 512) ||
+      !BeamBlockageInternal_createTemporaryFilename(filename, tmpname, 560)) {
+    return 0;
+  }
+  result = BeamBlockageInternal_writeFieldFile(phifield, tmpname);
+  if (result == 1 && rename(tmpname, filename) != 0) {
+    RAVE_ERROR1("Failed to rename cache file to %s", filename);
+    result = 0;
+  }
+  if (result == 1) {
+    BBFieldCache_put(filename, phifield);
+  } else {
+    unlink(tmpname);
+  }
+  return result;
+}
+
+/**
+ * Returns a cached file matching the given scan if there is one.
+ * @param[in] self - self
+ * @param[in] scan - the scan
+ * @param[in] dblim - Limit of Gaussian approximation of main lobe
+ */
+static RaveField_t* BeamBlockageInternal_getCachedFile(BeamBlockage_t* self, PolarScan_t* scan, double dblim)
+{
+  RaveField_t* result = NULL;
+  char filename[512];
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((scan != NULL), "scan == NULL");
+
+  if (self->cachedir != NULL) {
+    if (self->cacheformat == BeamBlockageCacheFormat_STORE) {
+      /* The store has its own index and is read with a single read, so the field cache is not used */
+      BBCacheFileKey key;
+      double gain = 0.0, offset = 0.0;
+      if (!BeamBlockageInternal_createStoreFilename(self, filename, 512)) {
+        goto done;
+      }
+      BeamBlockageInternal_createLookupKey(self, scan, dblim, &key);
+      result = BBCacheStore_read(filename, &key, &gain, &offset);
+      if (result != NULL && !BeamBlockageInternal_addMetaInformation(result, gain, offset, dblim)) {
+        RAVE_OBJECT_RELEASE(result);
+      }
+      goto done;
+    }
+
+    if (!BeamBlockageInternal_createCacheFilename(self, scan, dblim, filename, 512)) {
+      goto done;
+    }
+
+    result = BBFieldCache_get(filename);
+    if (result != NULL) {
+      goto done;
+    }
+
+    if (self->cacheformat == BeamBlockageCacheFormat_BINARY) {
+      BBCacheFileKey key, stored, tolerance;
+      double gain = 0.0, offset = 0.0;
+      BeamBlockageInternal_createCacheKey(self, scan, dblim, &key);
+      if (BeamBlockageInternal_isQuantizedKey(self)) {
+        /* The header contains the exact geometry the field was calculated for */
+        BeamBlockageInternal_createToleranceKey(self, &tolerance);
+        result = BBCacheFile_readMatching(filename, &key, &tolerance, &stored, &gain, &offset);
+        if (result != NULL && !BeamBlockageInternal_addGeometryInformation(result, &stored)) {
+          RAVE_OBJECT_RELEASE(result);
+        }
+      } else {
+        result = BBCacheFile_read(filename, &key, &gain, &offset);
+      }
+      if (result != NULL && !BeamBlockageInternal_addMetaInformation(result, gain, offset, dblim)) {
+        RAVE_OBJECT_RELEASE(result);
+      }
+      if (result != NULL) {
+        BBFieldCache_put(filename, result);
+      }
+      goto done;
+    }
+
+    result = BeamBlockageInternal_readFieldFile(filename);
+    if (result != NULL) {
+      BBFieldCache_put(filename, result);
+    }
+  }
+
+done:
+  if (result != NULL && self->cacheformat != BeamBlockageCacheFormat_STORE &&
+      !BeamBlockageInternal_matchesGeometry(self, scan, dblim, result)) {
+    RAVE_WARNING1("Cache file %s was calculated for another geometry, ignoring it", filename);
+    RAVE_OBJECT_RELEASE(result);
+  }
+  if (result != NULL) {
+    if (self->cacheformat != BeamBlockageCacheFormat_STORE) {
+      BeamBlockageInternal_touchCacheFile(filename);
+    }
+    pthread_mutex_lock(&stats_lock);
+    stats_hits++;
+    pthread_mutex_unlock(&stats_lock);
+  }
+  return result;
+}
+
+/**
+ * Writes a rave field to the cache. There is no particular file properties or
+ * compressions used. The file is first written to a temporary file in the cache
+ * directory and then renamed so that readers never see a partially written file.
+ * @param[in] self - self
+ * @param[in] scan - the scan
+ * @param[in] field - the rave field
+ * @param[in] dblim - Limit of Gaussian approximation of main lobe
+ * @return 1 on success otherwise 0
+ */
+static int BeamBlockageInternal_writeCachedFile(BeamBlockage_t* self, PolarScan_t* scan, RaveField_t* field, double dblim)
+{
+  int result = 0;
+  char filename[512], tmpname[560];
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((scan != NULL), "scan == NULL");
+  RAVE_ASSERT((field != NULL), "field == NULL");
+
+  if (self->cachedir == NULL) {
+    return 1; /* We always succeed when there is no cache file to be written */
+  }
+
+  if (self->cacheformat == BeamBlockageCacheFormat_STORE) {
+    /* Appending to the store is protected by the store itself */
+    BBCacheFileKey key;
+    double gain = 0.0, offset = 0.0;
+    BeamBlockageInternal_createLookupKey(self, scan, dblim, &key);
+    return BeamBlockageInternal_createStoreFilename(self, filename, 512) &&
+           BeamBlockageInternal_getMetaInformation(field, &gain, &offset) &&
+           BBCacheStore_write(filename, &key, field, gain, offset);
+  }
+
+  if (!BeamBlockageInternal_createCacheFilename(self, scan, dblim, filename, 512) ||
+      !BeamBlockageInternal_createTemporaryFilename(filename, tmpname, 560)) {
+    return 0;
+  }
+
+  if (self->cacheformat == BeamBlockageCacheFormat_BINARY) {
+    BBCacheFileKey key;
+    double gain = 0.0, offset = 0.0;
+    BeamBlockageInternal_createCacheKey(self, scan, dblim, &key);
+    result = BeamBlockageInternal_getMetaInformation(field, &gain, &offset);
+    if (result == 1) {
+      result = BBCacheFile_write(tmpname, &key, field, gain, offset);
+    }
+  } else {
+    result = BeamBlockageInternal_writeFieldFile(field, tmpname);
+  }
+
+  if (result == 1 && rename(tmpname, filename) != 0) {
+    RAVE_ERROR1("Failed to rename cache file to %s", filename);
+    result = 0;
+  }
+  if (result == 1) {
+    BBFieldCache_put(filename, field);
+    BeamBlockageInternal_autoCleanCache(self);
+  } else {
+    unlink(tmpname);
+  }
+
+  return result;
+}
+
+/**
+ * Calculates the blockage for the provided scan without involving the cache. The caller looks up
+ * and writes the cached blocking elevation angles, so this can be called from any thread.
+ * @param[in] self - self
+ * @param[in] mapper - the topography reader
+ * @param[in] scan - the scan to check blockage
+ * @param[in] region - the topography covering the scan, if NULL it is read by the mapper
+ * @param[in] dBlim - Limit of Gaussian approximation of main lobe
+ * @param[in] nthreads - number of threads to split the rays between
+ * @param[in,out] cachedphi - NULL if the blocking elevation angles aren't cached. Otherwise, if *cachedphi is set
+ * it is the cached sine of the blocking elevation angles that is used instead of the topography,
+ * and if *cachedphi is NULL it is set to the calculated sines that should be written to the cache.
+ * @return the beam blockage field on success otherwise NULL
+ */
+static RaveField_t* BeamBlockageInternal_computeBlockage(BeamBlockage_t* self, BeamBlockageMap_t* mapper, PolarScan_t* scan, BBTopography_t* region, double dBlim, int nthreads, RaveField_t** cachedphi)
+{
+  RaveField_t *field = NULL, *result = NULL, *phifield = NULL;
+  BBTopography_t *topo = NULL;
+  double RE = 0.0, R = 0;
+  PolarNavigator_t* navigator = NULL;
+  long bi = 0, ri = 0;
+  long nbins = 0, nrays = 0;
+  double* phi = NULL;
+  double* groundRange = NULL;
+  double *gg = NULL, *den = NULL;
+  double height = 0.0, Rh2 = 0.0;
+  double beamwidth = 0.0;
+  double limits[BEAMBLOCKAGE_NLEVELS];
+  int nworkers = 1;
+  double gtopo_alt0 = 0.0, gtmp = 0.0;
+  BeamBlockageBeam beam;
+  BeamBlockageRays rays;
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  /* We want range to be between 0 - 255 as unsigned char */
+  beam.gain = 1 / 255.0;
+  beam.offset = 0.0;
+
+  nbins = PolarScan_getNbins(scan);
+  nrays = PolarScan_getNrays(scan);
+
+  field = RAVE_OBJECT_NEW(&RaveField_TYPE);
+  if (field == NULL || !RaveField_createData(field, nbins, nrays, RaveDataType_UCHAR)) {
+    goto done;
+  }
+
+  nworkers = BBThreads_getWorkers(nthreads, nrays);
+  phi = RAVE_MALLOC(sizeof(double)*nbins*nworkers);
+  if (phi == NULL) {
+    goto done;
+  }
+
+  beamwidth = PolarScan_getBeamwidth(scan) * 180.0 / M_PI;
+  beam.elangle = PolarScan_getElangle(scan) * 180.0 / M_PI;
+
+  /* Width of Gaussian */
+  beam.c = -((beamwidth/2.0)*(beamwidth/2.0))/log(0.5);
+
+  /* Elevation limits */
+  beam.elLim = sqrt( -beam.c*log(pow(10.0,(dBlim/10.0)) ) );
+
+  /* Find total blockage within -elLim to +elLim */
+  beam.bb_tot = sqrt(M_PI*beam.c) * erf(beam.elLim/sqrt(beam.c));
+
+  memset(&rays, 0, sizeof(BeamBlockageRays));
+  rays.beam = &beam;
+  rays.limits = limits;
+  rays.uselimits = BeamBlockageInternal_createLimits(&beam, limits);
+  rays.field = field;
+  rays.bbdata = (unsigned char*)RaveField_getData(field);
+  rays.nbins = nbins;
+  rays.phi = phi;
+
+  if (cachedphi != NULL && *cachedphi != NULL) {
+    phifield = RAVE_OBJECT_COPY(*cachedphi);
+  }
+
+  if (phifield != NULL) {
+    /* The topography is not needed when the blocking elevation angles are known */
+    rays.phiin = (const double*)RaveField_getData(phifield);
+  } else {
+    navigator = PolarScan_getNavigator(scan);
+    if (navigator == NULL) {
+      RAVE_ERROR0("Scan does not have a polar navigator instance attached");
+      goto done;
+    }
+
+    groundRange = BeamBlockageInternal_computeGroundRange(self, scan);
+    if (groundRange == NULL) {
+      goto done;
+    }
+
+    if (region != NULL) {
+      topo = BeamBlockageMap_mapTopography(mapper, region, scan);
+    } else {
+      topo = BeamBlockageMap_getTopographyForScan(mapper, scan);
+    }
+    if (topo == NULL) {
+      goto done;
+    }
+
+    gg = RAVE_MALLOC(sizeof(double)*nbins);
+    den = RAVE_MALLOC(sizeof(double)*nbins);
+    if (gg == NULL || den == NULL) {
+      goto done;
+    }
+
+    RE = PolarNavigator_getEarthRadiusOrigin(navigator);
+    R = 1.0/((1.0/RE) + PolarNavigator_getDndh(navigator));
+    height = PolarNavigator_getAlt0(navigator);
+
+    /* Determine topography's height at the radar's position
+     * and use it if it is higher. Even add a short "tower"
+     * to get the feed-horn's height above the ground.
+     * Remember: this is a guess for dealing with cases where
+     * the radar's height may be unknown or inconsistent with the DEM. */
+    for (ri = 0; ri < nrays; ri++) {
+      BBTopography_getValue(topo, 0, ri, &gtmp);
+      if (gtmp > gtopo_alt0) {
+        gtopo_alt0 = gtmp;
+      }
+    }  /* Assume a 5 m antenna radius (S-band) */
+    if ((gtopo_alt0+5.0) > height) {
+      height = gtopo_alt0 + 5.0;
+    }
+
+    /* Per bin parts of the sine of the blocking elevation angle */
+    Rh2 = (R+height)*(R+height);
+    for (bi = 0; bi < nbins; bi++) {
+      gg[bi] = groundRange[bi]*groundRange[bi];
+      den[bi] = 2*groundRange[bi]*(R+height);
+    }
+
+    rays.R = R;
+    rays.Rh2 = Rh2;
+    rays.gg = gg;
+    rays.den = den;
+    rays.topo = topo;
+    if (BBTopography_getDataType(topo) == RaveDataType_SHORT) {
+      rays.topodata = (const short*)BBTopography_getData(topo);
+    }
+
+    if (cachedphi != NULL) {
+      phifield = RAVE_OBJECT_NEW(&RaveField_TYPE);
+      if (phifield == NULL || !RaveField_createData(phifield, nbins, nrays, RaveDataType_DOUBLE)) {
+        goto done;
+      }
+      rays.phiout = (double*)RaveField_getData(phifield);
+    }
+  }
+
+  BBThreads_run(nworkers, nrays, BeamBlockageInternal_raysWorker, &rays);
+
+  if (!BeamBlockageInternal_addMetaInformation(field, beam.gain, beam.offset, dBlim)) {
+    goto done;
+  }
+  if (BeamBlockageInternal_isQuantizedKey(self)) {
+    BBCacheFileKey key;
+    BeamBlockageInternal_createCacheKey(self, scan, dBlim, &key);
+    if (!BeamBlockageInternal_addGeometryInformation(field, &key)) {
+      goto done;
+    }
+  }
+
+  if (rays.phiout != NULL) {
+    *cachedphi = RAVE_OBJECT_COPY(phifield);
+  }
+  result = RAVE_OBJECT_COPY(field);
+done:
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  pthread_mutex_lock(&stats_lock);
+  if (self->cachedir != NULL) {
+    stats_misses++;
+  }
+  if (result != NULL) {
+    stats_computed++;
+    stats_computetime += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  }
+  pthread_mutex_unlock(&stats_lock);
+  RAVE_OBJECT_RELEASE(navigator);
+  RAVE_OBJECT_RELEASE(field);
+  RAVE_OBJECT_RELEASE(phifield);
+  RAVE_OBJECT_RELEASE(topo);
+  RAVE_FREE(phi);
+  RAVE_FREE(gg);
+  RAVE_FREE(den);
+  RAVE_FREE(groundRange);
+  return result;
+}
+
+/**
+ * Calculates the blockage for the provided scan, see \ref BeamBlockageInternal_computeBlockage, using
+ * and writing the cached blocking elevation angles if they are cached. The angles are read from and
+ * written to the cache in the calling thread.
+ * @param[in] self - self
+ * @param[in] mapper - the topography reader
+ * @param[in] scan - the scan to check blockage
+ * @param[in] dBlim - Limit of Gaussian approximation of main lobe
+ * @param[in] nthreads - number of threads to split the rays between
+ * @return the beam blockage field on success otherwise NULL
+ */
+static RaveField_t* BeamBlockageInternal_computeBlockageUsingPhiCache(BeamBlockage_t* self, BeamBlockageMap_t* mapper, PolarScan_t* scan, double dBlim, int nthreads)
+{
+  RaveField_t *field = NULL, *phifield = NULL;
+  int cached = 0;
+
+  if (!self->cachephi || self->cachedir == NULL) {
+    return BeamBlockageInternal_computeBlockage(self, mapper, scan, NULL, dBlim, nthreads, NULL);
+  }
+
+  phifield = BeamBlockageInternal_getCachedPhi(self, scan);
+  cached = (phifield != NULL);
+  field = BeamBlockageInternal_computeBlockage(self, mapper, scan, NULL, dBlim, nthreads, &phifield);
+  if (field != NULL && !cached && phifield != NULL && !BeamBlockageInternal_writeCachedPhi(self, scan, phifield)) {
+    RAVE_WARNING0("Failed to write blocking elevation angles to the cache");
+  }
+  RAVE_OBJECT_RELEASE(phifield);
+  return field;
+}
+
+/**
+ * Returns the blockage for the scan from the cache or calculates and caches it. Only one process
+ * calculates a given field, the others wait for it and read the result.
+ * @param[in] self - self
+ * @param[in] mapper - the topography reader
+ * @param[in] scan - the scan
+ * @param[in] dBlim - Limit of Gaussian approximation of main lobe
+ * @param[in] nthreads - number of threads to split the rays between
+ * @param[out] computed - set to 1 if the field was calculated and 0 if it was read from the cache, may be NULL
+ * @return the blockage field or NULL on failure
+ */
+static RaveField_t* BeamBlockageInternal_getOrComputeBlockage(BeamBlockage_t* self, BeamBlockageMap_t* mapper, PolarScan_t* scan, double dBlim, int nthreads, int* computed)
+{
+  RaveField_t* field = NULL;
+  int lock = -1;
+
+  if (computed != NULL) {
+    *computed = 0;
+  }
+
+  if (self->rewritecache == 0) {
+    /* If we want to recreate cache, there is no meaning to read the cached file */
+    field = BeamBlockageInternal_getCachedFile(self, scan, dBlim);
+    if (field != NULL) {
+      return field; /* We already have what we want so return before we do anything else */
+    }
+  }
+
+  lock = BeamBlockageInternal_lockCacheFile(self, scan, dBlim, 1);
+  if (lock >= 0 && self->rewritecache == 0 && BeamBlockageInternal_hasCachedFile(self, scan, dBlim)) {
+    field = BeamBlockageInternal_getCachedFile(self, scan, dBlim);
+  }
+
+  if (field == NULL) {
+    field = BeamBlockageInternal_computeBlockageUsingPhiCache(self, mapper, scan, dBlim, nthreads);
+    if (field != NULL && !BeamBlockageInternal_writeCachedFile(self, scan, field, dBlim)) {
+      RAVE_ERROR0("Failed to generate cache file");
+    }
+    if (computed != NULL) {
+      *computed = (field != NULL);
+    }
+  }
+
+  BeamBlockageInternal_unlockCacheFile(lock);
+  return field;
+}
+
+/**
+ * Gives the scan a copy of its navigator. The scans in a volume usually share their navigator
+ * and reference counts are not thread safe, so each scan must have its own navigator before
+ * scans are processed concurrently.
+ * @param[in] scan - the scan
+ * @param[out] original - the original navigator that should be set back when done, may be set to NULL
+ * @return 1 on success otherwise 0
+ */
+static int BeamBlockageInternal_detachNavigator(PolarScan_t* scan, PolarNavigator_t** original)
+{
+  PolarNavigator_t* navigator = PolarScan_getNavigator(scan);
+  *original = NULL;
+  if (navigator != NULL) {
+    PolarNavigator_t* copy = RAVE_OBJECT_CLONE(navigator);
+    if (copy == NULL) {
+      RAVE_OBJECT_RELEASE(navigator);
+      return 0;
+    }
+    PolarScan_setNavigator(scan, copy);
+    RAVE_OBJECT_RELEASE(copy);
+  }
+  *original = navigator;
+  return 1;
+}
+
+/**
+ * Calculates the blockage for the scans [start, end) that did not have a cached blockage field.
+ * @param[in] arg - the \ref BeamBlockageVolume
+ * @param[in] thread - the thread index
+ * @param[in] start - first scan
+ * @param[in] end - one past the last scan
+ */
+static void BeamBlockageInternal_volumeBlockageWorker(void* arg, int thread, long start, long end)
+{
+  BeamBlockageVolume* vol = (BeamBlockageVolume*)arg;
+  long i = 0;
+
+  for (i = start; i < end; i++) {
+    if (vol->fields[i] == NULL && !vol->deferred[i]) {
+      vol->fields[i] = BeamBlockageInternal_computeBlockage(vol->self, vol->mapper, vol->scans[i], vol->region, vol->dBlim, 1,
+                                                            (vol->phi != NULL) ? &vol->phi[i] : NULL);
+    }
+    vol->status[i] = (vol->fields[i] != NULL);
+  }
+}
+
+/**
+ * Restores the scans [start, end) with their blockage field.
+ * @param[in] arg - the \ref BeamBlockageVolume
+ * @param[in] thread - the thread index
+ * @param[in] start - first scan
+ * @param[in] end - one past the last scan
+ */
+static void BeamBlockageInternal_volumeRestoreWorker(void* arg, int thread, long start, long end)
+{
+  BeamBlockageVolume* vol = (BeamBlockageVolume*)arg;
+  long i = 0;
+
+  for (i = start; i < end; i++) {
+    if (vol->status[i] && !BeamBlockage_restore(vol->scans[i], vol->fields[i], vol->quantity, vol->threshold)) {
+      vol->status[i] = 0;
+    }
+  }
+}
+
+/**
+ * Precomputes the blockage for the scans [start, end) and reports the progress.
+ * @param[in] arg - the \ref BeamBlockagePrecompute
+ * @param[in] thread - the thread index
+ * @param[in] start - first scan
+ * @param[in] end - one past the last scan
+ */
+static void BeamBlockageInternal_precomputeWorker(void* arg, int thread, long start, long end)
+{
+  BeamBlockagePrecompute* pre = (BeamBlockagePrecompute*)arg;
+  long i = 0;
+
+  for (i = start; i < end; i++) {
+    struct timespec t0, t1;
+    RaveField_t* field = NULL;
+    BeamBlockagePrecomputeStatus status = BeamBlockagePrecompute_FAILED;
+    int computed = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    field = BeamBlockageInternal_getOrComputeBlockage(pre->self, pre->mapper, pre->scans[i], pre->dBlim, 1, &computed);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (field != NULL) {
+      status = computed ? BeamBlockagePrecompute_COMPUTED : BeamBlockagePrecompute_CACHED;
+    }
+    RAVE_OBJECT_RELEASE(field);
+
+    pthread_mutex_lock(&pre->lock);
+    pre->ndone++;
+    if (status == BeamBlockagePrecompute_FAILED) {
+      pre->nfailed++;
+    }
+    if (pre->progress != NULL) {
+      pre->progress(pre->data, (int)i, pre->ndone, pre->nscans, status,
+                    (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9);
+    }
+    pthread_mutex_unlock(&pre->lock);
+  }
+}
+
+/**
+ * Creates the restore action and the dB correction for each of the values that a blockage field
+ * of type unsigned char can have. Same calculation as for each bin in \ref BeamBlockage_restore.
+ * @param[in] bbgain - gain of the blockage field
+ * @param[in] bboffset - offset of the blockage field
+ * @param[in] threshold - the percentage threshold used when restoring
+ * @param[out] actions - BEAMBLOCKAGE_NLEVELS actions
+ * @param[out] corrections - BEAMBLOCKAGE_NLEVELS dB corrections, 0 unless the action is to correct
+ */
+static void BeamBlockageInternal_createRestoreTable(double bbgain, double bboffset, double threshold, unsigned char* actions, double* corrections)
+{
+  int k = 0;
+  for (k = 0; k < BEAMBLOCKAGE_NLEVELS; k++) {
+    /* ODIM's rule for representing quality is that 0=lowest, 1=highest quality. Therefore revert. */
+    double bbpercent = 1.0 - (bbgain * (double)k + bboffset);
+    corrections[k] = 0.0;
+    if (bbpercent < 0.0 || bbpercent > 1.0) {
+      actions[k] = BeamBlockageRestoreAction_INVALID;
+    } else if ((bbpercent > 0.0) && (bbpercent <= threshold) && (bbpercent != 1.0)) {
+      /* Two-way blockage multiplicative correction in dB */
+      corrections[k] = 10.0 * log10(1.0 / (pow(1.0-bbpercent,2)));
+      actions[k] = BeamBlockageRestoreAction_CORRECT;
+    } else if (bbpercent > threshold) {
+      actions[k] = BeamBlockageRestoreAction_MASK;
+    } else {
+      actions[k] = BeamBlockageRestoreAction_KEEP;
+    }
+  }
+}
+
+/**
+ * Converts a value to unsigned char in the same way as when setting a value in a parameter
+ * of type unsigned char, i.e. limited to 0 - 255 and rounded.
+ * @param[in] v - the value
+ * @return the raw value
+ */
+static unsigned char BeamBlockageInternal_toUchar(double v)
+{
+  if (v < 0.0) {
+    v = 0.0;
+  } else if (v > 255.0) {
+    v = 255.0;
+  }
+  return (unsigned char)(v + 0.5);
+}
+
+/**
+ * Restores a parameter of type unsigned char with a blockage field of type unsigned char.
+ * Gives the same result as the bin by bin restoring in \ref BeamBlockage_restore but works
+ * directly on the data and takes the correction for each blockage value from a table.
+ * @param[in] parameter - the parameter to restore
+ * @param[in] blockage - the blockage field, same dimensions as the parameter
+ * @param[in] bbgain - gain of the blockage field
+ * @param[in] bboffset - offset of the blockage field
+ * @param[in] threshold - the percentage threshold used when restoring
+ * @return 1 on success, 0 if the blockage field has values that are out of bounds
+ */
+static int BeamBlockageInternal_restoreUchar(PolarScanParam_t* parameter, RaveField_t* blockage, double bbgain, double bboffset, double threshold)
+{
+  unsigned char actions[BEAMBLOCKAGE_NLEVELS];
+  double corrections[BEAMBLOCKAGE_NLEVELS];
+  unsigned char* data = (unsigned char*)PolarScanParam_getData(parameter);
+  const unsigned char* bbdata = (const unsigned char*)RaveField_getData(blockage);
+  double gain = PolarScanParam_getGain(parameter);
+  double offset = PolarScanParam_getOffset(parameter);
+  double nodata = PolarScanParam_getNodata(parameter);
+  double undetect = PolarScanParam_getUndetect(parameter);
+  unsigned char nodataraw = BeamBlockageInternal_toUchar(nodata);
+  long i = 0, n = PolarScanParam_getNrays(parameter) * PolarScanParam_getNbins(parameter);
+
+  if (data == NULL || bbdata == NULL) {
+    RAVE_ERROR0("Parameter or blockage field does not have any data");
+    return 0;
+  }
+
+  BeamBlockageInternal_createRestoreTable(bbgain, bboffset, threshold, actions, corrections);
+
+  for (i = 0; i < n; i++) {
+    double raw = (double)data[i];
+    unsigned char action = actions[bbdata[i]];
+    if (action == BeamBlockageRestoreAction_KEEP || raw == nodata) {
+      continue; /* Nothing to do or nodata */
+    }
+    if (action == BeamBlockageRestoreAction_CORRECT) {
+      if (raw != undetect) {
+        double dbz_corr = (offset + raw * gain) + corrections[bbdata[i]];
+        data[i] = BeamBlockageInternal_toUchar(round((dbz_corr - offset) / gain));
+      }
+    } else if (action == BeamBlockageRestoreAction_MASK) {
+      data[i] = nodataraw; /* Uncorrectable */
+    } else {
+      RAVE_ERROR0("beamb values are out of bounds, check scaling");
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*@} End of Private functions */
+
+/*@{ Interface functions */
+int BeamBlockage_setTopo30Directory(BeamBlockage_t* self, const char* topodirectory)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return BeamBlockageMap_setTopo30Directory(self->mapper, topodirectory);
+}
+
+const char* BeamBlockage_getTopo30Directory(BeamBlockage_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return (const char*)BeamBlockageMap_getTopo30Directory(self->mapper);
+}
+
+unsigned long BeamBlockage_getTopographyId(BeamBlockage_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return BeamBlockageMap_getTopographyId(self->mapper);
+}
+
+int BeamBlockage_setCacheDirectory(BeamBlockage_t* self, const char* cachedir)
+{
+  char* tmp = NULL;
+  int result = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  if (cachedir != NULL) {
+    tmp = RAVE_STRDUP(cachedir);
+    if (tmp == NULL) {
+      goto done;
+    }
+  }
+  RAVE_FREE(self->cachedir);
+  self->cachedir = tmp;
+  tmp = NULL; // Release responsibility for memory
+  result = 1;
+done:
+  RAVE_FREE(tmp);
+  return result;
+}
+
+const char* BeamBlockage_getCacheDirectory(BeamBlockage_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return (const char*)self->cachedir;
+}
+
+void BeamBlockage_setRewriteCache(BeamBlockage_t* self, int recreateCache)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->rewritecache = recreateCache;
+}
+
+int BeamBlockage_getRewriteCache(BeamBlockage_t* self)
+{
+  return self->rewritecache;
+}
+
+int BeamBlockage_setCacheFormat(BeamBlockage_t* self, BeamBlockageCacheFormat format)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (format != BeamBlockageCacheFormat_HDF5 && format != BeamBlockageCacheFormat_BINARY &&
+      format != BeamBlockageCacheFormat_STORE) {
+    RAVE_ERROR1("Unknown cache format %d", (int)format);
+    return 0;
+  }
+  self->cacheformat = format;
+  return 1;
+}
+
+BeamBlockageCacheFormat BeamBlockage_getCacheFormat(BeamBlockage_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->cacheformat;
+}
+
+int BeamBlockage_compactCache(BeamBlockage_t* self)
+{
+  char filename[512];
 
-  return result;
-}
+  RAVE_ASSERT((self != NULL), "self == NULL");
 
-/*@} End of Private functions */
+  if (self->cachedir == NULL || self->cacheformat != BeamBlockageCacheFormat_STORE) {
+    return 1; /* Only the store contains superseded fields */
+  }
+  if (!BeamBlockageInternal_createStoreFilename(self, filename, 512)) {
+    return 0;
+  }
+  return BBCacheStore_compact(filename);
+}
 
-/*@{ Interface functions */
-int BeamBlockage_setTopo30Directory(BeamBlockage_t* self, const char* topodirectory)
+void BeamBlockage_setCacheMaxSize(BeamBlockage_t* self, long long maxsize)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
-  return BeamBlockageMap_setTopo30Directory(self->mapper, topodirectory);
+  self->cachemaxsize = (maxsize < 0) ? 0 : maxsize;
 }
 
-const char* BeamBlockage_getTopo30Directory(BeamBlockage_t* self)
+long long BeamBlockage_getCacheMaxSize(BeamBlockage_t* self)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
-  return (const char*)BeamBlockageMap_getTopo30Directory(self->mapper);
+  return self->cachemaxsize;
 }
 
-int BeamBlockage_setCacheDirectory(BeamBlockage_t* self, const char* cachedir)
+void BeamBlockage_setCacheMaxAge(BeamBlockage_t* self, long maxage)
 {
-  char* tmp = NULL;
-  int result = 0;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->cachemaxage = (maxage < 0) ? 0 : maxage;
+}
 
+long BeamBlockage_getCacheMaxAge(BeamBlockage_t* self)
+{
   RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->cachemaxage;
+}
 
-  if (cachedir != NULL) {
-    tmp = RAVE_STRDUP(cachedir);
-    if (tmp == NULL) {
-      goto done;
-    }
+int BeamBlockage_setCacheTolerance(BeamBlockage_t* self, const BeamBlockageCacheTolerance* tolerance)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (tolerance == NULL) {
+    memset(&self->cachetolerance, 0, sizeof(BeamBlockageCacheTolerance));
+    return 1;
   }
-  RAVE_FREE(self->cachedir);
-  self->cachedir = tmp;
-  tmp = NULL; // Release responsibility for memory
-  result = 1;
-done:
-  RAVE_FREE(tmp);
-  return result;
+  if (tolerance->position < 0.0 || tolerance->height < 0.0 || tolerance->angle < 0.0 || tolerance->range < 0.0) {
+    RAVE_ERROR0("Cache key tolerances must not be negative");
+    return 0;
+  }
+  self->cachetolerance = *tolerance;
+  return 1;
 }
 
-const char* BeamBlockage_getCacheDirectory(BeamBlockage_t* self)
+void BeamBlockage_getCacheTolerance(BeamBlockage_t* self, BeamBlockageCacheTolerance* tolerance)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
-  return (const char*)self->cachedir;
+  RAVE_ASSERT((tolerance != NULL), "tolerance == NULL");
+  *tolerance = self->cachetolerance;
 }
 
-void BeamBlockage_setRewriteCache(BeamBlockage_t* self, int recreateCache)
+void BeamBlockage_setCachePhi(BeamBlockage_t* self, int cachephi)
 {
   RAVE_ASSERT((self != NULL), "self == NULL");
-  self->rewritecache = recreateCache;
+  self->cachephi = cachephi ? 1 : 0;
 }
 
-int BeamBlockage_getRewriteCache(BeamBlockage_t* self)
+int BeamBlockage_getCachePhi(BeamBlockage_t* self)
 {
-  return self->rewritecache;
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->cachephi;
 }
 
-RaveField_t* BeamBlockage_getBlockage(BeamBlockage_t* self, PolarScan_t* scan, double dBlim)
+long BeamBlockage_cleanCache(BeamBlockage_t* self)
 {
-  RaveField_t *field = NULL, *result = NULL;
-  BBTopography_t *topo = NULL;
-  double RE = 0.0, R = 0;
-  PolarNavigator_t* navigator = NULL;
-  long bi = 0, ri = 0;
-  long nbins = 0, nrays = 0;
-  double* phi = NULL;
-  double* groundRange = NULL;
-  double height = 0.0;
-  double beamwidth = 0.0, elangle = 0.0;
-  double c, elLim, bb_tot;
-  double elBlock = 0.0;
-  double gtopo_alt0 = 0.0, gtmp = 0.0;
-
-  /* We want range to be between 0 - 255 as unsigned char */
-  double gain = 1 / 255.0;
-  double offset = 0.0;
-
   RAVE_ASSERT((self != NULL), "self == NULL");
+  return BeamBlockageInternal_cleanCache(self);
+}
 
-  if (scan == NULL) {
-    return NULL;
-  }
+int BeamBlockage_getCacheStatistics(BeamBlockage_t* self, BeamBlockageCacheStatistics* stats)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((stats != NULL), "stats == NULL");
 
-  if (self->rewritecache == 0) {
-    /* If we want to recreate cache, there is no meaning to read the cached file */
-    field = BeamBlockageInternal_getCachedFile(self, scan, dBlim);
-    if (field != NULL) {
-      return field; /* We already have what we want so return before we do anything else */
+  memset(stats, 0, sizeof(BeamBlockageCacheStatistics));
+  if (self->cachedir != NULL) {
+    if (self->cacheformat == BeamBlockageCacheFormat_STORE) {
+      char filename[512];
+      struct stat st;
+      if (!BeamBlockageInternal_createStoreFilename(self, filename, 512)) {
+        return 0;
+      }
+      if (stat(filename, &st) == 0) {
+        stats->entries = BBCacheStore_getNumberOfEntries(filename);
+        stats->bytes = st.st_size;
+      }
+    } else {
+      long i = 0, nfiles = 0;
+      BeamBlockageCacheFile* files = BeamBlockageInternal_listCacheFiles(self, &nfiles);
+      for (i = 0; i < nfiles; i++) {
+        stats->bytes += files[i].size;
+      }
+      stats->entries = nfiles;
+      RAVE_FREE(files);
     }
   }
 
-  navigator = PolarScan_getNavigator(scan);
-  if (navigator == NULL) {
-    RAVE_ERROR0("Scan does not have a polar navigator instance attached");
-    goto done;
-  }
-
-  groundRange = BeamBlockageInternal_computeGroundRange(self, scan);
-  if (groundRange == NULL) {
-    goto done;
-  }
+  pthread_mutex_lock(&stats_lock);
+  stats->hits = stats_hits;
+  stats->misses = stats_misses;
+  stats->computed = stats_computed;
+  stats->computetime = stats_computetime;
+  stats->evicted = stats_evicted;
+  pthread_mutex_unlock(&stats_lock);
+  return 1;
+}
 
-  topo = BeamBlockageMap_getTopographyForScan(self->mapper, scan);
-  if (topo == NULL) {
-    goto done;
-  }
+void BeamBlockage_resetCacheStatistics(void)
+{
+  pthread_mutex_lock(&stats_lock);
+  stats_hits = 0;
+  stats_misses = 0;
+  stats_computed = 0;
+  stats_computetime = 0.0;
+  stats_evicted = 0;
+  pthread_mutex_unlock(&stats_lock);
+}
 
-  nbins = PolarScan_getNbins(scan);
-  nrays = PolarScan_getNrays(scan);
+void BeamBlockage_setThreads(BeamBlockage_t* self, int nthreads)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->nthreads = (nthreads < 1) ? 1 : nthreads;
+  BeamBlockageMap_setThreads(self->mapper, self->nthreads);
+}
 
-  field = RAVE_OBJECT_NEW(&RaveField_TYPE);
-  if (field == NULL || !RaveField_createData(field, nbins, nrays, RaveDataType_UCHAR)) {
-    goto done;
-  }
+int BeamBlockage_getThreads(BeamBlockage_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->nthreads;
+}
 
-  phi = RAVE_MALLOC(sizeof(double)*nbins);
-  if (phi == NULL) {
-    goto done;
-  }
+void BeamBlockage_setHorizon(BeamBlockage_t* self, int horizon)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  BeamBlockageMap_setHorizon(self->mapper, horizon);
+}
 
-  RE = PolarNavigator_getEarthRadiusOrigin(navigator);
-  R = 1.0/((1.0/RE) + PolarNavigator_getDndh(navigator));
-  height = PolarNavigator_getAlt0(navigator);
+int BeamBlockage_getHorizon(BeamBlockage_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return BeamBlockageMap_getHorizon(self->mapper);
+}
 
-  /* Determine topography's height at the radar's position
-   * and use it if it is higher. Even add a short "tower"
-   * to get the feed-horn's height above the ground.
-   * Remember: this is a guess for dealing with cases where
-   * the radar's height may be unknown or inconsistent with the DEM. */
-  for (ri = 0; ri < nrays; ri++) {
-    BBTopography_getValue(topo, 0, ri, &gtmp);
-    if (gtmp > gtopo_alt0) {
-      gtopo_alt0 = gtmp;
-    }
-  }  /* Assume a 5 m antenna radius (S-band) */
-  if ((gtopo_alt0+5.0) > height) {
-    height = gtopo_alt0 + 5.0;
-  }
+void BeamBlockage_setLevels(BeamBlockage_t* self, int levels)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  BeamBlockageMap_setLevels(self->mapper, levels);
+}
 
-  beamwidth = PolarScan_getBeamwidth(scan) * 180.0 / M_PI;
-  elangle = PolarScan_getElangle(scan) * 180.0 / M_PI;
+int BeamBlockage_getLevels(BeamBlockage_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return BeamBlockageMap_getLevels(self->mapper);
+}
 
-  /* Width of Gaussian */
-  c = -((beamwidth/2.0)*(beamwidth/2.0))/log(0.5);
+int BeamBlockage_setSampling(BeamBlockage_t* self, BeamBlockageMapSampling sampling)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return BeamBlockageMap_setSampling(self->mapper, sampling);
+}
 
-  /* Elevation limits */
-  elLim = sqrt( -c*log(pow(10.0,(dBlim/10.0)) ) );
+BeamBlockageMapSampling BeamBlockage_getSampling(BeamBlockage_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return BeamBlockageMap_getSampling(self->mapper);
+}
 
-  /* Find total blockage within -elLim to +elLim */
-  bb_tot = sqrt(M_PI*c) * erf(elLim/sqrt(c));
+void BeamBlockage_setCompressed(BeamBlockage_t* self, int compressed)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  BeamBlockageMap_setCompressed(self->mapper, compressed);
+}
 
-  for (ri = 0; ri < nrays; ri++) {
-    for (bi = 0; bi < nbins; bi++) {
-      double v = 0.0;
-      BBTopography_getValue(topo, bi, ri, &v);
-      phi[bi] = RAD2DEG(asin((((v+R)*(v+R)) - (groundRange[bi]*groundRange[bi]) - ((R+height)*(R+height))) / (2*groundRange[bi]*(R+height))));
-    }
-    BeamBlockageInternal_cummax(phi, nbins);
+int BeamBlockage_getCompressed(BeamBlockage_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return BeamBlockageMap_getCompressed(self->mapper);
+}
 
-    for (bi = 0; bi < nbins; bi++) {
-      double bbval = 0.0;
-      elBlock = phi[bi];
-      if (elBlock < elangle - elLim) {
-        elBlock = -9999.0;
-      }
-      if (elBlock > elangle + elLim) {
-        elBlock = elangle + elLim;
-      }
-      bbval = -1.0/2.0 * sqrt(M_PI * c) * (erf((elangle - elBlock)/sqrt(c)) - erf(elLim/sqrt(c)))/bb_tot;
+void BeamBlockage_setBlockLayout(BeamBlockage_t* self, int blocklayout)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  BeamBlockageMap_setBlockLayout(self->mapper, blocklayout);
+}
 
-      /* Discard non-physical values for blockage */
-      if (bbval < 0.0) {
-        bbval = 0.0;
-      } else if (bbval > 1.0) {
-        bbval = 1.0;
-      }
+int BeamBlockage_getBlockLayout(BeamBlockage_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return BeamBlockageMap_getBlockLayout(self->mapper);
+}
 
-      /* ODIM's rule for representing quality is that 0=lowest, 1=highest quality. Therefore invert. */
-      bbval = ((1.0-bbval) - offset) / gain;
-      RaveField_setValue(field, bi, ri, bbval);
-    }
-  }
+void BeamBlockage_setHdf5LockFunctions(BeamBlockageHdf5LockFunction lock, BeamBlockageHdf5UnlockFunction unlock, void* data)
+{
+  pthread_mutex_lock(&hdf5_lock);
+  hdf5_lockfunction = lock;
+  hdf5_unlockfunction = unlock;
+  hdf5_lockdata = data;
+  pthread_mutex_unlock(&hdf5_lock);
+}
 
-  if (!BeamBlockageInternal_addMetaInformation(field, gain, offset, dBlim)) {
-    goto done;
-  }
+RaveField_t* BeamBlockage_getBlockage(BeamBlockage_t* self, PolarScan_t* scan, double dBlim)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
 
-  if (!BeamBlockageInternal_writeCachedFile(self, scan, field, dBlim)) {
-    RAVE_ERROR0("Failed to generate cache file");
+  if (scan == NULL) {
+    return NULL;
   }
 
-  result = RAVE_OBJECT_COPY(field);
-done:
-  RAVE_OBJECT_RELEASE(navigator);
-  RAVE_OBJECT_RELEASE(field);
-  RAVE_OBJECT_RELEASE(topo);
-  RAVE_FREE(phi);
-  RAVE_FREE(groundRange);
-  return result;
+  return BeamBlockageInternal_getOrComputeBlockage(self, self->mapper, scan, dBlim, self->nthreads, NULL);
 }
 
 int BeamBlockage_restore(PolarScan_t* scan, RaveField_t* blockage, const char* quantity, double threshold)
@@ -683,6 +2513,12 @@ int BeamBlockage_restore(PolarScan_t* scan, RaveField_t* blockage, const char* q
     }
   }
 
+  if (PolarScanParam_getDataType(parameter) == RaveDataType_UCHAR && RaveField_getDataType(blockage) == RaveDataType_UCHAR) {
+    /* The common case, the correction only depends on the 256 blockage values */
+    result = BeamBlockageInternal_restoreUchar(parameter, blockage, bbgain, bboffset, threshold);
+    goto done;
+  }
+
   for (ri = 0; ri < nrays; ri++) {
     for (bi = 0; bi < nbins; bi++) {
 
@@ -734,6 +2570,290 @@ done:
   return result;
 }
 
+int BeamBlockage_processVolume(BeamBlockage_t* self, PolarVolume_t* pvol, double dBlim, const char* quantity, double threshold, double maxelev, int reprocess)
+{
+  BeamBlockageVolume vol;
+  PolarNavigator_t** navigators = NULL;
+  int* locks = NULL;
+  int* cached = NULL;
+  int* phicached = NULL;
+  RaveField_t* existing = NULL;
+  PolarScan_t* farthest = NULL;
+  int nscans = 0, ncomputed = 0, samesite = 1, i = 0, n = 0;
+  int result = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  memset(&vol, 0, sizeof(vol));
+
+  if (pvol == NULL) {
+    RAVE_ERROR0("Trying to process NULL volume");
+    return 0;
+  }
+
+  nscans = PolarVolume_getNumberOfScans(pvol);
+  if (nscans <= 0) {
+    return 1;
+  }
+
+  vol.scans = RAVE_MALLOC(sizeof(PolarScan_t*) * nscans);
+  vol.fields = RAVE_MALLOC(sizeof(RaveField_t*) * nscans);
+  vol.deferred = RAVE_MALLOC(sizeof(int) * nscans);
+  vol.status = RAVE_MALLOC(sizeof(int) * nscans);
+  navigators = RAVE_MALLOC(sizeof(PolarNavigator_t*) * nscans);
+  locks = RAVE_MALLOC(sizeof(int) * nscans);
+  cached = RAVE_MALLOC(sizeof(int) * nscans);
+  phicached = RAVE_MALLOC(sizeof(int) * nscans);
+  if (self->cachephi && self->cachedir != NULL) {
+    vol.phi = RAVE_MALLOC(sizeof(RaveField_t*) * nscans);
+  }
+  if (vol.scans == NULL || vol.fields == NULL || vol.deferred == NULL || vol.status == NULL ||
+      navigators == NULL || locks == NULL || cached == NULL || phicached == NULL ||
+      (self->cachephi && self->cachedir != NULL && vol.phi == NULL)) {
+    RAVE_ERROR0("Failed to allocate memory for volume processing");
+    goto done;
+  }
+  memset(vol.scans, 0, sizeof(PolarScan_t*) * nscans);
+  memset(vol.fields, 0, sizeof(RaveField_t*) * nscans);
+  memset(vol.deferred, 0, sizeof(int) * nscans);
+  memset(vol.status, 0, sizeof(int) * nscans);
+  memset(navigators, 0, sizeof(PolarNavigator_t*) * nscans);
+  memset(cached, 0, sizeof(int) * nscans);
+  memset(phicached, 0, sizeof(int) * nscans);
+  if (vol.phi != NULL) {
+    memset(vol.phi, 0, sizeof(RaveField_t*) * nscans);
+  }
+  for (i = 0; i < nscans; i++) {
+    locks[i] = -1;
+  }
+
+  vol.self = self;
+  vol.dBlim = dBlim;
+  vol.quantity = quantity;
+  vol.threshold = threshold;
+  vol.mapper = RAVE_OBJECT_CLONE(self->mapper);
+  if (vol.mapper == NULL) {
+    goto done;
+  }
+  BeamBlockageMap_setThreads(vol.mapper, 1); /* The scans are processed concurrently instead */
+
+  /* Select the scans to process. Everything that touches reference counts or the HDF5 cache,
+   * including the cached blocking elevation angles, is done here and after the concurrent part. The scans in a volume usually share their
+   * navigator, so each scan gets its own copy while the scans are processed. */
+  for (i = 0; i < nscans; i++) {
+    PolarScan_t* scan = PolarVolume_getScan(pvol, i);
+    PolarNavigator_t* navigator = NULL;
+    if (scan == NULL) {
+      continue;
+    }
+    if (PolarScan_getElangle(scan) >= maxelev ||
+        (quantity != NULL && !PolarScan_hasParameter(scan, quantity))) {
+      RAVE_OBJECT_RELEASE(scan);
+      continue;
+    }
+    if (!reprocess) {
+      existing = PolarScan_findQualityFieldByHowTask(scan, "se.smhi.detector.beamblockage");
+      if (existing != NULL) {
+        RAVE_OBJECT_RELEASE(existing);
+        RAVE_OBJECT_RELEASE(scan);
+        continue;
+      }
+    }
+
+    if (!BeamBlockageInternal_detachNavigator(scan, &navigator)) {
+      RAVE_OBJECT_RELEASE(scan);
+      goto done;
+    }
+    navigators[n] = navigator;
+    vol.scans[n] = scan;
+
+    if (self->rewritecache == 0) {
+      vol.fields[n] = BeamBlockageInternal_getCachedFile(self, scan, dBlim);
+      cached[n] = (vol.fields[n] != NULL);
+    }
+    if (vol.fields[n] == NULL) {
+      /* Fields that another process is computing are waited for when our own locks have been
+       * released, taking one lock at a time so that two processes can't wait for each other */
+      locks[n] = BeamBlockageInternal_lockCacheFile(self, scan, dBlim, 0);
+      vol.deferred[n] = (locks[n] == BEAMBLOCKAGE_LOCK_BUSY);
+    }
+    if (vol.fields[n] == NULL && !vol.deferred[n]) {
+      if (farthest != NULL && (PolarScan_getLatitude(scan) != PolarScan_getLatitude(farthest) ||
+                               PolarScan_getLongitude(scan) != PolarScan_getLongitude(farthest))) {
+        samesite = 0;
+      }
+      if (farthest == NULL || PolarScan_getMaxDistance(scan) > PolarScan_getMaxDistance(farthest)) {
+        farthest = scan;
+      }
+      if (vol.phi != NULL) {
+        vol.phi[n] = BeamBlockageInternal_getCachedPhi(self, scan);
+        phicached[n] = (vol.phi[n] != NULL);
+      }
+      ncomputed++;
+    }
+    n++;
+  }
+
+  /* All scans from the same site are covered by the topography of the farthest reaching scan */
+  if (ncomputed > 1 && samesite) {
+    vol.region = BeamBlockageMap_readTopographyForScan(vol.mapper, farthest);
+  }
+
+  BBThreads_run(self->nthreads, n, BeamBlockageInternal_volumeBlockageWorker, &vol);
+
+  for (i = 0; i < n; i++) {
+    if (vol.status[i] && !cached[i] && !vol.deferred[i] &&
+        !BeamBlockageInternal_writeCachedFile(self, vol.scans[i], vol.fields[i], dBlim)) {
+      RAVE_ERROR0("Failed to generate cache file");
+    }
+    if (vol.status[i] && vol.phi != NULL && vol.phi[i] != NULL && !phicached[i] &&
+        !BeamBlockageInternal_writeCachedPhi(self, vol.scans[i], vol.phi[i])) {
+      RAVE_WARNING0("Failed to write blocking elevation angles to the cache");
+    }
+    BeamBlockageInternal_unlockCacheFile(locks[i]);
+    locks[i] = -1;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (vol.deferred[i]) {
+      int lock = BeamBlockageInternal_lockCacheFile(self, vol.scans[i], dBlim, 1);
+      if (self->rewritecache == 0) {
+        vol.fields[i] = BeamBlockageInternal_getCachedFile(self, vol.scans[i], dBlim);
+      }
+      if (vol.fields[i] == NULL) {
+        /* The region only covers the scans that were computed above */
+        vol.fields[i] = BeamBlockageInternal_computeBlockageUsingPhiCache(self, vol.mapper, vol.scans[i], dBlim, self->nthreads);
+        if (vol.fields[i] != NULL && !BeamBlockageInternal_writeCachedFile(self, vol.scans[i], vol.fields[i], dBlim)) {
+          RAVE_ERROR0("Failed to generate cache file");
+        }
+      }
+      BeamBlockageInternal_unlockCacheFile(lock);
+      vol.status[i] = (vol.fields[i] != NULL);
+    }
+  }
+
+  if (quantity != NULL) {
+    BBThreads_run(self->nthreads, n, BeamBlockageInternal_volumeRestoreWorker, &vol);
+  }
+
+  result = 1;
+  for (i = 0; i < n; i++) {
+    if (vol.status[i]) {
+      if (!PolarScan_addOrReplaceQualityField(vol.scans[i], vol.fields[i])) {
+        RAVE_ERROR0("Failed to add blockage field to scan");
+        result = 0;
+      }
+    } else {
+      result = 0;
+    }
+  }
+
+done:
+  for (i = 0; i < n; i++) {
+    BeamBlockageInternal_unlockCacheFile(locks[i]);
+    if (navigators[i] != NULL) {
+      PolarScan_setNavigator(vol.scans[i], navigators[i]);
+    }
+    RAVE_OBJECT_RELEASE(navigators[i]);
+    RAVE_OBJECT_RELEASE(vol.fields[i]);
+    RAVE_OBJECT_RELEASE(vol.scans[i]);
+    if (vol.phi != NULL) {
+      RAVE_OBJECT_RELEASE(vol.phi[i]);
+    }
+  }
+  RAVE_OBJECT_RELEASE(vol.region);
+  RAVE_OBJECT_RELEASE(vol.mapper);
+  RAVE_FREE(vol.scans);
+  RAVE_FREE(vol.fields);
+  RAVE_FREE(vol.deferred);
+  RAVE_FREE(vol.status);
+  RAVE_FREE(navigators);
+  RAVE_FREE(locks);
+  RAVE_FREE(cached);
+  RAVE_FREE(phicached);
+  RAVE_FREE(vol.phi);
+  return result;
+}
+
+int BeamBlockage_precompute(BeamBlockage_t* self, RaveObjectList_t* scans, double dBlim, BeamBlockageProgressFunction progress, void* data)
+{
+  BeamBlockagePrecompute pre;
+  PolarNavigator_t** navigators = NULL;
+  int nscans = 0, i = 0;
+  int result = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  if (scans == NULL) {
+    RAVE_ERROR0("Trying to precompute NULL list");
+    return 0;
+  }
+  if (self->cachedir == NULL) {
+    RAVE_ERROR0("Precomputing the blockage requires a cache directory");
+    return 0;
+  }
+
+  memset(&pre, 0, sizeof(pre));
+  pthread_mutex_init(&pre.lock, NULL);
+
+  nscans = RaveObjectList_size(scans);
+  if (nscans <= 0) {
+    result = 1;
+    goto done;
+  }
+
+  pre.scans = RAVE_MALLOC(sizeof(PolarScan_t*) * nscans);
+  navigators = RAVE_MALLOC(sizeof(PolarNavigator_t*) * nscans);
+  if (pre.scans == NULL || navigators == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for precomputing");
+    goto done;
+  }
+  memset(pre.scans, 0, sizeof(PolarScan_t*) * nscans);
+  memset(navigators, 0, sizeof(PolarNavigator_t*) * nscans);
+
+  pre.self = self;
+  pre.dBlim = dBlim;
+  pre.progress = progress;
+  pre.data = data;
+  pre.mapper = RAVE_OBJECT_CLONE(self->mapper);
+  if (pre.mapper == NULL) {
+    goto done;
+  }
+  BeamBlockageMap_setThreads(pre.mapper, 1); /* The scans are processed concurrently instead */
+
+  /* Reference counts are not thread safe so everything that touches them is done here */
+  for (i = 0; i < nscans; i++) {
+    RaveCoreObject* obj = RaveObjectList_get(scans, i);
+    if (obj == NULL || !RAVE_OBJECT_CHECK_TYPE(obj, &PolarScan_TYPE)) {
+      RAVE_ERROR1("Item %d in the list is not a polar scan", i);
+      RAVE_OBJECT_RELEASE(obj);
+      goto done;
+    }
+    pre.scans[i] = (PolarScan_t*)obj;
+    if (!BeamBlockageInternal_detachNavigator(pre.scans[i], &navigators[i])) {
+      goto done;
+    }
+  }
+  pre.nscans = nscans;
+
+  BBThreads_run(self->nthreads, nscans, BeamBlockageInternal_precomputeWorker, &pre);
+
+  result = (pre.nfailed == 0);
+done:
+  for (i = 0; i < nscans && pre.scans != NULL && navigators != NULL; i++) {
+    if (navigators[i] != NULL) {
+      PolarScan_setNavigator(pre.scans[i], navigators[i]);
+    }
+    RAVE_OBJECT_RELEASE(navigators[i]);
+    RAVE_OBJECT_RELEASE(pre.scans[i]);
+  }
+  RAVE_OBJECT_RELEASE(pre.mapper);
+  RAVE_FREE(pre.scans);
+  RAVE_FREE(navigators);
+  pthread_mutex_destroy(&pre.lock);
+  return result;
+}
+
 /*@} End of Interface functions */
 
 RaveCoreObjectType BeamBlockage_TYPE = {
@@ -29,17 +29,90 @@ along with beamb.  If not, see <http://www.gnu.org/licenses/>.
 #include "rave_object.h"
 #include "rave_field.h"
 #include "polarscan.h"
+#include "polarvolume.h"
+#include "raveobject_list.h"
+#include "beamblockagemap.h"
 
 /**
  * Defines a beam blockage object
  */
 typedef struct _BeamBlockage_t BeamBlockage_t;
 
+/**
+ * The file formats that can be used for the cache files
+ */
+typedef enum BeamBlockageCacheFormat {
+  BeamBlockageCacheFormat_HDF5 = 0,  /**< ODIM HDF5 file, (default) */
+  BeamBlockageCacheFormat_BINARY = 1, /**< fixed header followed by the raw values, see bbcachefile.h */
+  BeamBlockageCacheFormat_STORE = 2   /**< all fields in one indexed file in the cache directory, see bbcachestore.h */
+} BeamBlockageCacheFormat;
+
 /**
  * Type definition to use when creating a rave object.
  */
 extern RaveCoreObjectType BeamBlockage_TYPE;
 
+/**
+ * The outcome of precomputing the blockage for one scan
+ */
+typedef enum BeamBlockagePrecomputeStatus {
+  BeamBlockagePrecompute_FAILED = 0,   /**< the blockage could not be calculated */
+  BeamBlockagePrecompute_COMPUTED = 1, /**< the blockage was calculated and written to the cache */
+  BeamBlockagePrecompute_CACHED = 2    /**< the blockage was already in the cache */
+} BeamBlockagePrecomputeStatus;
+
+/**
+ * Called by \ref BeamBlockage_precompute each time a scan has been processed. The calls are
+ * serialized but made from the threads that process the scans.
+ * @param[in] data - the user data provided to \ref BeamBlockage_precompute
+ * @param[in] index - the index of the scan in the list
+ * @param[in] ndone - number of scans processed so far
+ * @param[in] total - total number of scans
+ * @param[in] status - the outcome for the scan
+ * @param[in] seconds - the time it took to process the scan
+ */
+typedef void (*BeamBlockageProgressFunction)(void* data, int index, int ndone, int total, BeamBlockagePrecomputeStatus status, double seconds);
+
+/**
+ * Called before a cache file is read or written with HDF5, see \ref BeamBlockage_setHdf5LockFunctions.
+ * @param[in] data - the user data provided to \ref BeamBlockage_setHdf5LockFunctions
+ * @return a token that is passed to the unlock function
+ */
+typedef void* (*BeamBlockageHdf5LockFunction)(void* data);
+
+/**
+ * Called after a cache file has been read or written with HDF5, see \ref BeamBlockage_setHdf5LockFunctions.
+ * @param[in] data - the user data provided to \ref BeamBlockage_setHdf5LockFunctions
+ * @param[in] token - the token returned by the lock function
+ */
+typedef void (*BeamBlockageHdf5UnlockFunction)(void* data, void* token);
+
+/**
+ * Usage of the cache. The entries and bytes describe the cache directory, the
+ * other values are totals for the process.
+ */
+typedef struct BeamBlockageCacheStatistics {
+  long entries;        /**< number of cached fields */
+  long long bytes;     /**< size of the cached fields */
+  long hits;           /**< number of fields read from the cache */
+  long misses;         /**< number of fields that had to be calculated when a cache was used */
+  long computed;       /**< number of calculated fields */
+  double computetime;  /**< total time in seconds spent calculating fields */
+  long evicted;        /**< number of cache files removed by the cache cleaning */
+} BeamBlockageCacheStatistics;
+
+/**
+ * Tolerances of the cache key. The geometry of a scan is rounded to multiples of the
+ * tolerances so that scans with nearly the same geometry share the cached field. A tolerance
+ * of 0 means that the value is used as is.
+ */
+typedef struct BeamBlockageCacheTolerance {
+  double position;  /**< longitude and latitude (degrees) */
+  double height;    /**< radar height (meters) */
+  double angle;     /**< elevation angle and beamwidth (degrees) */
+  double range;     /**< bin length and range to the first bin (meters) */
+} BeamBlockageCacheTolerance;
+
 /**
  * Sets the topo30 directory.
  * @param[in] self - self
@@ -55,9 +128,19 @@ int BeamBlockage_setTopo30Directory(BeamBlockage_t* self, const char* topodirect
  */
 const char* BeamBlockage_getTopo30Directory(BeamBlockage_t* self);
 
+/**
+ * Returns the identity of the topography in the topo30 directory, see \ref BeamBlockageMap_getTopographyId.
+ * It is part of the cache key so that fields calculated from another topography are not used.
+ * @param[in] self - self
+ * @return the identity, a 32 bit value
+ */
+unsigned long BeamBlockage_getTopographyId(BeamBlockage_t* self);
+
 /**
  * Sets the cache directory. Default is the value specified in the
  * internal config.h file. If set to NULL, then caching is disabled.
+ * The cached fields are keyed on the scan geometry, the dB limit, the identity of the topography
+ * and how the topography is mapped against the scan (horizon, sampling and overview levels).
  * @param[in] self - self
  * @param[in] cachedir - the cache directory
  * @return 1 on success otherwise 0
@@ -87,6 +170,226 @@ void BeamBlockage_setRewriteCache(BeamBlockage_t* self, int recreateCache);
  */
 int BeamBlockage_getRewriteCache(BeamBlockage_t* self);
 
+/**
+ * Sets the format of the cache files. The binary format is memory mapped when read and
+ * needs no HDF5 parsing and the store keeps all fields in a single file. Fields cached in one
+ * format are not used when another format is selected.
+ * @param[in] self - self
+ * @param[in] format - the cache format
+ * @return 1 on success or 0 if format is not a known format
+ */
+int BeamBlockage_setCacheFormat(BeamBlockage_t* self, BeamBlockageCacheFormat format);
+
+/**
+ * Returns the format of the cache files.
+ * @param[in] self - self
+ * @return the cache format (default BeamBlockageCacheFormat_HDF5)
+ */
+BeamBlockageCacheFormat BeamBlockage_getCacheFormat(BeamBlockage_t* self);
+
+/**
+ * Removes the superseded fields from the cache. Only the store format keeps superseded
+ * fields, for the other formats nothing is done.
+ * @param[in] self - self
+ * @return 1 on success otherwise 0
+ */
+int BeamBlockage_compactCache(BeamBlockage_t* self);
+
+/**
+ * Sets the max size of the cache files in the cache directory. When a new cache file has been
+ * written and the size is exceeded, the least recently used files are removed. The store format
+ * is not affected, see \ref BeamBlockage_compactCache.
+ * @param[in] self - self
+ * @param[in] maxsize - max number of bytes, 0 means no limit (default 0)
+ */
+void BeamBlockage_setCacheMaxSize(BeamBlockage_t* self, long long maxsize);
+
+/**
+ * Returns the max size of the cache files in the cache directory.
+ * @param[in] self - self
+ * @return max number of bytes, 0 means no limit
+ */
+long long BeamBlockage_getCacheMaxSize(BeamBlockage_t* self);
+
+/**
+ * Sets the max age of the cache files. Files that haven't been used for this long are removed
+ * when the cache is cleaned. The store format is not affected.
+ * @param[in] self - self
+ * @param[in] maxage - max number of seconds since the file was used, 0 means no limit (default 0)
+ */
+void BeamBlockage_setCacheMaxAge(BeamBlockage_t* self, long maxage);
+
+/**
+ * Returns the max age of the cache files.
+ * @param[in] self - self
+ * @return max number of seconds, 0 means no limit
+ */
+long BeamBlockage_getCacheMaxAge(BeamBlockage_t* self);
+
+/**
+ * Sets the tolerances of the cache key. When any tolerance is set the cache files are named from
+ * the quantized geometry (with a q prefix) and the exact geometry that the field was calculated for
+ * is kept in the entry and checked when the field is read. Fields cached with exact keys are not
+ * used with tolerances and vice versa.
+ * @param[in] self - self
+ * @param[in] tolerance - the tolerances, NULL or all 0 means exact keys (default)
+ * @return 1 on success or 0 if any tolerance is negative
+ */
+int BeamBlockage_setCacheTolerance(BeamBlockage_t* self, const BeamBlockageCacheTolerance* tolerance);
+
+/**
+ * Returns the tolerances of the cache key.
+ * @param[in] self - self
+ * @param[out] tolerance - the tolerances
+ */
+void BeamBlockage_getCacheTolerance(BeamBlockage_t* self, BeamBlockageCacheTolerance* tolerance);
+
+/**
+ * Sets if the blocking elevation angles should be cached. The angles only depend on the
+ * ground geometry of the scan, so when they are cached the blockage for another dB limit or
+ * beamwidth is derived from them without reading the topography. The result is identical to a
+ * full calculation. Only used when a cache directory is set. The angles are stored as HDF5
+ * files named phi_lon_lat_height_elangle_nrays_nbins_rscale_rstart_mapping_topography.h5, where
+ * mapping describes how the topography is mapped against the scan and topography is the
+ * identity of the topography, see \ref BeamBlockage_getTopographyId.
+ * @param[in] self - self
+ * @param[in] cachephi - 1 if the angles should be cached, otherwise 0 (default 0)
+ */
+void BeamBlockage_setCachePhi(BeamBlockage_t* self, int cachephi);
+
+/**
+ * Returns if the blocking elevation angles are cached.
+ * @param[in] self - self
+ * @return 1 if the angles are cached otherwise 0
+ */
+int BeamBlockage_getCachePhi(BeamBlockage_t* self);
+
+/**
+ * Removes cache files until the cache directory is within the max size and max age. The least
+ * recently used files are removed first and files that are being written are left. The cache is
+ * also cleaned automatically after new cache files have been written, at most once a minute.
+ * @param[in] self - self
+ * @return the number of removed files
+ */
+long BeamBlockage_cleanCache(BeamBlockage_t* self);
+
+/**
+ * Returns the usage of the cache.
+ * @param[in] self - self
+ * @param[out] stats - the statistics
+ * @return 1 on success otherwise 0
+ */
+int BeamBlockage_getCacheStatistics(BeamBlockage_t* self, BeamBlockageCacheStatistics* stats);
+
+/**
+ * Resets the process wide hit, miss, computed and evicted counters.
+ */
+void BeamBlockage_resetCacheStatistics(void);
+
+/**
+ * Sets the number of threads that are used when calculating the blockage. The rays are
+ * split between the threads and the result is the same regardless of number of threads.
+ * (Default 1)
+ * @param[in] self - self
+ * @param[in] nthreads - the number of threads, values < 1 are treated as 1
+ */
+void BeamBlockage_setThreads(BeamBlockage_t* self, int nthreads);
+
+/**
+ * Returns the number of threads that are used when calculating the blockage.
+ * @param[in] self - self
+ * @return the number of threads
+ */
+int BeamBlockage_getThreads(BeamBlockage_t* self);
+
+/**
+ * Sets if the topography should be taken from the horizon profile of the radar site, see
+ * \ref BeamBlockageMap_setHorizon. The terrain along each azimuth is then only sampled once
+ * for all scans from the site, at the cost of bins close to a topography cell border sometimes
+ * getting the height of the neighbouring cell. Since the result is approximate, the horizon setting
+ * is part of the cache key and fields calculated this way never replace exact fields in the cache.
+ *
+ * The horizon profile takes precedence over the sampling, which in turn takes precedence over the
+ * overview levels: with horizon set, \ref BeamBlockage_setSampling and \ref BeamBlockage_setLevels
+ * have no effect, and with MEAN or MAX sampling the levels have no effect. Only the settings that
+ * take effect are part of the cache key. (Default 0)
+ * @param[in] self - self
+ * @param[in] horizon - 1 if the horizon profile should be used, otherwise 0
+ */
+void BeamBlockage_setHorizon(BeamBlockage_t* self, int horizon);
+
+/**
+ * Returns if the topography is taken from the horizon profile of the radar site.
+ * @param[in] self - self
+ * @return 1 if the horizon profile is used, otherwise 0
+ */
+int BeamBlockage_getHorizon(BeamBlockage_t* self);
+
+/**
+ * Sets the number of overview levels created for the topography, see \ref BeamBlockageMap_setLevels.
+ * Far bins will then get the mean height of the cells within their footprint instead of the
+ * height of a single cell, which matters most for topographies with a finer resolution than GTOPO30.
+ * The levels are ignored when the horizon profile or MEAN or MAX sampling is used and are part
+ * of the cache key when they take effect, see \ref BeamBlockage_setHorizon. (Default 0)
+ * @param[in] self - self
+ * @param[in] levels - the number of overview levels, 0 to only use the topography itself
+ */
+void BeamBlockage_setLevels(BeamBlockage_t* self, int levels);
+
+/**
+ * Returns the number of overview levels created for the topography.
+ * @param[in] self - self
+ * @return the number of overview levels
+ */
+int BeamBlockage_getLevels(BeamBlockage_t* self);
+
+/**
+ * Sets how the topography within the footprint of each bin is sampled, see \ref BeamBlockageMap_setSampling.
+ * With MAX, a single high cell within the footprint blocks the whole bin, which gives a more
+ * conservative blockage than NEAREST. The sampling is ignored when the horizon profile is used,
+ * see \ref BeamBlockage_setHorizon. (Default NEAREST)
+ * @param[in] self - self
+ * @param[in] sampling - the sampling
+ * @return 1 on success, 0 if the sampling is unknown
+ */
+int BeamBlockage_setSampling(BeamBlockage_t* self, BeamBlockageMapSampling sampling);
+
+/**
+ * Returns how the topography within the footprint of each bin is sampled.
+ * @param[in] self - self
+ * @return the sampling
+ */
+BeamBlockageMapSampling BeamBlockage_getSampling(BeamBlockage_t* self);
+
+/**
+ * Sets if the topography is compressed in memory, see \ref BeamBlockageMap_setCompressed. This
+ * lowers the memory used for topography when many sites are processed in the same process. (Default 0)
+ * @param[in] self - self
+ * @param[in] compressed - 1 if the topography should be compressed, otherwise 0
+ */
+void BeamBlockage_setCompressed(BeamBlockage_t* self, int compressed);
+
+/**
+ * Returns if the topography is compressed in memory.
+ * @param[in] self - self
+ * @return 1 if compressed, otherwise 0
+ */
+int BeamBlockage_getCompressed(BeamBlockage_t* self);
+
+/**
+ * Sets if the topography regions are stored in blocks in memory, see \ref BeamBlockageMap_setBlockLayout. (Default 0)
+ * @param[in] self - self
+ * @param[in] blocklayout - 1 if the regions should be stored in blocks, otherwise 0
+ */
+void BeamBlockage_setBlockLayout(BeamBlockage_t* self, int blocklayout);
+
+/**
+ * Returns if the topography regions are stored in blocks in memory.
+ * @param[in] self - self
+ * @return 1 if stored in blocks, otherwise 0
+ */
+int BeamBlockage_getBlockLayout(BeamBlockage_t* self);
+
 /**
  * Gets the blockage for the provided scan.
  * @param[in] self - self
@@ -107,4 +410,49 @@ RaveField_t* BeamBlockage_getBlockage(BeamBlockage_t* self, PolarScan_t* scan, d
  */
 int BeamBlockage_restore(PolarScan_t* scan, RaveField_t* blockage, const char* quantity, double threshold);
 
+/**
+ * Calculates the blockage for the scans in a volume and attaches the blockage fields to the
+ * scans as quality fields. The scans are processed concurrently using the number of threads
+ * set with \ref BeamBlockage_setThreads and scans from the same site share the topography.
+ * The cache is used in the same way as by \ref BeamBlockage_getBlockage. The cache files, including
+ * the cached blocking elevation angles, are only read and written by the calling thread.
+ * @param[in] self - self
+ * @param[in] pvol - the volume, the scans are modified in place
+ * @param[in] dBlim - Limit of Gaussian approximation of main lobe
+ * @param[in] quantity - the parameter to be restored. If NULL, no scans are restored and scans are
+ * processed regardless of which parameters they have, otherwise only scans with this parameter are processed.
+ * @param[in] threshold - the percentage threshold used when restoring
+ * @param[in] maxelev - only scans with an elevation angle below this value (in radians) are processed
+ * @param[in] reprocess - if 0, scans that already have a beam blockage quality field are left as they are
+ * @return 1 if all processed scans got a blockage field (and were restored), otherwise 0
+ */
+int BeamBlockage_processVolume(BeamBlockage_t* self, PolarVolume_t* pvol, double dBlim, const char* quantity, double threshold, double maxelev, int reprocess);
+
+/**
+ * Fills the cache with the blockage for a list of scans, e.g. the scan strategies of all radars
+ * in a network. Only the geometry of the scans is used. The scans are processed concurrently using
+ * the number of threads set with \ref BeamBlockage_setThreads, fields that already are cached are
+ * only recalculated if the cache is rewritten. Each thread reads and writes the cache files of its
+ * own scans, so the HDF5 lock functions are called from all threads, see \ref BeamBlockage_setHdf5LockFunctions.
+ * @param[in] self - self, must have a cache directory
+ * @param[in] scans - list of PolarScan_t
+ * @param[in] dBlim - Limit of Gaussian approximation of main lobe
+ * @param[in] progress - called each time a scan has been processed, may be NULL
+ * @param[in] data - user data to the progress function
+ * @return 1 if the blockage for all scans is in the cache, otherwise 0
+ */
+int BeamBlockage_precompute(BeamBlockage_t* self, RaveObjectList_t* scans, double dBlim, BeamBlockageProgressFunction progress, void* data);
+
+/**
+ * Sets functions that are called around each HDF5 read and write of a cache file. HDF5 is not
+ * necessarily built thread safe, and the internal lock only serializes the HDF5 calls made by
+ * beamb, so an application that uses HDF5 from other threads must make beamb take the same
+ * lock as those threads, e.g. the Python GIL. The functions are process wide and the lock
+ * function is called before the internal lock is taken. They should be set before the cache is used.
+ * @param[in] lock - the lock function, NULL to only use the internal lock
+ * @param[in] unlock - the unlock function, NULL to only use the internal lock
+ * @param[in] data - user data to the functions
+ */
+void BeamBlockage_setHdf5LockFunctions(BeamBlockageHdf5LockFunction lock, BeamBlockageHdf5UnlockFunction unlock, void* data);
+
 #endif /* BEAMBLOCKAGE_H */
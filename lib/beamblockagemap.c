@@ -23,6 +23,10 @@ along with beamb.  If not, see <http://www.gnu.org/licenses/>.
  * @date 2011-11-14
  */
 #include "beamblockagemap.h"
+#include "bbtopographycache.h"
+#include "bbgeometrycache.h"
+#include "bbhorizoncache.h"
+#include "bbthreads.h"
 #include "rave_debug.h"
 #include "rave_alloc.h"
 #include "math.h"
@@ -30,9 +34,22 @@ along with beamb.  If not, see <http://www.gnu.org/licenses/>.
 #include "rave_field.h"
 #include "polarnav.h"
 #include <stdio.h>
+#include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/stat.h>
 #include "config.h"
 
+/**
+ * Nominal extent of a topography tile in degrees.
+ */
+typedef struct _BeamBlockageMapTile {
+  char name[64];    /**< the tile name (without suffix) */
+  double west;      /**< western boundary */
+  double north;     /**< northern boundary */
+  double east;      /**< eastern boundary */
+  double south;     /**< southern boundary */
+} BeamBlockageMapTile;
+
 /**
  * Represents the beam blockage algorithm
  */
@@ -40,8 +57,75 @@ struct _BeamBlockageMap_t {
   RAVE_OBJECT_HEAD /** Always on top */
   char* topodir;   /**< the topo30 directory */
   PolarNavigator_t* navigator; /**< the navigator */
+  int nthreads;    /**< number of threads used when mapping the topography against a scan */
+  int horizon;     /**< if the topography should be taken from the horizon profile of the site */
+  int levels;      /**< number of overview levels created for the topography regions */
+  BeamBlockageMapSampling sampling; /**< how the topography within the footprint of a bin is sampled */
+  int compressed;  /**< if the tiles and topography regions should be compressed in memory */
+  int blocklayout; /**< if the topography regions should be stored in blocks in memory */
+  BeamBlockageMapTile* tiles; /**< the tile index, ordered by southern boundary */
+  int ntiles;      /**< number of tiles in the tile index */
+  int* gridstart;  /**< first entry in gridtiles for each cell in the tile grid, see \ref BeamBlockageMapInternal_createTileGrid */
+  int* gridtiles;  /**< the indices of the tiles that overlap each cell in the tile grid */
+  unsigned long topographyid; /**< identifies the tiles, see \ref BeamBlockageMapInternal_createTopographyId */
+};
+
+/**
+ * The GTOPO30 tiles, used when the topography directory does not have a tile manifest.
+ */
+static const BeamBlockageMapTile BEAMBLOCKAGEMAP_TILES[] = {
+  {"W180N90", -180.0, 90.0, -140.0, 40.0},
+  {"W140N90", -140.0, 90.0, -100.0, 40.0},
+  {"W100N90", -100.0, 90.0, -60.0, 40.0},
+  {"W060N90", -60.0, 90.0, -20.0, 40.0},
+  {"W020N90", -20.0, 90.0, 20.0, 40.0},
+  {"E020N90", 20.0, 90.0, 60.0, 40.0},
+  {"E060N90", 60.0, 90.0, 100.0, 40.0},
+  {"E100N90", 100.0, 90.0, 140.0, 40.0},
+  {"E140N90", 140.0, 90.0, 180.0, 40.0},
+  {"W180N40", -180.0, 40.0, -140.0, -10.0},
+  {"W140N40", -140.0, 40.0, -100.0, -10.0},
+  {"W100N40", -100.0, 40.0, -60.0, -10.0},
+  {"W060N40", -60.0, 40.0, -20.0, -10.0},
+  {"W020N40", -20.0, 40.0, 20.0, -10.0},
+  {"E020N40", 20.0, 40.0, 60.0, -10.0},
+  {"E060N40", 60.0, 40.0, 100.0, -10.0},
+  {"E100N40", 100.0, 40.0, 140.0, -10.0},
+  {"E140N40", 140.0, 40.0, 180.0, -10.0},
+  {"W180S10", -180.0, -10.0, -140.0, -60.0},
+  {"W140S10", -140.0, -10.0, -100.0, -60.0},
+  {"W100S10", -100.0, -10.0, -60.0, -60.0},
+  {"W060S10", -60.0, -10.0, -20.0, -60.0},
+  {"W020S10", -20.0, -10.0, 20.0, -60.0},
+  {"E020S10", 20.0, -10.0, 60.0, -60.0},
+  {"E060S10", 60.0, -10.0, 100.0, -60.0},
+  {"E100S10", 100.0, -10.0, 140.0, -60.0},
+  {"E140S10", 140.0, -10.0, 180.0, -60.0},
+  {"W180S60", -180.0, -60.0, -120.0, -90.0},
+  {"W120S60", -120.0, -60.0, -60.0, -90.0},
+  {"W060S60", -60.0, -60.0, 0.0, -90.0},
+  {"W000S60", 0.0, -60.0, 60.0, -90.0},
+  {"E060S60", 60.0, -60.0, 120.0, -90.0},
+  {"E120S60", 120.0, -60.0, 180.0, -90.0}
 };
 
+/**
+ * Number of tiles in \ref BEAMBLOCKAGEMAP_TILES
+ */
+#define BEAMBLOCKAGEMAP_NTILES (sizeof(BEAMBLOCKAGEMAP_TILES)/sizeof(BEAMBLOCKAGEMAP_TILES[0]))
+
+/**
+ * Name of the tile manifest in the topography directory. Each line contains the name of a tile
+ * (without suffix) followed by its western, northern, eastern and southern boundary in degrees.
+ * Empty lines and lines starting with # are ignored.
+ */
+#define BEAMBLOCKAGEMAP_MANIFEST "beamb_tiles.txt"
+
+/**
+ * Number of cells that always are added around a region when reading a region
+ */
+#define BEAMBLOCKAGEMAP_REGION_MARGIN 2
+
 /**
  * Converts a radian to a degree
  */
@@ -52,6 +136,26 @@ struct _BeamBlockageMap_t {
  */
 #define DEG2RAD(deg) (deg*M_PI/180.0)
 
+/**
+ * Size in degrees of the cells in the tile grid, see \ref BeamBlockageMapInternal_createTileGrid
+ */
+#define BEAMBLOCKAGEMAP_GRID_STEP 5.0
+
+/**
+ * Number of rows in the tile grid
+ */
+#define BEAMBLOCKAGEMAP_GRID_NROWS 36
+
+/**
+ * Number of columns in the tile grid
+ */
+#define BEAMBLOCKAGEMAP_GRID_NCOLS 72
+
+/**
+ * Number of cells in the tile grid
+ */
+#define BEAMBLOCKAGEMAP_GRID_NCELLS (BEAMBLOCKAGEMAP_GRID_NROWS * BEAMBLOCKAGEMAP_GRID_NCOLS)
+
 /*@{ Private functions */
 /**
  * Constructor.
@@ -61,15 +165,37 @@ static int BeamBlockageMap_constructor(RaveCoreObject* obj)
   BeamBlockageMap_t* self = (BeamBlockageMap_t*)obj;
   self->topodir = NULL;
   self->navigator = RAVE_OBJECT_NEW(&PolarNavigator_TYPE);
-
-  if (self->navigator == NULL || !BeamBlockageMap_setTopo30Directory(self, BEAMB_GTOPO30_DIR)) {
+  self->nthreads = 1;
+  self->horizon = 0;
+  self->levels = 0;
+  self->sampling = BeamBlockageMapSampling_NEAREST;
+  self->compressed = 0;
+  self->blocklayout = 0;
+  self->tiles = NULL;
+  self->ntiles = 0;
+  self->gridstart = NULL;
+  self->gridtiles = NULL;
+  self->topographyid = 0;
+
+  if (self->navigator == NULL) {
     goto error;
   }
+  if (!BeamBlockageMap_setTopo30Directory(self, BEAMB_GTOPO30_DIR)) {
+    /* Keep an empty tile index so that another topo30 directory still can be set */
+    RAVE_WARNING1("Failed to create the tile index for %s, no tiles until another topo30 directory is set", BEAMB_GTOPO30_DIR);
+    self->topodir = RAVE_STRDUP(BEAMB_GTOPO30_DIR);
+    if (self->topodir == NULL) {
+      goto error;
+    }
+  }
 
   return 1;
 error:
   RAVE_OBJECT_RELEASE(self->navigator);
   RAVE_FREE(self->topodir);
+  RAVE_FREE(self->tiles);
+  RAVE_FREE(self->gridstart);
+  RAVE_FREE(self->gridtiles);
   return 0;
 }
 
@@ -81,6 +207,9 @@ static void BeamBlockageMap_destructor(RaveCoreObject* obj)
 {
   BeamBlockageMap_t* self = (BeamBlockageMap_t*)obj;
   RAVE_FREE(self->topodir);
+  RAVE_FREE(self->tiles);
+  RAVE_FREE(self->gridstart);
+  RAVE_FREE(self->gridtiles);
   RAVE_OBJECT_RELEASE(self->navigator);
 }
 
@@ -93,24 +222,352 @@ static int BeamBlockageMap_copyconstructor(RaveCoreObject* obj, RaveCoreObject*
   BeamBlockageMap_t* src = (BeamBlockageMap_t*)srcobj;
   this->topodir = NULL;
   this->navigator = RAVE_OBJECT_CLONE(src->navigator);
-  if (!BeamBlockageMap_setTopo30Directory(this, BeamBlockageMap_getTopo30Directory(src)) ||
-      this->navigator == NULL) {
+  this->nthreads = src->nthreads;
+  this->horizon = src->horizon;
+  this->levels = src->levels;
+  this->sampling = src->sampling;
+  this->compressed = src->compressed;
+  this->blocklayout = src->blocklayout;
+  this->tiles = NULL;
+  this->ntiles = src->ntiles;
+  this->gridstart = NULL;
+  this->gridtiles = NULL;
+  this->topographyid = src->topographyid;
+  if (src->topodir != NULL && (this->topodir = RAVE_STRDUP(src->topodir)) == NULL) {
+    goto error;
+  }
+  if (src->ntiles > 0) {
+    /* The tile index is copied so that the manifest isn't read again */
+    this->tiles = RAVE_MALLOC(sizeof(BeamBlockageMapTile) * src->ntiles);
+    if (this->tiles == NULL) {
+      goto error;
+    }
+    memcpy(this->tiles, src->tiles, sizeof(BeamBlockageMapTile) * src->ntiles);
+  }
+  if (src->gridstart != NULL) {
+    int nentries = src->gridstart[BEAMBLOCKAGEMAP_GRID_NCELLS];
+    this->gridstart = RAVE_MALLOC(sizeof(int) * (BEAMBLOCKAGEMAP_GRID_NCELLS + 1));
+    this->gridtiles = RAVE_MALLOC(sizeof(int) * (nentries + 1));
+    if (this->gridstart == NULL || this->gridtiles == NULL) {
+      goto error;
+    }
+    memcpy(this->gridstart, src->gridstart, sizeof(int) * (BEAMBLOCKAGEMAP_GRID_NCELLS + 1));
+    memcpy(this->gridtiles, src->gridtiles, sizeof(int) * nentries);
+  }
+  if (this->navigator == NULL) {
     goto error;
   }
   return 1;
 error:
   RAVE_FREE(this->topodir);
+  RAVE_FREE(this->tiles);
+  RAVE_FREE(this->gridstart);
+  RAVE_FREE(this->gridtiles);
   RAVE_OBJECT_RELEASE(this->navigator);
   return 0;
 }
 
+/**
+ * Orders tiles by their southern boundary.
+ */
+static int BeamBlockageMapInternal_compareSouth(const void* a, const void* b)
+{
+  const BeamBlockageMapTile* ta = (const BeamBlockageMapTile*)a;
+  const BeamBlockageMapTile* tb = (const BeamBlockageMapTile*)b;
+  if (ta->south != tb->south) {
+    return (ta->south < tb->south) ? -1 : 1;
+  }
+  return (ta->west < tb->west) ? -1 : (ta->west > tb->west) ? 1 : 0;
+}
+
+/**
+ * Orders pointers to tiles from north to south and west to east.
+ */
+static int BeamBlockageMapInternal_compareNorthWest(const void* a, const void* b)
+{
+  const BeamBlockageMapTile* ta = *(const BeamBlockageMapTile* const*)a;
+  const BeamBlockageMapTile* tb = *(const BeamBlockageMapTile* const*)b;
+  if (ta->north != tb->north) {
+    return (ta->north > tb->north) ? -1 : 1;
+  }
+  return (ta->west < tb->west) ? -1 : (ta->west > tb->west) ? 1 : 0;
+}
+
+/**
+ * Reads the tile manifest, see \ref BEAMBLOCKAGEMAP_MANIFEST.
+ * @param[in] filename - the manifest
+ * @param[out] ntiles - the number of tiles
+ * @return the tiles on success otherwise NULL
+ */
+static BeamBlockageMapTile* BeamBlockageMapInternal_readManifest(const char* filename, int* ntiles)
+{
+  BeamBlockageMapTile *tiles = NULL, *result = NULL;
+  FILE* fp = NULL;
+  char line[1024];
+  int n = 0, nalloc = 0, lineno = 0;
+
+  *ntiles = 0;
+
+  fp = fopen(filename, "r");
+  if (fp == NULL) {
+    RAVE_ERROR1("Failed to open %s for reading", filename);
+    goto done;
+  }
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    BeamBlockageMapTile tile;
+    char token[64];
+    lineno++;
+    if (sscanf(line, "%63s", token) != 1 || token[0] == '#') {
+      continue;
+    }
+    memset(&tile, 0, sizeof(tile));
+    if (sscanf(line, "%63s %lf %lf %lf %lf", tile.name, &tile.west, &tile.north, &tile.east, &tile.south) != 5 ||
+        tile.north <= tile.south || tile.east <= tile.west) {
+      RAVE_ERROR2("Invalid tile on line %d in %s", lineno, filename);
+      goto done;
+    }
+    if (n == nalloc) {
+      BeamBlockageMapTile* tmp = RAVE_REALLOC(tiles, sizeof(BeamBlockageMapTile) * (nalloc + 64));
+      if (tmp == NULL) {
+        RAVE_ERROR0("Failed to allocate memory for tile index");
+        goto done;
+      }
+      tiles = tmp;
+      nalloc += 64;
+    }
+    tiles[n++] = tile;
+  }
+
+  if (n == 0) {
+    RAVE_ERROR1("No tiles in %s", filename);
+    goto done;
+  }
+
+  *ntiles = n;
+  result = tiles;
+  tiles = NULL;
+done:
+  if (fp != NULL) {
+    fclose(fp);
+  }
+  RAVE_FREE(tiles);
+  return result;
+}
+
+/**
+ * Creates the tile index for a topography directory. The tiles are read from the manifest in
+ * the directory if there is one, otherwise the GTOPO30 tiles are used.
+ * @param[in] topodir - the topography directory, may be NULL
+ * @param[out] ntiles - the number of tiles
+ * @return the tiles ordered by southern boundary on success otherwise NULL
+ */
+static BeamBlockageMapTile* BeamBlockageMapInternal_createTileIndex(const char* topodir, int* ntiles)
+{
+  BeamBlockageMapTile* tiles = NULL;
+  char fname[1024];
+
+  *ntiles = 0;
+
+  if (topodir != NULL) {
+    snprintf(fname, sizeof(fname), "%s/%s", topodir, BEAMBLOCKAGEMAP_MANIFEST);
+  }
+  if (topodir != NULL && access(fname, F_OK) == 0) {
+    tiles = BeamBlockageMapInternal_readManifest(fname, ntiles);
+  } else {
+    tiles = RAVE_MALLOC(sizeof(BEAMBLOCKAGEMAP_TILES));
+    if (tiles == NULL) {
+      RAVE_ERROR0("Failed to allocate memory for tile index");
+    } else {
+      memcpy(tiles, BEAMBLOCKAGEMAP_TILES, sizeof(BEAMBLOCKAGEMAP_TILES));
+      *ntiles = BEAMBLOCKAGEMAP_NTILES;
+    }
+  }
+
+  if (tiles != NULL) {
+    qsort(tiles, *ntiles, sizeof(BeamBlockageMapTile), BeamBlockageMapInternal_compareSouth);
+  }
+  return tiles;
+}
+
+/**
+ * Returns the range of tile grid cells that an extent covers along one axis.
+ * @param[in] low - the lower boundary (degrees)
+ * @param[in] high - the upper boundary (degrees)
+ * @param[in] origin - the boundary of the first cell (degrees)
+ * @param[in] ncells - the number of cells along the axis
+ * @param[in] wrap - if the axis wraps around, otherwise the range is clamped to the grid
+ * @param[out] first - the first cell, may be negative or beyond ncells if wrap is set
+ * @param[out] last - the last cell, last - first is less than ncells
+ */
+static void BeamBlockageMapInternal_gridRange(double low, double high, double origin, int ncells, int wrap, int* first, int* last)
+{
+  *first = (int)floor((low - origin) / BEAMBLOCKAGEMAP_GRID_STEP);
+  *last = (int)ceil((high - origin) / BEAMBLOCKAGEMAP_GRID_STEP) - 1;
+  if (*last < *first) {
+    *last = *first;
+  }
+  if (wrap) {
+    if (*last - *first >= ncells) {
+      *last = *first + ncells - 1;
+    }
+  } else {
+    *first = (*first < 0) ? 0 : (*first >= ncells) ? ncells - 1 : *first;
+    *last = (*last < 0) ? 0 : (*last >= ncells) ? ncells - 1 : *last;
+  }
+}
+
+/**
+ * Returns the index of a cell in the tile grid.
+ * @param[in] row - the row, counted from the south
+ * @param[in] col - the column, counted from longitude -180 and wrapped around
+ * @return the cell index
+ */
+static int BeamBlockageMapInternal_gridCell(int row, int col)
+{
+  col %= BEAMBLOCKAGEMAP_GRID_NCOLS;
+  if (col < 0) {
+    col += BEAMBLOCKAGEMAP_GRID_NCOLS;
+  }
+  return row * BEAMBLOCKAGEMAP_GRID_NCOLS + col;
+}
+
+/**
+ * Creates the tile grid, a global grid of BEAMBLOCKAGEMAP_GRID_STEP degree cells where each cell
+ * lists the tiles that overlap it. The tiles of cell c are gridtiles[gridstart[c]] up to
+ * gridtiles[gridstart[c + 1]].
+ * @param[in] tiles - the tile index
+ * @param[in] ntiles - the number of tiles
+ * @param[out] gridstart - the first entry of each cell, BEAMBLOCKAGEMAP_GRID_NCELLS + 1 entries
+ * @param[out] gridtiles - the tile indices
+ * @return 1 on success otherwise 0
+ */
+static int BeamBlockageMapInternal_createTileGrid(const BeamBlockageMapTile* tiles, int ntiles, int** gridstart, int** gridtiles)
+{
+  int *start = NULL, *entries = NULL;
+  int i = 0, r = 0, c = 0, pass = 0, result = 0;
+
+  *gridstart = NULL;
+  *gridtiles = NULL;
+
+  start = RAVE_MALLOC(sizeof(int) * (BEAMBLOCKAGEMAP_GRID_NCELLS + 1));
+  if (start == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for tile grid");
+    goto done;
+  }
+  memset(start, 0, sizeof(int) * (BEAMBLOCKAGEMAP_GRID_NCELLS + 1));
+
+  /* The first pass counts the tiles in each cell and the second fills in the tile indices */
+  for (pass = 0; pass < 2; pass++) {
+    for (i = 0; i < ntiles; i++) {
+      int r0, r1, c0, c1;
+      BeamBlockageMapInternal_gridRange(tiles[i].south, tiles[i].north, -90.0, BEAMBLOCKAGEMAP_GRID_NROWS, 0, &r0, &r1);
+      BeamBlockageMapInternal_gridRange(tiles[i].west, tiles[i].east, -180.0, BEAMBLOCKAGEMAP_GRID_NCOLS, 1, &c0, &c1);
+      for (r = r0; r <= r1; r++) {
+        for (c = c0; c <= c1; c++) {
+          int cell = BeamBlockageMapInternal_gridCell(r, c);
+          if (pass == 0) {
+            start[cell + 1]++;
+          } else {
+            entries[start[cell]++] = i;
+          }
+        }
+      }
+    }
+    if (pass == 0) {
+      for (i = 0; i < BEAMBLOCKAGEMAP_GRID_NCELLS; i++) {
+        start[i + 1] += start[i];
+      }
+      entries = RAVE_MALLOC(sizeof(int) * (start[BEAMBLOCKAGEMAP_GRID_NCELLS] + 1));
+      if (entries == NULL) {
+        RAVE_ERROR0("Failed to allocate memory for tile grid");
+        goto done;
+      }
+    }
+  }
+
+  /* Filling in the indices moved each start to the start of the next cell */
+  for (i = BEAMBLOCKAGEMAP_GRID_NCELLS; i > 0; i--) {
+    start[i] = start[i - 1];
+  }
+  start[0] = 0;
+
+  *gridstart = start;
+  *gridtiles = entries;
+  start = NULL;
+  entries = NULL;
+  result = 1;
+done:
+  RAVE_FREE(start);
+  RAVE_FREE(entries);
+  return result;
+}
+
+/**
+ * Adds bytes to a FNV-1a hash.
+ * @param[in] hash - the hash so far
+ * @param[in] data - the bytes
+ * @param[in] len - number of bytes
+ * @return the new hash
+ */
+static unsigned long BeamBlockageMapInternal_hash(unsigned long hash, const void* data, size_t len)
+{
+  const unsigned char* p = (const unsigned char*)data;
+  size_t i = 0;
+  for (i = 0; i < len; i++) {
+    hash = ((hash ^ p[i]) * 16777619UL) & 0xffffffffUL;
+  }
+  return hash;
+}
+
+/**
+ * Creates the identity of the topography in a directory. It is a 32 bit hash of the tile index and
+ * the size and modification time of each tile's .HDR and .DEM file, so it changes when a tile is
+ * replaced but not when the same files are accessed through another path.
+ * @param[in] topodir - the topography directory, may be NULL
+ * @param[in] tiles - the tile index
+ * @param[in] ntiles - the number of tiles
+ * @return the identity
+ */
+static unsigned long BeamBlockageMapInternal_createTopographyId(const char* topodir, const BeamBlockageMapTile* tiles, int ntiles)
+{
+  static const char* suffixes[] = {"HDR", "DEM"};
+  unsigned long hash = 2166136261UL;
+  char fname[1024];
+  int i = 0, j = 0;
+
+  for (i = 0; i < ntiles; i++) {
+    double bounds[4] = {tiles[i].west, tiles[i].north, tiles[i].east, tiles[i].south};
+    hash = BeamBlockageMapInternal_hash(hash, tiles[i].name, strlen(tiles[i].name) + 1);
+    hash = BeamBlockageMapInternal_hash(hash, bounds, sizeof(bounds));
+    for (j = 0; j < 2; j++) {
+      struct stat st;
+      long long fileinfo[2] = {-1, -1};
+      if (topodir != NULL) {
+        snprintf(fname, sizeof(fname), "%s/%s.%s", topodir, tiles[i].name, suffixes[j]);
+      } else {
+        snprintf(fname, sizeof(fname), "%s.%s", tiles[i].name, suffixes[j]);
+      }
+      if (stat(fname, &st) == 0) {
+        fileinfo[0] = (long long)st.st_size;
+        fileinfo[1] = (long long)st.st_mtime;
+      }
+      hash = BeamBlockageMapInternal_hash(hash, fileinfo, sizeof(fileinfo));
+    }
+  }
+  return hash;
+}
+
 /**
  * Reads the gropo30 header file and populates the BBTopography instance with header information.
+ * The data field is not allocated, that is done by \ref BeamBlockageMapInternal_fillData.
  * @param[in] self - self
  * @param[in] filename - the gtopo file
- * @param[in] info - the structure
+ * @param[out] ncols - the number of columns in the data file
+ * @param[out] nrows - the number of rows in the data file
+ * @return the topography skeleton on success otherwise NULL
  */
-static BBTopography_t* BeamBlockageMapInternal_readHeader(BeamBlockageMap_t* self, const char* filename)
+static BBTopography_t* BeamBlockageMapInternal_readHeader(BeamBlockageMap_t* self, const char* filename, long* ncols, long* nrows)
 {
   /* Declaration of variables */
   char fname[1024];
@@ -119,10 +576,14 @@ static BBTopography_t* BeamBlockageMapInternal_readHeader(BeamBlockageMap_t* sel
   double f;
   FILE* fp = NULL;
   BBTopography_t *result = NULL, *field = NULL;
-  long ncols = 0, nrows = 0;
   int nbits = 0;
 
   RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((ncols != NULL), "ncols == NULL");
+  RAVE_ASSERT((nrows != NULL), "nrows == NULL");
+
+  *ncols = 0;
+  *nrows = 0;
 
   if (filename == NULL) {
     goto done;
@@ -148,9 +609,9 @@ static BBTopography_t* BeamBlockageMapInternal_readHeader(BeamBlockageMap_t* sel
   while (fgets(line, sizeof(line), fp) > 0) {
     if (sscanf(line, "%s %lf", token, &f) == 2) {
       if (strcmp(token, "NROWS") == 0) {
-        nrows = (long)f;
+        *nrows = (long)f;
       } else if (strcmp(token, "NCOLS") == 0) {
-        ncols = (long)f;
+        *ncols = (long)f;
       } else if (strcmp(token, "NBITS") == 0) {
         nbits = (int)f;
       } else if (strcmp(token, "ULXMAP") == 0) {
@@ -170,15 +631,11 @@ static BBTopography_t* BeamBlockageMapInternal_readHeader(BeamBlockageMap_t* sel
     goto done;
   }
 
-  if (nrows == 0 || ncols == 0) {
+  if (*nrows == 0 || *ncols == 0) {
     RAVE_ERROR0("NROWS / NCOLS must not be 0");
     goto done;
   }
 
-  if (!BBTopography_createData(field, ncols, nrows, RaveDataType_SHORT)) {
-    goto done;
-  }
-
   result = RAVE_OBJECT_COPY(field);
 done:
   RAVE_OBJECT_RELEASE(field);
@@ -191,20 +648,22 @@ done:
 /**
  * Fills the data in the topography field. The topography field should first have been created
  * with a call to \ref BeamBlockageMapInternal_readHeader in order to get correct dimensions
- * etc.
+ * etc. The .DEM file is mapped read-only into the field if possible, otherwise the file will be
+ * read into memory.
  * @param[in] self - self
  * @param[in] filename - the filename (exluding suffix and directory name)
  * @param[in] field - the gtopo30 topography skeleton.
+ * @param[in] ncols - the number of columns in the file
+ * @param[in] nrows - the number of rows in the file
  * @returns 1 on success otherwise 0
  */
-static int BeamBlockageMapInternal_fillData(BeamBlockageMap_t* self, const char* filename, BBTopography_t* field)
+static int BeamBlockageMapInternal_fillData(BeamBlockageMap_t* self, const char* filename, BBTopography_t* field, long ncols, long nrows)
 {
   int result = 0;
   FILE *fp = NULL;
   char fname[1024];
-  short *tmp = NULL;
-  long col, row;
-  long nrows = 0, ncols = 0;
+  short *data = NULL;
+  long i = 0;
   long nitems = 0;
 
   RAVE_ASSERT((self != NULL), "self == NULL");
@@ -214,40 +673,37 @@ static int BeamBlockageMapInternal_fillData(BeamBlockageMap_t* self, const char*
     goto done;
   }
 
-  if (BBTopography_getDataType(field) != RaveDataType_SHORT) {
-    RAVE_ERROR0("Only supports reading of short data");
-    goto done;
-  }
-
   if (self->topodir != NULL) {
     sprintf(fname, "%s/%s.DEM", self->topodir, filename);
   } else {
     sprintf(fname, "%s.DEM", filename);
   }
 
+  if (BBTopography_mapFile(field, fname, ncols, nrows)) {
+    result = 1;
+    goto done;
+  }
+  RAVE_WARNING1("Could not map %s, reading it into memory instead", fname);
+
   fp = fopen(fname, "rb");
   if (fp == NULL) {
     goto done;
   }
 
-  nrows = BBTopography_getNrows(field);
-  ncols = BBTopography_getNcols(field);
-  nitems = nrows * ncols;
-  tmp = RAVE_MALLOC(sizeof(short)*nitems);
-  if (tmp == NULL) {
+  if (!BBTopography_createData(field, ncols, nrows, RaveDataType_SHORT)) {
     RAVE_ERROR0("Failed to allocate memory for data");
     goto done;
   }
 
-  if (fread(tmp, sizeof(short), nitems, fp) != nitems) {
-    RAVE_WARNING0("Could not read correct number of items");
+  nitems = nrows * ncols;
+  data = (short*)BBTopography_getData(field);
+  if (data == NULL || fread(data, sizeof(short), (size_t)nitems, fp) != (size_t)nitems) {
+    RAVE_ERROR1("Could not read correct number of items from %s", fname);
+    goto done;
   }
 
-  for (col = 0; col < ncols; col++) {
-    for (row = 0; row < nrows; row++) {
-      short temp = ntohs(tmp[row*ncols + col]);
-      BBTopography_setValue(field, col, row, temp);
-    }
+  for (i = 0; i < nitems; i++) {
+    data[i] = (short)ntohs((unsigned short)data[i]);
   }
 
   result = 1;
@@ -255,13 +711,13 @@ done:
   if (fp != NULL) {
     fclose(fp);
   }
-  RAVE_FREE(tmp);
   return result;
 }
 
 /**
  * Reads the topography with the specified filename. The directory path should not be used, instead
- * the topo30dir variable will be used.
+ * the topo30dir variable will be used. Tiles are shared with other instances through the
+ * topography cache, see \ref BBTopographyCache_get.
  * @param[in] self - self
  * @param[in] filename - the gtopo30 filename (excluding suffix)
  * @returns the topography on success otherwise NULL
@@ -269,18 +725,37 @@ done:
 static BBTopography_t* BeamBlockageMapInternal_readTopography(BeamBlockageMap_t* self, const char* filename)
 {
   BBTopography_t *result = NULL, *field = NULL;
+  long ncols = 0, nrows = 0;
+  char fname[1024];
 
   RAVE_ASSERT((self != NULL), "self == NULL");
 
   if (filename != NULL) {
-    field = BeamBlockageMapInternal_readHeader(self, filename);
-    if (field != NULL) {
-      if (!BeamBlockageMapInternal_fillData(self, filename, field)) {
+    if (self->topodir != NULL) {
+      snprintf(fname, sizeof(fname), "%s/%s.DEM", self->topodir, filename);
+    } else {
+      snprintf(fname, sizeof(fname), "%s.DEM", filename);
+    }
+    field = BBTopographyCache_get(fname);
+    if (field == NULL) {
+      field = BeamBlockageMapInternal_readHeader(self, filename, &ncols, &nrows);
+      if (field != NULL) {
+        if (!BeamBlockageMapInternal_fillData(self, filename, field, ncols, nrows) ||
+            (self->compressed && !BBTopography_compress(field))) {
+          goto done;
+        }
+        BBTopographyCache_put(fname, field);
+      }
+    } else if (self->compressed && !BBTopography_isCompressed(field)) {
+      /* Cached by someone that did not compress it, replace it with the compressed tile */
+      if (!BBTopography_compress(field)) {
         goto done;
       }
+      BBTopographyCache_put(fname, field);
     }
   }
 
+
   result = RAVE_OBJECT_COPY(field);
 done:
   RAVE_OBJECT_RELEASE(field);
@@ -288,476 +763,1011 @@ done:
 }
 
 /**
- * Creates a topography that is mapped against a specific scan.
- * @param[in] self - self
- * @param[in] topo - the overall topography that hopefully covers the scan
- * @param[in] scan - the scan that should get the topography mapped
- * @return the mapped topography on success otherwise NULL
+ * Value in the cell index table for bins that can't be navigated
  */
-static BBTopography_t* BeamBlockageMapInternal_createMappedTopography(BeamBlockageMap_t* self, BBTopography_t* topo, PolarScan_t* scan)
-{
-  BBTopography_t *field = NULL, *result = NULL;
-  long nrays = 0, nbins = 0;
-  long ri = 0, bi = 0;
+#define BEAMBLOCKAGEMAP_NO_POSITION BBGEOMETRYCACHE_NO_POSITION
 
-  RAVE_ASSERT((self != NULL), "self == NULL");
-  RAVE_ASSERT((topo != NULL), "topo == NULL");
-  RAVE_ASSERT((scan != NULL), "scan == NULL");
+/**
+ * Value in the cell index table for bins that are outside the topography
+ */
+#define BEAMBLOCKAGEMAP_OUTSIDE BBGEOMETRYCACHE_OUTSIDE
 
-  nrays = PolarScan_getNrays(scan);
-  nbins = PolarScan_getNbins(scan);
+/**
+ * Sample step used when validating the separable navigation, every n:th ray and bin is checked
+ */
+#define BEAMBLOCKAGEMAP_VALIDATION_SAMPLES 16
 
-  field = RAVE_OBJECT_NEW(&BBTopography_TYPE);
-  if (field == NULL) {
-    goto done;
-  }
-  if (!BBTopography_createData(field, nbins, nrays, BBTopography_getDataType(topo))) {
-    RAVE_ERROR0("Failed to create data field");
-    goto done;
-  }
+/**
+ * Maximum allowed difference in cells between the separable navigation and the scan navigation
+ */
+#define BEAMBLOCKAGEMAP_VALIDATION_TOLERANCE 0.01
 
-  for (ri = 0; ri < nrays; ri++) {
-    for (bi = 0; bi < nbins; bi++) {
+/**
+ * Number of horizon profile samples per topography cell
+ */
+#define BEAMBLOCKAGEMAP_HORIZON_SAMPLING 4
+
+/**
+ * The data shared by the threads that map the topography against a scan. Each thread
+ * processes a range of rays.
+ */
+typedef struct _BeamBlockageMapWork {
+  BBTopography_t* topo;  /**< the topography */
+  short* data;           /**< the data of the mapped topography, nrays * nbins */
+  PolarScan_t* scan;     /**< the scan */
+  long nbins;            /**< number of bins in the scan */
+  long ncols;            /**< number of columns in the topography */
+  double lon0;           /**< radar longitude */
+  double sinlat0;        /**< sine of the radar latitude */
+  double* sindist;       /**< sine of the angular distance of each bin */
+  double* cosdist;       /**< cosine of the angular distance of each bin */
+  double* raysin;        /**< sine of the azimuth of each ray times cosine of the radar latitude */
+  double* raycos;        /**< cosine of the azimuth of each ray times cosine of the radar latitude */
+  int* indices;          /**< the cell indices */
+  double coslat0;        /**< cosine of the radar latitude */
+  double* dist;          /**< angular surface distance of each bin */
+  double* azimuth;       /**< azimuth of each ray */
+  double step;           /**< angular distance between two horizon samples */
+  long nsamples;         /**< number of horizon samples along each ray */
+  double* heights;       /**< the horizon profile, nrays * nsamples */
+  int* binlevels;        /**< the overview level used for each bin, NULL if only the topography itself is used */
+  BeamBlockageMapSampling sampling; /**< how the footprint of each bin is sampled */
+  long* halfcols;        /**< half the footprint width of each bin in columns, used unless sampling is nearest */
+  long* halfrows;        /**< half the footprint height of each bin in rows, used unless sampling is nearest */
+} BeamBlockageMapWork;
+
+/**
+ * Navigates each bin in the rays [start, end) through the scan, see \ref BeamBlockageMapInternal_createCellIndices.
+ * @param[in] arg - the \ref BeamBlockageMapWork
+ * @param[in] thread - the thread index
+ * @param[in] start - first ray
+ * @param[in] end - one past the last ray
+ */
+static void BeamBlockageMapInternal_cellIndicesWorker(void* arg, int thread, long start, long end)
+{
+  BeamBlockageMapWork* work = (BeamBlockageMapWork*)arg;
+  long ri = 0, bi = 0, ci = 0, rowi = 0;
+
+  for (ri = start; ri < end; ri++) {
+    for (bi = 0; bi < work->nbins; bi++) {
       double lonval = 0.0, latval = 0.0;
-      if (PolarScan_getLonLatFromIndex(scan, bi, ri, &lonval, &latval)) {
-        double v = 0.0;
-        BBTopography_getValueAtLonLat(topo, lonval, latval, &v);
-        /* According to original code, no values < 0 are allowed */
-        if (v < 0.0) {
-          BBTopography_setValue(field, bi, ri, 0.0);
+      int idx = BEAMBLOCKAGEMAP_NO_POSITION;
+      if (PolarScan_getLonLatFromIndex(work->scan, bi, ri, &lonval, &latval)) {
+        if (BBTopography_getIndexAtLonLat(work->topo, lonval, latval, &ci, &rowi)) {
+          idx = (int)(rowi * work->ncols + ci);
         } else {
-          BBTopography_setValue(field, bi, ri, v);
+          idx = BEAMBLOCKAGEMAP_OUTSIDE;
         }
       }
+      work->indices[ri * work->nbins + bi] = idx;
     }
   }
+}
 
-  result = RAVE_OBJECT_COPY(field);
-done:
-  RAVE_OBJECT_RELEASE(field);
-  return result;
+/**
+ * Positions the bins in the rays [start, end) from the precalculated navigation factors,
+ * see \ref BeamBlockageMapInternal_createSeparableCellIndices.
+ * @param[in] arg - the \ref BeamBlockageMapWork
+ * @param[in] thread - the thread index
+ * @param[in] start - first ray
+ * @param[in] end - one past the last ray
+ */
+static void BeamBlockageMapInternal_separableCellIndicesWorker(void* arg, int thread, long start, long end)
+{
+  BeamBlockageMapWork* work = (BeamBlockageMapWork*)arg;
+  long ri = 0, bi = 0, ci = 0, rowi = 0;
+
+  for (ri = start; ri < end; ri++) {
+    for (bi = 0; bi < work->nbins; bi++) {
+      double z = work->sinlat0*work->cosdist[bi] + work->sindist[bi]*work->raycos[ri];
+      double lat = asin(z);
+      double lon = work->lon0 + atan2(work->sindist[bi]*work->raysin[ri], work->cosdist[bi] - work->sinlat0*z);
+      if (BBTopography_getIndexAtLonLat(work->topo, lon, lat, &ci, &rowi)) {
+        work->indices[ri * work->nbins + bi] = (int)(rowi * work->ncols + ci);
+      } else {
+        work->indices[ri * work->nbins + bi] = BEAMBLOCKAGEMAP_OUTSIDE;
+      }
+    }
+  }
 }
 
+/**
+ * Fills the rays [start, end) of the mapped topography with the topography values of
+ * the cell indices, see \ref BeamBlockageMapInternal_createMappedTopography.
+ * @param[in] arg - the \ref BeamBlockageMapWork
+ * @param[in] thread - the thread index
+ * @param[in] start - first ray
+ * @param[in] end - one past the last ray
+ */
+static void BeamBlockageMapInternal_mapTopographyWorker(void* arg, int thread, long start, long end)
+{
+  BeamBlockageMapWork* work = (BeamBlockageMapWork*)arg;
+  double nodata = BBTopography_getNodata(work->topo);
+  long ri = 0, bi = 0;
+
+  for (ri = start; ri < end; ri++) {
+    for (bi = 0; bi < work->nbins; bi++) {
+      int idx = work->indices[ri * work->nbins + bi];
+      if (idx != BEAMBLOCKAGEMAP_NO_POSITION) {
+        double v = nodata;
+        if (idx != BEAMBLOCKAGEMAP_OUTSIDE) {
+          long col = idx % work->ncols, row = idx / work->ncols;
+          int ok = 0;
+          if (work->sampling == BeamBlockageMapSampling_MEAN) {
+            ok = BBTopography_getFootprintMean(work->topo, col - work->halfcols[bi], row - work->halfrows[bi],
+                                               col + work->halfcols[bi], row + work->halfrows[bi], &v);
+            v = floor(v + 0.5);
+          } else if (work->sampling == BeamBlockageMapSampling_MAX) {
+            ok = BBTopography_getFootprintMax(work->topo, col - work->halfcols[bi], row - work->halfrows[bi],
+                                              col + work->halfcols[bi], row + work->halfrows[bi], &v);
+          } else {
+            int level = (work->binlevels != NULL) ? work->binlevels[bi] : 0;
+            ok = BBTopography_getLevelValue(work->topo, level, col >> level, row >> level, &v);
+          }
+          if (!ok) {
+            v = nodata;
+          }
+        }
+        /* According to original code, no values < 0 are allowed */
+        work->data[ri * work->nbins + bi] = (short)((v < 0.0) ? 0.0 : v);
+      }
+    }
+  }
+}
 
 /**
- * Read the actual tiles and concatenate them if required.
- * @param[in] tnames - comma-separated string (no spaces) containing the names of GTOPO30 tiles.
- * If there are two aligned vertically, then the order is: "north,south".
- * If there are two aligned horizontally, then the order is: "west,east".
- * If there are four, then the order is: "nw,ne,sw,se".
- * @param[in] orient - concatenation orientation, when relevant: "v" or "h", otherwise NULL
- * @returns flag corresponding to topography field made
- */
-BBTopography_t* BeamBlockageMapInternal_makeTopographyField(BeamBlockageMap_t* self, const char* tnames, const char* orient)
-{
-	BBTopography_t *field = NULL, *result = NULL;
-	const char* delim = ",";
-	char* saveptr;
-	int i, n;
-
-	/* Determine number of substrings */
-	for (i=0, n=1; tnames[i]; i++)
-		n += (tnames[i] == ',');
-
-	/* Single tile */
-	if (n == 1) {
-		if ((field = BeamBlockageMapInternal_readTopography(self, tnames)) == NULL) {
-			goto done;
-		}
-	}
-
-	/* Two tiles */
-	else if (n == 2) {
-		char* s = RAVE_STRDUP(tnames);
-		char* one = strtok_r(s, delim, &saveptr);
-		char* two = strtok_r(NULL, delim, &saveptr);
-	    BBTopography_t *field1 = BeamBlockageMapInternal_readTopography(self, (const char*)one);
-	    BBTopography_t *field2 = BeamBlockageMapInternal_readTopography(self, (const char*)two);
-	    if (field1 != NULL && field2 != NULL) {
-			if (strcmp(orient, "h")==0) {
-				field = BBTopography_concatX(field1, field2);
-			} else if (strcmp(orient,"v")==0) {
-				field = BBTopography_concatY(field1, field2);
-			}
-	    }
-	    RAVE_FREE(s);
-	    RAVE_OBJECT_RELEASE(field1);
-	    RAVE_OBJECT_RELEASE(field2);
-	}
-
-	/* Four tiles */
-	else if (n == 4) {
-		char* s = RAVE_STRDUP(tnames);
-		char* one = strtok_r(s, delim, &saveptr);
-		char* two = strtok_r(NULL, delim, &saveptr);
-		char* tre = strtok_r(NULL, delim, &saveptr);
-		char* fyr = strtok_r(NULL, delim, &saveptr);
-	    BBTopography_t *field1 = BeamBlockageMapInternal_readTopography(self, (const char*)one);
-	    BBTopography_t *field2 = BeamBlockageMapInternal_readTopography(self, (const char*)two);
-	    BBTopography_t *field3 = BeamBlockageMapInternal_readTopography(self, (const char*)tre);
-	    BBTopography_t *field4 = BeamBlockageMapInternal_readTopography(self, (const char*)fyr);
-	    if (field1 != NULL && field2 != NULL && field3 != NULL && field4 != NULL) {
-	        BBTopography_t *field5 = BBTopography_concatX(field1, field2);
-	        BBTopography_t *field6 = BBTopography_concatX(field3, field4);
-	        field = BBTopography_concatY(field5, field6);
-	        RAVE_OBJECT_RELEASE(field5);
-	        RAVE_OBJECT_RELEASE(field6);
-	    }
-	    RAVE_FREE(s);
-	    RAVE_OBJECT_RELEASE(field1);
-	    RAVE_OBJECT_RELEASE(field2);
-	    RAVE_OBJECT_RELEASE(field3);
-	    RAVE_OBJECT_RELEASE(field4);
-	}
-
-	result = RAVE_OBJECT_COPY(field);
-done:
-	RAVE_OBJECT_RELEASE(field);
-	return result;
+ * Samples the topography along the rays [start, end) of the horizon profile, see
+ * \ref BeamBlockageMapInternal_createHorizonTopography.
+ * @param[in] arg - the \ref BeamBlockageMapWork
+ * @param[in] thread - the thread index
+ * @param[in] start - first ray
+ * @param[in] end - one past the last ray
+ */
+static void BeamBlockageMapInternal_horizonWorker(void* arg, int thread, long start, long end)
+{
+  BeamBlockageMapWork* work = (BeamBlockageMapWork*)arg;
+  double nodata = BBTopography_getNodata(work->topo);
+  long ri = 0, k = 0, ci = 0, rowi = 0;
+
+  for (ri = start; ri < end; ri++) {
+    double raysin = sin(work->azimuth[ri])*work->coslat0, raycos = cos(work->azimuth[ri])*work->coslat0;
+    double* heights = work->heights + ri * work->nsamples;
+    for (k = 0; k < work->nsamples; k++) {
+      double h = k * work->step;
+      double z = work->sinlat0*cos(h) + sin(h)*raycos;
+      double lat = asin(z);
+      double lon = work->lon0 + atan2(sin(h)*raysin, cos(h) - work->sinlat0*z);
+      double v = nodata;
+      if (!BBTopography_getIndexAtLonLat(work->topo, lon, lat, &ci, &rowi) ||
+          !BBTopography_getValue(work->topo, ci, rowi, &v)) {
+        v = nodata;
+      }
+      heights[k] = v;
+    }
+  }
 }
 
-/*@} End of Private functions */
+/**
+ * Fills the rays [start, end) of the mapped topography with the horizon profile sample that is
+ * closest to each bin, see \ref BeamBlockageMapInternal_createHorizonTopography.
+ * @param[in] arg - the \ref BeamBlockageMapWork
+ * @param[in] thread - the thread index
+ * @param[in] start - first ray
+ * @param[in] end - one past the last ray
+ */
+static void BeamBlockageMapInternal_horizonMapWorker(void* arg, int thread, long start, long end)
+{
+  BeamBlockageMapWork* work = (BeamBlockageMapWork*)arg;
+  long ri = 0, bi = 0;
 
-/*@{ Interface functions */
+  for (ri = start; ri < end; ri++) {
+    const double* heights = work->heights + ri * work->nsamples;
+    for (bi = 0; bi < work->nbins; bi++) {
+      double v = heights[lround(work->dist[bi] / work->step)];
+      /* According to original code, no values < 0 are allowed */
+      work->data[ri * work->nbins + bi] = (short)((v < 0.0) ? 0.0 : v);
+    }
+  }
+}
 
 /**
- * Find out which maps are needed to cover given area
- * @param[in] lat - latitude of radar in degrees
- * @param[in] lon - longitude of radar in degrees
- * @param[in] d - maximum range of radar in meters
- * @returns flag corresponding to map to be read
+ * Calculates which topography cell each bin in the scan is located in by navigating each bin
+ * through the scan.
+ * @param[in] self - self
+ * @param[in] topo - the topography
+ * @param[in] scan - the scan
+ * @param[out] indices - nrays * nbins indices, see \ref BBGeometryCache_get. Bins that can't be
+ * navigated will get BEAMBLOCKAGEMAP_NO_POSITION and bins outside the topography will get BEAMBLOCKAGEMAP_OUTSIDE.
  */
-BBTopography_t* BeamBlockageMap_readTopography(BeamBlockageMap_t* self, double lat, double lon, double d)
+static void BeamBlockageMapInternal_createCellIndices(BeamBlockageMap_t* self, BBTopography_t* topo, PolarScan_t* scan, int* indices)
 {
-  double lat_e, lon_e, lat_w, lon_w, lat_n, lat_s;
-  double earthRadius = 0.0;
-  BBTopography_t *field = NULL, *result = NULL;
-
-  RAVE_ASSERT((self != NULL), "self == NULL");
-  earthRadius = PolarNavigator_getEarthRadius(self->navigator, lat);
+  BeamBlockageMapWork work;
+  memset(&work, 0, sizeof(work));
+  work.topo = topo;
+  work.scan = scan;
+  work.nbins = PolarScan_getNbins(scan);
+  work.ncols = BBTopography_getNcols(topo);
+  work.indices = indices;
+  BBThreads_run(self->nthreads, PolarScan_getNrays(scan), BeamBlockageMapInternal_cellIndicesWorker, &work);
+}
 
-  /* Find out which map is needed
-     see http://www.movable-type.co.uk/scripts/latlong.html */
-  lat_e = asin(sin(lat) * cos(d/earthRadius) + cos(lat) * sin(d/earthRadius) * cos(M_PI/2.));
-  lon_e = lon + atan2( sin(M_PI/2.) * sin(d/earthRadius) * cos(lat), \
-          cos(d/earthRadius) - sin(lat) * sin(lat_e) );
-  lat_w = asin( sin(lat) * cos(d/earthRadius) + cos(lat) * sin(d/earthRadius) * cos(3.*M_PI/2.) );
-  lon_w = lon + atan2( sin(3.*M_PI/2.) * sin(d/earthRadius) * cos(lat), \
-          cos(d/earthRadius) - sin(lat) * sin(lat_w) );
-  lat_n = asin( sin(lat) * cos(d/earthRadius) + cos(lat) * sin(d/earthRadius) * cos(0.) );
-  lat_s = asin( sin(lat) * cos(d/earthRadius) + cos(lat) * sin(d/earthRadius) * cos(M_PI) );
-
-  lat_e = RAD2DEG(lat_e);  /* For more legible code below */
-  lon_e = RAD2DEG(lon_e);
-  lat_w = RAD2DEG(lat_w);
-  lon_w = RAD2DEG(lon_w);
-  lat_n = RAD2DEG(lat_n);
-  lat_s = RAD2DEG(lat_s);
-
-  /* Some of the following combination are clearly unrealistic from a radar perspective, but ... */
-  /* West to East, North to South */
-  /* Row 1 */
-  if      ( (lat_s >= 40.0) && (lon_w >= -180.0) && (lon_e <= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W180N90", NULL);
-  }
-  else if ( (lat_s >= 40.0) && (lon_w >= -140.0) && (lon_e <= -100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W140N90", NULL);
-  }
-  else if ( (lat_s >= 40.0) && (lon_w >= -100.0) && (lon_e <= -60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W100N90", NULL);
-  }
-  else if ( (lat_s >= 40.0) && (lon_w >= -60.0) && (lon_e <= -20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W060N90", NULL);
-  }
-  else if ( (lat_s >= 40.0) && (lon_w >= -20.0) && (lon_e <= 20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W020N90", NULL);
-  }
-  else if ( (lat_s >= 40.0) && (lon_w >= 20.0) && (lon_e <= 60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E020N90", NULL);
-  }
-  else if ( (lat_s >= 40.0) && (lon_w >= 60.0) && (lon_e <= 100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E060N90", NULL);
-  }
-  else if ( (lat_s >= 40.0) && (lon_w >= 100.0) && (lon_e <= 140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E100N90", NULL);
-  }
-  else if ( (lat_s >= 40.0) && (lon_w >= 140.0) && (lon_e <= 180.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E140N90", NULL);
-  }
-  /* Row 2 */
-  else if ( (lat_s >= -10.0) && (lat_n <= 40.0) && (lon_w >= -180.0) && (lon_e <= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W180N40", NULL);
-  }
-  else if ( (lat_s >= -10.0) && (lat_n <= 40.0) && (lon_w >= -140.0) && (lon_e <= -100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W140N40", NULL);
-  }
-  else if ( (lat_s >= -10.0) && (lat_n <= 40.0) && (lon_w >= -100.0) && (lon_e <= -60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W100N40", NULL);
-  }
-  else if ( (lat_s >= -10.0) && (lat_n <= 40.0) && (lon_w >= -60.0) && (lon_e <= -20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W060N40", NULL);
-  }
-  else if ( (lat_s >= -10.0) && (lat_n <= 40.0) && (lon_w >= -20.0) && (lon_e <= 20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W020N40", NULL);
-  }
-  else if ( (lat_s >= -10.0) && (lat_n <= 40.0) && (lon_w >= 20.0) && (lon_e <= 60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E020N40", NULL);
-  }
-  else if ( (lat_s >= -10.0) && (lat_n <= 40.0) && (lon_w >= 60.0) && (lon_e <= 100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E060N40", NULL);
-  }
-  else if ( (lat_s >= -10.0) && (lat_n <= 40.0) && (lon_w >= 100.0) && (lon_e <= 140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E100N40", NULL);
-  }
-  else if ( (lat_s >= -10.0) && (lat_n <= 40.0) && (lon_w >= 140.0) && (lon_e <= 180.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E140N40", NULL);
+/**
+ * Derives the surface distance of each bin and the azimuth of each ray from the scans own
+ * navigation, using the fact that the position of a bin is given by the azimuth of its ray and
+ * the surface distance of its bin. A sample of the bins is compared with the scans own navigation
+ * and if the difference is more than a fraction of a cell, the scan can't be navigated this way.
+ * @param[in] topo - the topography, used for the tolerance
+ * @param[in] scan - the scan
+ * @param[out] dist - the angular surface distance of each bin (radians)
+ * @param[out] azimuth - the azimuth of each ray (radians)
+ * @return 1 if the scan can be navigated from the distances and azimuths, otherwise 0
+ */
+static int BeamBlockageMapInternal_getSeparableNavigation(BBTopography_t* topo, PolarScan_t* scan, double* dist, double* azimuth)
+{
+  long nrays = PolarScan_getNrays(scan), nbins = PolarScan_getNbins(scan);
+  double lat0 = PolarScan_getLatitude(scan), lon0 = PolarScan_getLongitude(scan);
+  double sinlat0 = sin(lat0), coslat0 = cos(lat0);
+  double xtol = BEAMBLOCKAGEMAP_VALIDATION_TOLERANCE * BBTopography_getXDim(topo);
+  double ytol = BEAMBLOCKAGEMAP_VALIDATION_TOLERANCE * BBTopography_getYDim(topo);
+  long ri = 0, bi = 0, rstep = 0, bstep = 0;
+  double lonval = 0.0, latval = 0.0;
+
+  /* Angular surface distance of each bin, from the first ray */
+  for (bi = 0; bi < nbins; bi++) {
+    double dlon = 0.0, h = 0.0;
+    if (!PolarScan_getLonLatFromIndex(scan, bi, 0, &lonval, &latval)) {
+      return 0;
+    }
+    dlon = lonval - lon0;
+    h = sin((latval - lat0)/2.0)*sin((latval - lat0)/2.0) + coslat0*cos(latval)*sin(dlon/2.0)*sin(dlon/2.0);
+    dist[bi] = 2.0*asin(sqrt((h < 1.0) ? h : 1.0));
   }
-  /* Row 3 */
-  else if ( (lat_s >= -60.0) && (lat_n <= -10.0) && (lon_w >= -180.0) && (lon_e <= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W180S10", NULL);
+
+  /* Azimuth of each ray, from the last bin */
+  for (ri = 0; ri < nrays; ri++) {
+    double dlon = 0.0;
+    if (!PolarScan_getLonLatFromIndex(scan, nbins - 1, ri, &lonval, &latval)) {
+      return 0;
+    }
+    dlon = lonval - lon0;
+    azimuth[ri] = atan2(sin(dlon)*cos(latval), coslat0*sin(latval) - sinlat0*cos(latval)*cos(dlon));
+  }
+
+  /* Verify that the scan navigation is spherical around the radar as assumed */
+  rstep = (nrays > BEAMBLOCKAGEMAP_VALIDATION_SAMPLES) ? nrays / BEAMBLOCKAGEMAP_VALIDATION_SAMPLES : 1;
+  bstep = (nbins > BEAMBLOCKAGEMAP_VALIDATION_SAMPLES) ? nbins / BEAMBLOCKAGEMAP_VALIDATION_SAMPLES : 1;
+  for (ri = 0; ri < nrays; ri += rstep) {
+    for (bi = 0; bi < nbins; bi += bstep) {
+      double z = sinlat0*cos(dist[bi]) + sin(dist[bi])*cos(azimuth[ri])*coslat0;
+      double lat = asin(z);
+      double lon = lon0 + atan2(sin(dist[bi])*sin(azimuth[ri])*coslat0, cos(dist[bi]) - sinlat0*z);
+      if (!PolarScan_getLonLatFromIndex(scan, bi, ri, &lonval, &latval) ||
+          fabs(lat - latval) > ytol || fabs(remainder(lon - lonval, 2.0*M_PI)) > xtol) {
+        RAVE_INFO0("Scan navigation differs from separable navigation, navigating each bin");
+        return 0;
+      }
+    }
   }
-  else if ( (lat_s >= -60.0) && (lat_n <= -10.0) && (lon_w >= -140.0) && (lon_e <= -100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W140S10", NULL);
+
+  return 1;
+}
+
+/**
+ * Calculates the same cell indices as \ref BeamBlockageMapInternal_createCellIndices but positions
+ * all bins on the sphere using the precalculated sine and cosine of the azimuth of each ray and the
+ * distance of each bin, see \ref BeamBlockageMapInternal_getSeparableNavigation.
+ * @param[in] self - self
+ * @param[in] topo - the topography
+ * @param[in] scan - the scan
+ * @param[out] indices - nrays * nbins indices
+ * @return 1 if the indices were calculated, 0 if the separable navigation can't be used for this scan
+ */
+static int BeamBlockageMapInternal_createSeparableCellIndices(BeamBlockageMap_t* self, BBTopography_t* topo, PolarScan_t* scan, int* indices)
+{
+  long nrays = PolarScan_getNrays(scan), nbins = PolarScan_getNbins(scan);
+  long ncols = BBTopography_getNcols(topo);
+  double lat0 = PolarScan_getLatitude(scan), lon0 = PolarScan_getLongitude(scan);
+  double sinlat0 = sin(lat0), coslat0 = cos(lat0);
+  double *sindist = NULL, *cosdist = NULL, *raysin = NULL, *raycos = NULL;
+  long ri = 0, bi = 0;
+  BeamBlockageMapWork work;
+  int result = 0;
+
+  if (nrays <= 0 || nbins <= 0) {
+    return 0;
   }
-  else if ( (lat_s >= -60.0) && (lat_n <= -10.0) && (lon_w >= -100.0) && (lon_e <= -60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W100S10", NULL);
+
+  sindist = RAVE_MALLOC(sizeof(double) * nbins);
+  cosdist = RAVE_MALLOC(sizeof(double) * nbins);
+  raysin = RAVE_MALLOC(sizeof(double) * nrays);
+  raycos = RAVE_MALLOC(sizeof(double) * nrays);
+  if (sindist == NULL || cosdist == NULL || raysin == NULL || raycos == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for navigation factors");
+    goto done;
   }
-  else if ( (lat_s >= -60.0) && (lat_n <= -10.0) && (lon_w >= -60.0) && (lon_e <= -20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W060S10", NULL);
+
+  /* The distances and azimuths are first placed in the sine arrays */
+  if (!BeamBlockageMapInternal_getSeparableNavigation(topo, scan, sindist, raysin)) {
+    goto done;
   }
-  else if ( (lat_s >= -60.0) && (lat_n <= -10.0) && (lon_w >= -20.0) && (lon_e <= 20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W020S10", NULL);
+  for (bi = 0; bi < nbins; bi++) {
+    double h = sindist[bi];
+    sindist[bi] = sin(h);
+    cosdist[bi] = cos(h);
   }
-  else if ( (lat_s >= -60.0) && (lat_n <= -10.0) && (lon_w >= 20.0) && (lon_e <= 60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E020S10", NULL);
+  /* Stored as sin(a)*cos(lat0) and cos(a)*cos(lat0) */
+  for (ri = 0; ri < nrays; ri++) {
+    double a = raysin[ri];
+    raysin[ri] = sin(a)*coslat0;
+    raycos[ri] = cos(a)*coslat0;
+  }
+
+  memset(&work, 0, sizeof(work));
+  work.topo = topo;
+  work.nbins = nbins;
+  work.ncols = ncols;
+  work.lon0 = lon0;
+  work.sinlat0 = sinlat0;
+  work.sindist = sindist;
+  work.cosdist = cosdist;
+  work.raysin = raysin;
+  work.raycos = raycos;
+  work.indices = indices;
+  BBThreads_run(self->nthreads, nrays, BeamBlockageMapInternal_separableCellIndicesWorker, &work);
+
+  result = 1;
+done:
+  RAVE_FREE(sindist);
+  RAVE_FREE(cosdist);
+  RAVE_FREE(raysin);
+  RAVE_FREE(raycos);
+  return result;
+}
+
+/**
+ * Maps the topography against a scan using the horizon profile of the site. The profile holds
+ * the terrain height along each azimuth at a fine distance step and is shared through the horizon
+ * cache by all scans from the same site with the same azimuths, regardless of their elevation angle,
+ * bin length and number of bins. Each bin gets the profile sample that is closest to it, so the
+ * bins get the height of a topography cell that is within a fraction of a cell from the bin.
+ * @param[in] self - self
+ * @param[in] topo - the overall topography that hopefully covers the scan
+ * @param[in] scan - the scan that should get the topography mapped
+ * @param[in] data - the data of the mapped topography, nrays * nbins
+ * @return 1 if the topography was mapped, 0 if the scan can't be navigated as a horizon profile
+ */
+static int BeamBlockageMapInternal_createHorizonTopography(BeamBlockageMap_t* self, BBTopography_t* topo, PolarScan_t* scan, short* data)
+{
+  long nrays = PolarScan_getNrays(scan), nbins = PolarScan_getNbins(scan);
+  double lat0 = PolarScan_getLatitude(scan);
+  double cell = 0.0, maxdist = 0.0;
+  double *dist = NULL, *azimuth = NULL, *heights = NULL;
+  BBHorizonKey key;
+  BeamBlockageMapWork work;
+  long bi = 0;
+  int result = 0;
+
+  if (nrays <= 0 || nbins <= 0) {
+    return 0;
   }
-  else if ( (lat_s >= -60.0) && (lat_n <= -10.0) && (lon_w >= 60.0) && (lon_e <= 100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E060S10", NULL);
+
+  dist = RAVE_MALLOC(sizeof(double) * nbins);
+  azimuth = RAVE_MALLOC(sizeof(double) * nrays);
+  if (dist == NULL || azimuth == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for navigation factors");
+    goto done;
   }
-  else if ( (lat_s >= -60.0) && (lat_n <= -10.0) && (lon_w >= 100.0) && (lon_e <= 140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E100S10", NULL);
+  if (!BeamBlockageMapInternal_getSeparableNavigation(topo, scan, dist, azimuth)) {
+    goto done;
   }
-  else if ( (lat_s >= -60.0) && (lat_n <= -10.0) && (lon_w >= 140.0) && (lon_e <= 180.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E140S10", NULL);
+
+  memset(&work, 0, sizeof(work));
+  work.topo = topo;
+  work.data = data;
+  work.nbins = nbins;
+  work.lon0 = PolarScan_getLongitude(scan);
+  work.sinlat0 = sin(lat0);
+  work.coslat0 = cos(lat0);
+  work.dist = dist;
+  work.azimuth = azimuth;
+
+  /* The profile is sampled a few times per cell, the cells are narrower east-west at high latitudes */
+  cell = BBTopography_getXDim(topo) * work.coslat0;
+  if (cell > BBTopography_getYDim(topo)) {
+    cell = BBTopography_getYDim(topo);
+  } else if (cell < BBTopography_getYDim(topo) / BEAMBLOCKAGEMAP_HORIZON_SAMPLING) {
+    cell = BBTopography_getYDim(topo) / BEAMBLOCKAGEMAP_HORIZON_SAMPLING;
+  }
+  work.step = cell / BEAMBLOCKAGEMAP_HORIZON_SAMPLING;
+  for (bi = 0; bi < nbins; bi++) {
+    if (dist[bi] > maxdist) {
+      maxdist = dist[bi];
+    }
   }
-  /* Horizontally-aligned pairs */
-  /* Row 1 */
-  else if ( (lat_s >= 40.0) && (lon_w >= 140.0) && (lon_e <= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E140N90,W180N90", "h");
+  work.nsamples = (long)ceil(maxdist / work.step) + 1;
+
+  heights = RAVE_MALLOC(sizeof(double) * nrays * work.nsamples);
+  if (heights == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for horizon profile");
+    goto done;
   }
-  else if ( (lat_s >= 40.0) && (lon_w <= -140.0) && (lon_e >= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W180N90,W140N90", "h");
+  work.heights = heights;
+
+  memset(&key, 0, sizeof(BBHorizonKey));
+  key.topographyid = BeamBlockageMap_getTopographyId(self);
+  key.lat = lat0;
+  key.lon = work.lon0;
+  key.step = work.step;
+  key.nrays = nrays;
+  key.ulxmap = BBTopography_getUlxmap(topo);
+  key.ulymap = BBTopography_getUlymap(topo);
+  key.xdim = BBTopography_getXDim(topo);
+  key.ydim = BBTopography_getYDim(topo);
+
+  if (!BBHorizonCache_get(&key, azimuth, work.nsamples, heights)) {
+    BBThreads_run(self->nthreads, nrays, BeamBlockageMapInternal_horizonWorker, &work);
+    BBHorizonCache_put(&key, azimuth, work.nsamples, heights);
   }
-  else if ( (lat_s >= 40.0) && (lon_w <= -100.0) && (lon_e >= -100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W140N90,W100N90", "h");
+
+  BBThreads_run(self->nthreads, nrays, BeamBlockageMapInternal_horizonMapWorker, &work);
+
+  result = 1;
+done:
+  RAVE_FREE(dist);
+  RAVE_FREE(azimuth);
+  RAVE_FREE(heights);
+  return result;
+}
+
+/**
+ * Returns the size of the footprint of a bin, i.e. the larger of the bin length and the beam
+ * width at the bins range.
+ * @param[in] scan - the scan
+ * @param[in] bin - the bin
+ * @return the footprint size in meters
+ */
+static double BeamBlockageMapInternal_getFootprint(PolarScan_t* scan, long bin)
+{
+  double rscale = PolarScan_getRscale(scan), rstart = PolarScan_getRstart(scan) * 1000.0; /* rstart is in km */
+  double footprint = (rstart + rscale * ((double)bin + 0.5)) * PolarScan_getBeamwidth(scan);
+  return (footprint > rscale) ? footprint : rscale;
+}
+
+/**
+ * Selects the overview level of the topography for each bin in the scan. A bin uses the coarsest
+ * level whose cells are not larger than the bins footprint, see \ref BBTopography_createOverviews
+ * and \ref BeamBlockageMapInternal_getFootprint.
+ * @param[in] self - self
+ * @param[in] topo - the topography
+ * @param[in] scan - the scan
+ * @param[out] binlevels - the level of each bin
+ */
+static void BeamBlockageMapInternal_getBinLevels(BeamBlockageMap_t* self, BBTopography_t* topo, PolarScan_t* scan, int* binlevels)
+{
+  long nbins = PolarScan_getNbins(scan), bi = 0;
+  double lat0 = PolarScan_getLatitude(scan);
+  double cell = BBTopography_getYDim(topo), xcell = BBTopography_getXDim(topo) * cos(lat0);
+  int maxlevel = BBTopography_getNlevels(topo);
+
+  if (maxlevel > self->levels) {
+    maxlevel = self->levels;
   }
-  else if ( (lat_s >= 40.0) && (lon_w <= -60.0) && (lon_e >= -60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W100N90,W060N90", "h");
+  if (xcell > cell) {
+    cell = xcell;
   }
-  else if ( (lat_s >= 40.0) && (lon_w <= -20.0) && (lon_e >= -20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W060N90,W020N90", "h");
+  cell *= PolarNavigator_getEarthRadius(self->navigator, lat0);
+
+  for (bi = 0; bi < nbins; bi++) {
+    double footprint = BeamBlockageMapInternal_getFootprint(scan, bi);
+    int level = 0;
+    while (level < maxlevel && cell * (double)(1L << (level + 1)) <= footprint) {
+      level++;
+    }
+    binlevels[bi] = level;
   }
-  else if ( (lat_s >= 40.0) && (lon_w <= 20.0) && (lon_e >= 20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W020N90,E020N90", "h");
+}
+
+/**
+ * Calculates the box of topography cells that is covered by the footprint of each bin in the
+ * scan, see \ref BeamBlockageMapInternal_getFootprint. The box is centered on the cell that
+ * contains the bin and is 2 * half + 1 cells wide, which is 1 cell when the footprint is smaller
+ * than a cell. The width of the cells is taken at the latitude of the radar.
+ * @param[in] self - self
+ * @param[in] topo - the topography
+ * @param[in] scan - the scan
+ * @param[out] halfcols - half the width of the box of each bin, in columns
+ * @param[out] halfrows - half the height of the box of each bin, in rows
+ */
+static void BeamBlockageMapInternal_getBinFootprints(BeamBlockageMap_t* self, BBTopography_t* topo, PolarScan_t* scan, long* halfcols, long* halfrows)
+{
+  long nbins = PolarScan_getNbins(scan), bi = 0;
+  double lat0 = PolarScan_getLatitude(scan);
+  double radius = PolarNavigator_getEarthRadius(self->navigator, lat0);
+  double xcell = BBTopography_getXDim(topo) * cos(lat0) * radius, ycell = BBTopography_getYDim(topo) * radius;
+
+  for (bi = 0; bi < nbins; bi++) {
+    double footprint = BeamBlockageMapInternal_getFootprint(scan, bi);
+    halfcols[bi] = (xcell > 0.0 && footprint > xcell) ? lround((footprint / xcell - 1.0) / 2.0) : 0;
+    halfrows[bi] = (ycell > 0.0 && footprint > ycell) ? lround((footprint / ycell - 1.0) / 2.0) : 0;
   }
-  else if ( (lat_s >= 40.0) && (lon_w <= 60.0) && (lon_e >= 60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E020N90,E060N90", "h");
+}
+
+/**
+ * Creates a topography that is mapped against a specific scan. The topography cell for each
+ * bin is taken from the geometry cache if the same geometry has been mapped against the
+ * same topography grid before. If the topography has overview levels, the height of each
+ * bin is taken from the level that matches the bins footprint, see \ref BeamBlockageMapInternal_getBinLevels.
+ * If the footprint is sampled and the topography has footprint tables, the height of each bin is
+ * instead the mean or maximum of the cells within the footprint, see \ref BeamBlockageMapInternal_getBinFootprints.
+ * If the horizon profiles are used, the topography is instead taken from the horizon
+ * profile of the site, see \ref BeamBlockageMapInternal_createHorizonTopography. The horizon
+ * profile takes precedence over the sampling which takes precedence over the overview levels,
+ * see \ref BeamBlockageMap_setHorizon. The mapped topography is always SHORT, as the tiles.
+ * @param[in] self - self
+ * @param[in] topo - the overall topography that hopefully covers the scan
+ * @param[in] scan - the scan that should get the topography mapped
+ * @return the mapped topography on success otherwise NULL
+ */
+static BBTopography_t* BeamBlockageMapInternal_createMappedTopography(BeamBlockageMap_t* self, BBTopography_t* topo, PolarScan_t* scan)
+{
+  BBTopography_t *field = NULL, *result = NULL;
+  BBGeometryKey key;
+  BeamBlockageMapWork work;
+  short* data = NULL;
+  int* indices = NULL;
+  int* binlevels = NULL;
+  long *halfcols = NULL, *halfrows = NULL;
+  int havekey = 0;
+  long nrays = 0, nbins = 0, ncols = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  RAVE_ASSERT((topo != NULL), "topo == NULL");
+  RAVE_ASSERT((scan != NULL), "scan == NULL");
+
+  nrays = PolarScan_getNrays(scan);
+  nbins = PolarScan_getNbins(scan);
+  ncols = BBTopography_getNcols(topo);
+
+  field = RAVE_OBJECT_NEW(&BBTopography_TYPE);
+  if (field == NULL) {
+    goto done;
   }
-  else if ( (lat_s >= 40.0) && (lon_w <= 100.0) && (lon_e >= 100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E060N90,E100N90", "h");
+  if (!BBTopography_createData(field, nbins, nrays, RaveDataType_SHORT)) {
+    RAVE_ERROR0("Failed to create data field");
+    goto done;
   }
-  else if ( (lat_s >= 40.0) && (lon_w <= 140.0) && (lon_e >= 140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E100N90,E140N90", "h");
+  /* The workers write into the data directly since BBTopography_setValue modifies the field */
+  data = (short*)BBTopography_getData(field);
+  if (data == NULL) {
+    goto done;
   }
-  /* Row 2 */
-  else if ( (lat_n <= 40.0) && (lat_s >= -10.0) && (lon_w >= 140.0) && (lon_e <= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E140N40,W180N40", "h");
+
+  if (self->horizon && BeamBlockageMapInternal_createHorizonTopography(self, topo, scan, data)) {
+    result = RAVE_OBJECT_COPY(field);
+    goto done;
   }
-  else if ( (lat_n <= 40.0) && (lat_s >= -10.0) && (lon_w <= -140.0) && (lon_e >= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W180N40,W140N40", "h");
+
+  indices = RAVE_MALLOC(sizeof(int) * nrays * nbins);
+  if (indices == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for cell indices");
+    goto done;
   }
-  else if ( (lat_n <= 40.0) && (lat_s >= -10.0) && (lon_w <= -100.0) && (lon_e >= -100.0) ) {
-  	  field = BeamBlockageMapInternal_makeTopographyField(self, "W140N40,W100N40", "h");
-    }
-  else if ( (lat_n <= 40.0) && (lat_s >= -10.0) && (lon_w <= -60.0) && (lon_e >= -60.0) ) {
-  	  field = BeamBlockageMapInternal_makeTopographyField(self, "W100N40,W060N40", "h");
-    }
-  else if ( (lat_n <= 40.0) && (lat_s >= -10.0) && (lon_w <= -20.0) && (lon_e >= -20.0) ) {
-  	  field = BeamBlockageMapInternal_makeTopographyField(self, "W060N40,W020N40", "h");
-    }
-  else if ( (lat_n <= 40.0) && (lat_s >= -10.0) && (lon_w <= 20.0) && (lon_e >= 20.0) ) {
-  	  field = BeamBlockageMapInternal_makeTopographyField(self, "W020N40,E020N40", "h");
+
+  havekey = BBGeometryCache_createKey(&key, scan, topo);
+  if (!havekey || !BBGeometryCache_get(&key, indices)) {
+    if (!BeamBlockageMapInternal_createSeparableCellIndices(self, topo, scan, indices)) {
+      BeamBlockageMapInternal_createCellIndices(self, topo, scan, indices);
     }
-  else if ( (lat_n <= 40.0) && (lat_s >= -10.0) && (lon_w <= 60.0) && (lon_e >= 60.0) ) {
-  	  field = BeamBlockageMapInternal_makeTopographyField(self, "E020N40,E060N40", "h");
+    if (havekey) {
+      BBGeometryCache_put(&key, indices);
     }
-  else if ( (lat_n <= 40.0) && (lat_s >= -10.0) && (lon_w <= 100.0) && (lon_e >= 100.0) ) {
-  	  field = BeamBlockageMapInternal_makeTopographyField(self, "E060N40,E100N40", "h");
+  }
+
+  memset(&work, 0, sizeof(work));
+  if (self->sampling != BeamBlockageMapSampling_NEAREST && BBTopography_hasFootprintTables(topo)) {
+    halfcols = RAVE_MALLOC(sizeof(long) * nbins);
+    halfrows = RAVE_MALLOC(sizeof(long) * nbins);
+    if (halfcols == NULL || halfrows == NULL) {
+      RAVE_ERROR0("Failed to allocate memory for bin footprints");
+      goto done;
     }
-  else if ( (lat_n <= 40.0) && (lat_s >= -10.0) && (lon_w <= 140.0) && (lon_e >= 140.0) ) {
-  	  field = BeamBlockageMapInternal_makeTopographyField(self, "E100N40,E140N40", "h");
+    BeamBlockageMapInternal_getBinFootprints(self, topo, scan, halfcols, halfrows);
+    work.sampling = self->sampling;
+  } else if (self->levels > 0 && BBTopography_getNlevels(topo) > 0) {
+    binlevels = RAVE_MALLOC(sizeof(int) * nbins);
+    if (binlevels == NULL) {
+      RAVE_ERROR0("Failed to allocate memory for bin levels");
+      goto done;
     }
-  /* Row 3 */
-  else if ( (lat_n <= -10.0) && (lat_s >= -60.0) && (lon_w >= 140.0) && (lon_e <= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E140S10,W180S10", "h");
+    BeamBlockageMapInternal_getBinLevels(self, topo, scan, binlevels);
   }
-  else if ( (lat_n <= -10.0) && (lat_s >= -60.0) && (lon_w <= -140.0) && (lon_e >= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W180S10,W140S10", "h");
-  }
-  else if ( (lat_n <= -10.0) && (lat_s >= -60.0) && (lon_w <= -100.0) && (lon_e >= -100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W140S10,W100S10", "h");
-  }
-  else if ( (lat_n <= -10.0) && (lat_s >= -60.0) && (lon_w <= -60.0) && (lon_e >= -60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W100S10,W060S10", "h");
-  }
-  else if ( (lat_n <= -10.0) && (lat_s >= -60.0) && (lon_w <= -20.0) && (lon_e >= -20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W060S10,W020S10", "h");
-  }
-  else if ( (lat_n <= -10.0) && (lat_s >= -60.0) && (lon_w <= 20.0) && (lon_e >= 20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W020S10,E020S10", "h");
-  }
-  else if ( (lat_n <= -10.0) && (lat_s >= -60.0) && (lon_w <= 60.0) && (lon_e >= 60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E020S10,E060S10", "h");
-  }
-  else if ( (lat_n <= -10.0) && (lat_s >= -60.0) && (lon_w <= 100.0) && (lon_e >= 100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E060S10,E100S10", "h");
-  }
-  else if ( (lat_n <= -10.0) && (lat_s >= -60.0) && (lon_w <= 140.0) && (lon_e >= 140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E100S10,E140S10", "h");
-  }
-  /* Vertically-aligned pairs, North to south, West to East */
-  /* Column 1 */
-  else if ( (lat_n >= 40.0) && (lat_s <= 40.0) && (lon_e <= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W180N90,W180N40", "v");
-  }
-  else if ( (lat_n >= -10.0) && (lat_s <= -10.0) && (lon_e <= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W180N40,W180S10", "v");
-  }
-  /* Column 2 */
-  else if ( (lat_n >= 40.0) && (lat_s <= 40.0) && (lon_w >= -140.0) && (lon_e <= -100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W140N90,W140N40", "v");
-  }
-  else if ( (lat_n >= -10.0) && (lat_s <= -10.0) && (lon_w >= -140.0) && (lon_e <= -100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W140N40,W140S10", "v");
-  }
-  /* Column 3 */
-  else if ( (lat_n >= 40.0) && (lat_s <= 40.0) && (lon_w >= -100.0) && (lon_e <= -60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W100N90,W100N40", "v");
-  }
-  else if ( (lat_n >= -10.0) && (lat_s <= -10.0) && (lon_w >= -100.0) && (lon_e <= -60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W100N40,W100S10", "v");
-  }
-  /* Column 4 */
-  else if ( (lat_n >= 40.0) && (lat_s <= 40.0) && (lon_w >= -60.0) && (lon_e <= -20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W060N90,W060N40", "v");
-  }
-  else if ( (lat_n >= -10.0) && (lat_s <= -10.0) && (lon_w >= -60.0) && (lon_e <= -20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W060N40,W060S10", "v");
-  }
-  /* Column 5 */
-  else if ( (lat_n >= 40.0) && (lat_s <= 40.0) && (lon_w >= -20.0) && (lon_e <= 20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W020N90,W020N40", "v");
-  }
-  else if ( (lat_n >= -10.0) && (lat_s <= -10.0) && (lon_w >= -20.0) && (lon_e <= 20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W020N40,W020S10", "v");
-  }
-  /* Column 6 */
-  else if ( (lat_n >= 40.0) && (lat_s <= 40.0) && (lon_w >= 20.0) && (lon_e <= 60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E020N90,E020N40", "v");
-  }
-  else if ( (lat_n >= -10.0) && (lat_s <= -10.0) && (lon_w >= 20.0) && (lon_e <= 60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E020N40,E020S10", "v");
-  }
-  /* Column 7 */
-  else if ( (lat_n >= 40.0) && (lat_s <= 40.0) && (lon_w >= 60.0) && (lon_e <= 100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E060N90,E060N40", "v");
-  }
-  else if ( (lat_n >= -10.0) && (lat_s <= -10.0) && (lon_w >= 60.0) && (lon_e <= 100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E060N40,E060S10", "v");
+
+  work.topo = topo;
+  work.data = data;
+  work.nbins = nbins;
+  work.ncols = ncols;
+  work.indices = indices;
+  work.binlevels = binlevels;
+  work.halfcols = halfcols;
+  work.halfrows = halfrows;
+  BBThreads_run(self->nthreads, nrays, BeamBlockageMapInternal_mapTopographyWorker, &work);
+
+  result = RAVE_OBJECT_COPY(field);
+done:
+  RAVE_FREE(indices);
+  RAVE_FREE(binlevels);
+  RAVE_FREE(halfcols);
+  RAVE_FREE(halfrows);
+  RAVE_OBJECT_RELEASE(field);
+  return result;
+}
+
+/**
+ * Read the actual tiles and combine them into a mosaic if required. The tiles are not
+ * concatenated, instead they are referenced by the resulting topography and positioned
+ * according to their upper left corner, see \ref BBTopography_addTile.
+ * @param[in] self - self
+ * @param[in] tiles - the tiles
+ * @param[in] ntiles - the number of tiles
+ * @returns the topography field on success otherwise NULL
+ */
+static BBTopography_t* BeamBlockageMapInternal_makeTopographyField(BeamBlockageMap_t* self, const BeamBlockageMapTile** tiles, int ntiles)
+{
+  BBTopography_t *field = NULL, *result = NULL, *tile = NULL;
+  int i = 0;
+
+  /* Single tile */
+  if (ntiles == 1) {
+    return BeamBlockageMapInternal_readTopography(self, tiles[0]->name);
   }
-  /* Column 8 */
-  else if ( (lat_n >= 40.0) && (lat_s <= 40.0) && (lon_w >= 100.0) && (lon_e <= 140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E100N90,E100N40", "v");
+
+  field = RAVE_OBJECT_NEW(&BBTopography_TYPE);
+  if (field == NULL) {
+    goto done;
   }
-  else if ( (lat_n >= -10.0) && (lat_s <= -10.0) && (lon_w >= 100.0) && (lon_e <= 140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E100N40,E100S10", "v");
+
+  for (i = 0; i < ntiles; i++) {
+    if ((tile = BeamBlockageMapInternal_readTopography(self, tiles[i]->name)) == NULL ||
+        !BBTopography_addTile(field, tile)) {
+      goto done;
+    }
+    RAVE_OBJECT_RELEASE(tile);
   }
-  /* Column 9 */
-  else if ( (lat_n >= 40.0) && (lat_s <= 40.0) && (lon_w >= 140.0) && (lon_e <= 180.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E140N90,E140N40", "v");
+
+  result = RAVE_OBJECT_COPY(field);
+done:
+  RAVE_OBJECT_RELEASE(tile);
+  RAVE_OBJECT_RELEASE(field);
+  return result;
+}
+
+/**
+ * Returns which of the 3 possible longitude shifts (-360, 0 or +360 degrees) that should be
+ * applied on the range [w1, e1] for it to overlap [w2, e2].
+ * @param[in] w1 - western boundary of first range (radians)
+ * @param[in] e1 - eastern boundary of first range (radians)
+ * @param[in] w2 - western boundary of second range (radians)
+ * @param[in] e2 - eastern boundary of second range (radians)
+ * @param[out] shifts - the shifts that gives an overlap, -1, 0 or 1 in units of 360 degrees
+ * @returns the number of shifts that gives an overlap
+ */
+static int BeamBlockageMapInternal_overlappingShifts(double w1, double e1, double w2, double e2, int* shifts)
+{
+  int k = 0, n = 0;
+  for (k = -1; k <= 1; k++) {
+    if (w1 + k*2.0*M_PI < e2 && e1 + k*2.0*M_PI > w2) {
+      shifts[n++] = k;
+    }
   }
-  else if ( (lat_n >= -10.0) && (lat_s <= -10.0) && (lon_w >= 140.0) && (lon_e <= 180.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E140N40,E140S10", "v");
+  return n;
+}
+
+/**
+ * Finds the tiles in the tile index that intersect a region. The candidates are the tiles listed
+ * in the cells of the tile grid that the region covers, so only tiles near the region are tested.
+ * @param[in] self - self
+ * @param[in] north - northern boundary of the region (radians)
+ * @param[in] south - southern boundary of the region (radians)
+ * @param[in] east - eastern boundary of the region (radians)
+ * @param[in] west - western boundary of the region (radians)
+ * @param[out] found - the intersecting tiles ordered from north to south and west to east, must have room for all tiles in the index
+ * @returns the number of intersecting tiles
+ */
+static int BeamBlockageMapInternal_findTiles(BeamBlockageMap_t* self, double north, double south, double east, double west, const BeamBlockageMapTile** found)
+{
+  unsigned char* seen = NULL;
+  int r0, r1, c0, c1, r = 0, c = 0, k = 0, n = 0, shifts[3];
+
+  if (self->ntiles == 0 || self->gridstart == NULL) {
+    return 0;
   }
-  /* Groups of four, again West to East, North to South */
-  /* Row 1 */
-  else if ( (lat_n > 40.0) && (lat_s < 40.0) && (lon_w >= 140.0) && (lon_e <= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E140N90,W180N90,E140N40,W180N40", NULL);
+
+  seen = RAVE_MALLOC(self->ntiles);
+  if (seen == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for tile search");
+    return 0;
   }
-  else if ( (lat_n > 40.0) && (lat_s < 40.0) && (lon_w <= -140.0) && (lon_e >= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W180N90,W140N90,W180N40,W140N40", NULL);
+  memset(seen, 0, self->ntiles);
+
+  BeamBlockageMapInternal_gridRange(RAD2DEG(south), RAD2DEG(north), -90.0, BEAMBLOCKAGEMAP_GRID_NROWS, 0, &r0, &r1);
+  BeamBlockageMapInternal_gridRange(RAD2DEG(west), RAD2DEG(east), -180.0, BEAMBLOCKAGEMAP_GRID_NCOLS, 1, &c0, &c1);
+  for (r = r0; r <= r1; r++) {
+    for (c = c0; c <= c1; c++) {
+      int cell = BeamBlockageMapInternal_gridCell(r, c);
+      for (k = self->gridstart[cell]; k < self->gridstart[cell + 1]; k++) {
+        const BeamBlockageMapTile* t = &self->tiles[self->gridtiles[k]];
+        if (seen[self->gridtiles[k]]) {
+          continue;
+        }
+        seen[self->gridtiles[k]] = 1;
+        if (DEG2RAD(t->south) < north && DEG2RAD(t->north) > south &&
+            BeamBlockageMapInternal_overlappingShifts(DEG2RAD(t->west), DEG2RAD(t->east), west, east, shifts) > 0) {
+          found[n++] = t;
+        }
+      }
+    }
   }
-  else if ( (lat_n > 40.0) && (lat_s < 40.0) && (lon_w <= -100.0) && (lon_e >= -100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W140N90,W100N90,W140N40,W100N40", NULL);
+  RAVE_FREE(seen);
+
+  qsort(found, n, sizeof(const BeamBlockageMapTile*), BeamBlockageMapInternal_compareNorthWest);
+  return n;
+}
+
+/**
+ * Copies the parts of a tile that overlaps the region into the region. The tile must have
+ * the same cell size as the region and be aligned with it.
+ * @param[in] region - the region to be filled
+ * @param[in] tile - the tile
+ * @returns 1 on success otherwise 0
+ */
+static int BeamBlockageMapInternal_copyTileToRegion(BBTopography_t* region, BBTopography_t* tile)
+{
+  double xdim = BBTopography_getXDim(region), ydim = BBTopography_getYDim(region);
+  long ncols = BBTopography_getNcols(region), nrows = BBTopography_getNrows(region);
+  long tncols = BBTopography_getNcols(tile), tnrows = BBTopography_getNrows(tile);
+  long ncircle = lround(2.0*M_PI/xdim);
+  long coff = 0, roff = 0, k = 0;
+  long c0 = 0, c1 = 0, r0 = 0, r1 = 0;
+
+  /* Position of the tiles upper left cell in the region */
+  coff = lround((BBTopography_getUlxmap(tile) - BBTopography_getUlxmap(region))/xdim);
+  roff = lround((BBTopography_getUlymap(region) - BBTopography_getUlymap(tile))/ydim);
+
+  r0 = (roff > 0) ? roff : 0;
+  r1 = (roff + tnrows < nrows) ? roff + tnrows : nrows;
+  if (r0 >= r1) {
+    return 1;
+  }
+
+  for (k = -1; k <= 1; k++) {
+    long off = coff + k*ncircle;
+    c0 = (off > 0) ? off : 0;
+    c1 = (off + tncols < ncols) ? off + tncols : ncols;
+    if (c0 < c1) {
+      if (!BBTopography_copyRegion(region, tile, c0 - off, r0 - roff, c0, r0, c1 - c0, r1 - r0)) {
+        return 0;
+      }
+    }
   }
-  else if ( (lat_n > 40.0) && (lat_s < 40.0) && (lon_w <= -60.0) && (lon_e >= -60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W100N90,W060N90,W100N40,W060N40", NULL);
+
+  return 1;
+}
+
+/*@} End of Private functions */
+
+/*@{ Interface functions */
+
+/**
+ * Find out which maps are needed to cover given area
+ * @param[in] lat - latitude of radar in degrees
+ * @param[in] lon - longitude of radar in degrees
+ * @param[in] d - maximum range of radar in meters
+ * @returns flag corresponding to map to be read
+ */
+BBTopography_t* BeamBlockageMap_readTopography(BeamBlockageMap_t* self, double lat, double lon, double d)
+{
+  double lat_e, lon_e, lat_w, lon_w, lat_n, lat_s;
+  double earthRadius = 0.0;
+  BBTopography_t *field = NULL, *result = NULL;
+  const BeamBlockageMapTile** tiles = NULL;
+  int ntiles = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  earthRadius = PolarNavigator_getEarthRadius(self->navigator, lat);
+
+  /* Find out which map is needed
+     see http://www.movable-type.co.uk/scripts/latlong.html */
+  lat_e = asin(sin(lat) * cos(d/earthRadius) + cos(lat) * sin(d/earthRadius) * cos(M_PI/2.));
+  lon_e = lon + atan2( sin(M_PI/2.) * sin(d/earthRadius) * cos(lat), \
+          cos(d/earthRadius) - sin(lat) * sin(lat_e) );
+  lat_w = asin( sin(lat) * cos(d/earthRadius) + cos(lat) * sin(d/earthRadius) * cos(3.*M_PI/2.) );
+  lon_w = lon + atan2( sin(3.*M_PI/2.) * sin(d/earthRadius) * cos(lat), \
+          cos(d/earthRadius) - sin(lat) * sin(lat_w) );
+  lat_n = asin( sin(lat) * cos(d/earthRadius) + cos(lat) * sin(d/earthRadius) * cos(0.) );
+  lat_s = asin( sin(lat) * cos(d/earthRadius) + cos(lat) * sin(d/earthRadius) * cos(M_PI) );
+
+  tiles = RAVE_MALLOC(sizeof(BeamBlockageMapTile*) * (self->ntiles + 1));
+  if (tiles == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for tiles");
+    goto done;
   }
-  else if ( (lat_n > 40.0) && (lat_s < 40.0) && (lon_w <= -20.0) && (lon_e >= -20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W060N90,W020N90,W060N40,W020N40", NULL);
+
+  ntiles = BeamBlockageMapInternal_findTiles(self, lat_n, lat_s, lon_e, lon_w, tiles);
+  if (ntiles == 0) {
+    RAVE_ERROR0("Topography maps do not cover requested area");
+    goto done;
   }
-  else if ( (lat_n > 40.0) && (lat_s < 40.0) && (lon_w <= 20.0) && (lon_e >= 20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W020N90,E020N90,W020N40,E020N40", NULL);
+
+  field = BeamBlockageMapInternal_makeTopographyField(self, tiles, ntiles);
+  if (field == NULL) {
+    goto done;
   }
-  else if ( (lat_n > 40.0) && (lat_s < 40.0) && (lon_w <= 60.0) && (lon_e >= 60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E020N90,E060N90,E020N40,E060N40", NULL);
+
+  result = RAVE_OBJECT_COPY(field);
+done:
+  RAVE_FREE(tiles);
+  RAVE_OBJECT_RELEASE(field);
+  return result;
+}
+
+BBTopography_t* BeamBlockageMap_readTopographyRegion(BeamBlockageMap_t* self, double north, double south, double east, double west)
+{
+  const BeamBlockageMapTile** found = NULL;
+  BBTopography_t** tiles = NULL;
+  BBTopography_t *field = NULL, *result = NULL;
+  int nfound = 0, ntiles = 0, i = 0;
+  double ulxmap = 0.0, ulymap = 0.0, xdim = 0.0, ydim = 0.0;
+  long c0 = 0, c1 = 0, r0 = 0, r1 = 0, margin = 0, ncircle = 0;
+  short nodata = 0, *data = NULL;
+  long nitems = 0, j = 0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+
+  if (north <= south) {
+    RAVE_ERROR0("Northern boundary must be north of the southern boundary");
+    return NULL;
   }
-  else if ( (lat_n > 40.0) && (lat_s < 40.0) && (lon_w <= 100.0) && (lon_e >= 100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E060N90,E100N90,E060N40,E100N40", NULL);
+  if (east < west) {
+    east += 2.0*M_PI;
   }
-  else if ( (lat_n > 40.0) && (lat_s < 40.0) && (lon_w <= 140.0) && (lon_e >= 140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E100N90,E140N90,E100N40,E140N40", NULL);
+  if (east - west >= 2.0*M_PI) {
+    west = -M_PI;
+    east = M_PI;
   }
-  /* Row 2 */
-  else if ( (lat_n > -10.0) && (lat_s < -10.0) && (lon_w >= 140.0) && (lon_e <= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E140N40,W180S10,E140N40,W180S10", NULL);
+
+  found = RAVE_MALLOC(sizeof(BeamBlockageMapTile*) * (self->ntiles + 1));
+  tiles = RAVE_MALLOC(sizeof(BBTopography_t*) * (self->ntiles + 1));
+  if (found == NULL || tiles == NULL) {
+    RAVE_ERROR0("Failed to allocate memory for tiles");
+    goto done;
   }
-  else if ( (lat_n > -10.0) && (lat_s < -10.0) && (lon_w <= -140.0) && (lon_e >= -140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W180N40,W140S10,W180N40,W140S10", NULL);
+
+  nfound = BeamBlockageMapInternal_findTiles(self, north, south, east, west, found);
+  if (nfound == 0) {
+    RAVE_ERROR0("Topography maps do not cover requested area");
+    goto done;
   }
-  else if ( (lat_n > -10.0) && (lat_s < -10.0) && (lon_w <= -100.0) && (lon_e >= -100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W140N40,W100S10,W140N40,W100S10", NULL);
+
+  for (i = 0; i < nfound; i++) {
+    tiles[ntiles] = BeamBlockageMapInternal_readTopography(self, found[i]->name);
+    if (tiles[ntiles] == NULL) {
+      RAVE_ERROR1("Failed to read topography tile %s", found[i]->name);
+      goto done;
+    }
+    ntiles++;
   }
-  else if ( (lat_n > -10.0) && (lat_s < -10.0) && (lon_w <= -60.0) && (lon_e >= -60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W100N40,W060S10,W100N40,W060S10", NULL);
+
+  /* The first tile is the north-western most and the region is aligned to its cells */
+  ulxmap = BBTopography_getUlxmap(tiles[0]);
+  ulymap = BBTopography_getUlymap(tiles[0]);
+  xdim = BBTopography_getXDim(tiles[0]);
+  ydim = BBTopography_getYDim(tiles[0]);
+  for (i = 1; i < ntiles; i++) {
+    if (fabs(BBTopography_getXDim(tiles[i]) - xdim) > 1e-12 || fabs(BBTopography_getYDim(tiles[i]) - ydim) > 1e-12) {
+      RAVE_ERROR0("Topography tiles must have same xdim and ydim");
+      goto done;
+    }
   }
-  else if ( (lat_n > -10.0) && (lat_s < -10.0) && (lon_w <= -20.0) && (lon_e >= -20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W060N40,W020S10,W060N40,W020S10", NULL);
+
+  margin = BEAMBLOCKAGEMAP_REGION_MARGIN + (long)(0.01*(east - west)/xdim);
+  c0 = (long)floor((west - ulxmap)/xdim) - margin;
+  c1 = (long)ceil((east - ulxmap)/xdim) + margin;
+  ncircle = lround(2.0*M_PI/xdim);
+  if (c1 - c0 > ncircle) {
+    c1 = c0 + ncircle;
   }
-  else if ( (lat_n > -10.0) && (lat_s < -10.0) && (lon_w <= 20.0) && (lon_e >= 20.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "W020N40,E020S10,W020N40,E020S10", NULL);
+  margin = BEAMBLOCKAGEMAP_REGION_MARGIN + (long)(0.01*(north - south)/ydim);
+  r0 = (long)floor((ulymap - north)/ydim) - margin;
+  r1 = (long)ceil((ulymap - south)/ydim) + margin;
+
+  field = RAVE_OBJECT_NEW(&BBTopography_TYPE);
+  if (field == NULL || !BBTopography_createData(field, c1 - c0, r1 - r0, RaveDataType_SHORT)) {
+    RAVE_ERROR0("Failed to create topography region");
+    goto done;
   }
-  else if ( (lat_n > -10.0) && (lat_s < -10.0) && (lon_w <= 60.0) && (lon_e >= 60.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E020N40,E060S10,E020N40,E060S10", NULL);
+  BBTopography_setNodata(field, BBTopography_getNodata(tiles[0]));
+  BBTopography_setXDim(field, xdim);
+  BBTopography_setYDim(field, ydim);
+  BBTopography_setUlxmap(field, ulxmap + c0*xdim);
+  BBTopography_setUlymap(field, ulymap - r0*ydim);
+
+  /* Parts of the region that are not covered by any tile will get nodata */
+  nodata = (short)BBTopography_getNodata(field);
+  data = (short*)BBTopography_getData(field);
+  nitems = (c1 - c0) * (r1 - r0);
+  for (j = 0; j < nitems; j++) {
+    data[j] = nodata;
   }
-  else if ( (lat_n > -10.0) && (lat_s < -10.0) && (lon_w <= 100.0) && (lon_e >= 100.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E060N40,E100S10,E060N40,E100S10", NULL);
+
+  for (i = 0; i < ntiles; i++) {
+    if (!BeamBlockageMapInternal_copyTileToRegion(field, tiles[i])) {
+      goto done;
+    }
   }
-  else if ( (lat_n > -10.0) && (lat_s < -10.0) && (lon_w <= 140.0) && (lon_e >= 140.0) ) {
-	  field = BeamBlockageMapInternal_makeTopographyField(self, "E100N40,E140S10,E100N40,E140S10", NULL);
+
+  if (self->compressed) {
+    if (!BBTopography_compress(field)) {
+      goto done;
+    }
+  } else if (self->blocklayout && !BBTopography_createBlockLayout(field)) {
+    goto done;
   }
 
-  else {
-    RAVE_ERROR0("Topography maps do not cover requested area");
+  if (self->levels > 0 && !BBTopography_createOverviews(field, self->levels)) {
+    goto done;
+  }
+  if (self->sampling != BeamBlockageMapSampling_NEAREST && !BBTopography_createFootprintTables(field)) {
     goto done;
   }
 
   result = RAVE_OBJECT_COPY(field);
 done:
+  for (i = 0; i < ntiles; i++) {
+    RAVE_OBJECT_RELEASE(tiles[i]);
+  }
+  RAVE_FREE(tiles);
+  RAVE_FREE(found);
   RAVE_OBJECT_RELEASE(field);
   return result;
 }
 
+BBTopography_t* BeamBlockageMap_readTopographyForScan(BeamBlockageMap_t* self, PolarScan_t* scan)
+{
+  double lat = 0.0, lon = 0.0, d = 0.0, dlon = 0.0;
+
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (scan == NULL) {
+    RAVE_ERROR0("Trying to read topography for NULL scan");
+    return NULL;
+  }
+
+  /* Bounding box of the spherical cap that is covered by the scan */
+  lat = PolarScan_getLatitude(scan);
+  lon = PolarScan_getLongitude(scan);
+  d = PolarScan_getMaxDistance(scan) / PolarNavigator_getEarthRadius(self->navigator, lat);
+  if (d >= M_PI/2.0 - fabs(lat)) {
+    dlon = M_PI; /* Covers a pole */
+  } else {
+    dlon = asin(sin(d) / cos(lat));
+  }
+
+  return BeamBlockageMap_readTopographyRegion(self,
+                                              (lat + d < M_PI/2.0) ? lat + d : M_PI/2.0,
+                                              (lat - d > -M_PI/2.0) ? lat - d : -M_PI/2.0,
+                                              lon + dlon,
+                                              lon - dlon);
+}
+
+BBTopography_t* BeamBlockageMap_mapTopography(BeamBlockageMap_t* self, BBTopography_t* topo, PolarScan_t* scan)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (topo == NULL || scan == NULL) {
+    RAVE_ERROR0("Trying to map topography with NULL topography or scan");
+    return NULL;
+  }
+  return BeamBlockageMapInternal_createMappedTopography(self, topo, scan);
+}
+
 BBTopography_t* BeamBlockageMap_getTopographyForScan(BeamBlockageMap_t* self, PolarScan_t* scan)
 {
   BBTopography_t *field = NULL, *result = NULL;
@@ -769,10 +1779,7 @@ BBTopography_t* BeamBlockageMap_getTopographyForScan(BeamBlockageMap_t* self, Po
     return NULL;
   }
 
-  if ((topo = BeamBlockageMap_readTopography(self,
-                                             PolarScan_getLatitude(scan),
-                                             PolarScan_getLongitude(scan),
-                                             PolarScan_getMaxDistance(scan))) == NULL) {
+  if ((topo = BeamBlockageMap_readTopographyForScan(self, scan)) == NULL) {
     goto done;
   }
 
@@ -788,6 +1795,10 @@ done:
 int BeamBlockageMap_setTopo30Directory(BeamBlockageMap_t* self, const char* topodirectory)
 {
   char* tmp = NULL;
+  BeamBlockageMapTile* tiles = NULL;
+  int* gridstart = NULL;
+  int* gridtiles = NULL;
+  int ntiles = 0;
   int result = 0;
 
   RAVE_ASSERT((self != NULL), "self == NULL");
@@ -800,12 +1811,31 @@ int BeamBlockageMap_setTopo30Directory(BeamBlockageMap_t* self, const char* topo
     }
   }
 
+  tiles = BeamBlockageMapInternal_createTileIndex(tmp, &ntiles);
+  if (tiles == NULL || !BeamBlockageMapInternal_createTileGrid(tiles, ntiles, &gridstart, &gridtiles)) {
+    goto done;
+  }
+
   RAVE_FREE(self->topodir);
   self->topodir = tmp;
   tmp = NULL; // Not responsible for memory any longer
+  RAVE_FREE(self->tiles);
+  self->tiles = tiles;
+  self->ntiles = ntiles;
+  RAVE_FREE(self->gridstart);
+  RAVE_FREE(self->gridtiles);
+  self->gridstart = gridstart;
+  self->gridtiles = gridtiles;
+  self->topographyid = BeamBlockageMapInternal_createTopographyId(self->topodir, self->tiles, self->ntiles);
+  tiles = NULL;
+  gridstart = NULL;
+  gridtiles = NULL;
   result = 1;
 done:
   RAVE_FREE(tmp);
+  RAVE_FREE(tiles);
+  RAVE_FREE(gridstart);
+  RAVE_FREE(gridtiles);
   return result;
 }
 
@@ -815,6 +1845,90 @@ const char* BeamBlockageMap_getTopo30Directory(BeamBlockageMap_t* self)
   return (const char*)self->topodir;
 }
 
+unsigned long BeamBlockageMap_getTopographyId(BeamBlockageMap_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->topographyid;
+}
+
+void BeamBlockageMap_setThreads(BeamBlockageMap_t* self, int nthreads)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->nthreads = (nthreads < 1) ? 1 : nthreads;
+}
+
+int BeamBlockageMap_getThreads(BeamBlockageMap_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->nthreads;
+}
+
+void BeamBlockageMap_setHorizon(BeamBlockageMap_t* self, int horizon)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->horizon = horizon ? 1 : 0;
+}
+
+int BeamBlockageMap_getHorizon(BeamBlockageMap_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->horizon;
+}
+
+void BeamBlockageMap_setLevels(BeamBlockageMap_t* self, int levels)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->levels = (levels > 0) ? levels : 0;
+}
+
+int BeamBlockageMap_getLevels(BeamBlockageMap_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->levels;
+}
+
+int BeamBlockageMap_setSampling(BeamBlockageMap_t* self, BeamBlockageMapSampling sampling)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  if (sampling != BeamBlockageMapSampling_NEAREST && sampling != BeamBlockageMapSampling_MEAN &&
+      sampling != BeamBlockageMapSampling_MAX) {
+    RAVE_ERROR1("Unknown sampling %d", (int)sampling);
+    return 0;
+  }
+  self->sampling = sampling;
+  return 1;
+}
+
+BeamBlockageMapSampling BeamBlockageMap_getSampling(BeamBlockageMap_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->sampling;
+}
+
+void BeamBlockageMap_setCompressed(BeamBlockageMap_t* self, int compressed)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->compressed = compressed ? 1 : 0;
+}
+
+int BeamBlockageMap_getCompressed(BeamBlockageMap_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->compressed;
+}
+
+void BeamBlockageMap_setBlockLayout(BeamBlockageMap_t* self, int blocklayout)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  self->blocklayout = blocklayout ? 1 : 0;
+}
+
+int BeamBlockageMap_getBlockLayout(BeamBlockageMap_t* self)
+{
+  RAVE_ASSERT((self != NULL), "self == NULL");
+  return self->blocklayout;
+}
+
 /*@} End of Interface functions */
 
 RaveCoreObjectType BeamBlockageMap_TYPE = {
@@ -35,16 +35,28 @@ along with beamb.  If not, see <http://www.gnu.org/licenses/>.
  */
 typedef struct _BeamBlockageMap_t BeamBlockageMap_t;
 
+/**
+ * How the topography is sampled for each bin when it is mapped against a scan
+ */
+typedef enum BeamBlockageMapSampling {
+  BeamBlockageMapSampling_NEAREST = 0, /**< the cell that contains the bin (default) */
+  BeamBlockageMapSampling_MEAN = 1,    /**< the mean of the cells within the bins footprint */
+  BeamBlockageMapSampling_MAX = 2      /**< the highest cell within the bins footprint */
+} BeamBlockageMapSampling;
+
 /**
  * Type definition to use when creating a rave object.
  */
 extern RaveCoreObjectType BeamBlockageMap_TYPE;
 
 /**
- * Sets the topo30 directory.
+ * Sets the topo30 directory. If the directory contains a tile manifest, beamb_tiles.txt,
+ * the tiles are taken from it, otherwise the GTOPO30 tiles are assumed. Each line in the
+ * manifest describes one tile as "name west north east south" with the boundaries in degrees,
+ * where name is the tile's .HDR/.DEM basename. Empty lines and lines starting with # are ignored.
  * @param[in] self - self
  * @param[in] topodirectory - the topo directory
- * @return 1 on success otherwise 0
+ * @return 1 on success otherwise 0 (e.g. if the manifest could not be read)
  */
 int BeamBlockageMap_setTopo30Directory(BeamBlockageMap_t* self, const char* topodirectory);
 
@@ -55,6 +67,129 @@ int BeamBlockageMap_setTopo30Directory(BeamBlockageMap_t* self, const char* topo
  */
 const char* BeamBlockageMap_getTopo30Directory(BeamBlockageMap_t* self);
 
+/**
+ * Returns the identity of the topography in the topo30 directory. It is calculated when the
+ * directory is set from the tile index and the size and modification time of the tile files, so
+ * it changes when the tiles are replaced. Used to tell fields calculated from different topographies apart.
+ * @param[in] self - self
+ * @return the identity, a 32 bit value
+ */
+unsigned long BeamBlockageMap_getTopographyId(BeamBlockageMap_t* self);
+
+/**
+ * Sets the number of threads that are used when mapping the topography against a scan. (Default 1)
+ * @param[in] self - self
+ * @param[in] nthreads - the number of threads, values < 1 are treated as 1
+ */
+void BeamBlockageMap_setThreads(BeamBlockageMap_t* self, int nthreads);
+
+/**
+ * Returns the number of threads that are used when mapping the topography against a scan.
+ * @param[in] self - self
+ * @return the number of threads
+ */
+int BeamBlockageMap_getThreads(BeamBlockageMap_t* self);
+
+/**
+ * Sets if the topography should be taken from the horizon profile of the radar site when
+ * mapping the topography against a scan. The profile holds the terrain height along each azimuth
+ * at a fraction of the topography cell size and is shared by all scans from the site, so only the
+ * first scan of a volume has to sample the topography. Each bin gets the height of the profile
+ * sample closest to it, which can be a neighbouring cell for bins close to a cell border.
+ *
+ * The mapping settings are applied in this order of precedence: the horizon profile, then the
+ * footprint sampling (\ref BeamBlockageMap_setSampling) and then the overview levels
+ * (\ref BeamBlockageMap_setLevels). When the horizon profile is used the sampling and the levels
+ * are ignored, and when the sampling is MEAN or MAX the levels are ignored. A scan that can't be
+ * navigated as a horizon profile is mapped as if the horizon profile wasn't used. (Default 0)
+ * @param[in] self - self
+ * @param[in] horizon - 1 if the horizon profile should be used, otherwise 0
+ */
+void BeamBlockageMap_setHorizon(BeamBlockageMap_t* self, int horizon);
+
+/**
+ * Returns if the topography is taken from the horizon profile of the radar site.
+ * @param[in] self - self
+ * @return 1 if the horizon profile is used, otherwise 0
+ */
+int BeamBlockageMap_getHorizon(BeamBlockageMap_t* self);
+
+/**
+ * Sets the number of overview levels that are created for the topography regions read by
+ * \ref BeamBlockageMap_readTopographyRegion, see \ref BBTopography_createOverviews. When a
+ * topography with overview levels is mapped against a scan, each bin gets its height from the
+ * coarsest level whose cells are not larger than the bins footprint (the larger of the bin length
+ * and the beam width at the bins range). This lets a fine topography be used without
+ * the far bins only sampling a single small cell. 0 means that only the topography itself is used.
+ * The levels are ignored when the horizon profile or the MEAN or MAX sampling is used, see
+ * \ref BeamBlockageMap_setHorizon. (Default 0)
+ * @param[in] self - self
+ * @param[in] levels - the number of overview levels
+ */
+void BeamBlockageMap_setLevels(BeamBlockageMap_t* self, int levels);
+
+/**
+ * Returns the number of overview levels created for the topography regions.
+ * @param[in] self - self
+ * @return the number of overview levels
+ */
+int BeamBlockageMap_getLevels(BeamBlockageMap_t* self);
+
+/**
+ * Sets how the topography within the footprint of each bin is sampled when the topography is
+ * mapped against a scan. The footprint is the larger of the bin length and the beam width at the
+ * bins range. For MEAN and MAX, footprint tables are created for the topography regions read by
+ * \ref BeamBlockageMap_readTopographyRegion so that each bin is sampled in constant time, see
+ * \ref BBTopography_createFootprintTables. The overview levels are not used when the footprint is
+ * sampled and the sampling is ignored when the horizon profile is used, see \ref BeamBlockageMap_setHorizon.
+ * (Default NEAREST)
+ * @param[in] self - self
+ * @param[in] sampling - the sampling
+ * @return 1 on success, 0 if the sampling is unknown
+ */
+int BeamBlockageMap_setSampling(BeamBlockageMap_t* self, BeamBlockageMapSampling sampling);
+
+/**
+ * Returns how the topography within the footprint of each bin is sampled.
+ * @param[in] self - self
+ * @return the sampling
+ */
+BeamBlockageMapSampling BeamBlockageMap_getSampling(BeamBlockageMap_t* self);
+
+/**
+ * Sets if the topography tiles and the topography regions read by \ref BeamBlockageMap_readTopographyRegion
+ * should be compressed in memory, see \ref BBTopography_compress. The tiles are then held compressed
+ * in the topography cache, which also counts their compressed size, so that many more tiles fit within
+ * the same cache size at the cost of decoding each value when it is read. (Default 0)
+ * @param[in] self - self
+ * @param[in] compressed - 1 if the topography should be compressed, otherwise 0
+ */
+void BeamBlockageMap_setCompressed(BeamBlockageMap_t* self, int compressed);
+
+/**
+ * Returns if the topography tiles and regions are compressed in memory.
+ * @param[in] self - self
+ * @return 1 if compressed, otherwise 0
+ */
+int BeamBlockageMap_getCompressed(BeamBlockageMap_t* self);
+
+/**
+ * Sets if the topography regions read by \ref BeamBlockageMap_readTopographyRegion should be stored
+ * in blocks in memory, see \ref BBTopography_createBlockLayout. This gives fewer cache and TLB
+ * misses when the region is mapped against the scans of a volume. Compressed regions are already
+ * stored in blocks, so this has no effect when the topography is compressed. (Default 0)
+ * @param[in] self - self
+ * @param[in] blocklayout - 1 if the regions should be stored in blocks, otherwise 0
+ */
+void BeamBlockageMap_setBlockLayout(BeamBlockageMap_t* self, int blocklayout);
+
+/**
+ * Returns if the topography regions are stored in blocks in memory.
+ * @param[in] self - self
+ * @return 1 if stored in blocks, otherwise 0
+ */
+int BeamBlockageMap_getBlockLayout(BeamBlockageMap_t* self);
+
 /**
  * Find out which maps are needed to cover given area
  * @param[in] lat - latitude of radar in radians
@@ -64,6 +199,40 @@ const char* BeamBlockageMap_getTopo30Directory(BeamBlockageMap_t* self);
  */
 BBTopography_t* BeamBlockageMap_readTopography(BeamBlockageMap_t* self, double lat, double lon, double d);
 
+/**
+ * Reads the part of the topography that covers the specified bounding box. Only the
+ * rows and columns of the tiles that are within the box (plus a small margin) are used
+ * and the result is a single field that has the size of the box. The box may reach
+ * across the +/-180 degree meridian in which case east will be less than west.
+ * @param[in] self - self
+ * @param[in] north - northern boundary in radians
+ * @param[in] south - southern boundary in radians
+ * @param[in] east - eastern boundary in radians
+ * @param[in] west - western boundary in radians
+ * @returns the topography field on success otherwise NULL
+ */
+BBTopography_t* BeamBlockageMap_readTopographyRegion(BeamBlockageMap_t* self, double north, double south, double east, double west);
+
+/**
+ * Reads the part of the topography that covers the area scanned by the scan, i.e. the bounding
+ * box of the spherical cap that is centered at the radar and reaches to the scans maximum distance.
+ * @param[in] self - self
+ * @param[in] scan - the polar scan
+ * @returns the topography field on success otherwise NULL
+ */
+BBTopography_t* BeamBlockageMap_readTopographyForScan(BeamBlockageMap_t* self, PolarScan_t* scan);
+
+/**
+ * Maps the provided topography against the scan sweep strategy. The topography should cover the
+ * scan, for example by being read with \ref BeamBlockageMap_readTopographyForScan for this or a scan
+ * from the same radar reaching at least as far. Bins outside the topography will get 0.
+ * @param[in] self - self
+ * @param[in] topo - the topography
+ * @param[in] scan - the polar scan
+ * @returns the topography with the corresponding dimensions. cols = bin and rows = rays
+ */
+BBTopography_t* BeamBlockageMap_mapTopography(BeamBlockageMap_t* self, BBTopography_t* topo, PolarScan_t* scan);
+
 /**
  * Returns a topography that matches the scan sweep strategy. I.e. the topography
  * for each bin/ray index.
@@ -29,6 +29,7 @@ from rave_quality_plugin import QUALITY_CONTROL_MODE_ANALYZE_AND_APPLY
 from rave_quality_plugin import QUALITY_CONTROL_MODE_ANALYZE
 
 import rave_pgf_logger
+import math
 
 import _polarscan
 import _polarvolume
@@ -54,6 +55,13 @@ class beamb_quality_plugin(rave_quality_plugin):
   #
   _cachedir = None
 
+  ##
+  # Number of threads used when processing the scans in a volume. The plugin
+  # runs inside the rave pgf together with other jobs so only one thread is
+  # used by default.
+  #
+  _nthreads = 1
+
   ##
   # Default constructor
   def __init__(self):
@@ -86,15 +94,12 @@ class beamb_quality_plugin(rave_quality_plugin):
           
         elif _polarvolume.isPolarVolume(obj):
           options = self._beamboptions.get_options_for_object(obj)
-          for i in range(obj.getNumberOfScans()):
-            scan = obj.getScan(i)
-            if reprocess_quality_flag == False and scan.findQualityFieldByHowTask("se.smhi.detector.beamblockage") != None:
-              continue
-            bb = self._create_bb()
-            result = bb.getBlockage(scan, options.dblimit)
-            if quality_control_mode != QUALITY_CONTROL_MODE_ANALYZE:
-              _beamblockage.restore(scan, result, "DBZH", options.bblimit)
-            scan.addOrReplaceQualityField(result)
+          quantity = "DBZH"
+          if quality_control_mode == QUALITY_CONTROL_MODE_ANALYZE:
+            quantity = None
+          bb = self._create_bb()
+          bb.nthreads = self._nthreads
+          bb.processVolume(obj, options.dblimit, quantity, options.bblimit, math.pi, reprocess_quality_flag)
       except:
         logger.exception("Failed to generate beam blockage field")
 
@@ -326,6 +326,165 @@ done:
   return result;
 }
 
+/**
+ * Adds a tile to the topography so that it becomes a mosaic.
+ * @param[in] self - self
+ * @param[in] args - the tile
+ * @return None on success otherwise NULL
+ */
+static PyObject* _pybbtopography_addTile(PyBBTopography* self, PyObject* args)
+{
+  PyObject* pyin = NULL;
+  if (!PyArg_ParseTuple(args, "O", &pyin)) {
+    return NULL;
+  }
+  if (!PyBBTopography_Check(pyin)) {
+    raiseException_returnNULL(PyExc_ValueError, "Argument must be another topography field");
+  }
+  if (!BBTopography_addTile(self->topo, ((PyBBTopography*)pyin)->topo)) {
+    raiseException_returnNULL(PyExc_ValueError, "Failed to add tile");
+  }
+  Py_RETURN_NONE;
+}
+
+/**
+ * Creates overview levels of the topography.
+ * @param[in] self - self
+ * @param[in] args - the number of levels
+ * @return None on success otherwise NULL
+ */
+static PyObject* _pybbtopography_createOverviews(PyBBTopography* self, PyObject* args)
+{
+  int nlevels = 0;
+  if (!PyArg_ParseTuple(args, "i", &nlevels)) {
+    return NULL;
+  }
+  if (!BBTopography_createOverviews(self->topo, nlevels)) {
+    raiseException_returnNULL(PyExc_MemoryError, "Failed to create overview levels");
+  }
+  Py_RETURN_NONE;
+}
+
+/**
+ * Returns an overview level of the topography.
+ * @param[in] self - self
+ * @param[in] args - the level
+ * @return a topography object on success otherwise NULL
+ */
+static PyObject* _pybbtopography_getLevel(PyBBTopography* self, PyObject* args)
+{
+  PyObject* result = NULL;
+  BBTopography_t* field = NULL;
+  int level = 0;
+  if (!PyArg_ParseTuple(args, "i", &level)) {
+    return NULL;
+  }
+  field = BBTopography_getLevel(self->topo, level);
+  if (field == NULL) {
+    raiseException_returnNULL(PyExc_IndexError, "No such overview level");
+  }
+  result = (PyObject*)PyBBTopography_New(field);
+  RAVE_OBJECT_RELEASE(field);
+  return result;
+}
+
+/**
+ * Compresses the topography data in memory.
+ * @param[in] self - self
+ * @param[in] args - N/A
+ * @return None on success otherwise NULL
+ */
+static PyObject* _pybbtopography_compress(PyBBTopography* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  if (!BBTopography_compress(self->topo)) {
+    raiseException_returnNULL(PyExc_ValueError, "Failed to compress topography");
+  }
+  Py_RETURN_NONE;
+}
+
+/**
+ * Stores the topography data in blocks in memory.
+ * @param[in] self - self
+ * @param[in] args - N/A
+ * @return None on success otherwise NULL
+ */
+static PyObject* _pybbtopography_createBlockLayout(PyBBTopography* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  if (!BBTopography_createBlockLayout(self->topo)) {
+    raiseException_returnNULL(PyExc_ValueError, "Failed to store topography in blocks");
+  }
+  Py_RETURN_NONE;
+}
+
+/**
+ * Creates the footprint tables of the topography.
+ * @param[in] self - self
+ * @param[in] args - N/A
+ * @return None on success otherwise NULL
+ */
+static PyObject* _pybbtopography_createFootprintTables(PyBBTopography* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  if (!BBTopography_createFootprintTables(self->topo)) {
+    raiseException_returnNULL(PyExc_MemoryError, "Failed to create footprint tables");
+  }
+  Py_RETURN_NONE;
+}
+
+/**
+ * Returns the mean of the cells within a box.
+ * @param[in] self - self
+ * @param[in] args - col0, row0, col1, row1
+ * @return a tuple (result, value) on success otherwise NULL
+ */
+static PyObject* _pybbtopography_getFootprintMean(PyBBTopography* self, PyObject* args)
+{
+  double value = 0.0;
+  long col0 = 0, row0 = 0, col1 = 0, row1 = 0;
+  int result = 0;
+
+  if (!PyArg_ParseTuple(args, "llll", &col0, &row0, &col1, &row1)) {
+    return NULL;
+  }
+  if (!BBTopography_hasFootprintTables(self->topo)) {
+    raiseException_returnNULL(PyExc_AttributeError, "Topography has no footprint tables");
+  }
+  result = BBTopography_getFootprintMean(self->topo, col0, row0, col1, row1, &value);
+
+  return Py_BuildValue("(id)", result, value);
+}
+
+/**
+ * Returns the highest cell within a box.
+ * @param[in] self - self
+ * @param[in] args - col0, row0, col1, row1
+ * @return a tuple (result, value) on success otherwise NULL
+ */
+static PyObject* _pybbtopography_getFootprintMax(PyBBTopography* self, PyObject* args)
+{
+  double value = 0.0;
+  long col0 = 0, row0 = 0, col1 = 0, row1 = 0;
+  int result = 0;
+
+  if (!PyArg_ParseTuple(args, "llll", &col0, &row0, &col1, &row1)) {
+    return NULL;
+  }
+  if (!BBTopography_hasFootprintTables(self->topo)) {
+    raiseException_returnNULL(PyExc_AttributeError, "Topography has no footprint tables");
+  }
+  result = BBTopography_getFootprintMax(self->topo, col0, row0, col1, row1, &value);
+
+  return Py_BuildValue("(id)", result, value);
+}
+
 /**
  * All methods a topography instance can have
  */
@@ -350,6 +509,18 @@ static struct PyMethodDef _pybbtopography_methods[] =
   {"getData", (PyCFunction)_pybbtopography_getData, 1},
   {"concatx", (PyCFunction)_pybbtopography_concatx, 1},
   {"concaty", (PyCFunction)_pybbtopography_concaty, 1},
+  {"addTile", (PyCFunction)_pybbtopography_addTile, 1},
+  {"nlevels", NULL, METH_VARARGS},
+  {"createOverviews", (PyCFunction)_pybbtopography_createOverviews, 1},
+  {"getLevel", (PyCFunction)_pybbtopography_getLevel, 1},
+  {"createFootprintTables", (PyCFunction)_pybbtopography_createFootprintTables, 1},
+  {"compressed", NULL, METH_VARARGS},
+  {"datasize", NULL, METH_VARARGS},
+  {"compress", (PyCFunction)_pybbtopography_compress, 1},
+  {"blocklayout", NULL, METH_VARARGS},
+  {"createBlockLayout", (PyCFunction)_pybbtopography_createBlockLayout, 1},
+  {"getFootprintMean", (PyCFunction)_pybbtopography_getFootprintMean, 1},
+  {"getFootprintMax", (PyCFunction)_pybbtopography_getFootprintMax, 1},
   {NULL, NULL} /* sentinel */
 };
 
@@ -372,6 +543,14 @@ static PyObject* _pybbtopography_getattro(PyBBTopography* self, PyObject* name)
     return PyLong_FromLong(BBTopography_getNcols(self->topo));
   } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("nrows", name) == 0) {
     return PyLong_FromLong(BBTopography_getNrows(self->topo));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("nlevels", name) == 0) {
+    return PyLong_FromLong(BBTopography_getNlevels(self->topo));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("compressed", name) == 0) {
+    return PyBool_FromLong(BBTopography_isCompressed(self->topo));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("blocklayout", name) == 0) {
+    return PyBool_FromLong(BBTopography_hasBlockLayout(self->topo));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("datasize", name) == 0) {
+    return PyLong_FromLong(BBTopography_getDataSize(self->topo));
   }
   return PyObject_GenericGetAttr((PyObject*)self, name);
 }
@@ -27,14 +27,17 @@ along with beamb.  If not, see <http://www.gnu.org/licenses/>.
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 
 #define PYBEAMBLOCKAGE_MODULE   /**< to get correct part in pybeamblockage */
 #include "pybeamblockage.h"
 
 #include "pypolarscan.h"
+#include "pypolarvolume.h"
 #include "pyravefield.h"
 #include "pyrave_debug.h"
 #include "rave_alloc.h"
+#include "bbfieldcache.h"
 
 /**
  * Debug this module
@@ -157,6 +160,7 @@ static PyObject* _pybeamblockage_restore(PyObject* self, PyObject* args)
   PyObject *o1 = NULL, *o2 = NULL;
   char* quantity = NULL;
   double threshold = 0.0;
+  int status = 0;
 
   if (!PyArg_ParseTuple(args, "OOsd", &o1, &o2, &quantity, &threshold)) {
     return NULL;
@@ -169,14 +173,19 @@ static PyObject* _pybeamblockage_restore(PyObject* self, PyObject* args)
     raiseException_returnNULL(PyExc_TypeError, "Second argument should be a PolarScan");
   }
 
-  if (!BeamBlockage_restore(((PyPolarScan*)o1)->scan, ((PyRaveField*)o2)->field, quantity, threshold)) {
+  /* The GIL is kept since the scan and the field are modified */
+  status = BeamBlockage_restore(((PyPolarScan*)o1)->scan, ((PyRaveField*)o2)->field, quantity, threshold);
+
+  if (!status) {
     raiseException_returnNULL(PyExc_RuntimeError, "Failed to restore scan");
   }
   Py_RETURN_NONE;
 }
 
 /**
- * Returns the blockage for the provided scan given gaussian limit.
+ * Returns the blockage for the provided scan given gaussian limit. The blockage is calculated
+ * without holding the GIL on clones of the beam blockage instance and the scan, since the rave
+ * objects aren't thread safe and other threads may use them meanwhile.
  * @param[in] self - self
  * @param[in] args - the arguments (PyPolarScan, double (Limit of Gaussian approximation of main lobe))
  * @return the PyRaveField on success otherwise NULL
@@ -185,6 +194,8 @@ static PyObject* _pybeamblockage_getBlockage(PyBeamBlockage* self, PyObject* arg
 {
   PyObject* pyin = NULL;
   double dBlim = 0;
+  BeamBlockage_t* beamb = NULL;
+  PolarScan_t* scan = NULL;
   RaveField_t* field = NULL;
   PyObject* result = NULL;
 
@@ -196,11 +207,293 @@ static PyObject* _pybeamblockage_getBlockage(PyBeamBlockage* self, PyObject* arg
     raiseException_returnNULL(PyExc_ValueError, "First argument should be a Polar Scan");
   }
 
-  field = BeamBlockage_getBlockage(self->beamb, ((PyPolarScan*)pyin)->scan, dBlim);
+  beamb = RAVE_OBJECT_CLONE(self->beamb);
+  scan = RAVE_OBJECT_CLONE(((PyPolarScan*)pyin)->scan);
+  if (beamb == NULL || scan == NULL) {
+    raiseException_gotoTag(done, PyExc_MemoryError, "Failed to clone beam blockage or scan");
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  field = BeamBlockage_getBlockage(beamb, scan, dBlim);
+  Py_END_ALLOW_THREADS
   if (field != NULL) {
     result = (PyObject*)PyRaveField_New(field);
   }
+done:
   RAVE_OBJECT_RELEASE(field);
+  RAVE_OBJECT_RELEASE(scan);
+  RAVE_OBJECT_RELEASE(beamb);
+  return result;
+}
+
+/**
+ * Calculates and attaches the blockage for the scans in a volume. The scans are processed
+ * without holding the GIL.
+ * @param[in] self - self
+ * @param[in] args - the arguments (PyPolarVolume, double (Limit of Gaussian approximation of main lobe),
+ * quantity to restore or None (optional), restore threshold (optional), max elevation angle in radians (optional),
+ * reprocess (optional))
+ * @return None on success otherwise NULL
+ */
+static PyObject* _pybeamblockage_processVolume(PyBeamBlockage* self, PyObject* args)
+{
+  PyObject* pyin = NULL;
+  double dBlim = 0.0, threshold = 1.0, maxelev = M_PI;
+  char* quantity = NULL;
+  int reprocess = 1, status = 0;
+
+  if (!PyArg_ParseTuple(args, "Od|zddi", &pyin, &dBlim, &quantity, &threshold, &maxelev, &reprocess)) {
+    return NULL;
+  }
+
+  if (!PyPolarVolume_Check(pyin)) {
+    raiseException_returnNULL(PyExc_ValueError, "First argument should be a Polar Volume");
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  status = BeamBlockage_processVolume(self->beamb, ((PyPolarVolume*)pyin)->pvol, dBlim, quantity, threshold, maxelev, reprocess);
+  Py_END_ALLOW_THREADS
+
+  if (!status) {
+    raiseException_returnNULL(PyExc_RuntimeError, "Failed to process volume");
+  }
+  Py_RETURN_NONE;
+}
+
+/**
+ * Lock function for \ref BeamBlockage_setHdf5LockFunctions. _raveio reads and writes files with
+ * HDF5 while holding the GIL, so the GIL is taken around the HDF5 calls made by beamb as well.
+ */
+static void* _pybeamblockage_lockHdf5(void* data)
+{
+  return (void*)(intptr_t)PyGILState_Ensure();
+}
+
+/**
+ * Unlock function for \ref BeamBlockage_setHdf5LockFunctions.
+ */
+static void _pybeamblockage_unlockHdf5(void* data, void* token)
+{
+  PyGILState_Release((PyGILState_STATE)(intptr_t)token);
+}
+
+/**
+ * Collects the outcome of \ref _pybeamblockage_precompute
+ */
+typedef struct _PyBeamBlockagePrecompute {
+  PyObject* callback;  /**< the python progress function or NULL */
+  PyObject* results;   /**< list with a (status, seconds) tuple for each scan */
+  PyObject* errtype;   /**< type of the exception raised by the progress function */
+  PyObject* errvalue;  /**< value of the exception raised by the progress function */
+  PyObject* errtb;     /**< traceback of the exception raised by the progress function */
+} PyBeamBlockagePrecompute;
+
+/**
+ * Progress function for BeamBlockage_precompute. Called from the threads processing the scans,
+ * so the GIL is taken before touching any python objects. After the progress function has raised
+ * an exception it isn't called any more.
+ */
+static void _pybeamblockage_precomputeProgress(void* data, int index, int ndone, int total, BeamBlockagePrecomputeStatus status, double seconds)
+{
+  PyBeamBlockagePrecompute* pre = (PyBeamBlockagePrecompute*)data;
+  PyGILState_STATE gstate = PyGILState_Ensure();
+  PyObject* item = Py_BuildValue("(id)", (int)status, seconds);
+
+  if (item != NULL) {
+    PyList_SetItem(pre->results, index, item); /* Steals the reference */
+  } else {
+    PyErr_Clear();
+  }
+
+  if (pre->callback != NULL && pre->errtype == NULL) {
+    PyObject* pyresult = PyObject_CallFunction(pre->callback, "iiiid", index, ndone, total, (int)status, seconds);
+    if (pyresult == NULL) {
+      PyErr_Fetch(&pre->errtype, &pre->errvalue, &pre->errtb);
+    }
+    Py_XDECREF(pyresult);
+  }
+
+  PyGILState_Release(gstate);
+}
+
+/**
+ * Fills the cache with the blockage for a list of scans. The scans are processed without holding the GIL.
+ * @param[in] self - self
+ * @param[in] args - the arguments (list of PyPolarScan, double (Limit of Gaussian approximation of main lobe),
+ * progress function (optional) called as progress(index, ndone, total, status, seconds))
+ * @return a list with a (status, seconds) tuple for each scan, status being one of the Precompute_ constants
+ */
+static PyObject* _pybeamblockage_precompute(PyBeamBlockage* self, PyObject* args)
+{
+  PyObject* pyscans = NULL;
+  PyObject* pycallback = NULL;
+  PyObject* result = NULL;
+  RaveObjectList_t* scans = NULL;
+  PyBeamBlockagePrecompute pre;
+  double dBlim = 0.0;
+  Py_ssize_t nscans = 0, i = 0;
+  int status = 0;
+
+  memset(&pre, 0, sizeof(pre));
+
+  if (!PyArg_ParseTuple(args, "Od|O", &pyscans, &dBlim, &pycallback)) {
+    return NULL;
+  }
+  if (!PySequence_Check(pyscans)) {
+    raiseException_returnNULL(PyExc_ValueError, "First argument should be a list of Polar Scans");
+  }
+  if (pycallback == Py_None) {
+    pycallback = NULL;
+  }
+  if (pycallback != NULL && !PyCallable_Check(pycallback)) {
+    raiseException_returnNULL(PyExc_ValueError, "Progress function must be callable");
+  }
+
+  scans = RAVE_OBJECT_NEW(&RaveObjectList_TYPE);
+  if (scans == NULL) {
+    raiseException_returnNULL(PyExc_MemoryError, "Failed to create list");
+  }
+  nscans = PySequence_Size(pyscans);
+  for (i = 0; i < nscans; i++) {
+    PyObject* pyscan = PySequence_GetItem(pyscans, i);
+    if (pyscan == NULL || !PyPolarScan_Check(pyscan)) {
+      Py_XDECREF(pyscan);
+      raiseException_gotoTag(done, PyExc_ValueError, "First argument should be a list of Polar Scans");
+    }
+    if (!RaveObjectList_add(scans, (RaveCoreObject*)((PyPolarScan*)pyscan)->scan)) {
+      Py_DECREF(pyscan);
+      raiseException_gotoTag(done, PyExc_MemoryError, "Failed to add scan to list");
+    }
+    Py_DECREF(pyscan);
+  }
+
+  pre.callback = pycallback;
+  pre.results = PyList_New(nscans);
+  if (pre.results == NULL) {
+    goto done;
+  }
+  for (i = 0; i < nscans; i++) {
+    Py_INCREF(Py_None);
+    PyList_SetItem(pre.results, i, Py_None);
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  status = BeamBlockage_precompute(self->beamb, scans, dBlim, _pybeamblockage_precomputeProgress, &pre);
+  Py_END_ALLOW_THREADS
+
+  if (pre.errtype != NULL) {
+    PyErr_Restore(pre.errtype, pre.errvalue, pre.errtb);
+    goto done;
+  }
+  if (!status && BeamBlockage_getCacheDirectory(self->beamb) == NULL) {
+    raiseException_gotoTag(done, PyExc_RuntimeError, "Precomputing requires a cache directory");
+  }
+
+  result = pre.results;
+  pre.results = NULL;
+done:
+  Py_XDECREF(pre.results);
+  RAVE_OBJECT_RELEASE(scans);
+  return result;
+}
+
+/**
+ * Removes the superseded fields from the cache.
+ * @param[in] self - self
+ * @param[in] args - N/A
+ * @return None on success otherwise NULL
+ */
+static PyObject* _pybeamblockage_compactCache(PyBeamBlockage* self, PyObject* args)
+{
+  int status = 0;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  status = BeamBlockage_compactCache(self->beamb);
+  Py_END_ALLOW_THREADS
+
+  if (!status) {
+    raiseException_returnNULL(PyExc_RuntimeError, "Failed to compact cache");
+  }
+  Py_RETURN_NONE;
+}
+
+/**
+ * Removes cache files until the cache is within the max size and max age.
+ * @param[in] self - self
+ * @param[in] args - N/A
+ * @return the number of removed files
+ */
+static PyObject* _pybeamblockage_cleanCache(PyBeamBlockage* self, PyObject* args)
+{
+  long nevicted = 0;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  nevicted = BeamBlockage_cleanCache(self->beamb);
+  Py_END_ALLOW_THREADS
+
+  return PyLong_FromLong(nevicted);
+}
+
+/**
+ * Adds a value to the statistics dictionary
+ * @param[in] dictionary - the dictionary
+ * @param[in] name - the key
+ * @param[in] value - the value, the reference is stolen
+ * @return 1 on success otherwise 0
+ */
+static int _pybeamblockage_setStatistic(PyObject* dictionary, const char* name, PyObject* value)
+{
+  int result = 0;
+  if (value != NULL) {
+    result = (PyDict_SetItemString(dictionary, name, value) == 0);
+  }
+  Py_XDECREF(value);
+  return result;
+}
+
+/**
+ * Returns the usage of the cache.
+ * @param[in] self - self
+ * @param[in] args - N/A
+ * @return a dictionary with entries, bytes, hits, misses, computed, computetime and evicted
+ */
+static PyObject* _pybeamblockage_getCacheStatistics(PyBeamBlockage* self, PyObject* args)
+{
+  BeamBlockageCacheStatistics stats;
+  PyObject* result = NULL;
+  int status = 0;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  status = BeamBlockage_getCacheStatistics(self->beamb, &stats);
+  Py_END_ALLOW_THREADS
+
+  if (!status) {
+    raiseException_returnNULL(PyExc_RuntimeError, "Failed to get cache statistics");
+  }
+  result = PyDict_New();
+  if (result == NULL ||
+      !_pybeamblockage_setStatistic(result, "entries", PyLong_FromLong(stats.entries)) ||
+      !_pybeamblockage_setStatistic(result, "bytes", PyLong_FromLongLong(stats.bytes)) ||
+      !_pybeamblockage_setStatistic(result, "hits", PyLong_FromLong(stats.hits)) ||
+      !_pybeamblockage_setStatistic(result, "misses", PyLong_FromLong(stats.misses)) ||
+      !_pybeamblockage_setStatistic(result, "computed", PyLong_FromLong(stats.computed)) ||
+      !_pybeamblockage_setStatistic(result, "computetime", PyFloat_FromDouble(stats.computetime)) ||
+      !_pybeamblockage_setStatistic(result, "evicted", PyLong_FromLong(stats.evicted))) {
+    Py_XDECREF(result);
+    return NULL;
+  }
   return result;
 }
 
@@ -210,9 +503,26 @@ static PyObject* _pybeamblockage_getBlockage(PyBeamBlockage* self, PyObject* arg
 static struct PyMethodDef _pybeamblockage_methods[] =
 {
   {"topo30dir", NULL, METH_VARARGS},
+  {"topographyid", NULL, METH_VARARGS},
   {"cachedir", NULL, METH_VARARGS},
   {"rewritecache", NULL, METH_VARARGS},
+  {"nthreads", NULL, METH_VARARGS},
+  {"cacheformat", NULL, METH_VARARGS},
+  {"cachemaxsize", NULL, METH_VARARGS},
+  {"cachemaxage", NULL, METH_VARARGS},
+  {"cachetolerance", NULL, METH_VARARGS},
+  {"cachephi", NULL, METH_VARARGS},
+  {"horizon", NULL, METH_VARARGS},
+  {"levels", NULL, METH_VARARGS},
+  {"sampling", NULL, METH_VARARGS},
+  {"compressed", NULL, METH_VARARGS},
+  {"blocklayout", NULL, METH_VARARGS},
   {"getBlockage", (PyCFunction)_pybeamblockage_getBlockage, 1},
+  {"processVolume", (PyCFunction)_pybeamblockage_processVolume, 1},
+  {"compactCache", (PyCFunction)_pybeamblockage_compactCache, 1},
+  {"precompute", (PyCFunction)_pybeamblockage_precompute, 1},
+  {"cleanCache", (PyCFunction)_pybeamblockage_cleanCache, 1},
+  {"getCacheStatistics", (PyCFunction)_pybeamblockage_getCacheStatistics, 1},
   {NULL, NULL} /* sentinel */
 };
 
@@ -238,6 +548,32 @@ static PyObject* _pybeamblockage_getattro(PyBeamBlockage* self, PyObject* name)
   } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("rewritecache", name) == 0) {
     int val = BeamBlockage_getRewriteCache(self->beamb);
     return PyBool_FromLong(val);
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("nthreads", name) == 0) {
+    return PyLong_FromLong(BeamBlockage_getThreads(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("cacheformat", name) == 0) {
+    return PyLong_FromLong(BeamBlockage_getCacheFormat(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("cachemaxsize", name) == 0) {
+    return PyLong_FromLongLong(BeamBlockage_getCacheMaxSize(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("cachemaxage", name) == 0) {
+    return PyLong_FromLong(BeamBlockage_getCacheMaxAge(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("cachephi", name) == 0) {
+    return PyBool_FromLong(BeamBlockage_getCachePhi(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("horizon", name) == 0) {
+    return PyBool_FromLong(BeamBlockage_getHorizon(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("levels", name) == 0) {
+    return PyLong_FromLong(BeamBlockage_getLevels(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("sampling", name) == 0) {
+    return PyLong_FromLong(BeamBlockage_getSampling(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("compressed", name) == 0) {
+    return PyBool_FromLong(BeamBlockage_getCompressed(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("blocklayout", name) == 0) {
+    return PyBool_FromLong(BeamBlockage_getBlockLayout(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("topographyid", name) == 0) {
+    return PyLong_FromUnsignedLong(BeamBlockage_getTopographyId(self->beamb));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("cachetolerance", name) == 0) {
+    BeamBlockageCacheTolerance tolerance;
+    BeamBlockage_getCacheTolerance(self->beamb, &tolerance);
+    return Py_BuildValue("(dddd)", tolerance.position, tolerance.height, tolerance.angle, tolerance.range);
   }
   return PyObject_GenericGetAttr((PyObject*)self, name);
 }
@@ -255,7 +591,7 @@ static int _pybeamblockage_setattro(PyBeamBlockage* self, PyObject* name, PyObje
   if (PY_COMPARE_STRING_WITH_ATTRO_NAME("topo30dir", name) == 0) {
     if (PyString_Check(val)) {
       if (!BeamBlockage_setTopo30Directory(self->beamb, PyString_AsString(val))) {
-        raiseException_gotoTag(done, PyExc_ValueError, "topo30dir must be a string or None");
+        raiseException_gotoTag(done, PyExc_ValueError, "Failed to set topo30dir");
       }
     } else if (val == Py_None) {
       BeamBlockage_setTopo30Directory(self->beamb, NULL);
@@ -278,6 +614,72 @@ static int _pybeamblockage_setattro(PyBeamBlockage* self, PyObject* name, PyObje
     } else {
       raiseException_gotoTag(done, PyExc_ValueError, "rewritecache must be a boolean");
     }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("nthreads", name) == 0) {
+    if ((PyLong_Check(val) || PyInt_Check(val)) && PyLong_AsLong(val) >= 1) {
+      BeamBlockage_setThreads(self->beamb, (int)PyLong_AsLong(val));
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "nthreads must be an integer >= 1");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("cacheformat", name) == 0) {
+    if (!(PyLong_Check(val) || PyInt_Check(val)) ||
+        !BeamBlockage_setCacheFormat(self->beamb, (BeamBlockageCacheFormat)PyLong_AsLong(val))) {
+      raiseException_gotoTag(done, PyExc_ValueError, "cacheformat must be CacheFormat_HDF5, CacheFormat_BINARY or CacheFormat_STORE");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("cachemaxsize", name) == 0) {
+    if ((PyLong_Check(val) || PyInt_Check(val)) && PyLong_AsLongLong(val) >= 0) {
+      BeamBlockage_setCacheMaxSize(self->beamb, PyLong_AsLongLong(val));
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "cachemaxsize must be an integer >= 0");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("cachemaxage", name) == 0) {
+    if ((PyLong_Check(val) || PyInt_Check(val)) && PyLong_AsLong(val) >= 0) {
+      BeamBlockage_setCacheMaxAge(self->beamb, PyLong_AsLong(val));
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "cachemaxage must be an integer >= 0");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("cachephi", name) == 0) {
+    if (PyBool_Check(val)) {
+      BeamBlockage_setCachePhi(self->beamb, val == Py_True?1:0);
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "cachephi must be a boolean");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("horizon", name) == 0) {
+    if (PyBool_Check(val)) {
+      BeamBlockage_setHorizon(self->beamb, val == Py_True?1:0);
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "horizon must be a boolean");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("levels", name) == 0) {
+    if ((PyLong_Check(val) || PyInt_Check(val)) && PyLong_AsLong(val) >= 0) {
+      BeamBlockage_setLevels(self->beamb, (int)PyLong_AsLong(val));
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "levels must be an integer >= 0");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("sampling", name) == 0) {
+    if (!(PyLong_Check(val) || PyInt_Check(val)) || !BeamBlockage_setSampling(self->beamb, (BeamBlockageMapSampling)PyLong_AsLong(val))) {
+      raiseException_gotoTag(done, PyExc_ValueError, "sampling must be one of Sampling_NEAREST, Sampling_MEAN or Sampling_MAX");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("compressed", name) == 0) {
+    if (PyBool_Check(val)) {
+      BeamBlockage_setCompressed(self->beamb, val == Py_True?1:0);
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "compressed must be a boolean");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("blocklayout", name) == 0) {
+    if (PyBool_Check(val)) {
+      BeamBlockage_setBlockLayout(self->beamb, val == Py_True?1:0);
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "blocklayout must be a boolean");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("cachetolerance", name) == 0) {
+    BeamBlockageCacheTolerance tolerance;
+    if (val == Py_None) {
+      BeamBlockage_setCacheTolerance(self->beamb, NULL);
+    } else if (!PyArg_ParseTuple(val, "dddd", &tolerance.position, &tolerance.height, &tolerance.angle, &tolerance.range) ||
+               !BeamBlockage_setCacheTolerance(self->beamb, &tolerance)) {
+      PyErr_Clear();
+      raiseException_gotoTag(done, PyExc_ValueError, "cachetolerance must be None or a tuple (position, height, angle, range) of values >= 0");
+    }
   } else {
     raiseException_gotoTag(done, PyExc_AttributeError, PY_RAVE_ATTRO_NAME_TO_STRING(name));
   }
@@ -340,13 +742,94 @@ PyTypeObject PyBeamBlockage_Type =
 /*@} End of Type definitions */
 
 /*@{ Functions */
+static PyObject* _pybeamblockage_setFieldCacheMaxSize(PyObject* self, PyObject* args)
+{
+  long size = 0;
+  if (!PyArg_ParseTuple(args, "l", &size)) {
+    return NULL;
+  }
+  BBFieldCache_setMaxSize(size);
+  Py_RETURN_NONE;
+}
 
+static PyObject* _pybeamblockage_getFieldCacheMaxSize(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  return PyLong_FromLong(BBFieldCache_getMaxSize());
+}
+
+static PyObject* _pybeamblockage_getFieldCacheSize(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  return PyLong_FromLong(BBFieldCache_getSize());
+}
+
+static PyObject* _pybeamblockage_getFieldCacheHits(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  return PyLong_FromLong(BBFieldCache_getHits());
+}
+
+static PyObject* _pybeamblockage_getFieldCacheMisses(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  return PyLong_FromLong(BBFieldCache_getMisses());
+}
+
+static PyObject* _pybeamblockage_clearFieldCache(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  BBFieldCache_clear();
+  Py_RETURN_NONE;
+}
+
+static PyObject* _pybeamblockage_resetCacheStatistics(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  BeamBlockage_resetCacheStatistics();
+  Py_RETURN_NONE;
+}
 /*@} End of Functions */
 
 /*@{ Module setup */
+/**
+ * Adds an integer constant to the module dictionary
+ * @param[in] dictionary - the module dictionary
+ * @param[in] name - the name of the constant
+ * @param[in] value - the value
+ */
+static void add_long_constant(PyObject* dictionary, const char* name, long value)
+{
+  PyObject* tmp = NULL;
+  tmp = PyInt_FromLong(value);
+  if (tmp != NULL) {
+    PyDict_SetItemString(dictionary, name, tmp);
+  }
+  Py_XDECREF(tmp);
+}
+
 static PyMethodDef functions[] = {
   {"new", (PyCFunction)_pybeamblockage_new, 1},
   {"restore", (PyCFunction)_pybeamblockage_restore, 1},
+  {"setFieldCacheMaxSize", (PyCFunction)_pybeamblockage_setFieldCacheMaxSize, 1},
+  {"getFieldCacheMaxSize", (PyCFunction)_pybeamblockage_getFieldCacheMaxSize, 1},
+  {"getFieldCacheSize", (PyCFunction)_pybeamblockage_getFieldCacheSize, 1},
+  {"getFieldCacheHits", (PyCFunction)_pybeamblockage_getFieldCacheHits, 1},
+  {"getFieldCacheMisses", (PyCFunction)_pybeamblockage_getFieldCacheMisses, 1},
+  {"clearFieldCache", (PyCFunction)_pybeamblockage_clearFieldCache, 1},
+  {"resetCacheStatistics", (PyCFunction)_pybeamblockage_resetCacheStatistics, 1},
   {NULL,NULL} /*Sentinel*/
 };
 
@@ -379,8 +862,24 @@ MOD_INIT(_beamblockage)
     return MOD_INIT_ERROR;
   }
 
+  add_long_constant(dictionary, "CacheFormat_HDF5", BeamBlockageCacheFormat_HDF5);
+  add_long_constant(dictionary, "CacheFormat_BINARY", BeamBlockageCacheFormat_BINARY);
+  add_long_constant(dictionary, "CacheFormat_STORE", BeamBlockageCacheFormat_STORE);
+  add_long_constant(dictionary, "Precompute_FAILED", BeamBlockagePrecompute_FAILED);
+  add_long_constant(dictionary, "Precompute_COMPUTED", BeamBlockagePrecompute_COMPUTED);
+  add_long_constant(dictionary, "Precompute_CACHED", BeamBlockagePrecompute_CACHED);
+  add_long_constant(dictionary, "Sampling_NEAREST", BeamBlockageMapSampling_NEAREST);
+  add_long_constant(dictionary, "Sampling_MEAN", BeamBlockageMapSampling_MEAN);
+  add_long_constant(dictionary, "Sampling_MAX", BeamBlockageMapSampling_MAX);
+
+#if PY_MAJOR_VERSION < 3 || (PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION < 7)
+  PyEval_InitThreads(); /* The precompute progress function and the HDF5 lock are called from other threads */
+#endif
+  BeamBlockage_setHdf5LockFunctions(_pybeamblockage_lockHdf5, _pybeamblockage_unlockHdf5, NULL);
+
   import_pyravefield();
   import_pypolarscan();
+  import_pypolarvolume();
   PYRAVE_DEBUG_INITIALIZE;
 
   return MOD_INIT_SUCCESS(module);
@@ -35,6 +35,9 @@ along with beamb.  If not, see <http://www.gnu.org/licenses/>.
 #include "pyrave_debug.h"
 #include "rave_alloc.h"
 #include "pybbtopography.h"
+#include "bbtopographycache.h"
+#include "bbgeometrycache.h"
+#include "bbhorizoncache.h"
 
 /**
  * Debug this module
@@ -157,24 +160,61 @@ static PyObject* _pybeamblockagemap_readTopography(PyBeamBlockageMap* self, PyOb
 {
   double lat = 0.0, lon = 0.0, radius = 0.0;
   PyObject* result = NULL;
+  BeamBlockageMap_t* map = NULL;
   BBTopography_t* field = NULL;
 
   if (!PyArg_ParseTuple(args, "ddd", &lat, &lon, &radius)) {
     return NULL;
   }
-  field = BeamBlockageMap_readTopography(self->map, lat, lon, radius);
+  map = RAVE_OBJECT_CLONE(self->map);
+  if (map == NULL) {
+    raiseException_returnNULL(PyExc_MemoryError, "Failed to clone beam blockage map");
+  }
+  Py_BEGIN_ALLOW_THREADS
+  field = BeamBlockageMap_readTopography(map, lat, lon, radius);
+  Py_END_ALLOW_THREADS
+  if (field != NULL) {
+    result = (PyObject*)PyBBTopography_New(field);
+  } else {
+    PyErr_SetString(PyExc_EnvironmentError, "Could not open topography");
+  }
+  RAVE_OBJECT_RELEASE(field);
+  RAVE_OBJECT_RELEASE(map);
+  return result;
+}
+
+static PyObject* _pybeamblockagemap_readTopographyRegion(PyBeamBlockageMap* self, PyObject* args)
+{
+  double north = 0.0, south = 0.0, east = 0.0, west = 0.0;
+  PyObject* result = NULL;
+  BeamBlockageMap_t* map = NULL;
+  BBTopography_t* field = NULL;
+
+  if (!PyArg_ParseTuple(args, "dddd", &north, &south, &east, &west)) {
+    return NULL;
+  }
+  map = RAVE_OBJECT_CLONE(self->map);
+  if (map == NULL) {
+    raiseException_returnNULL(PyExc_MemoryError, "Failed to clone beam blockage map");
+  }
+  Py_BEGIN_ALLOW_THREADS
+  field = BeamBlockageMap_readTopographyRegion(map, north, south, east, west);
+  Py_END_ALLOW_THREADS
   if (field != NULL) {
     result = (PyObject*)PyBBTopography_New(field);
   } else {
     PyErr_SetString(PyExc_EnvironmentError, "Could not open topography");
   }
   RAVE_OBJECT_RELEASE(field);
+  RAVE_OBJECT_RELEASE(map);
   return result;
 }
 
 static PyObject* _pybeamblockagemap_getTopographyForScan(PyBeamBlockageMap* self, PyObject* args)
 {
   PyObject* pyin = NULL;
+  BeamBlockageMap_t* map = NULL;
+  PolarScan_t* scan = NULL;
   BBTopography_t* field = NULL;
   PyObject* result = NULL;
   if (!PyArg_ParseTuple(args, "O", &pyin)) {
@@ -183,11 +223,21 @@ static PyObject* _pybeamblockagemap_getTopographyForScan(PyBeamBlockageMap* self
   if (!PyPolarScan_Check(pyin)) {
     raiseException_returnNULL(PyExc_ValueError, "In object must be a polar scan");
   }
-  field = BeamBlockageMap_getTopographyForScan(self->map, ((PyPolarScan*)pyin)->scan);
+  map = RAVE_OBJECT_CLONE(self->map);
+  scan = RAVE_OBJECT_CLONE(((PyPolarScan*)pyin)->scan);
+  if (map == NULL || scan == NULL) {
+    raiseException_gotoTag(done, PyExc_MemoryError, "Failed to clone beam blockage map or scan");
+  }
+  Py_BEGIN_ALLOW_THREADS
+  field = BeamBlockageMap_getTopographyForScan(map, scan);
+  Py_END_ALLOW_THREADS
   if (field != NULL) {
     result = (PyObject*)PyBBTopography_New(field);
   }
+done:
   RAVE_OBJECT_RELEASE(field);
+  RAVE_OBJECT_RELEASE(scan);
+  RAVE_OBJECT_RELEASE(map);
   return result;
 }
 
@@ -197,7 +247,14 @@ static PyObject* _pybeamblockagemap_getTopographyForScan(PyBeamBlockageMap* self
 static struct PyMethodDef _pybeamblockagemap_methods[] =
 {
   {"topo30dir", NULL, METH_VARARGS},
+  {"topographyid", NULL, METH_VARARGS},
+  {"horizon", NULL, METH_VARARGS},
+  {"levels", NULL, METH_VARARGS},
+  {"sampling", NULL, METH_VARARGS},
+  {"compressed", NULL, METH_VARARGS},
+  {"blocklayout", NULL, METH_VARARGS},
   {"readTopography", (PyCFunction)_pybeamblockagemap_readTopography, 1},
+  {"readTopographyRegion", (PyCFunction)_pybeamblockagemap_readTopographyRegion, 1},
   {"getTopographyForScan", (PyCFunction)_pybeamblockagemap_getTopographyForScan, 1},
   {NULL, NULL} /* sentinel */
 };
@@ -214,6 +271,18 @@ static PyObject* _pybeamblockagemap_getattro(PyBeamBlockageMap* self, PyObject*
     } else {
       Py_RETURN_NONE;
     }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("horizon", name) == 0) {
+    return PyBool_FromLong(BeamBlockageMap_getHorizon(self->map));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("levels", name) == 0) {
+    return PyLong_FromLong(BeamBlockageMap_getLevels(self->map));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("sampling", name) == 0) {
+    return PyLong_FromLong(BeamBlockageMap_getSampling(self->map));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("compressed", name) == 0) {
+    return PyBool_FromLong(BeamBlockageMap_getCompressed(self->map));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("blocklayout", name) == 0) {
+    return PyBool_FromLong(BeamBlockageMap_getBlockLayout(self->map));
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("topographyid", name) == 0) {
+    return PyLong_FromUnsignedLong(BeamBlockageMap_getTopographyId(self->map));
   }
   return PyObject_GenericGetAttr((PyObject*)self, name);
 }
@@ -231,13 +300,41 @@ static int _pybeamblockagemap_setattro(PyBeamBlockageMap* self, PyObject* name,
   if (PY_COMPARE_STRING_WITH_ATTRO_NAME("topo30dir", name) == 0) {
     if (PyString_Check(val)) {
       if (!BeamBlockageMap_setTopo30Directory(self->map, PyString_AsString(val))) {
-        raiseException_gotoTag(done, PyExc_ValueError, "topo30dir must be a string or None");
+        raiseException_gotoTag(done, PyExc_ValueError, "Failed to set topo30dir");
       }
     } else if (val == Py_None) {
       BeamBlockageMap_setTopo30Directory(self->map, NULL);
     } else {
       raiseException_gotoTag(done, PyExc_ValueError, "topo30dir must be a string or None");
     }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("horizon", name) == 0) {
+    if (PyBool_Check(val)) {
+      BeamBlockageMap_setHorizon(self->map, val == Py_True?1:0);
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "horizon must be a boolean");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("levels", name) == 0) {
+    if ((PyLong_Check(val) || PyInt_Check(val)) && PyLong_AsLong(val) >= 0) {
+      BeamBlockageMap_setLevels(self->map, (int)PyLong_AsLong(val));
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "levels must be an integer >= 0");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("sampling", name) == 0) {
+    if (!(PyLong_Check(val) || PyInt_Check(val)) || !BeamBlockageMap_setSampling(self->map, (BeamBlockageMapSampling)PyLong_AsLong(val))) {
+      raiseException_gotoTag(done, PyExc_ValueError, "sampling must be one of Sampling_NEAREST, Sampling_MEAN or Sampling_MAX");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("compressed", name) == 0) {
+    if (PyBool_Check(val)) {
+      BeamBlockageMap_setCompressed(self->map, val == Py_True?1:0);
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "compressed must be a boolean");
+    }
+  } else if (PY_COMPARE_STRING_WITH_ATTRO_NAME("blocklayout", name) == 0) {
+    if (PyBool_Check(val)) {
+      BeamBlockageMap_setBlockLayout(self->map, val == Py_True?1:0);
+    } else {
+      raiseException_gotoTag(done, PyExc_ValueError, "blocklayout must be a boolean");
+    }
   } else {
     raiseException_gotoTag(done, PyExc_AttributeError, PY_RAVE_ATTRO_NAME_TO_STRING(name));
   }
@@ -301,12 +398,143 @@ PyTypeObject PyBeamBlockageMap_Type =
 /*@} End of Type definitions */
 
 /*@{ Functions */
+static PyObject* _pybeamblockagemap_setTileCacheMaxSize(PyObject* self, PyObject* args)
+{
+  long size = 0;
+  if (!PyArg_ParseTuple(args, "l", &size)) {
+    return NULL;
+  }
+  BBTopographyCache_setMaxSize(size);
+  Py_RETURN_NONE;
+}
+
+static PyObject* _pybeamblockagemap_getTileCacheMaxSize(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  return PyLong_FromLong(BBTopographyCache_getMaxSize());
+}
+
+static PyObject* _pybeamblockagemap_getTileCacheSize(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  return PyLong_FromLong(BBTopographyCache_getSize());
+}
+
+static PyObject* _pybeamblockagemap_clearTileCache(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  BBTopographyCache_clear();
+  Py_RETURN_NONE;
+}
+
+static PyObject* _pybeamblockagemap_setGeometryCacheMaxSize(PyObject* self, PyObject* args)
+{
+  long size = 0;
+  if (!PyArg_ParseTuple(args, "l", &size)) {
+    return NULL;
+  }
+  BBGeometryCache_setMaxSize(size);
+  Py_RETURN_NONE;
+}
+
+static PyObject* _pybeamblockagemap_getGeometryCacheMaxSize(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  return PyLong_FromLong(BBGeometryCache_getMaxSize());
+}
+
+static PyObject* _pybeamblockagemap_getGeometryCacheSize(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  return PyLong_FromLong(BBGeometryCache_getSize());
+}
 
+static PyObject* _pybeamblockagemap_clearGeometryCache(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  BBGeometryCache_clear();
+  Py_RETURN_NONE;
+}
+
+static PyObject* _pybeamblockagemap_setHorizonCacheMaxSize(PyObject* self, PyObject* args)
+{
+  long size = 0;
+  if (!PyArg_ParseTuple(args, "l", &size)) {
+    return NULL;
+  }
+  BBHorizonCache_setMaxSize(size);
+  Py_RETURN_NONE;
+}
+
+static PyObject* _pybeamblockagemap_getHorizonCacheMaxSize(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  return PyLong_FromLong(BBHorizonCache_getMaxSize());
+}
+
+static PyObject* _pybeamblockagemap_getHorizonCacheSize(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  return PyLong_FromLong(BBHorizonCache_getSize());
+}
+
+static PyObject* _pybeamblockagemap_clearHorizonCache(PyObject* self, PyObject* args)
+{
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+  BBHorizonCache_clear();
+  Py_RETURN_NONE;
+}
 /*@} End of Functions */
 
 /*@{ Module setup */
+/**
+ * Adds an integer constant to the module dictionary
+ * @param[in] dictionary - the module dictionary
+ * @param[in] name - the name of the constant
+ * @param[in] value - the value
+ */
+static void add_long_constant(PyObject* dictionary, const char* name, long value)
+{
+  PyObject* tmp = NULL;
+  tmp = PyInt_FromLong(value);
+  if (tmp != NULL) {
+    PyDict_SetItemString(dictionary, name, tmp);
+  }
+  Py_XDECREF(tmp);
+}
+
 static PyMethodDef functions[] = {
   {"new", (PyCFunction)_pybeamblockagemap_new, 1},
+  {"setTileCacheMaxSize", (PyCFunction)_pybeamblockagemap_setTileCacheMaxSize, 1},
+  {"getTileCacheMaxSize", (PyCFunction)_pybeamblockagemap_getTileCacheMaxSize, 1},
+  {"getTileCacheSize", (PyCFunction)_pybeamblockagemap_getTileCacheSize, 1},
+  {"clearTileCache", (PyCFunction)_pybeamblockagemap_clearTileCache, 1},
+  {"setGeometryCacheMaxSize", (PyCFunction)_pybeamblockagemap_setGeometryCacheMaxSize, 1},
+  {"getGeometryCacheMaxSize", (PyCFunction)_pybeamblockagemap_getGeometryCacheMaxSize, 1},
+  {"getGeometryCacheSize", (PyCFunction)_pybeamblockagemap_getGeometryCacheSize, 1},
+  {"clearGeometryCache", (PyCFunction)_pybeamblockagemap_clearGeometryCache, 1},
+  {"setHorizonCacheMaxSize", (PyCFunction)_pybeamblockagemap_setHorizonCacheMaxSize, 1},
+  {"getHorizonCacheMaxSize", (PyCFunction)_pybeamblockagemap_getHorizonCacheMaxSize, 1},
+  {"getHorizonCacheSize", (PyCFunction)_pybeamblockagemap_getHorizonCacheSize, 1},
+  {"clearHorizonCache", (PyCFunction)_pybeamblockagemap_clearHorizonCache, 1},
   {NULL,NULL} /*Sentinel*/
 };
 
@@ -339,6 +567,10 @@ MOD_INIT(_beamblockagemap)
     return MOD_INIT_ERROR;
   }
 
+  add_long_constant(dictionary, "Sampling_NEAREST", BeamBlockageMapSampling_NEAREST);
+  add_long_constant(dictionary, "Sampling_MEAN", BeamBlockageMapSampling_MEAN);
+  add_long_constant(dictionary, "Sampling_MAX", BeamBlockageMapSampling_MAX);
+
   import_bbtopography();
   import_pypolarscan();
   PYRAVE_DEBUG_INITIALIZE;
@@ -30,6 +30,7 @@ import _bbtopography
 import os, string
 import _rave
 import numpy
+import math
 
 class PyBBTopographyTest(unittest.TestCase):
   def setUp(self):
@@ -141,6 +142,178 @@ class PyBBTopographyTest(unittest.TestCase):
     self.assertAlmostEqual(25.0, result.getValue(5,14)[1], 4)    
 
 
+  def test_addTile(self):
+    obj = _bbtopography.new()
+    obj.setData(numpy.zeros((10,10), numpy.int16))
+    obj.xdim = obj.ydim = 0.01
+    obj.ulxmap = 0.1
+    obj.ulymap = 1.0
+    obj.setValue(5,4,20.0)
+
+    obj2 = _bbtopography.new()
+    obj2.setData(numpy.zeros((6,10), numpy.int16))
+    obj2.xdim = obj2.ydim = 0.01
+    obj2.ulxmap = 0.1
+    obj2.ulymap = 0.9
+    obj2.setValue(5,4,25.0)
+
+    obj3 = _bbtopography.new()
+    obj3.setData(numpy.zeros((10,4), numpy.int16))
+    obj3.xdim = obj3.ydim = 0.01
+    obj3.ulxmap = 0.2
+    obj3.ulymap = 1.0
+    obj3.setValue(1,2,30.0)
+
+    result = _bbtopography.new()
+    result.addTile(obj)
+    result.addTile(obj2)
+    result.addTile(obj3)
+    self.assertEqual(14, result.ncols)
+    self.assertEqual(16, result.nrows)
+    self.assertAlmostEqual(0.1, result.ulxmap, 4)
+    self.assertAlmostEqual(1.0, result.ulymap, 4)
+    self.assertAlmostEqual(20.0, result.getValue(5,4)[1], 4)
+    self.assertAlmostEqual(25.0, result.getValue(5,14)[1], 4)
+    self.assertAlmostEqual(30.0, result.getValue(11,2)[1], 4)
+    self.assertAlmostEqual(-9999.0, result.getValue(12,12)[1], 4)
+    self.assertEqual(0, result.getValue(14,0)[0])
+
+    data = result.getData()
+    self.assertEqual(20, data[4][5])
+    self.assertEqual(25, data[14][5])
+    self.assertEqual(30, data[2][11])
+
+  def test_addTile_acrossDateline(self):
+    east = _bbtopography.new()
+    east.setData(numpy.zeros((10,10), numpy.int16))
+    east.xdim = east.ydim = 0.01
+    east.ulxmap = math.pi - 0.1
+    east.ulymap = 1.0
+    east.setValue(9,0,10.0)
+
+    west = _bbtopography.new()
+    west.setData(numpy.zeros((10,10), numpy.int16))
+    west.xdim = west.ydim = 0.01
+    west.ulxmap = -math.pi
+    west.ulymap = 1.0
+    west.setValue(0,0,20.0)
+
+    result = _bbtopography.new()
+    result.addTile(east)
+    result.addTile(west)
+    self.assertEqual(20, result.ncols)
+    self.assertAlmostEqual(10.0, result.getValueAtLonLat(math.pi - 0.005, 0.995), 4)
+    self.assertAlmostEqual(20.0, result.getValueAtLonLat(-math.pi + 0.005, 0.995), 4)
+
+
+  def test_createOverviews(self):
+    obj = _bbtopography.new()
+    obj.setData(numpy.array([[1, 3, 10, -9999],
+                             [5, 7, -9999, -9999],
+                             [2, 2, 4, 6]], numpy.int16))
+    obj.xdim = obj.ydim = 0.01
+    obj.ulxmap = 0.1
+    obj.ulymap = 1.0
+    self.assertEqual(0, obj.nlevels)
+    obj.createOverviews(3)
+    self.assertEqual(2, obj.nlevels)
+
+    level = obj.getLevel(1)
+    self.assertEqual(2, level.ncols)
+    self.assertEqual(2, level.nrows)
+    self.assertAlmostEqual(0.02, level.xdim, 4)
+    self.assertAlmostEqual(1.0, level.ulymap, 4)
+    self.assertAlmostEqual(4.0, level.getValue(0,0)[1], 4)
+    self.assertAlmostEqual(10.0, level.getValue(1,0)[1], 4)
+    self.assertAlmostEqual(2.0, level.getValue(0,1)[1], 4)
+    self.assertAlmostEqual(5.0, level.getValue(1,1)[1], 4)
+    self.assertAlmostEqual(4.0, obj.getLevel(2).getValue(0,0)[1], 4)
+
+    obj.setValue(0,0,2.0)
+    self.assertEqual(0, obj.nlevels)
+
+  def test_getFootprint(self):
+    data = numpy.array([[1, 3, 10, -9999, 8],
+                        [5, 7, -9999, -9999, 2],
+                        [2, 2, 4, 6, 1],
+                        [9, 0, 3, 1, 5]], numpy.int16)
+    obj = _bbtopography.new()
+    obj.nodata = -9999
+    obj.setData(data)
+    obj.createFootprintTables()
+
+    for (col0, row0, col1, row1) in [(0,0,0,0), (0,0,1,1), (1,0,3,2), (0,0,4,3), (2,1,3,1), (3,2,4,3)]:
+      box = data[row0:row1+1, col0:col1+1]
+      valid = box[box != -9999]
+      self.assertAlmostEqual(valid.mean(), obj.getFootprintMean(col0, row0, col1, row1)[1], 4)
+      self.assertAlmostEqual(valid.max(), obj.getFootprintMax(col0, row0, col1, row1)[1], 4)
+    self.assertAlmostEqual(10.0, obj.getFootprintMax(0, 0, 4, 3)[1], 4)
+    self.assertAlmostEqual(3.0, obj.getFootprintMean(-2, -2, 0, 1)[1], 4)
+    self.assertEqual(0, obj.getFootprintMean(3, 1, 3, 1)[0])
+
+    obj.setValue(0,0,2.0)
+    try:
+      obj.getFootprintMean(0, 0, 1, 1)
+      self.fail("Expected AttributeError")
+    except AttributeError:
+      pass
+
+  def test_compress(self):
+    data = numpy.zeros((70, 130), numpy.int16)
+    data[:, :] = numpy.arange(130) * 7 - 200
+    data[3, 5] = -9999
+    data[60:70, 0:70] = -9999
+    data[65, 129] = 32767
+    obj = _bbtopography.new()
+    obj.setData(data)
+    self.assertFalse(obj.compressed)
+    self.assertEqual(70*130*2, obj.datasize)
+    obj.compress()
+    self.assertTrue(obj.compressed)
+    self.assertTrue(obj.datasize < 70*130*2)
+    self.assertEqual((1, -9999.0), obj.getValue(5, 3))
+    self.assertEqual((1, 32767.0), obj.getValue(129, 65))
+    self.assertEqual(0, obj.getValue(130, 0)[0])
+    self.assertTrue((data == obj.getData()).all())
+    self.assertFalse(obj.compressed)
+
+  def test_compress_nodataWithinRange(self):
+    # The block spans -5..122 with nodata 0 inside the range, so range + 1 is a power of two and
+    # nodata has to be coded as a normal value
+    data = numpy.zeros((64, 64), numpy.int16)
+    data[:, :] = numpy.arange(64) * 2 - 5
+    data[0, 0] = 122
+    data[10, 10] = 0
+    obj = _bbtopography.new()
+    obj.nodata = 0
+    obj.setData(data)
+    obj.compress()
+    self.assertTrue(obj.compressed)
+    self.assertEqual(0.0, obj.getValue(10, 10)[1])
+    self.assertEqual(122.0, obj.getValue(0, 0)[1])
+    self.assertEqual(-5.0, obj.getValue(0, 1)[1])
+    self.assertTrue((data == obj.getData()).all())
+
+  def test_createBlockLayout(self):
+    data = numpy.arange(70*130, dtype=numpy.int16).reshape((70, 130))
+    obj = _bbtopography.new()
+    obj.setData(data)
+    obj.xdim = obj.ydim = 0.01
+    obj.ulxmap = 0.1
+    obj.ulymap = 1.0
+    self.assertFalse(obj.blocklayout)
+    obj.createBlockLayout()
+    self.assertTrue(obj.blocklayout)
+    self.assertEqual(130, obj.ncols)
+    self.assertEqual(70, obj.nrows)
+    for col, row in [(0, 0), (63, 0), (64, 1), (129, 5), (0, 64), (100, 69), (129, 69)]:
+      self.assertEqual((1, float(data[row][col])), obj.getValue(col, row))
+    self.assertAlmostEqual(float(data[65][128]), obj.getValueAtLonLat(0.1 + 1.285, 1.0 - 0.655)[1], 4)
+    self.assertEqual(0, obj.getValue(0, 70)[0])
+    self.assertTrue((data == obj.getData()).all())
+    self.assertFalse(obj.blocklayout)
+
+
 if __name__ == "__main__":
   #import sys;sys.argv = ['', 'Test.testName']
   unittest.main()
\ No newline at end of file
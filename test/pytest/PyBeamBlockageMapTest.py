@@ -29,6 +29,7 @@ import _raveio
 import _beamblockage
 import _beamblockagemap
 import os, string
+import tempfile, shutil
 import _rave
 import math
 
@@ -59,6 +60,17 @@ class PyBeamBlockageMapTest(unittest.TestCase):
     self.assertEqual(6000, result.nrows)
     self.assertEqual(4800, result.ncols)
     
+  def testReadTopo30_valuesMatchData(self):
+    a = _beamblockagemap.new()
+    a.topo30dir="../../data/gtopo30"
+    result = a.readTopography(60*math.pi/180, 0*math.pi/180.0, 100000)
+    v1 = result.getValue(2400, 3600)
+    data = result.getData()
+    self.assertEqual(1, v1[0])
+    self.assertEqual(data[3600][2400], v1[1])
+    self.assertEqual(6000, data.shape[0])
+    self.assertEqual(4800, data.shape[1])
+
   def testReadTopo30_combined(self):
     a = _beamblockagemap.new()
     a.topo30dir="../../data/gtopo30"
@@ -67,12 +79,256 @@ class PyBeamBlockageMapTest(unittest.TestCase):
     self.assertEqual(6000, result.nrows)
     self.assertEqual(9600, result.ncols)
   
+  def testReadTopographyRegion(self):
+    a = _beamblockagemap.new()
+    a.topo30dir="../../data/gtopo30"
+    full = a.readTopography(60*math.pi/180, 20*math.pi/180.0, 200000)
+    result = a.readTopographyRegion(61*math.pi/180, 59*math.pi/180, 22*math.pi/180, 18*math.pi/180)
+    self.assertTrue(result != None)
+    self.assertTrue(result.nrows < 300)
+    self.assertTrue(result.ncols < 600)
+    for lon, lat in [(18.5, 59.5), (19.99, 60.0), (20.01, 60.0), (21.5, 60.5)]:
+      self.assertEqual(full.getValueAtLonLat(lon*math.pi/180, lat*math.pi/180),
+                       result.getValueAtLonLat(lon*math.pi/180, lat*math.pi/180))
+
+  def testReadTopo30_manifest(self):
+    topodir = tempfile.mkdtemp()
+    try:
+      for ext in [".HDR", ".DEM"]:
+        os.symlink(os.path.abspath("../../data/gtopo30/W020N90" + ext), os.path.join(topodir, "nordic" + ext))
+      with open(os.path.join(topodir, "beamb_tiles.txt"), "w") as fp:
+        fp.write("# name west north east south\n\nnordic -20 90 20 40\n")
+      a = _beamblockagemap.new()
+      a.topo30dir=topodir
+      result = a.readTopography(60*math.pi/180, 0*math.pi/180.0, 100000)
+      self.assertEqual(6000, result.nrows)
+      self.assertEqual(4800, result.ncols)
+      b = _beamblockagemap.new()
+      b.topo30dir="../../data/gtopo30"
+      self.assertEqual(b.readTopography(60*math.pi/180, 0*math.pi/180.0, 100000).getValue(2400, 3600), result.getValue(2400, 3600))
+      try:
+        a.readTopography(60*math.pi/180, 30*math.pi/180.0, 100000)
+        self.fail("Expected IOError")
+      except IOError:
+        pass
+    finally:
+      shutil.rmtree(topodir)
+
+  def testTopo30_badManifest(self):
+    topodir = tempfile.mkdtemp()
+    try:
+      with open(os.path.join(topodir, "beamb_tiles.txt"), "w") as fp:
+        fp.write("nordic -20 90\n")
+      a = _beamblockagemap.new()
+      try:
+        a.topo30dir=topodir
+        self.fail("Expected ValueError")
+      except ValueError:
+        pass
+    finally:
+      shutil.rmtree(topodir)
+
+  def testTileCache(self):
+    _beamblockagemap.clearTileCache()
+    self.assertEqual(0, _beamblockagemap.getTileCacheSize())
+    a = _beamblockagemap.new()
+    a.topo30dir="../../data/gtopo30"
+    r1 = a.readTopography(60*math.pi/180, 0*math.pi/180.0, 100000)
+    self.assertEqual(6000*4800*2, _beamblockagemap.getTileCacheSize())
+    b = _beamblockagemap.new()
+    b.topo30dir="../../data/gtopo30"
+    r2 = b.readTopography(60*math.pi/180, 0*math.pi/180.0, 100000)
+    self.assertEqual(6000*4800*2, _beamblockagemap.getTileCacheSize())
+    self.assertEqual(r1.getValue(2400, 3600), r2.getValue(2400, 3600))
+    _beamblockagemap.clearTileCache()
+    self.assertEqual(0, _beamblockagemap.getTileCacheSize())
+
+  def testTileCache_maxSize(self):
+    oldsize = _beamblockagemap.getTileCacheMaxSize()
+    try:
+      _beamblockagemap.clearTileCache()
+      _beamblockagemap.setTileCacheMaxSize(6000*4800*2)
+      a = _beamblockagemap.new()
+      a.topo30dir="../../data/gtopo30"
+      a.readTopography(60*math.pi/180, 20*math.pi/180.0, 200000)
+      self.assertEqual(6000*4800*2, _beamblockagemap.getTileCacheSize())
+      _beamblockagemap.setTileCacheMaxSize(0)
+      self.assertEqual(0, _beamblockagemap.getTileCacheSize())
+    finally:
+      _beamblockagemap.setTileCacheMaxSize(oldsize)
+
+  def testTileCache_compressed(self):
+    _beamblockagemap.clearTileCache()
+    a = _beamblockagemap.new()
+    a.topo30dir="../../data/gtopo30"
+    self.assertEqual(False, a.compressed)
+    a.compressed = True
+    self.assertEqual(True, a.compressed)
+    r1 = a.readTopography(60*math.pi/180, 0*math.pi/180.0, 100000)
+    self.assertTrue(r1.compressed)
+    self.assertTrue(_beamblockagemap.getTileCacheSize() < 6000*4800*2)
+    b = _beamblockagemap.new()
+    b.topo30dir="../../data/gtopo30"
+    _beamblockagemap.clearTileCache()
+    r2 = b.readTopography(60*math.pi/180, 0*math.pi/180.0, 100000)
+    for col, row in [(0, 0), (2400, 3600), (4799, 5999), (1234, 567)]:
+      self.assertEqual(r2.getValue(col, row), r1.getValue(col, row))
+    region = a.readTopographyRegion(61*math.pi/180, 59*math.pi/180, 22*math.pi/180, 18*math.pi/180)
+    self.assertTrue(region.compressed)
+    _beamblockagemap.clearTileCache()
+
+  def testGetTopographyForScan_blockLayout(self):
+    a = _beamblockagemap.new()
+    a.topo30dir="../../data/gtopo30"
+    b = _beamblockagemap.new()
+    b.topo30dir="../../data/gtopo30"
+    self.assertEqual(False, b.blocklayout)
+    b.blocklayout = True
+    self.assertEqual(True, b.blocklayout)
+    region = b.readTopographyRegion(61*math.pi/180, 59*math.pi/180, 22*math.pi/180, 18*math.pi/180)
+    self.assertTrue(region.blocklayout)
+    scan = _raveio.open(self.SCAN_FILENAME).object
+    self.assertTrue((a.getTopographyForScan(scan).getData() == b.getTopographyForScan(scan).getData()).all())
+
   def testGetTopographyForScan(self):
     a = _beamblockagemap.new()
     a.topo30dir="../../data/gtopo30"
     scan = _raveio.open(self.SCAN_FILENAME).object
     topo = a.getTopographyForScan(scan)
     self.assertEqual(174, topo.getData()[0][0])
+
+  def testGetTopographyForScan_matchesScanNavigation(self):
+    a = _beamblockagemap.new()
+    a.topo30dir="../../data/gtopo30"
+    scan = _raveio.open(self.SCAN_FILENAME).object
+    # The real site, the site moved next to the 20E tile edge and next to the 20E/40N tile corner
+    for lon, lat in [(scan.longitude, scan.latitude), (19.5*math.pi/180, 59.5*math.pi/180), (19.8*math.pi/180, 40.3*math.pi/180)]:
+      scan.longitude, scan.latitude = lon, lat
+      topo = a.getTopographyForScan(scan).getData()
+      positions = [[scan.getLonLatFromIndex(bi, ri) for bi in range(scan.nbins)] for ri in range(scan.nrays)]
+      lons = [p[0] for row in positions for p in row]
+      lats = [p[1] for row in positions for p in row]
+      pad = 0.1*math.pi/180
+      region = a.readTopographyRegion(max(lats) + pad, min(lats) - pad, max(lons) + pad, min(lons) - pad)
+      if lat < 50*math.pi/180:
+        self.assertTrue(min(lats) < 40*math.pi/180 < max(lats))
+      if lon > 19*math.pi/180:
+        self.assertTrue(min(lons) < 20*math.pi/180 < max(lons))
+
+      # The separable navigation may only differ from the navigation of each bin for bins
+      # within a hundredth of a cell from a cell border, see BEAMBLOCKAGEMAP_VALIDATION_TOLERANCE
+      dx, dy = 0.01*region.xdim, 0.01*region.ydim
+      mismatches = 0
+      for ri in range(scan.nrays):
+        for bi in range(scan.nbins):
+          blon, blat = positions[ri][bi]
+          if topo[ri][bi] != max(region.getValueAtLonLat(blon, blat), 0):
+            mismatches += 1
+            neighbours = [max(region.getValueAtLonLat(blon + x, blat + y), 0) for x, y in [(-dx, 0), (dx, 0), (0, -dy), (0, dy)]]
+            self.assertTrue(topo[ri][bi] in neighbours)
+      self.assertTrue(mismatches < 0.001*scan.nrays*scan.nbins)
+
+  def testGetTopographyForScan_geometryCache(self):
+    _beamblockagemap.clearGeometryCache()
+    a = _beamblockagemap.new()
+    a.topo30dir="../../data/gtopo30"
+    scan = _raveio.open(self.SCAN_FILENAME).object
+    topo1 = a.getTopographyForScan(scan)
+    self.assertEqual(scan.nrays*scan.nbins*4, _beamblockagemap.getGeometryCacheSize())
+    topo2 = a.getTopographyForScan(scan)
+    self.assertEqual(scan.nrays*scan.nbins*4, _beamblockagemap.getGeometryCacheSize())
+    self.assertTrue((topo1.getData() == topo2.getData()).all())
+    self.assertEqual(174, topo2.getData()[0][0])
+    _beamblockagemap.clearGeometryCache()
+    self.assertEqual(0, _beamblockagemap.getGeometryCacheSize())
+
+  def testGetTopographyForScan_levels(self):
+    a = _beamblockagemap.new()
+    a.topo30dir="../../data/gtopo30"
+    b = _beamblockagemap.new()
+    b.topo30dir="../../data/gtopo30"
+    self.assertEqual(0, b.levels)
+    b.levels = 3
+    self.assertEqual(3, b.levels)
+    region = b.readTopographyRegion(61*math.pi/180, 59*math.pi/180, 22*math.pi/180, 18*math.pi/180)
+    self.assertEqual(3, region.nlevels)
+    scan = _raveio.open(self.SCAN_FILENAME).object
+    topo1 = a.getTopographyForScan(scan)
+    topo2 = b.getTopographyForScan(scan)
+    self.assertEqual(topo1.getData().shape, topo2.getData().shape)
+    # The closest bins have a smaller footprint than a cell
+    self.assertTrue((topo1.getData()[:,0] == topo2.getData()[:,0]).all())
+
+  def testGetTopographyForScan_sampling(self):
+    a = _beamblockagemap.new()
+    a.topo30dir="../../data/gtopo30"
+    b = _beamblockagemap.new()
+    b.topo30dir="../../data/gtopo30"
+    self.assertEqual(_beamblockagemap.Sampling_NEAREST, b.sampling)
+    b.sampling = _beamblockagemap.Sampling_MAX
+    self.assertEqual(_beamblockagemap.Sampling_MAX, b.sampling)
+    try:
+      b.sampling = 3
+      self.fail("Expected ValueError")
+    except ValueError:
+      pass
+    scan = _raveio.open(self.SCAN_FILENAME).object
+    topo1 = a.getTopographyForScan(scan)
+    topo2 = b.getTopographyForScan(scan)
+    self.assertEqual(topo1.getData().shape, topo2.getData().shape)
+    self.assertTrue((topo2.getData() >= topo1.getData()).all())
+
+  def testGetTopographyForScan_horizon(self):
+    _beamblockagemap.clearHorizonCache()
+    a = _beamblockagemap.new()
+    a.topo30dir="../../data/gtopo30"
+    b = _beamblockagemap.new()
+    b.topo30dir="../../data/gtopo30"
+    self.assertEqual(False, b.horizon)
+    b.horizon = True
+    scan = _raveio.open(self.SCAN_FILENAME).object
+    topo1 = a.getTopographyForScan(scan)
+    topo2 = b.getTopographyForScan(scan)
+    size = _beamblockagemap.getHorizonCacheSize()
+    self.assertTrue(size > 0)
+    # Only bins close to a cell border can get the height of a neighbouring cell
+    self.assertTrue((topo1.getData() == topo2.getData()).mean() > 0.9)
+    # Another elevation angle from the same site uses the same profile
+    scan.elangle = scan.elangle + 2.0*math.pi/180.0
+    b.getTopographyForScan(scan)
+    self.assertEqual(size, _beamblockagemap.getHorizonCacheSize())
+    _beamblockagemap.clearHorizonCache()
+    self.assertEqual(0, _beamblockagemap.getHorizonCacheSize())
+
+  def testGetTopographyForScan_horizonReplacedTile(self):
+    topodir = tempfile.mkdtemp()
+    try:
+      for ext in [".HDR", ".DEM"]:
+        shutil.copy("../../data/gtopo30/W020N90" + ext, os.path.join(topodir, "W020N90" + ext))
+      with open(os.path.join(topodir, "beamb_tiles.txt"), "w") as fp:
+        fp.write("W020N90 -20 90 20 40\n")
+      _beamblockagemap.clearHorizonCache()
+      scan = _raveio.open(self.SCAN_FILENAME).object
+      a = _beamblockagemap.new()
+      a.topo30dir=topodir
+      a.horizon = True
+      expected = a.getTopographyForScan(scan).getData()
+      size = _beamblockagemap.getHorizonCacheSize()
+      self.assertTrue(size > 0)
+
+      # A tile replaced in the same directory is another topography and must be sampled again
+      st = os.stat(os.path.join(topodir, "W020N90.DEM"))
+      os.utime(os.path.join(topodir, "W020N90.DEM"), (st.st_atime, st.st_mtime - 3600))
+      b = _beamblockagemap.new()
+      b.topo30dir=topodir
+      b.horizon = True
+      self.assertNotEqual(a.topographyid, b.topographyid)
+      result = b.getTopographyForScan(scan).getData()
+      self.assertEqual(2 * size, _beamblockagemap.getHorizonCacheSize())
+      self.assertTrue((expected == result).all())
+    finally:
+      _beamblockagemap.clearHorizonCache()
+      shutil.rmtree(topodir)
     
 if __name__ == "__main__":
   #import sys;sys.argv = ['', 'Test.testName']
@@ -27,26 +27,42 @@ import unittest
 
 import _raveio
 import _beamblockage
-import os, string
+import _beamblockagemap
+import _polarnav
+import os, string, math
 import _rave
 import _ravefield
 import numpy
+import threading
+import tempfile, shutil
 
 class PyBeamBlockageTest(unittest.TestCase):
   SCAN_FILENAME = "fixtures/scan_sevil_20100702T113200Z.h5"
   FIXTURE_2 = "fixtures/sevil_0.5_20111223T0000Z.h5"
+  VOLUME_FIXTURE = "fixtures/pvol_seosu_20090501T120000Z.h5"
   
-  CACHEFILE_1 = "/tmp/15.94_58.11_222_40.00_420_120_1000.00_0.00_0.90_-20.00.h5"
-  CACHEFILE_2 = "/tmp/15.94_58.11_223_0.50_420_120_2000.00_0.00_0.90_-20.00.h5"
-  CACHEFILE_3 = "/tmp/15.94_58.11_223_0.50_420_120_2000.00_0.00_0.90_-25.00.h5"
+  CACHEFILE_1 = "/tmp/15.94_58.11_222_40.00_420_120_1000.00_0.00_0.90_-20.00_%s.h5"
+  CACHEFILE_2 = "/tmp/15.94_58.11_223_0.50_420_120_2000.00_0.00_0.90_-20.00_%s.h5"
+  CACHEFILE_3 = "/tmp/15.94_58.11_223_0.50_420_120_2000.00_0.00_0.90_-25.00_%s.h5"
+  BINARY_CACHEFILE_1 = "/tmp/15.94_58.11_222_40.00_420_120_1000.00_0.00_0.90_-20.00_%s.bbc"
   
   def setUp(self):
+    # The cache filenames end with how the topography is mapped and the identity of the topography
+    a = _beamblockage.new()
+    a.topo30dir="../../data/gtopo30"
+    mapping = "n_%08x" % a.topographyid
+    self.CACHEFILE_1 = PyBeamBlockageTest.CACHEFILE_1 % mapping
+    self.CACHEFILE_2 = PyBeamBlockageTest.CACHEFILE_2 % mapping
+    self.CACHEFILE_3 = PyBeamBlockageTest.CACHEFILE_3 % mapping
+    self.BINARY_CACHEFILE_1 = PyBeamBlockageTest.BINARY_CACHEFILE_1 % mapping
     if os.path.isfile(self.CACHEFILE_1):
       os.unlink(self.CACHEFILE_1)
     if os.path.isfile(self.CACHEFILE_2):
       os.unlink(self.CACHEFILE_2)
     if os.path.isfile(self.CACHEFILE_3):
       os.unlink(self.CACHEFILE_3)
+    if os.path.isfile(self.BINARY_CACHEFILE_1):
+      os.unlink(self.BINARY_CACHEFILE_1)
       
   def tearDown(self):
     if os.path.isfile(self.CACHEFILE_1):
@@ -55,6 +71,8 @@ class PyBeamBlockageTest(unittest.TestCase):
       os.unlink(self.CACHEFILE_2)
     if os.path.isfile(self.CACHEFILE_3):
       os.unlink(self.CACHEFILE_3)
+    if os.path.isfile(self.BINARY_CACHEFILE_1):
+      os.unlink(self.BINARY_CACHEFILE_1)
         
   def testNew(self):
     a = _beamblockage.new()
@@ -72,6 +90,18 @@ class PyBeamBlockageTest(unittest.TestCase):
     a.cachedir="/tmp"
     self.assertEqual("/tmp", a.cachedir)
   
+  def testNthreads(self):
+    a = _beamblockage.new()
+    self.assertEqual(1, a.nthreads)
+    a.nthreads = 4
+    self.assertEqual(4, a.nthreads)
+    try:
+      a.nthreads = 0
+      self.fail("Expected ValueError")
+    except ValueError:
+      pass
+    self.assertEqual(4, a.nthreads)
+
   def testReadTopo30(self):
     a = _beamblockage.new()
     a.topo30dir="../../data/gtopo30"
@@ -106,6 +136,141 @@ class PyBeamBlockageTest(unittest.TestCase):
     self.assertEqual(scan.nbins, result.xsize)
     self.assertEqual(scan.nrays, result.ysize)
 
+  def test_getBlockage_threads(self):
+    a = _beamblockage.new()
+    a.topo30dir="../../data/gtopo30"
+    a.cachedir=None # No caching
+    scan = _raveio.open(self.SCAN_FILENAME).object
+    expected = a.getBlockage(scan, -20.0).getData()
+
+    a.nthreads = 3
+    result = a.getBlockage(scan, -20.0).getData()
+    self.assertTrue(numpy.array_equal(expected, result))
+
+  def test_getBlockage_pythonThreads(self):
+    scan = _raveio.open(self.SCAN_FILENAME).object
+    a = _beamblockage.new()
+    a.topo30dir="../../data/gtopo30"
+    a.cachedir=None # No caching
+    expected = a.getBlockage(scan, -20.0).getData()
+
+    results = [None]*4
+    def run(i):
+      b = _beamblockage.new()
+      b.topo30dir="../../data/gtopo30"
+      b.cachedir=None
+      results[i] = b.getBlockage(_raveio.open(self.SCAN_FILENAME).object, -20.0).getData()
+    threads = [threading.Thread(target=run, args=(i,)) for i in range(len(results))]
+    for t in threads:
+      t.start()
+    for t in threads:
+      t.join()
+
+    for r in results:
+      self.assertTrue(numpy.array_equal(expected, r))
+
+  def referenceBlockage(self, scan, dBlim):
+    # The per bin asin/erf computation that the limit based getBlockage must reproduce
+    nav = _polarnav.new()
+    nav.lon0 = scan.longitude
+    nav.lat0 = scan.latitude
+    nav.alt0 = scan.height
+    groundRange = [nav.reToDh(scan.rscale * (bi + 0.5), scan.elangle)[0] for bi in range(scan.nbins)]
+
+    m = _beamblockagemap.new()
+    m.topo30dir="../../data/gtopo30"
+    topo = m.getTopographyForScan(scan).getData()
+
+    R = 1.0/((1.0/nav.getEarthRadiusOrigin()) + nav.dndh)
+    height = nav.alt0
+    gtopo_alt0 = max(0.0, max([float(topo[ri][0]) for ri in range(scan.nrays)]))
+    if gtopo_alt0 + 5.0 > height:
+      height = gtopo_alt0 + 5.0
+
+    beamwidth = scan.beamwidth * 180.0 / math.pi
+    elangle = scan.elangle * 180.0 / math.pi
+    c = -((beamwidth/2.0)*(beamwidth/2.0))/math.log(0.5)
+    elLim = math.sqrt(-c*math.log(math.pow(10.0, dBlim/10.0)))
+    bb_tot = math.sqrt(math.pi*c) * math.erf(elLim/math.sqrt(c))
+
+    # Rays where the sine is outside [-1, 1] are marked as invalid and not compared
+    result = numpy.zeros((scan.nrays, scan.nbins), numpy.uint8)
+    valid = numpy.ones(scan.nrays, bool)
+    for ri in range(scan.nrays):
+      phimax = -1e10
+      for bi in range(scan.nbins):
+        v = float(topo[ri][bi])
+        gr = groundRange[bi]
+        x = (((v+R)*(v+R)) - gr*gr - (R+height)*(R+height)) / (2*gr*(R+height))
+        if x < -1.0 or x > 1.0:
+          valid[ri] = False
+          break
+        phi = math.degrees(math.asin(x))
+        phimax = max(phimax, phi)
+        elBlock = phimax
+        if elBlock < elangle - elLim:
+          elBlock = -9999.0
+        if elBlock > elangle + elLim:
+          elBlock = elangle + elLim
+        bbval = -1.0/2.0 * math.sqrt(math.pi*c) * (math.erf((elangle - elBlock)/math.sqrt(c)) - math.erf(elLim/math.sqrt(c)))/bb_tot
+        bbval = min(1.0, max(0.0, bbval))
+        result[ri][bi] = int((1.0 - bbval) * 255.0)
+    return result, valid
+
+  def test_getBlockage_matchesReference(self):
+    a = _beamblockage.new()
+    a.topo30dir="../../data/gtopo30"
+    a.cachedir=None # No caching
+    for filename in [self.SCAN_FILENAME, self.FIXTURE_2]:
+      for beamwidth in [0.5, 0.9, 2.0]:
+        for dBlim in [-1.0, -6.0, -20.0]:
+          scan = _raveio.open(filename).object
+          scan.beamwidth = beamwidth * math.pi / 180.0
+          result = a.getBlockage(scan, dBlim).getData().astype(numpy.int32)
+          expected, valid = self.referenceBlockage(scan, dBlim)
+          self.assertEqual(expected.shape, result.shape)
+          self.assertTrue(numpy.count_nonzero(valid) > 0)
+          expected = expected.astype(numpy.int32)[valid]
+          result = result[valid]
+          # Only rounding at the quantization steps may differ
+          diff = numpy.abs(expected - result)
+          self.assertTrue(diff.max() <= 1, "%s, beamwidth=%g, dblim=%g" % (filename, beamwidth, dBlim))
+          self.assertTrue(numpy.count_nonzero(diff) <= diff.size // 1000, "%s, beamwidth=%g, dblim=%g" % (filename, beamwidth, dBlim))
+
+  def test_processVolume(self):
+    a = _beamblockage.new()
+    a.topo30dir="../../data/gtopo30"
+    a.cachedir=None # No caching
+    a.nthreads = 4
+    volume = _raveio.open(self.VOLUME_FIXTURE).object
+    expected = _raveio.open(self.VOLUME_FIXTURE).object
+
+    a.processVolume(volume, -20.0, "DBZH", 0.7)
+
+    for i in range(volume.getNumberOfScans()):
+      scan = volume.getScan(i)
+      escan = expected.getScan(i)
+      field = a.getBlockage(escan, -20.0)
+      _beamblockage.restore(escan, field, "DBZH", 0.7)
+      result = scan.findQualityFieldByHowTask("se.smhi.detector.beamblockage")
+      self.assertTrue(result != None)
+      self.assertTrue(numpy.array_equal(field.getData(), result.getData()))
+      self.assertTrue(numpy.array_equal(escan.getParameter("DBZH").getData(), scan.getParameter("DBZH").getData()))
+
+  def test_processVolume_maxelev(self):
+    a = _beamblockage.new()
+    a.topo30dir="../../data/gtopo30"
+    a.cachedir=None # No caching
+    volume = _raveio.open(self.VOLUME_FIXTURE).object
+
+    a.processVolume(volume, -20.0, None, 0.0, volume.getScan(0).elangle + 1e-6)
+
+    self.assertTrue(volume.getScan(0).findQualityFieldByHowTask("se.smhi.detector.beamblockage") != None)
+    for i in range(1, volume.getNumberOfScans()):
+      scan = volume.getScan(i)
+      if scan.elangle > volume.getScan(0).elangle + 1e-6:
+        self.assertTrue(scan.findQualityFieldByHowTask("se.smhi.detector.beamblockage") == None)
+
   def test_getBlockage_caching(self):
     a = _beamblockage.new()
     a.topo30dir="../../data/gtopo30"
@@ -124,6 +289,458 @@ class PyBeamBlockageTest(unittest.TestCase):
     self.assertEqual(scan.nbins, result.xsize)
     self.assertEqual(scan.nrays, result.ysize)
     
+  def test_getBlockage_fieldCache(self):
+    _beamblockage.clearFieldCache()
+    a = _beamblockage.new()
+    a.topo30dir="../../data/gtopo30"
+    a.cachedir="/tmp"
+    scan = _raveio.open(self.SCAN_FILENAME).object
+
+    result = a.getBlockage(scan, -20.0)
+    self.assertEqual(0, _beamblockage.getFieldCacheHits())
+    self.assertEqual(1, _beamblockage.getFieldCacheMisses())
+    self.assertEqual(scan.nbins*scan.nrays, _beamblockage.getFieldCacheSize())
+
+    result2 = a.getBlockage(scan, -20.0)
+    self.assertEqual(1, _beamblockage.getFieldCacheHits())
+    self.assertEqual(1, _beamblockage.getFieldCacheMisses())
+    self.assertTrue(numpy.array_equal(result.getData(), result2.getData()))
+
+    # A removed cache file is not taken from memory either
+    os.unlink(self.CACHEFILE_1)
+    a.getBlockage(scan, -20.0)
+    self.assertEqual(1, _beamblockage.getFieldCacheHits())
+    self.assertEqual(2, _beamblockage.getFieldCacheMisses())
+    self.assertTrue(os.path.isfile(self.CACHEFILE_1))
+
+    _beamblockage.clearFieldCache()
+    self.assertEqual(0, _beamblockage.getFieldCacheSize())
+
+  def testCacheformat(self):
+    a = _beamblockage.new()
+    self.assertEqual(_beamblockage.CacheFormat_HDF5, a.cacheformat)
+    a.cacheformat = _beamblockage.CacheFormat_BINARY
+    self.assertEqual(_beamblockage.CacheFormat_BINARY, a.cacheformat)
+    try:
+      a.cacheformat = 99
+      self.fail("Expected ValueError")
+    except ValueError:
+      pass
+    self.assertEqual(_beamblockage.CacheFormat_BINARY, a.cacheformat)
+
+  def test_getBlockage_binaryCache(self):
+    a = _beamblockage.new()
+    a.topo30dir="../../data/gtopo30"
+    a.cachedir="/tmp"
+    a.cacheformat = _beamblockage.CacheFormat_BINARY
+    scan = _raveio.open(self.SCAN_FILENAME).object
+
+    result = a.getBlockage(scan, -20.0)
+    self.assertTrue(os.path.isfile(self.BINARY_CACHEFILE_1))
+    self.assertFalse(os.path.isfile(self.CACHEFILE_1))
+    self.assertEqual(os.path.getsize(self.BINARY_CACHEFILE_1) - scan.nbins*scan.nrays, 152)
+
+    _beamblockage.clearFieldCache()
+    result2 = a.getBlockage(scan, -20.0)
+    self.assertEqual(_rave.RaveDataType_UCHAR, result2.datatype)
+    self.assertEqual("se.smhi.detector.beamblockage", result2.getAttribute("how/task"))
+    self.assertEqual("DBLIMIT:-20", result2.getAttribute("how/task_args"))
+    self.assertAlmostEqual(result.getAttribute("what/gain"), result2.getAttribute("what/gain"), 8)
+    self.assertAlmostEqual(result.getAttribute("what/offset"), result2.getAttribute("what/offset"), 8)
+    self.assertTrue(numpy.array_equal(result.getData(), result2.getData()))
+
+  def test_getBlockage_cacheStore(self):
+    cachedir = tempfile.mkdtemp()
+    try:
+      a = _beamblockage.new()
+      a.topo30dir="../../data/gtopo30"
+      a.cachedir=cachedir
+      a.cacheformat = _beamblockage.CacheFormat_STORE
+      scan = _raveio.open(self.SCAN_FILENAME).object
+      scan2 = _raveio.open(self.FIXTURE_2).object
+
+      result = a.getBlockage(scan, -20.0)
+      result2 = a.getBlockage(scan2, -20.0)
+      self.assertTrue(os.path.isfile(os.path.join(cachedir, "beamb_cache.bbs")))
+      self.assertFalse(os.path.isfile(self.CACHEFILE_1))
+
+      b = _beamblockage.new()
+      b.topo30dir="../../data/gtopo30"
+      b.cachedir=cachedir
+      b.cacheformat = _beamblockage.CacheFormat_STORE
+      cached = b.getBlockage(scan, -20.0)
+      cached2 = b.getBlockage(scan2, -20.0)
+      self.assertEqual("se.smhi.detector.beamblockage", cached.getAttribute("how/task"))
+      self.assertTrue(numpy.array_equal(result.getData(), cached.getData()))
+      self.assertTrue(numpy.array_equal(result2.getData(), cached2.getData()))
+
+      # Rewriting supersedes the old field, compacting removes it
+      b.rewritecache = True
+      b.getBlockage(scan, -20.0)
+      size = os.path.getsize(os.path.join(cachedir, "beamb_cache.bbs"))
+      b.compactCache()
+      self.assertTrue(os.path.getsize(os.path.join(cachedir, "beamb_cache.bbs")) < size)
+      b.rewritecache = False
+      self.assertTrue(numpy.array_equal(result.getData(), b.getBlockage(scan, -20.0).getData()))
+    finally:
+      shutil.rmtree(cachedir)
+
+  def test_getBlockage_cacheStoreCorruptRecord(self):
+    cachedir = tempfile.mkdtemp()
+    cachedir2 = tempfile.mkdtemp()
+    try:
+      a = _beamblockage.new()
+      a.topo30dir="../../data/gtopo30"
+      a.cachedir=cachedir
+      a.cacheformat = _beamblockage.CacheFormat_STORE
+      scan = _raveio.open(self.SCAN_FILENAME).object
+      scan2 = _raveio.open(self.FIXTURE_2).object
+      a.getBlockage(scan, -20.0)
+      result2 = a.getBlockage(scan2, -20.0)
+
+      # Destroy the magic of the first record, which starts right after the 32 byte store header.
+      # The store is copied to a directory that hasn't been indexed by this process.
+      with open(os.path.join(cachedir, "beamb_cache.bbs"), "rb") as fp:
+        data = bytearray(fp.read())
+      data[32:36] = b"\0\0\0\0"
+      storefile = os.path.join(cachedir2, "beamb_cache.bbs")
+      with open(storefile, "wb") as fp:
+        fp.write(data)
+
+      _beamblockage.clearFieldCache()
+      b = _beamblockage.new()
+      b.topo30dir="../../data/gtopo30"
+      b.cachedir=cachedir2
+      b.cacheformat = _beamblockage.CacheFormat_STORE
+      self.assertTrue(numpy.array_equal(result2.getData(), b.getBlockage(scan2, -20.0).getData()))
+      self.assertEqual(len(data), os.path.getsize(storefile))
+
+      # The corrupt record is recalculated and appended, the record after it is kept
+      b.getBlockage(scan, -20.0)
+      self.assertTrue(os.path.getsize(storefile) > len(data))
+      _beamblockage.clearFieldCache()
+      self.assertTrue(numpy.array_equal(result2.getData(), b.getBlockage(scan2, -20.0).getData()))
+    finally:
+      shutil.rmtree(cachedir)
+      shutil.rmtree(cachedir2)
+
+  def test_precompute(self):
+    cachedir = tempfile.mkdtemp()
+    try:
+      a = _beamblockage.new()
+      a.topo30dir="../../data/gtopo30"
+      a.cachedir=cachedir
+      a.cacheformat = _beamblockage.CacheFormat_BINARY
+      a.nthreads = 2
+      scans = [_raveio.open(self.SCAN_FILENAME).object, _raveio.open(self.FIXTURE_2).object]
+      calls = []
+
+      result = a.precompute(scans, -20.0, lambda index, ndone, total, status, seconds: calls.append((index, ndone, total, status)))
+      self.assertEqual(2, len(result))
+      self.assertEqual([_beamblockage.Precompute_COMPUTED]*2, [status for status, seconds in result])
+      self.assertEqual([1, 2], sorted([c[1] for c in calls]))
+      self.assertEqual([0, 1], sorted([c[0] for c in calls]))
+      self.assertEqual(2, len(os.listdir(cachedir)) - len([f for f in os.listdir(cachedir) if f.endswith(".lock")]))
+
+      result = a.precompute(scans, -20.0)
+      self.assertEqual([_beamblockage.Precompute_CACHED]*2, [status for status, seconds in result])
+
+      a.cachedir = None
+      try:
+        a.precompute(scans, -20.0)
+        self.fail("Expected RuntimeError")
+      except RuntimeError:
+        pass
+    finally:
+      shutil.rmtree(cachedir)
+
+  def testCacheBudget(self):
+    a = _beamblockage.new()
+    self.assertEqual(0, a.cachemaxsize)
+    self.assertEqual(0, a.cachemaxage)
+    a.cachemaxsize = 1000000
+    a.cachemaxage = 3600
+    self.assertEqual(1000000, a.cachemaxsize)
+    self.assertEqual(3600, a.cachemaxage)
+    try:
+      a.cachemaxsize = -1
+      self.fail("Expected ValueError")
+    except ValueError:
+      pass
+    self.assertEqual(1000000, a.cachemaxsize)
+
+  def test_cleanCache(self):
+    cachedir = tempfile.mkdtemp()
+    try:
+      a = _beamblockage.new()
+      a.topo30dir="../../data/gtopo30"
+      a.cachedir=cachedir
+      scan1 = _raveio.open(self.SCAN_FILENAME).object
+      scan2 = _raveio.open(self.FIXTURE_2).object
+      _beamblockage.resetCacheStatistics()
+
+      a.getBlockage(scan1, -20.0)
+      a.getBlockage(scan2, -20.0)
+      a.getBlockage(scan2, -20.0)
+      stats = a.getCacheStatistics()
+      self.assertEqual(2, stats["entries"])
+      self.assertEqual(1, stats["hits"])
+      self.assertEqual(2, stats["misses"])
+      self.assertEqual(2, stats["computed"])
+      self.assertTrue(stats["computetime"] > 0.0)
+      self.assertTrue(stats["bytes"] > 0)
+
+      # Only the most recently used field fits
+      a.cachemaxsize = stats["bytes"] - 1
+      self.assertEqual(1, a.cleanCache())
+      stats = a.getCacheStatistics()
+      self.assertEqual(1, stats["entries"])
+      self.assertEqual(1, stats["evicted"])
+      self.assertTrue(os.path.isfile(os.path.join(cachedir, os.path.basename(self.CACHEFILE_2))))
+    finally:
+      shutil.rmtree(cachedir)
+
+  def test_cleanCache_oldFilename(self):
+    cachedir = tempfile.mkdtemp()
+    try:
+      # Cache file named as before the topography was part of the name
+      oldfile = os.path.join(cachedir, "15.94_58.11_222_40.00_420_120_1000.00_0.00_0.90_-20.00.h5")
+      with open(oldfile, "wb") as fp:
+        fp.write(b"\0" * 1024)
+      os.utime(oldfile, (0, 0))
+
+      a = _beamblockage.new()
+      a.topo30dir="../../data/gtopo30"
+      a.cachedir=cachedir
+      a.getBlockage(_raveio.open(self.SCAN_FILENAME).object, -20.0)
+      stats = a.getCacheStatistics()
+      self.assertEqual(2, stats["entries"])
+
+      a.cachemaxsize = stats["bytes"] - 1
+      self.assertEqual(1, a.cleanCache())
+      self.assertFalse(os.path.isfile(oldfile))
+      self.assertTrue(os.path.isfile(os.path.join(cachedir, os.path.basename(self.CACHEFILE_1))))
+    finally:
+      shutil.rmtree(cachedir)
+
+  def test_getBlockage_cacheKeyLevels(self):
+    for cacheformat in [_beamblockage.CacheFormat_HDF5, _beamblockage.CacheFormat_BINARY, _beamblockage.CacheFormat_STORE]:
+      cachedir = tempfile.mkdtemp()
+      try:
+        a = _beamblockage.new()
+        a.topo30dir="../../data/gtopo30"
+        a.cachedir=cachedir
+        a.cacheformat=cacheformat
+        scan = _raveio.open(self.SCAN_FILENAME).object
+        _beamblockage.clearFieldCache()
+        _beamblockage.resetCacheStatistics()
+
+        a.getBlockage(scan, -20.0)
+        a.levels = 2
+        a.getBlockage(scan, -20.0)
+        a.getBlockage(scan, -20.0)
+        stats = a.getCacheStatistics()
+        self.assertEqual(2, stats["computed"])
+        self.assertEqual(1, stats["hits"])
+        if cacheformat == _beamblockage.CacheFormat_HDF5:
+          self.assertEqual(1, len([f for f in os.listdir(cachedir) if f.endswith("_l2_%08x.h5" % a.topographyid)]))
+          self.assertEqual(1, len([f for f in os.listdir(cachedir) if f.endswith("_n_%08x.h5" % a.topographyid)]))
+      finally:
+        shutil.rmtree(cachedir)
+
+  def test_getBlockage_cacheKeySampling(self):
+    for cacheformat in [_beamblockage.CacheFormat_HDF5, _beamblockage.CacheFormat_BINARY, _beamblockage.CacheFormat_STORE]:
+      cachedir = tempfile.mkdtemp()
+      try:
+        a = _beamblockage.new()
+        a.topo30dir="../../data/gtopo30"
+        a.cachedir=cachedir
+        a.cacheformat=cacheformat
+        a.cachetolerance = (0.01, 5.0, 0.05, 10.0)
+        scan = _raveio.open(self.SCAN_FILENAME).object
+        _beamblockage.clearFieldCache()
+        _beamblockage.resetCacheStatistics()
+
+        a.sampling = _beamblockage.Sampling_MEAN
+        mean = a.getBlockage(scan, -20.0)
+        a.sampling = _beamblockage.Sampling_MAX
+        maxblockage = a.getBlockage(scan, -20.0)
+        _beamblockage.clearFieldCache()
+        cached = a.getBlockage(scan, -20.0)
+        stats = a.getCacheStatistics()
+        self.assertEqual(2, stats["computed"])
+        self.assertEqual(1, stats["hits"])
+        self.assertTrue(numpy.array_equal(maxblockage.getData(), cached.getData()))
+        self.assertTrue((maxblockage.getData() >= mean.getData()).all())
+        if cacheformat == _beamblockage.CacheFormat_HDF5:
+          self.assertEqual(1, len([f for f in os.listdir(cachedir) if f.endswith("_mean_%08x.h5" % a.topographyid)]))
+          self.assertEqual(1, len([f for f in os.listdir(cachedir) if f.endswith("_max_%08x.h5" % a.topographyid)]))
+      finally:
+        shutil.rmtree(cachedir)
+
+  def test_getBlockage_cacheKeyHorizon(self):
+    cachedir = tempfile.mkdtemp()
+    try:
+      a = _beamblockage.new()
+      a.topo30dir="../../data/gtopo30"
+      a.cachedir=cachedir
+      scan = _raveio.open(self.SCAN_FILENAME).object
+      _beamblockage.clearFieldCache()
+      _beamblockage.resetCacheStatistics()
+
+      exact = a.getBlockage(scan, -20.0)
+      a.horizon = True
+      a.getBlockage(scan, -20.0)
+      # The sampling and levels have no effect with the horizon profile, so the entry is shared
+      a.sampling = _beamblockage.Sampling_MAX
+      a.levels = 2
+      a.getBlockage(scan, -20.0)
+      a.horizon = False
+      a.sampling = _beamblockage.Sampling_NEAREST
+      a.levels = 0
+      cached = a.getBlockage(scan, -20.0)
+
+      stats = a.getCacheStatistics()
+      self.assertEqual(2, stats["computed"])
+      self.assertEqual(2, stats["hits"])
+      self.assertTrue(numpy.array_equal(exact.getData(), cached.getData()))
+      self.assertEqual(1, len([f for f in os.listdir(cachedir) if f.endswith("_h_%08x.h5" % a.topographyid)]))
+      self.assertEqual(1, len([f for f in os.listdir(cachedir) if f.endswith("_n_%08x.h5" % a.topographyid)]))
+    finally:
+      shutil.rmtree(cachedir)
+
+  def testTopographyId(self):
+    a = _beamblockage.new()
+    a.topo30dir="../../data/gtopo30"
+    b = _beamblockage.new()
+    b.topo30dir="../../data/gtopo30/"
+    self.assertEqual(a.topographyid, b.topographyid)
+    self.assertTrue(a.topographyid >= 0 and a.topographyid <= 0xffffffff)
+    b.topo30dir="/tmp"
+    self.assertNotEqual(a.topographyid, b.topographyid)
+
+  def testCacheTolerance(self):
+    a = _beamblockage.new()
+    self.assertEqual((0.0, 0.0, 0.0, 0.0), a.cachetolerance)
+    a.cachetolerance = (0.01, 5.0, 0.05, 10.0)
+    self.assertEqual((0.01, 5.0, 0.05, 10.0), a.cachetolerance)
+    try:
+      a.cachetolerance = (0.01, -1.0, 0.05, 10.0)
+      self.fail("Expected ValueError")
+    except ValueError:
+      pass
+    self.assertEqual((0.01, 5.0, 0.05, 10.0), a.cachetolerance)
+    a.cachetolerance = None
+    self.assertEqual((0.0, 0.0, 0.0, 0.0), a.cachetolerance)
+
+  def test_getBlockage_cacheTolerance(self):
+    cachedir = tempfile.mkdtemp()
+    try:
+      a = _beamblockage.new()
+      a.topo30dir="../../data/gtopo30"
+      a.cachedir=cachedir
+      a.cachetolerance = (0.01, 5.0, 0.05, 10.0)
+      scan = _raveio.open(self.SCAN_FILENAME).object
+      _beamblockage.resetCacheStatistics()
+
+      result = a.getBlockage(scan, -20.0)
+      self.assertTrue("how/beamb_geometry" in result.getAttributeNames())
+      scan.elangle = scan.elangle + 0.0001 * math.pi / 180.0
+      _beamblockage.clearFieldCache()
+      result2 = a.getBlockage(scan, -20.0)
+
+      self.assertEqual(1, len([f for f in os.listdir(cachedir) if f.startswith("q") and f.endswith(".h5")]))
+      stats = a.getCacheStatistics()
+      self.assertEqual(1, stats["computed"])
+      self.assertEqual(1, stats["hits"])
+      self.assertTrue(numpy.array_equal(result.getData(), result2.getData()))
+    finally:
+      shutil.rmtree(cachedir)
+
+  def testCachePhi(self):
+    a = _beamblockage.new()
+    self.assertEqual(False, a.cachephi)
+    a.cachephi = True
+    self.assertEqual(True, a.cachephi)
+    try:
+      a.cachephi = 1
+      self.fail("Expected ValueError")
+    except ValueError:
+      pass
+
+  def testHorizon(self):
+    a = _beamblockage.new()
+    self.assertEqual(False, a.horizon)
+    a.horizon = True
+    self.assertEqual(True, a.horizon)
+    try:
+      a.horizon = 1
+      self.fail("Expected ValueError")
+    except ValueError:
+      pass
+
+  def test_getBlockage_cachePhi(self):
+    cachedir = tempfile.mkdtemp()
+    try:
+      a = _beamblockage.new()
+      a.topo30dir="../../data/gtopo30"
+      a.cachedir=cachedir
+      a.cachephi = True
+      scan = _raveio.open(self.SCAN_FILENAME).object
+
+      a.getBlockage(scan, -20.0)
+      self.assertEqual(1, len([f for f in os.listdir(cachedir) if f.startswith("phi_") and f.endswith(".h5")]))
+
+      # Derived from the cached angles, must be identical to a full calculation
+      _beamblockage.clearFieldCache()
+      result = a.getBlockage(scan, -25.0)
+      b = _beamblockage.new()
+      b.topo30dir="../../data/gtopo30"
+      expected = b.getBlockage(scan, -25.0)
+      self.assertTrue(numpy.array_equal(expected.getData(), result.getData()))
+    finally:
+      shutil.rmtree(cachedir)
+
+  def test_getBlockage_cachePhiMapping(self):
+    cachedir = tempfile.mkdtemp()
+    try:
+      a = _beamblockage.new()
+      a.topo30dir="../../data/gtopo30"
+      a.cachedir=cachedir
+      a.cachephi = True
+      scan = _raveio.open(self.SCAN_FILENAME).object
+
+      a.getBlockage(scan, -20.0)
+      a.sampling = _beamblockage.Sampling_MAX
+      a.getBlockage(scan, -20.0)
+      phifiles = [f for f in os.listdir(cachedir) if f.startswith("phi_") and f.endswith(".h5")]
+      self.assertEqual(2, len(phifiles))
+      self.assertEqual(1, len([f for f in phifiles if f.endswith("_max_%08x.h5" % a.topographyid)]))
+
+      # Derived from the angles of the same mapping
+      _beamblockage.clearFieldCache()
+      result = a.getBlockage(scan, -25.0)
+      b = _beamblockage.new()
+      b.topo30dir="../../data/gtopo30"
+      b.sampling = _beamblockage.Sampling_MAX
+      expected = b.getBlockage(scan, -25.0)
+      self.assertTrue(numpy.array_equal(expected.getData(), result.getData()))
+    finally:
+      shutil.rmtree(cachedir)
+
+  def test_getBlockage_cacheLock(self):
+    a = _beamblockage.new()
+    a.topo30dir="../../data/gtopo30"
+    a.cachedir="/tmp"
+    scan = _raveio.open(self.SCAN_FILENAME).object
+
+    a.getBlockage(scan, -20.0)
+    self.assertTrue(os.path.isfile(self.CACHEFILE_1))
+    self.assertTrue(os.path.isfile(self.CACHEFILE_1 + ".lock"))
+    tmpfiles = [f for f in os.listdir("/tmp") if f.startswith(os.path.basename(self.CACHEFILE_1)) and f.endswith(".tmp")]
+    self.assertEqual([], tmpfiles)
+    os.unlink(self.CACHEFILE_1 + ".lock")
+
   def test_getBlockage2(self):
     a = _beamblockage.new()
     a.topo30dir="../../data/gtopo30"
@@ -214,6 +831,34 @@ class PyBeamBlockageTest(unittest.TestCase):
     field.addAttribute("what/offset", 0.0)
     _beamblockage.restore(scan, field, "DBZH", 0.5)
     
+  def test_restore_values(self):
+    scan = _raveio.open(self.FIXTURE_2).object
+    param = scan.getParameter("DBZH")
+    raw = param.getData().astype(numpy.float64)
+
+    # No blockage, correctable blockage and blockage above the threshold
+    bbraw = numpy.zeros((scan.nrays, scan.nbins), numpy.uint8)
+    bbraw[0::3,:] = 255
+    bbraw[1::3,:] = 230
+    bbraw[2::3,:] = 100
+    field = _ravefield.new()
+    field.setData(bbraw)
+    field.addAttribute("how/task", "se.smhi.detector.beamblockage")
+    field.addAttribute("what/gain", 1.0/255.0)
+    field.addAttribute("what/offset", 0.0)
+    _beamblockage.restore(scan, field, "DBZH", 0.5)
+
+    bbpercent = 1.0 - (1.0/255.0) * bbraw.astype(numpy.float64)
+    isdata = (raw != param.nodata) & (raw != param.undetect)
+    expected = raw.copy()
+    correct = isdata & (bbpercent > 0.0) & (bbpercent <= 0.5)
+    dbz = (param.offset + raw * param.gain) + 10.0 * numpy.log10(1.0 / (1.0 - bbpercent)**2)
+    corrected = (dbz - param.offset) / param.gain
+    corrected = numpy.clip(numpy.sign(corrected) * numpy.floor(numpy.abs(corrected) + 0.5), 0, 255)
+    expected[correct] = corrected[correct]
+    expected[(raw != param.nodata) & (bbpercent > 0.5)] = param.nodata
+    self.assertTrue((expected == scan.getParameter("DBZH").getData()).all())
+
   def test_restore_missing_howtask(self):
     scan = _raveio.open(self.FIXTURE_2).object
 
@@ -29,7 +29,7 @@ import _raveio
 import _beamblockage
 import beamb_quality_plugin
 import rave_quality_plugin
-import os, string
+import os, string, glob
 import _rave
 import numpy
 
@@ -41,21 +41,21 @@ class beamb_quality_plugin_test(unittest.TestCase):
   SCAN_FIXTURE = "fixtures/sevil_0.5_20111223T0000Z.h5"
   VOLUME_FIXTURE = "fixtures/pvol_seosu_20090501T120000Z.h5"
   
-  CACHEFILES = ["/tmp/15.94_58.11_223_0.50_420_120_2000.00_0.00_0.90_-20.00.h5",
-                "/tmp/15.94_58.11_223_1.00_420_120_2000.00_0.00_0.90_-20.00.h5",
-                "/tmp/14.76_63.30_465_0.50_420_120_2000.00_0.00_1.00_-20.00.h5",
-                "/tmp/14.76_63.30_465_1.00_420_120_2000.00_0.00_1.00_-20.00.h5",
-                "/tmp/14.76_63.30_465_14.00_420_120_1000.00_0.00_1.00_-20.00.h5",
-                "/tmp/14.76_63.30_465_1.50_420_120_2000.00_0.00_1.00_-20.00.h5",
-                "/tmp/14.76_63.30_465_2.00_420_120_2000.00_0.00_1.00_-20.00.h5",
-                "/tmp/14.76_63.30_465_24.00_420_120_1000.00_0.00_1.00_-20.00.h5",
-                "/tmp/14.76_63.30_465_2.50_420_120_1000.00_0.00_1.00_-20.00.h5",
-                "/tmp/14.76_63.30_465_40.00_420_120_1000.00_0.00_1.00_-20.00.h5",
-                "/tmp/14.76_63.30_465_4.00_420_120_1000.00_0.00_1.00_-20.00.h5",
-                "/tmp/14.76_63.30_465_8.00_420_120_1000.00_0.00_1.00_-20.00.h5"]
+  CACHEFILES = ["/tmp/15.94_58.11_223_0.50_420_120_2000.00_0.00_0.90_-20.00_*.h5",
+                "/tmp/15.94_58.11_223_1.00_420_120_2000.00_0.00_0.90_-20.00_*.h5",
+                "/tmp/14.76_63.30_465_0.50_420_120_2000.00_0.00_1.00_-20.00_*.h5",
+                "/tmp/14.76_63.30_465_1.00_420_120_2000.00_0.00_1.00_-20.00_*.h5",
+                "/tmp/14.76_63.30_465_14.00_420_120_1000.00_0.00_1.00_-20.00_*.h5",
+                "/tmp/14.76_63.30_465_1.50_420_120_2000.00_0.00_1.00_-20.00_*.h5",
+                "/tmp/14.76_63.30_465_2.00_420_120_2000.00_0.00_1.00_-20.00_*.h5",
+                "/tmp/14.76_63.30_465_24.00_420_120_1000.00_0.00_1.00_-20.00_*.h5",
+                "/tmp/14.76_63.30_465_2.50_420_120_1000.00_0.00_1.00_-20.00_*.h5",
+                "/tmp/14.76_63.30_465_40.00_420_120_1000.00_0.00_1.00_-20.00_*.h5",
+                "/tmp/14.76_63.30_465_4.00_420_120_1000.00_0.00_1.00_-20.00_*.h5",
+                "/tmp/14.76_63.30_465_8.00_420_120_1000.00_0.00_1.00_-20.00_*.h5"]
 
   def setUp(self):
-    for file in self.CACHEFILES:
+    for file in [f for pattern in self.CACHEFILES for f in glob.glob(pattern)]:
       if os.path.isfile(file):
         try:
           os.unlink(file)
@@ -63,7 +63,7 @@ class beamb_quality_plugin_test(unittest.TestCase):
           pass
       
   def tearDown(self):
-    for file in self.CACHEFILES:
+    for file in [f for pattern in self.CACHEFILES for f in glob.glob(pattern)]:
       if os.path.isfile(file):
         try:
           os.unlink(file)